@@ -0,0 +1,207 @@
+// FlexAssetCache.cpp
+// Native translation unit (compiled without /clr and without the precompiled header), see FlexAssetCache.h
+#include "FlexAssetCache.h"
+#include "FlexKernels.h"
+#include <NvFlex.h>
+#include <NvFlexExt.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <mutex>
+
+namespace FlexAssetCache {
+
+	//file layout: header, then particles (4 floats each), spring indices (2 ints), spring coefficients, spring rest lengths,
+	//shape indices, shape offsets, shape coefficients, shape centers (3 floats each)
+	static const uint32_t fileMagic = 0x53415846;	//"FXAS"
+	static const uint32_t fileVersion = 1;
+
+	struct FileHeader {
+		uint32_t Magic;
+		uint32_t Version;
+		uint64_t Key;
+		int32_t NumParticles, MaxParticles, NumSprings, NumShapeIndices, NumShapes;
+	};
+
+	struct Entry {
+		NvFlexExtAsset* Asset;
+		bool Generated;		//true: allocated by NvFlexExt, false: loaded from disk by us
+	};
+
+	static std::mutex lock;
+	static std::unordered_map<uint64_t, Entry> entries;
+	static std::wstring directory;
+	static Statistics statistics = { 0, 0, 0, 0 };
+
+#pragma region hashing
+	unsigned long long SoftBodyKey(const float* vertices, int numVertices, const int* indices, int numIndices, const SoftBodyParams& params) {
+		uint64_t h = 0x736F6674626F6479ull;	//"softbody"
+		h = FlexKernels::HashBytes(h, vertices, sizeof(float) * 3 * (long long)numVertices);
+		h = FlexKernels::HashBytes(h, indices, sizeof(int) * (long long)numIndices);
+		h = FlexKernels::HashBytes(h, &params, sizeof(SoftBodyParams));
+		return h;
+	}
+#pragma endregion
+
+#pragma region persistence
+	static std::wstring FilePath(uint64_t key) {
+		wchar_t name[32];
+		swprintf(name, 32, L"%016llx.flexasset", (unsigned long long)key);
+		std::wstring path = directory;
+		if (path.back() != L'\\' && path.back() != L'/')
+			path += L'\\';
+		return path + name;
+	}
+
+	template<typename T>
+	static bool Read(FILE* file, T*& dst, int count) {
+		dst = count > 0 ? new T[count] : NULL;
+		return count == 0 || fread(dst, sizeof(T), count, file) == (size_t)count;
+	}
+
+	template<typename T>
+	static bool Write(FILE* file, const T* src, int count) {
+		return count == 0 || fwrite(src, sizeof(T), count, file) == (size_t)count;
+	}
+
+	static void DeleteLoaded(NvFlexExtAsset* a) {
+		delete[] a->particles;
+		delete[] a->springIndices;
+		delete[] a->springCoefficients;
+		delete[] a->springRestLengths;
+		delete[] a->shapeIndices;
+		delete[] a->shapeOffsets;
+		delete[] a->shapeCoefficients;
+		delete[] a->shapeCenters;
+		delete a;
+	}
+
+	static NvFlexExtAsset* Load(uint64_t key) {
+		FILE* file = _wfopen(FilePath(key).c_str(), L"rb");
+		if (!file)
+			return NULL;
+		FileHeader header;
+		NvFlexExtAsset* a = NULL;
+		if (fread(&header, sizeof(header), 1, file) == 1 && header.Magic == fileMagic && header.Version == fileVersion && header.Key == key &&
+			header.NumParticles >= 0 && header.NumSprings >= 0 && header.NumShapeIndices >= 0 && header.NumShapes >= 0) {
+			a = new NvFlexExtAsset();
+			memset(a, 0, sizeof(NvFlexExtAsset));
+			a->numParticles = header.NumParticles;
+			a->maxParticles = header.MaxParticles;
+			a->numSprings = header.NumSprings;
+			a->numShapeIndices = header.NumShapeIndices;
+			a->numShapes = header.NumShapes;
+			bool complete = Read(file, a->particles, 4 * a->numParticles) &&
+				Read(file, a->springIndices, 2 * a->numSprings) &&
+				Read(file, a->springCoefficients, a->numSprings) &&
+				Read(file, a->springRestLengths, a->numSprings) &&
+				Read(file, a->shapeIndices, a->numShapeIndices) &&
+				Read(file, a->shapeOffsets, a->numShapes) &&
+				Read(file, a->shapeCoefficients, a->numShapes) &&
+				Read(file, a->shapeCenters, 3 * a->numShapes);
+			if (!complete) {
+				DeleteLoaded(a);
+				a = NULL;
+			}
+		}
+		fclose(file);
+		return a;
+	}
+
+	//writes to a temporary file first, so a crash never leaves a truncated asset behind
+	static void Save(uint64_t key, const NvFlexExtAsset* a) {
+		std::wstring path = FilePath(key);
+		std::wstring temporary = path + L".tmp";
+		FILE* file = _wfopen(temporary.c_str(), L"wb");
+		if (!file)
+			return;
+		FileHeader header = { fileMagic, fileVersion, key, a->numParticles, a->maxParticles, a->numSprings, a->numShapeIndices, a->numShapes };
+		bool complete = fwrite(&header, sizeof(header), 1, file) == 1 &&
+			Write(file, a->particles, 4 * a->numParticles) &&
+			Write(file, a->springIndices, 2 * a->numSprings) &&
+			Write(file, a->springCoefficients, a->numSprings) &&
+			Write(file, a->springRestLengths, a->numSprings) &&
+			Write(file, a->shapeIndices, a->numShapeIndices) &&
+			Write(file, a->shapeOffsets, a->numShapes) &&
+			Write(file, a->shapeCoefficients, a->numShapes) &&
+			Write(file, a->shapeCenters, 3 * a->numShapes);
+		complete = fclose(file) == 0 && complete;
+		_wremove(path.c_str());
+		if (!complete || _wrename(temporary.c_str(), path.c_str()) != 0)
+			_wremove(temporary.c_str());
+	}
+#pragma endregion
+
+	static NvFlexExtAsset* Generate(const float* vertices, int numVertices, const int* indices, int numIndices, const SoftBodyParams& p) {
+		NvFlexExtAsset* a = NvFlexExtCreateSoftFromMesh(vertices, numVertices, indices, numIndices, p.ParticleSpacing, p.VolumeSampling, p.SurfaceSampling,
+			p.ClusterSpacing, p.ClusterRadius, p.ClusterStiffness, p.LinkRadius, p.LinkStiffness, p.GlobalStiffness);
+
+		//sometimes the last shape in the generated asset contains all particles. this bug is removed here
+		if (a && a->numShapes > 1 && a->numParticles == a->shapeOffsets[a->numShapes - 1] - a->shapeOffsets[a->numShapes - 2]) {
+			a->numShapes = a->numShapes - 1;
+			a->numShapeIndices -= a->numParticles;
+		}
+		return a;
+	}
+
+	NvFlexExtAsset* GetSoftBody(const float* vertices, int numVertices, const int* indices, int numIndices, const SoftBodyParams& params) {
+		uint64_t key = SoftBodyKey(vertices, numVertices, indices, numIndices, params);
+		std::lock_guard<std::mutex> guard(lock);
+
+		auto found = entries.find(key);
+		if (found != entries.end()) {
+			statistics.MemoryHits++;
+			return found->second.Asset;
+		}
+
+		Entry entry = { NULL, false };
+		if (!directory.empty())
+			entry.Asset = Load(key);
+		if (entry.Asset)
+			statistics.DiskHits++;
+		else {
+			entry.Asset = Generate(vertices, numVertices, indices, numIndices, params);
+			entry.Generated = true;
+			statistics.Misses++;
+			if (!entry.Asset)
+				return NULL;
+			if (!directory.empty())
+				Save(key, entry.Asset);
+		}
+		entries[key] = entry;
+		statistics.Resident = (int)entries.size();
+		return entry.Asset;
+	}
+
+	bool Contains(const NvFlexExtAsset* asset) {
+		std::lock_guard<std::mutex> guard(lock);
+		for (auto& e : entries)
+			if (e.second.Asset == asset)
+				return true;
+		return false;
+	}
+
+	void SetDirectory(const wchar_t* dir) {
+		std::lock_guard<std::mutex> guard(lock);
+		directory = dir ? dir : L"";
+	}
+
+	void Clear() {
+		std::lock_guard<std::mutex> guard(lock);
+		for (auto& e : entries) {
+			if (e.second.Generated)
+				NvFlexExtDestroyAsset(e.second.Asset);
+			else
+				DeleteLoaded(e.second.Asset);
+		}
+		entries.clear();
+		statistics.Resident = 0;
+	}
+
+	Statistics GetStatistics() {
+		std::lock_guard<std::mutex> guard(lock);
+		return statistics;
+	}
+}
@@ -0,0 +1,41 @@
+// FlexAssetCache.h
+// Content addressed cache for soft body assets. Generating a soft body (voxelization, clustering, links) takes seconds on dense meshes,
+// so assets are kept in memory by a hash of the mesh and the sampling parameters, and optionally persisted in a cache directory.
+// FlexAssetCache.cpp is compiled without /clr.
+#pragma once
+
+struct NvFlexExtAsset;
+
+namespace FlexAssetCache {
+
+	///The nine parameters of NvFlexExtCreateSoftFromMesh
+	struct SoftBodyParams {
+		float ParticleSpacing, VolumeSampling, SurfaceSampling;
+		float ClusterSpacing, ClusterRadius, ClusterStiffness;
+		float LinkRadius, LinkStiffness, GlobalStiffness;
+	};
+
+	///64 bit content hash of the vertices, the triangle indices and the sampling parameters
+	unsigned long long SoftBodyKey(const float* vertices, int numVertices, const int* indices, int numIndices, const SoftBodyParams& params);
+
+	///Returns the soft body asset for this mesh and parameters. On a miss the asset is loaded from the cache directory or generated
+	///(and then written to the cache directory). The asset is owned by the cache and stays valid until Clear() is called.
+	NvFlexExtAsset* GetSoftBody(const float* vertices, int numVertices, const int* indices, int numIndices, const SoftBodyParams& params);
+
+	///True, if the asset is owned by the cache and must not be destroyed by the caller
+	bool Contains(const NvFlexExtAsset* asset);
+
+	///Directory for persisted assets. NULL or an empty string disables persistence. The directory must exist.
+	void SetDirectory(const wchar_t* directory);
+
+	///Destroys all cached assets. Files in the cache directory are kept.
+	void Clear();
+
+	struct Statistics {
+		int MemoryHits;		//served from memory
+		int DiskHits;		//loaded from the cache directory
+		int Misses;			//generated
+		int Resident;		//assets held in memory
+	};
+	Statistics GetStatistics();
+}
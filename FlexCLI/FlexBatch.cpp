@@ -0,0 +1,149 @@
+#include "stdafx.h"
+#include "FlexCLI.h"
+
+using namespace System::Diagnostics;
+using namespace System::Threading::Tasks;
+
+namespace FlexCLI {
+
+	///<summary>baseScene, baseParams and baseOptions are shared by all variants and must not change while Run is busy. collisionGeometry can be null.</summary>
+	FlexBatch::FlexBatch(FlexScene^ baseScene, FlexParams^ baseParams, FlexSolverOptions^ baseOptions, FlexCollisionGeometry^ collisionGeometry) {
+		if (!baseScene || !baseScene->IsValid())
+			throw gcnew Exception("FlexCLI: FlexBatch::FlexBatch(...) ---> Invalid base scene");
+		if (!baseParams || !baseParams->IsValid())
+			throw gcnew Exception("FlexCLI: FlexBatch::FlexBatch(...) ---> Invalid base params");
+		if (!baseOptions || !baseOptions->IsValid())
+			throw gcnew Exception("FlexCLI: FlexBatch::FlexBatch(...) ---> Invalid base solver options");
+
+		this->baseScene = baseScene;
+		this->baseParams = baseParams;
+		this->baseOptions = baseOptions;
+		this->collisionGeometry = collisionGeometry ? collisionGeometry : gcnew FlexCollisionGeometry();
+		variantParams = gcnew List<FlexParams^>();
+		variantOptions = gcnew List<FlexSolverOptions^>();
+		ForceFields = gcnew List<FlexForceField^>();
+		MaxConcurrency = Environment::ProcessorCount;
+		ConvergenceSpeed = 0.0f;
+	}
+
+	int FlexBatch::AddVariant(FlexParams^ flexParams, FlexSolverOptions^ flexSolverOptions) {
+		FlexParams^ p = flexParams ? flexParams : baseParams;
+		FlexSolverOptions^ o = flexSolverOptions ? flexSolverOptions : baseOptions;
+		if (!p->IsValid())
+			throw gcnew Exception("FlexCLI: int FlexBatch::AddVariant(...) ---> Invalid params for variant nr. " + variantParams->Count);
+		if (!o->IsValid())
+			throw gcnew Exception("FlexCLI: int FlexBatch::AddVariant(...) ---> Invalid solver options for variant nr. " + variantParams->Count);
+		if (baseScene->NumParticles() > o->MaxParticles)
+			throw gcnew Exception("FlexCLI: int FlexBatch::AddVariant(...) ---> MaxParticles of variant nr. " + variantParams->Count + " is below the base scene's particle count");
+		variantParams->Add(p);
+		variantOptions->Add(o);
+		return variantParams->Count - 1;
+	}
+
+	///<summary>Variants are scheduled on the .Net thread pool, whose idle workers steal queued variants from busy ones, so uneven run times balance out.
+	///A failing variant doesn't stop the others, its result carries the error message instead.</summary>
+	array<FlexBatchResult^>^ FlexBatch::Run(int maxUpdates) {
+		if (maxUpdates < 1)
+			throw gcnew Exception("FlexCLI: array<FlexBatchResult^>^ FlexBatch::Run(int maxUpdates) ---> maxUpdates has to be > 0");
+
+		//every variant holds a solver of its own, so the number of concurrent ones is capped by the variants and by MaxConcurrency
+		this->maxUpdates = maxUpdates;
+		results = gcnew array<FlexBatchResult^>(variantParams->Count);
+		ParallelOptions^ options = gcnew ParallelOptions();
+		options->MaxDegreeOfParallelism = Math::Max(1, Math::Min(MaxConcurrency, variantParams->Count));
+		Parallel::For(0, variantParams->Count, options, gcnew Action<int>(this, &FlexBatch::RunVariant));
+
+		array<FlexBatchResult^>^ finished = results;
+		results = nullptr;
+		return finished;
+	}
+
+	///Runs one variant on a Flex instance of its own and writes its result. Called concurrently for different variants.
+	void FlexBatch::RunVariant(int variant) {
+		FlexBatchResult^ result = gcnew FlexBatchResult();
+		result->Variant = variant;
+		result->Params = variantParams[variant];
+		result->Options = variantOptions[variant];
+		Stopwatch^ watch = Stopwatch::StartNew();
+
+		Flex^ flex = nullptr;
+		FlexScene^ scene = nullptr;
+		try {
+			scene = baseScene->CloneShared();
+			//the solver is sized by the variant's limits, params and collision geometry are scaled by its stability scaling factor
+			flex = gcnew Flex(result->Options);
+			flex->SetParams(result->Params);
+			flex->SetCollisionGeometry(collisionGeometry);
+			flex->SetForceFields(ForceFields);
+			flex->SetScene(scene);
+
+			while (result->Updates < maxUpdates) {
+				flex->UpdateSolver();
+				result->Updates++;
+				if (ConvergenceSpeed > 0.0f) {
+					scene->SyncState();
+					float maxSpeedSquared = 0.0f;
+					for (int i = 0; i < scene->ParticleCount; i++) {
+						FlexParticleData% p = scene->ParticleData[i];
+						maxSpeedSquared = Math::Max(maxSpeedSquared, p.VelocityX * p.VelocityX + p.VelocityY * p.VelocityY + p.VelocityZ * p.VelocityZ);
+					}
+					if (maxSpeedSquared <= ConvergenceSpeed * ConvergenceSpeed) {
+						result->Converged = true;
+						break;
+					}
+				}
+			}
+			scene->SyncState();
+
+			//metrics, against the untouched particle pool of the base scene
+			double sumSpeed = 0.0, energy = 0.0;
+			float maxSpeedSquared = 0.0f, maxDisplacementSquared = 0.0f;
+			for (int i = 0; i < scene->ParticleCount; i++) {
+				FlexParticleData% p = scene->ParticleData[i];
+				FlexParticleData% p0 = baseScene->ParticleData[i];
+				float speedSquared = p.VelocityX * p.VelocityX + p.VelocityY * p.VelocityY + p.VelocityZ * p.VelocityZ;
+				float dx = p.PositionX - p0.PositionX, dy = p.PositionY - p0.PositionY, dz = p.PositionZ - p0.PositionZ;
+				sumSpeed += Math::Sqrt(speedSquared);
+				if (p.InverseMass > 0.0f)
+					energy += 0.5 * speedSquared / p.InverseMass;
+				maxSpeedSquared = Math::Max(maxSpeedSquared, speedSquared);
+				maxDisplacementSquared = Math::Max(maxDisplacementSquared, dx * dx + dy * dy + dz * dz);
+			}
+			result->MaxSpeed = (float)Math::Sqrt(maxSpeedSquared);
+			result->MeanSpeed = scene->ParticleCount > 0 ? (float)(sumSpeed / scene->ParticleCount) : 0.0f;
+			result->KineticEnergy = (float)energy;
+			result->MaxDisplacement = (float)Math::Sqrt(maxDisplacementSquared);
+		}
+		catch (Exception^ e) {
+			result->Error = e->Message;
+		}
+		finally {
+			//the scene outlives the solver, it must not wait for readbacks of a destroyed instance
+			if (scene)
+				scene->Flex = nullptr;
+			if (flex)
+				delete flex;
+		}
+
+		result->Scene = scene;
+		result->Seconds = watch->Elapsed.TotalSeconds;
+		results[variant] = result;
+	}
+
+	String^ FlexBatchResult::ToString() {
+		String^ str = gcnew String("FlexBatchResult:");
+		str += "\nVariant = " + Variant.ToString();
+		if (Error) {
+			str += "\nError = " + Error;
+			return str;
+		}
+		str += "\nUpdates = " + Updates.ToString();
+		str += "\nConverged = " + Converged.ToString();
+		str += "\nMaxSpeed = " + MaxSpeed.ToString();
+		str += "\nMeanSpeed = " + MeanSpeed.ToString();
+		str += "\nKineticEnergy = " + KineticEnergy.ToString();
+		str += "\nMaxDisplacement = " + MaxDisplacement.ToString();
+		str += "\nSeconds = " + Seconds.ToString();
+		return str;
+	}
+}
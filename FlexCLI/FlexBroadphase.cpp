@@ -0,0 +1,165 @@
+// FlexBroadphase.cpp
+// Native translation unit (compiled without /clr and without the precompiled header), see FlexBroadphase.h
+#include "FlexBroadphase.h"
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+
+namespace FlexBroadphase {
+
+	void TransformBounds(const float* local, const float* position, const float* rotation, float* world) {
+		//NvFlex rotates by x * (2w^2 - 1) + 2w * (q x x) + 2q * (q . x), the columns of the matrix are the rotated unit vectors
+		float x = rotation[0], y = rotation[1], z = rotation[2], w = rotation[3];
+		float d = 2.0f * w * w - 1.0f;
+		float m[3][3] = {
+			{ d + 2.0f * x * x, 2.0f * (x * y - w * z), 2.0f * (x * z + w * y) },
+			{ 2.0f * (y * x + w * z), d + 2.0f * y * y, 2.0f * (y * z - w * x) },
+			{ 2.0f * (z * x - w * y), 2.0f * (z * y + w * x), d + 2.0f * z * z } };
+
+		//rotate the center, the extents grow by the absolute matrix
+		float center[3], extent[3];
+		for (int j = 0; j < 3; j++) {
+			center[j] = 0.5f * (local[j] + local[j + 3]);
+			extent[j] = 0.5f * (local[j + 3] - local[j]);
+		}
+		for (int i = 0; i < 3; i++) {
+			float c = position[i], e = 0.0f;
+			for (int j = 0; j < 3; j++) {
+				c += m[i][j] * center[j];
+				e += fabsf(m[i][j]) * extent[j];
+			}
+			world[i] = c - e;
+			world[i + 3] = c + e;
+		}
+	}
+
+	static inline bool Overlaps(const float* lowerA, const float* upperA, const float* lowerB, const float* upperB) {
+		return lowerA[0] <= upperB[0] && upperA[0] >= lowerB[0]
+			&& lowerA[1] <= upperB[1] && upperA[1] >= lowerB[1]
+			&& lowerA[2] <= upperB[2] && upperA[2] >= lowerB[2];
+	}
+
+	void Tree::Build(const float* bounds, int count) {
+		nodes.clear();
+		order.resize(count);
+		for (int i = 0; i < count; i++)
+			order[i] = i;
+		if (count == 0)
+			return;
+
+		std::vector<float> centers(count * 3);
+		for (int i = 0; i < count; i++)
+			for (int j = 0; j < 3; j++)
+				centers[i * 3 + j] = 0.5f * (bounds[i * 6 + j] + bounds[i * 6 + j + 3]);
+
+		nodes.reserve(2 * (count / LeafSize + 1));
+		BuildNode(bounds, centers, 0, count);
+	}
+
+	///Splits at the median center along the longest axis of the node's center bounds, so the depth stays logarithmic for any shape layout
+	int Tree::BuildNode(const float* bounds, std::vector<float>& centers, int first, int count) {
+		int index = (int)nodes.size();
+		nodes.push_back(Node());
+
+		float lower[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, upper[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		float centerLower[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, centerUpper[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		for (int i = first; i < first + count; i++) {
+			const float* b = &bounds[order[i] * 6];
+			const float* c = &centers[order[i] * 3];
+			for (int j = 0; j < 3; j++) {
+				lower[j] = std::min(lower[j], b[j]);
+				upper[j] = std::max(upper[j], b[j + 3]);
+				centerLower[j] = std::min(centerLower[j], c[j]);
+				centerUpper[j] = std::max(centerUpper[j], c[j]);
+			}
+		}
+
+		if (count <= LeafSize) {
+			Node& leaf = nodes[index];
+			for (int j = 0; j < 3; j++) {
+				leaf.Lower[j] = lower[j];
+				leaf.Upper[j] = upper[j];
+			}
+			leaf.Right = -1;
+			leaf.First = first;
+			leaf.Count = count;
+			return index;
+		}
+
+		int axis = 0;
+		for (int j = 1; j < 3; j++)
+			if (centerUpper[j] - centerLower[j] > centerUpper[axis] - centerLower[axis])
+				axis = j;
+		int half = count / 2;
+		std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count,
+			[&centers, axis](int a, int b) { return centers[a * 3 + axis] < centers[b * 3 + axis]; });
+
+		BuildNode(bounds, centers, first, half);
+		int right = BuildNode(bounds, centers, first + half, count - half);
+
+		//'nodes' may have grown, don't hold a reference across the recursion
+		Node& inner = nodes[index];
+		for (int j = 0; j < 3; j++) {
+			inner.Lower[j] = lower[j];
+			inner.Upper[j] = upper[j];
+		}
+		inner.Right = right;
+		inner.First = first;
+		inner.Count = 0;
+		return index;
+	}
+
+	void Tree::Refit(const float* bounds) {
+		//children always follow their parent, so walking backwards sees both children before the parent
+		for (int n = (int)nodes.size() - 1; n >= 0; n--) {
+			Node& node = nodes[n];
+			if (node.Count > 0) {
+				for (int j = 0; j < 3; j++) {
+					node.Lower[j] = FLT_MAX;
+					node.Upper[j] = -FLT_MAX;
+				}
+				for (int i = node.First; i < node.First + node.Count; i++) {
+					const float* b = &bounds[order[i] * 6];
+					for (int j = 0; j < 3; j++) {
+						node.Lower[j] = std::min(node.Lower[j], b[j]);
+						node.Upper[j] = std::max(node.Upper[j], b[j + 3]);
+					}
+				}
+			}
+			else {
+				const Node& left = nodes[n + 1];
+				const Node& right = nodes[node.Right];
+				for (int j = 0; j < 3; j++) {
+					node.Lower[j] = std::min(left.Lower[j], right.Lower[j]);
+					node.Upper[j] = std::max(left.Upper[j], right.Upper[j]);
+				}
+			}
+		}
+	}
+
+	void Tree::Query(const float* bounds, const float* lower, const float* upper, std::vector<int>& hits) const {
+		if (nodes.empty())
+			return;
+		size_t firstHit = hits.size();
+		int stack[64];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0) {
+			const Node& node = nodes[stack[--top]];
+			if (!Overlaps(node.Lower, node.Upper, lower, upper))
+				continue;
+			if (node.Count > 0) {
+				for (int i = node.First; i < node.First + node.Count; i++) {
+					const float* b = &bounds[order[i] * 6];
+					if (Overlaps(b, b + 3, lower, upper))
+						hits.push_back(order[i]);
+				}
+			}
+			else {
+				stack[top++] = node.Right;
+				stack[top++] = (int)(&node - &nodes[0]) + 1;
+			}
+		}
+		std::sort(hits.begin() + firstHit, hits.end());
+	}
+}
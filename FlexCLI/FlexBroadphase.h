@@ -0,0 +1,38 @@
+// FlexBroadphase.h
+// Native bounding volume hierarchy over the world space bounding boxes of the collision shapes. FlexBroadphase.cpp is compiled without /clr.
+// Flex::UpdateSolver queries it with the particle bounds to submit only the shapes particles can reach, see FlexSolverOptions::BroadphaseInterval.
+#pragma once
+#include <vector>
+
+namespace FlexBroadphase {
+
+	///Shapes per leaf
+	const int LeafSize = 4;
+
+	///Writes the world space bounding box of a local box [lower x, y, z, upper x, y, z] placed at 'position' [x, y, z] under the quaternion 'rotation' [x, y, z, w].
+	///The rotation is evaluated the way NvFlex does, so the zero quaternion mirrors the box through the position.
+	void TransformBounds(const float* local, const float* position, const float* rotation, float* world);
+
+	class Tree {
+	public:
+		///Builds the hierarchy over 'count' boxes [lower x, y, z, upper x, y, z]
+		void Build(const float* bounds, int count);
+		///Updates all node boxes after boxes moved, the topology stays the one of the last Build
+		void Refit(const float* bounds);
+		///Appends the indices of all boxes overlapping [lower, upper] to 'hits', in ascending order. 'bounds' are the boxes of the last Build or Refit.
+		void Query(const float* bounds, const float* lower, const float* upper, std::vector<int>& hits) const;
+		int Count() const { return (int)order.size(); }
+
+	private:
+		struct Node {
+			float Lower[3];
+			float Upper[3];
+			int Right;		//inner nodes: index of the right child, the left one follows the node directly
+			int First;		//leaves: first entry in 'order'
+			int Count;		//leaves: number of boxes, 0 for inner nodes
+		};
+		std::vector<Node> nodes;
+		std::vector<int> order;
+		int BuildNode(const float* bounds, std::vector<float>& centers, int first, int count);
+	};
+}
@@ -1,31 +1,31 @@
 // This is the main DLL file.
 #include "stdafx.h"
 #include "FlexCLI.h"
+#include "FlexKernels.h"
+#include "FlexDistanceField.h"
+#include "FlexSimplify.h"
+#include "FlexBroadphase.h"
+#include "FlexPipeline.h"
 
 namespace FlexCLI {
 
-	NvFlexLibrary* Library;
-	NvFlexSolver* Solver;
-	NvFlexParams Params;
-	NvFlexExtForceFieldCallback* ForceFieldCallback; 
-	int n; //The particle count in this very iteration
-	float dt;
-	int subSteps;
-	int numFixedIter;
-
-	int maxParticles = 131072;
-	int maxDiffuseParticles = 0;
-	int maxNeighborsPerParticle = 96;
-	int maxCollisionShapeNumber = 65536;			//some geometries requires more entries (sphere: 2, box: 3, mesh: arbitrary), therefore this is NOT the max nr. of collision objects! 
-	int maxCollisionMeshVertexCount = 65536;		//max nr. of vertices in a single collision mesh
-	int maxCollisionMeshIndexCount = 65536;			//max nr. of faces in a single collision mesh
-	int maxCollisionConvexShapePlanes = 65536;		//max nr. of faces in all convex collision meshes combined
-	int maxRigidBodies = 65536;						//max nr. of rigid bodies
-	int maxSprings = 196608;						//max nr. of springs
-	int maxDynamicTriangles = 131072;				//needed for cloth
-
-	float stabilityScaling = 1.0f;					//this is to tackle the weird bug, where large objects tend to drift away
-	float invStabScale = 1.0f;
+	const int maxContactsPerParticle = 6;			//fixed by NvFlex
+
+	//the NvFlex library is shared by all Flex instances: initialized with the first one, shut down once the last one is destroyed
+	NvFlexLibrary* sharedLibrary = NULL;
+	int sharedLibraryReferences = 0;
+
+	//collision mesh cache: cooked meshes are shared by content hash and destroyed once no collision shape references them
+	struct CollisionMeshEntry {
+		unsigned int Mesh;		//NvFlexTriangleMeshId, NvFlexConvexMeshId or NvFlexDistanceFieldId
+		int ShapeType;			//NvFlexCollisionShapeType
+		int References;			//number of shapes in the current collision geometry using this mesh
+		long long Bytes;
+		float Lower[3];			//distance fields only: grid corner and edge length, already scaled by stabilityScaling
+		float Size;
+	};
+
+	struct FlexState;
 
 	struct SimBuffers {
 		NvFlexBuffer* Particles;
@@ -63,40 +63,31 @@ namespace FlexCLI {
 		NvFlexBuffer* InflatableRestVolumes;
 		NvFlexBuffer* InflatableOverPressures;
 		NvFlexBuffer* InflatableConstraintScales;
+		//Buffers for optional readback channels, only allocated when requested
+		NvFlexBuffer* Normals;
+		NvFlexBuffer* Densities;
+		NvFlexBuffer* ContactPlanes;
+		NvFlexBuffer* ContactVelocities;
+		NvFlexBuffer* ContactIndices;
+		NvFlexBuffer* ContactCounts;
+		//Buffers for broadphase culling, only allocated when enabled
+		NvFlexBuffer* CulledGeometry;
+		NvFlexBuffer* CulledPosition;
+		NvFlexBuffer* CulledPrevPosition;
+		NvFlexBuffer* CulledRotation;
+		NvFlexBuffer* CulledPrevRotation;
+		NvFlexBuffer* CulledFlags;
+		NvFlexBuffer* ParticleLower;
+		NvFlexBuffer* ParticleUpper;
 
 		///Tells the host upon startup, how much memory it will need and reserves this memory
-		void Allocate() {
-			Particles = NvFlexAllocBuffer(Library, maxParticles, sizeof(float4), eNvFlexBufferHost);
-			Velocities = NvFlexAllocBuffer(Library, maxParticles, sizeof(float3), eNvFlexBufferHost);
-			Phases = NvFlexAllocBuffer(Library, maxParticles, sizeof(int), eNvFlexBufferHost);
-			Active = NvFlexAllocBuffer(Library, maxParticles, sizeof(int), eNvFlexBufferHost);
-			CollisionGeometry = NvFlexAllocBuffer(Library, maxCollisionShapeNumber, sizeof(float4), eNvFlexBufferHost);
-			Position = NvFlexAllocBuffer(Library, maxCollisionShapeNumber, sizeof(float4), eNvFlexBufferHost);
-			PrevPosition = NvFlexAllocBuffer(Library, maxCollisionShapeNumber, sizeof(float4), eNvFlexBufferHost);
-			Rotation = NvFlexAllocBuffer(Library, maxCollisionShapeNumber, sizeof(float4), eNvFlexBufferHost);
-			PrevRotation = NvFlexAllocBuffer(Library, maxCollisionShapeNumber, sizeof(float4), eNvFlexBufferHost);
-			Flags = NvFlexAllocBuffer(Library, maxCollisionShapeNumber, sizeof(int), eNvFlexBufferHost);
-			CollisionMeshVertices = NvFlexAllocBuffer(Library, maxCollisionMeshVertexCount, sizeof(float3), eNvFlexBufferHost);
-			CollisionMeshIndices = NvFlexAllocBuffer(Library, maxCollisionMeshIndexCount, sizeof(int) * 3, eNvFlexBufferHost);
-			CollisionConvexMeshPlanes = NvFlexAllocBuffer(Library, maxCollisionConvexShapePlanes, sizeof(float4), eNvFlexBufferHost);
-			RigidOffets = NvFlexAllocBuffer(Library, maxRigidBodies + 1, sizeof(int), eNvFlexBufferHost);
-			RigidIndices = NvFlexAllocBuffer(Library, maxRigidBodies, sizeof(int), eNvFlexBufferHost);
-			RigidRestPositions = NvFlexAllocBuffer(Library, maxRigidBodies, sizeof(float3), eNvFlexBufferHost);
-			RigidRestNormals = NvFlexAllocBuffer(Library, maxRigidBodies, sizeof(float4), eNvFlexBufferHost);
-			RigidStiffnesses = NvFlexAllocBuffer(Library, maxRigidBodies, sizeof(float), eNvFlexBufferHost);
-			RigidRotations = NvFlexAllocBuffer(Library, maxRigidBodies, sizeof(float4), eNvFlexBufferHost);
-			RigidTranslations = NvFlexAllocBuffer(Library, maxRigidBodies, sizeof(float3), eNvFlexBufferHost);
-			SpringPairIndices = NvFlexAllocBuffer(Library, maxSprings * 2, sizeof(int), eNvFlexBufferHost);
-			SpringLengths = NvFlexAllocBuffer(Library, maxSprings, sizeof(float), eNvFlexBufferHost);
-			SpringCoefficients = NvFlexAllocBuffer(Library, maxSprings, sizeof(float), eNvFlexBufferHost);
-			DynamicTriangleIndices = NvFlexAllocBuffer(Library, maxDynamicTriangles * 3, sizeof(int), eNvFlexBufferHost);
-			DynamicTriangleNormals = NvFlexAllocBuffer(Library, maxDynamicTriangles, sizeof(float3), eNvFlexBufferHost);
-			InflatableStartIndices = NvFlexAllocBuffer(Library, maxDynamicTriangles, sizeof(int), eNvFlexBufferHost);
-			InflatableNumTriangles = NvFlexAllocBuffer(Library, maxDynamicTriangles, sizeof(int), eNvFlexBufferHost);
-			InflatableRestVolumes = NvFlexAllocBuffer(Library, maxDynamicTriangles / 4, sizeof(float), eNvFlexBufferHost);
-			InflatableOverPressures = NvFlexAllocBuffer(Library, maxDynamicTriangles / 4, sizeof(float), eNvFlexBufferHost);
-			InflatableConstraintScales = NvFlexAllocBuffer(Library, maxDynamicTriangles / 4, sizeof(float), eNvFlexBufferHost);
-		}
+		void Allocate(const FlexState& s);
+
+		///Allocates the buffers of optional readback channels the first time they are requested
+		void AllocateReadback(const FlexState& s, int channels);
+
+		///Allocates the buffers of the culled shape set the first time the broadphase is used
+		void AllocateBroadphase(const FlexState& s);
 
 		///<summary>
 		///Performs the following steps for every buffer: Check if pointer is 0; if it is, do nothing. If it is not, free buffer (NvFlex function) and set pointer to 0.
@@ -222,133 +213,474 @@ namespace FlexCLI {
 				NvFlexFreeBuffer(InflatableConstraintScales);
 				InflatableConstraintScales = NULL;
 			}
+			if (Normals) {
+				NvFlexFreeBuffer(Normals);
+				Normals = NULL;
+			}
+			if (Densities) {
+				NvFlexFreeBuffer(Densities);
+				Densities = NULL;
+			}
+			if (ContactPlanes) {
+				NvFlexFreeBuffer(ContactPlanes);
+				ContactPlanes = NULL;
+			}
+			if (ContactVelocities) {
+				NvFlexFreeBuffer(ContactVelocities);
+				ContactVelocities = NULL;
+			}
+			if (ContactIndices) {
+				NvFlexFreeBuffer(ContactIndices);
+				ContactIndices = NULL;
+			}
+			if (ContactCounts) {
+				NvFlexFreeBuffer(ContactCounts);
+				ContactCounts = NULL;
+			}
+			if (CulledGeometry) {
+				NvFlexFreeBuffer(CulledGeometry);
+				CulledGeometry = NULL;
+			}
+			if (CulledPosition) {
+				NvFlexFreeBuffer(CulledPosition);
+				CulledPosition = NULL;
+			}
+			if (CulledPrevPosition) {
+				NvFlexFreeBuffer(CulledPrevPosition);
+				CulledPrevPosition = NULL;
+			}
+			if (CulledRotation) {
+				NvFlexFreeBuffer(CulledRotation);
+				CulledRotation = NULL;
+			}
+			if (CulledPrevRotation) {
+				NvFlexFreeBuffer(CulledPrevRotation);
+				CulledPrevRotation = NULL;
+			}
+			if (CulledFlags) {
+				NvFlexFreeBuffer(CulledFlags);
+				CulledFlags = NULL;
+			}
+			if (ParticleLower) {
+				NvFlexFreeBuffer(ParticleLower);
+				ParticleLower = NULL;
+			}
+			if (ParticleUpper) {
+				NvFlexFreeBuffer(ParticleUpper);
+				ParticleUpper = NULL;
+			}
 		}
 	};
 
-	SimBuffers Buffers;
+	///Readback device of FlexPipeline, forwarding to the NvFlex solver. Buffers live in host memory, the Get... calls only queue copies.
+	struct NvFlexReadbackDevice {
+		typedef NvFlexBuffer Buffer;
+		NvFlexLibrary* Library;
+		NvFlexSolver* Solver;
+
+		NvFlexReadbackDevice(NvFlexLibrary* library, NvFlexSolver* solver) : Library(library), Solver(solver) {}
+		Buffer* Alloc(int count, int stride) { return NvFlexAllocBuffer(Library, count, stride, eNvFlexBufferHost); }
+		void Free(Buffer* buffer) { NvFlexFreeBuffer(buffer); }
+		void GetParticles(Buffer* particles, int count) { NvFlexGetParticles(Solver, particles, count); }
+		void GetVelocities(Buffer* velocities, int count) { NvFlexGetVelocities(Solver, velocities, count); }
+		void GetPhases(Buffer* phases, int count) { NvFlexGetPhases(Solver, phases, count); }
+		void GetRigidTransforms(Buffer* rotations, Buffer* translations) { NvFlexGetRigidTransforms(Solver, rotations, translations); }
+		void* Map(Buffer* buffer, bool wait) { return NvFlexMap(buffer, wait ? eNvFlexMapWait : eNvFlexMapDoNotWait); }
+		void Unmap(Buffer* buffer) { NvFlexUnmap(buffer); }
+	};
+
+	///<summary>
+	///Native state of one Flex instance: solver, parameters, limits, buffers and collision shape bookkeeping.
+	///Every Flex object owns one, so several simulations can run side by side, on different threads too. Only the NvFlex library is shared.
+	///</summary>
+	struct FlexState {
+		NvFlexLibrary* Library;						//shared by all instances, see sharedLibrary
+		NvFlexSolver* Solver;
+		NvFlexParams Params;
+		NvFlexExtForceFieldCallback* ForceFieldCallback;
+		int n; //The particle count in this very iteration
+		int nActive; //The number of active particles
+		float dt;
+		int subSteps;
+		int numFixedIter;
+
+		int maxParticles = 131072;
+		int maxDiffuseParticles = 0;
+		int maxNeighborsPerParticle = 96;
+		int maxCollisionShapeNumber = 65536;			//some geometries requires more entries (sphere: 2, box: 3, mesh: arbitrary), therefore this is NOT the max nr. of collision objects! 
+		int maxCollisionMeshVertexCount = 65536;		//max nr. of vertices in a single collision mesh
+		int maxCollisionMeshIndexCount = 65536;			//max nr. of faces in a single collision mesh
+		int maxCollisionConvexShapePlanes = 65536;		//max nr. of faces in all convex collision meshes combined
+		int maxRigidBodies = 65536;						//max nr. of rigid bodies
+		int maxSprings = 196608;						//max nr. of springs
+		int maxDynamicTriangles = 131072;				//needed for cloth
+
+		float stabilityScaling = 1.0f;					//this is to tackle the weird bug, where large objects tend to drift away
+		float invStabScale = 1.0f;
+
+		int readbackChannels = (int)FlexReadback::Default;	//FlexReadback flags, see FlexSolverOptions::Readback
+		bool pipelinedReadback = false;					//see FlexSolverOptions::PipelinedReadback
+		int syncInterval = 1;							//solver steps per host readback
+		bool stateSynced = false;						//true, once all particle channels have been read back after the last upload
+
+		std::map<unsigned long long, CollisionMeshEntry> collisionMeshes;
+		std::vector<unsigned long long> collisionMeshesInUse;	//one key per mesh shape of the current collision geometry
+		int collisionMeshHits = 0;
+		int collisionMeshMisses = 0;
+		long long collisionMeshBytes = 0;
+		int numCollisionShapes = 0;						//shapes set by the last SetCollisionGeometry call
+		std::vector<int> movedColliders;				//shapes moved by the last UpdateColliderTransforms call, their previous pose still differs
+		std::vector<float3> colliderOffsets;			//per shape: shape origin relative to the user's origin, only non-zero for distance fields
+		int firstMeshShape = 0, numMeshShapes = 0;		//shape ranges of AddMesh meshes and mesh instances in the last SetCollisionGeometry call
+		int firstMeshInstanceShape = 0, numMeshInstanceShapes = 0;
+		std::map<int, unsigned int> deformedColliders;	//shape index to the private triangle mesh UpdateColliderMeshVertices writes to, not part of the mesh cache
+		int collisionIndicesShape = -1;					//deformed shape whose faces Buffers.CollisionMeshIndices holds, -1 after any other mesh upload
+
+		//broadphase: only shapes overlapping the inflated particle bounds are submitted, see FlexSolverOptions::BroadphaseInterval
+		int broadphaseInterval = 0;
+		float broadphaseMargin = 0.0f;					//already scaled by stabilityScaling
+		int broadphaseSteps = 0;						//solver steps since the particle bounds were read
+		bool particleBoundsKnown = false;				//false until the first read after enabling the broadphase or uploading particles, all shapes are submitted meanwhile
+		float particleLower[3], particleUpper[3];		//inflated particle bounds of the last read
+		std::vector<float> colliderLocalBounds;			//per shape: [lower, upper] in the shape's own frame
+		std::vector<float> colliderBounds;				//per shape: [lower, upper] in world space
+		FlexBroadphase::Tree colliderTree;
+		bool colliderTreeStale = false;					//shapes moved or deformed since the tree was last refit
+		std::vector<int> culledColliders;				//shapes submitted by the last culled SubmitCollisionShapes call
+
+		SimBuffers Buffers;
+		FlexPipeline::Readback<NvFlexReadbackDevice> Readback;		//pipelined readback, see FlexSolverOptions::PipelinedReadback
+
+		NvFlexReadbackDevice ReadbackDevice() { return NvFlexReadbackDevice(Library, Solver); }
+
+		///Stores the bounds of a shape in its own frame, the corners may come in any order
+		void SetColliderLocalBounds(int shape, float ax, float ay, float az, float bx, float by, float bz) {
+			float* b = &colliderLocalBounds[shape * 6];
+			b[0] = ax < bx ? ax : bx;
+			b[1] = ay < by ? ay : by;
+			b[2] = az < bz ? az : bz;
+			b[3] = ax < bx ? bx : ax;
+			b[4] = ay < by ? by : ay;
+			b[5] = az < bz ? bz : az;
+		}
 
-	///<summary>Create a default Flex engine object. This will initialize a solver, create buffers and set up default NvFlexParams.</summary>
+		///Places the local bounds of a shape at its pose
+		void UpdateColliderBounds(int shape, const float4& position, const float4& rotation) {
+			FlexBroadphase::TransformBounds(&colliderLocalBounds[shape * 6], &position.x, &rotation.x, &colliderBounds[shape * 6]);
+		}
+	};
+
+	///Tells the host upon startup, how much memory it will need and reserves this memory
+	void SimBuffers::Allocate(const FlexState& s) {
+		Particles = NvFlexAllocBuffer(s.Library, s.maxParticles, sizeof(float4), eNvFlexBufferHost);
+		Velocities = NvFlexAllocBuffer(s.Library, s.maxParticles, sizeof(float3), eNvFlexBufferHost);
+		Phases = NvFlexAllocBuffer(s.Library, s.maxParticles, sizeof(int), eNvFlexBufferHost);
+		Active = NvFlexAllocBuffer(s.Library, s.maxParticles, sizeof(int), eNvFlexBufferHost);
+		CollisionGeometry = NvFlexAllocBuffer(s.Library, s.maxCollisionShapeNumber, sizeof(float4), eNvFlexBufferHost);
+		Position = NvFlexAllocBuffer(s.Library, s.maxCollisionShapeNumber, sizeof(float4), eNvFlexBufferHost);
+		PrevPosition = NvFlexAllocBuffer(s.Library, s.maxCollisionShapeNumber, sizeof(float4), eNvFlexBufferHost);
+		Rotation = NvFlexAllocBuffer(s.Library, s.maxCollisionShapeNumber, sizeof(float4), eNvFlexBufferHost);
+		PrevRotation = NvFlexAllocBuffer(s.Library, s.maxCollisionShapeNumber, sizeof(float4), eNvFlexBufferHost);
+		Flags = NvFlexAllocBuffer(s.Library, s.maxCollisionShapeNumber, sizeof(int), eNvFlexBufferHost);
+		CollisionMeshVertices = NvFlexAllocBuffer(s.Library, s.maxCollisionMeshVertexCount, sizeof(float3), eNvFlexBufferHost);
+		CollisionMeshIndices = NvFlexAllocBuffer(s.Library, s.maxCollisionMeshIndexCount, sizeof(int) * 3, eNvFlexBufferHost);
+		CollisionConvexMeshPlanes = NvFlexAllocBuffer(s.Library, s.maxCollisionConvexShapePlanes, sizeof(float4), eNvFlexBufferHost);
+		RigidOffets = NvFlexAllocBuffer(s.Library, s.maxRigidBodies + 1, sizeof(int), eNvFlexBufferHost);
+		RigidIndices = NvFlexAllocBuffer(s.Library, s.maxRigidBodies, sizeof(int), eNvFlexBufferHost);
+		RigidRestPositions = NvFlexAllocBuffer(s.Library, s.maxRigidBodies, sizeof(float3), eNvFlexBufferHost);
+		RigidRestNormals = NvFlexAllocBuffer(s.Library, s.maxRigidBodies, sizeof(float4), eNvFlexBufferHost);
+		RigidStiffnesses = NvFlexAllocBuffer(s.Library, s.maxRigidBodies, sizeof(float), eNvFlexBufferHost);
+		RigidRotations = NvFlexAllocBuffer(s.Library, s.maxRigidBodies, sizeof(float4), eNvFlexBufferHost);
+		RigidTranslations = NvFlexAllocBuffer(s.Library, s.maxRigidBodies, sizeof(float3), eNvFlexBufferHost);
+		SpringPairIndices = NvFlexAllocBuffer(s.Library, s.maxSprings * 2, sizeof(int), eNvFlexBufferHost);
+		SpringLengths = NvFlexAllocBuffer(s.Library, s.maxSprings, sizeof(float), eNvFlexBufferHost);
+		SpringCoefficients = NvFlexAllocBuffer(s.Library, s.maxSprings, sizeof(float), eNvFlexBufferHost);
+		DynamicTriangleIndices = NvFlexAllocBuffer(s.Library, s.maxDynamicTriangles * 3, sizeof(int), eNvFlexBufferHost);
+		DynamicTriangleNormals = NvFlexAllocBuffer(s.Library, s.maxDynamicTriangles, sizeof(float3), eNvFlexBufferHost);
+		InflatableStartIndices = NvFlexAllocBuffer(s.Library, s.maxDynamicTriangles, sizeof(int), eNvFlexBufferHost);
+		InflatableNumTriangles = NvFlexAllocBuffer(s.Library, s.maxDynamicTriangles, sizeof(int), eNvFlexBufferHost);
+		InflatableRestVolumes = NvFlexAllocBuffer(s.Library, s.maxDynamicTriangles / 4, sizeof(float), eNvFlexBufferHost);
+		InflatableOverPressures = NvFlexAllocBuffer(s.Library, s.maxDynamicTriangles / 4, sizeof(float), eNvFlexBufferHost);
+		InflatableConstraintScales = NvFlexAllocBuffer(s.Library, s.maxDynamicTriangles / 4, sizeof(float), eNvFlexBufferHost);
+	}
+
+	///Allocates the buffers of optional readback channels the first time they are requested
+	void SimBuffers::AllocateReadback(const FlexState& s, int channels) {
+		if ((channels & (int)FlexReadback::Normals) && !Normals)
+			Normals = NvFlexAllocBuffer(s.Library, s.maxParticles, sizeof(float4), eNvFlexBufferHost);
+		if ((channels & (int)FlexReadback::Densities) && !Densities)
+			Densities = NvFlexAllocBuffer(s.Library, s.maxParticles, sizeof(float), eNvFlexBufferHost);
+		if ((channels & (int)FlexReadback::Contacts) && !ContactPlanes) {
+			ContactPlanes = NvFlexAllocBuffer(s.Library, s.maxParticles * maxContactsPerParticle, sizeof(float4), eNvFlexBufferHost);
+			ContactVelocities = NvFlexAllocBuffer(s.Library, s.maxParticles * maxContactsPerParticle, sizeof(float4), eNvFlexBufferHost);
+			ContactIndices = NvFlexAllocBuffer(s.Library, s.maxParticles, sizeof(int), eNvFlexBufferHost);
+			ContactCounts = NvFlexAllocBuffer(s.Library, s.maxParticles, sizeof(unsigned int), eNvFlexBufferHost);
+		}
+	}
+
+	///Allocates the buffers of the culled shape set the first time the broadphase is used
+	void SimBuffers::AllocateBroadphase(const FlexState& s) {
+		if (CulledGeometry)
+			return;
+		CulledGeometry = NvFlexAllocBuffer(s.Library, s.maxCollisionShapeNumber, sizeof(float4), eNvFlexBufferHost);
+		CulledPosition = NvFlexAllocBuffer(s.Library, s.maxCollisionShapeNumber, sizeof(float4), eNvFlexBufferHost);
+		CulledPrevPosition = NvFlexAllocBuffer(s.Library, s.maxCollisionShapeNumber, sizeof(float4), eNvFlexBufferHost);
+		CulledRotation = NvFlexAllocBuffer(s.Library, s.maxCollisionShapeNumber, sizeof(float4), eNvFlexBufferHost);
+		CulledPrevRotation = NvFlexAllocBuffer(s.Library, s.maxCollisionShapeNumber, sizeof(float4), eNvFlexBufferHost);
+		CulledFlags = NvFlexAllocBuffer(s.Library, s.maxCollisionShapeNumber, sizeof(int), eNvFlexBufferHost);
+		ParticleLower = NvFlexAllocBuffer(s.Library, 1, sizeof(float3), eNvFlexBufferHost);
+		ParticleUpper = NvFlexAllocBuffer(s.Library, 1, sizeof(float3), eNvFlexBufferHost);
+	}
+
+	///<summary>Create a default Flex engine object. This will initialize a solver, create buffers and set up default NvFlexParams.
+	///Each Flex object owns its solver, other Flex objects keep running.</summary>
 	Flex::Flex() {
-		if (Solver)
-			Destroy();
+		Initialize(nullptr);
+	}
+
+	///<summary>Create a Flex engine object whose solver and buffers are sized by the limits in 'flexSolverOptions'. Params, collision geometry and force fields set afterwards are scaled by its stability scaling factor.</summary>
+	Flex::Flex(FlexSolverOptions^ flexSolverOptions) {
+		if (!flexSolverOptions || !flexSolverOptions->IsValid())
+			throw gcnew Exception("FlexCLI: Flex::Flex(FlexSolverOptions^ flexSolverOptions) ---> Invalid solver options");
+		Initialize(flexSolverOptions);
+	}
 
-		Library = NvFlexInit();
+	///Sets up default params and the solver, with the limits of 'flexSolverOptions' or the FlexState defaults if it is null
+	void Flex::Initialize(FlexSolverOptions^ flexSolverOptions) {
+		state = new FlexState();
+		state->Library = AcquireLibrary();
 
 		//set default Params
 #pragma region Params
-		Params.gravity[0] = 0.0f;
-		Params.gravity[1] = 0.0f;
-		Params.gravity[2] = -9.81f;
-
-		Params.wind[0] = 0.0f;
-		Params.wind[1] = 0.0f;
-		Params.wind[2] = 0.0f;
-
-		Params.radius = 0.15f;
-		Params.viscosity = 0.0f;
-		Params.dynamicFriction = 0.0f;
-		Params.staticFriction = 0.0f;
-		Params.particleFriction = 0.0f; // scale friction between particles by default
-		Params.freeSurfaceDrag = 0.0f;
-		Params.drag = 0.0f;
-		Params.lift = 0.0f;
-		Params.numIterations = 3;
-		Params.fluidRestDistance = 0.0f;
-		Params.solidRestDistance = 0.0f;
-
-		Params.anisotropyScale = 1.0f;
-		Params.anisotropyMin = 0.1f;
-		Params.anisotropyMax = 2.0f;
-		Params.smoothing = 1.0f;
-
-		Params.dissipation = 0.0f;
-		Params.damping = 0.0f;
-		Params.particleCollisionMargin = 0.0f;
-		Params.shapeCollisionMargin = 0.0f;
-		Params.collisionDistance = 0.0f;
-		Params.plasticThreshold = 0.0f;
-		Params.plasticCreep = 0.0f;
-		Params.fluid = true;
-		Params.sleepThreshold = 0.0f;
-		Params.shockPropagation = 0.0f;
-		Params.restitution = 0.0f;
-
-		Params.maxSpeed = FLT_MAX;
-		Params.maxAcceleration = 100.0f;	// approximately 10x gravity
-
-		Params.relaxationMode = eNvFlexRelaxationLocal;
-		Params.relaxationFactor = 1.0f;
-		Params.solidPressure = 1.0f;
-		Params.adhesion = 0.0f;
-		Params.cohesion = 0.025f;
-		Params.surfaceTension = 0.0f;
-		Params.vorticityConfinement = 0.0f;
-		Params.buoyancy = 1.0f;
-		Params.diffuseThreshold = 100.0f;
-		Params.diffuseBuoyancy = 1.0f;
-		Params.diffuseDrag = 0.8f;
-		Params.diffuseBallistic = 16;
-		Params.diffuseSortAxis[0] = 0.0f;
-		Params.diffuseSortAxis[1] = 0.0f;
-		Params.diffuseSortAxis[2] = 0.0f;
-		Params.diffuseLifetime = 2.0f;
+		state->Params.gravity[0] = 0.0f;
+		state->Params.gravity[1] = 0.0f;
+		state->Params.gravity[2] = -9.81f;
+
+		state->Params.wind[0] = 0.0f;
+		state->Params.wind[1] = 0.0f;
+		state->Params.wind[2] = 0.0f;
+
+		state->Params.radius = 0.15f;
+		state->Params.viscosity = 0.0f;
+		state->Params.dynamicFriction = 0.0f;
+		state->Params.staticFriction = 0.0f;
+		state->Params.particleFriction = 0.0f; // scale friction between particles by default
+		state->Params.freeSurfaceDrag = 0.0f;
+		state->Params.drag = 0.0f;
+		state->Params.lift = 0.0f;
+		state->Params.numIterations = 3;
+		state->Params.fluidRestDistance = 0.0f;
+		state->Params.solidRestDistance = 0.0f;
+
+		state->Params.anisotropyScale = 1.0f;
+		state->Params.anisotropyMin = 0.1f;
+		state->Params.anisotropyMax = 2.0f;
+		state->Params.smoothing = 1.0f;
+
+		state->Params.dissipation = 0.0f;
+		state->Params.damping = 0.0f;
+		state->Params.particleCollisionMargin = 0.0f;
+		state->Params.shapeCollisionMargin = 0.0f;
+		state->Params.collisionDistance = 0.0f;
+		state->Params.plasticThreshold = 0.0f;
+		state->Params.plasticCreep = 0.0f;
+		state->Params.fluid = true;
+		state->Params.sleepThreshold = 0.0f;
+		state->Params.shockPropagation = 0.0f;
+		state->Params.restitution = 0.0f;
+
+		state->Params.maxSpeed = FLT_MAX;
+		state->Params.maxAcceleration = 100.0f;	// approximately 10x gravity
+
+		state->Params.relaxationMode = eNvFlexRelaxationLocal;
+		state->Params.relaxationFactor = 1.0f;
+		state->Params.solidPressure = 1.0f;
+		state->Params.adhesion = 0.0f;
+		state->Params.cohesion = 0.025f;
+		state->Params.surfaceTension = 0.0f;
+		state->Params.vorticityConfinement = 0.0f;
+		state->Params.buoyancy = 1.0f;
+		state->Params.diffuseThreshold = 100.0f;
+		state->Params.diffuseBuoyancy = 1.0f;
+		state->Params.diffuseDrag = 0.8f;
+		state->Params.diffuseBallistic = 16;
+		state->Params.diffuseSortAxis[0] = 0.0f;
+		state->Params.diffuseSortAxis[1] = 0.0f;
+		state->Params.diffuseSortAxis[2] = 0.0f;
+		state->Params.diffuseLifetime = 2.0f;
 
 		// planes created after particles
-		Params.numPlanes = 0;
+		state->Params.numPlanes = 0;
 #pragma endregion
 
-		Buffers.Allocate();
-
 		FlexForceFields = gcnew List<FlexForceField^>();
 
-		Solver = NvFlexCreateSolver(Library, maxParticles, maxDiffuseParticles, maxNeighborsPerParticle);
+		//without a solver, SetSolverOptions only stores the options
+		if (flexSolverOptions)
+			SetSolverOptions(flexSolverOptions);
+		CreateSolver();
+	}
+
+	///Allocates the buffers, the solver and the force field callback for the limits currently in FlexState
+	void Flex::CreateSolver() {
+		state->Buffers.Allocate(*state);
+
+		state->Solver = NvFlexCreateSolver(state->Library, state->maxParticles, state->maxDiffuseParticles, state->maxNeighborsPerParticle);
+
+		state->ForceFieldCallback = NvFlexExtCreateForceFieldCallback(state->Solver);
+	}
+
+	///Releases the solver and all buffers sized by its limits. Collision meshes live in the library and stay cached.
+	void Flex::DestroySolver() {
+		FinishReadback();
+		if (state->Library)
+			NvFlexFlush(state->Library);
+		state->Buffers.Destroy();
+		NvFlexReadbackDevice device = state->ReadbackDevice();
+		state->Readback.Destroy(device);
+		uploadedScene = nullptr;
+		triangleNormalsSet = false;
+		state->stateSynced = false;
+		state->culledColliders.clear();
+		state->particleBoundsKnown = false;
+		state->broadphaseSteps = 0;
+
+		if (state->ForceFieldCallback) {
+			NvFlexExtDestroyForceFieldCallback(state->ForceFieldCallback);
+			state->ForceFieldCallback = 0;
+		}
+		if (state->Solver) {
+			NvFlexDestroySolver(state->Solver);
+			state->Solver = 0;
+		}
+	}
+
+	///Uploads params, collision shapes, force fields and the scene once more, after the solver was created anew or the stability scaling changed.
+	///Collider poses set by UpdateColliderTransforms fall back to the ones in the collision geometry.
+	void Flex::Reupload() {
+		if (flexParams)
+			SetParams(flexParams);
+		else
+			NvFlexSetParams(state->Solver, &state->Params);
+		if (collisionGeometry)
+			SetCollisionGeometry(collisionGeometry);
+		if (FlexForceFields->Count > 0)
+			SetForceFields(FlexForceFields);
+		//full upload, the particles in the solver are in the old scale
+		uploadedScene = nullptr;
+		if (Scene)
+			SetScene(Scene);
+	}
 
-		if (ForceFieldCallback)
-			NvFlexExtDestroyForceFieldCallback(ForceFieldCallback);
+	///<summary>Releases this object's solver and native state, like Destroy. Other Flex objects keep running.</summary>
+	Flex::~Flex() {
+		if (!state)
+			return;
+		Destroy();
+		delete state;
+		state = NULL;
+	}
 
-		ForceFieldCallback = NvFlexExtCreateForceFieldCallback(Solver);
+	///The finalizer runs on the finalizer thread, it must neither wait for readbacks, call into NvFlex nor take the library lock.
+	///Solver, buffers and the library reference of an instance that was never disposed are leaked, only the host side state is freed.
+	Flex::!Flex() {
+		if (!state)
+			return;
+		if (state->Library)
+			System::Diagnostics::Trace::TraceWarning("FlexCLI: Flex instance was not disposed, its solver is leaked. Call Destroy or Dispose when done.");
+		delete state;
+		state = NULL;
+	}
+
+	///<summary>Returns the library shared by all Flex objects, initializing it for the first one. Adds a reference to it.</summary>
+	NvFlexLibrary* Flex::AcquireLibrary() {
+		System::Threading::Monitor::Enter(libraryLock);
+		try {
+			if (!sharedLibrary)
+				sharedLibrary = NvFlexInit();
+			if (sharedLibrary)
+				sharedLibraryReferences++;
+			return sharedLibrary;
+		}
+		finally {
+			System::Threading::Monitor::Exit(libraryLock);
+		}
+	}
+
+	///<summary>Drops a reference to the shared library and shuts it down once no Flex object uses it any more</summary>
+	void Flex::ReleaseLibrary() {
+		System::Threading::Monitor::Enter(libraryLock);
+		try {
+			if (--sharedLibraryReferences == 0) {
+				NvFlexShutdown(sharedLibrary);
+				sharedLibrary = NULL;
+			}
+		}
+		finally {
+			System::Threading::Monitor::Exit(libraryLock);
+		}
 	}
 
 	///<summary>Returns true if pointers to library and solver objects are valid</summary>
 	bool Flex::IsReady() {
-		return Library && Solver;
+		return state && state->Library && state->Solver;
 	}
 
 	///Registration methods private and public
 
 	///<summary>Register different collision geometries wrapped into the FlexCollisionGeometry class.</summary>
 	void Flex::SetCollisionGeometry(FlexCollisionGeometry^ flexCollisionGeometry) {
+		//meshes have to fit the upload buffers, checked before anything is changed or mapped
+		float maxSimplificationError = flexCollisionGeometry->MeshSimplification * state->Params.collisionDistance / state->stabilityScaling;
+		for (int i = 0; i < flexCollisionGeometry->NumMeshes; i++)
+			CheckTriangleMeshLimits(flexCollisionGeometry->MeshVertices[i], flexCollisionGeometry->MeshFaces[i], maxSimplificationError, "mesh nr. " + i);
+		if (flexCollisionGeometry->NumMeshInstances > 0)
+			for (int i = 0; i < flexCollisionGeometry->InstancedMeshVertices->Count; i++)
+				CheckTriangleMeshLimits(flexCollisionGeometry->InstancedMeshVertices[i], flexCollisionGeometry->InstancedMeshFaces[i], maxSimplificationError, "instanced mesh nr. " + i);
+
+		//meshes of the previous geometry are released after the new shapes are set, so unchanged meshes are reused instead of cooked again
+		std::vector<unsigned long long> previousMeshes;
+		previousMeshes.swap(state->collisionMeshesInUse);
+		std::map<int, unsigned int> previousDeformed;
+		previousDeformed.swap(state->deformedColliders);
+		collisionGeometry = flexCollisionGeometry;
 
 		//PLANES
 		//if (flexCollisionGeometry->NumPlanes > 0 && flexCollisionGeometry->Planes) {
 			//unlike other collision geometries, planes are registered in the Flex param (NvFlexParams)
-			Params.numPlanes = flexCollisionGeometry->NumPlanes;
+			state->Params.numPlanes = flexCollisionGeometry->NumPlanes;
 			for (int i = 0; i < flexCollisionGeometry->NumPlanes; i++) {
-				Params.planes[i][0] = flexCollisionGeometry->Planes[i * 4];
-				Params.planes[i][1] = flexCollisionGeometry->Planes[i * 4 + 1];
-				Params.planes[i][2] = flexCollisionGeometry->Planes[i * 4 + 2];
-				Params.planes[i][3] = flexCollisionGeometry->Planes[i * 4 + 3] * stabilityScaling;
+				state->Params.planes[i][0] = flexCollisionGeometry->Planes[i * 4];
+				state->Params.planes[i][1] = flexCollisionGeometry->Planes[i * 4 + 1];
+				state->Params.planes[i][2] = flexCollisionGeometry->Planes[i * 4 + 2];
+				state->Params.planes[i][3] = flexCollisionGeometry->Planes[i * 4 + 3] * state->stabilityScaling;
 			}
-			NvFlexSetParams(Solver, &Params);
+			NvFlexSetParams(state->Solver, &state->Params);
 		//}
 
 
 		//EVERYTHING ELSE
 		//prepare generic buffers, shape specific buffers are handled in the respective field 
-		NvFlexCollisionGeometry* geometry = (NvFlexCollisionGeometry*)NvFlexMap(Buffers.CollisionGeometry, 0);
-		float4* positions = (float4*)NvFlexMap(Buffers.Position, 0);
-		float4* rotations = (float4*)NvFlexMap(Buffers.Rotation, 0);
-		int* flags = (int*)NvFlexMap(Buffers.Flags, 0);
+		NvFlexCollisionGeometry* geometry = (NvFlexCollisionGeometry*)NvFlexMap(state->Buffers.CollisionGeometry, 0);
+		float4* positions = (float4*)NvFlexMap(state->Buffers.Position, 0);
+		float4* rotations = (float4*)NvFlexMap(state->Buffers.Rotation, 0);
+		float4* prevPositions = (float4*)NvFlexMap(state->Buffers.PrevPosition, 0);
+		float4* prevRotations = (float4*)NvFlexMap(state->Buffers.PrevRotation, 0);
+		int* flags = (int*)NvFlexMap(state->Buffers.Flags, 0);
 		int numShapes = 0;
+		state->colliderLocalBounds.resize(6 * (flexCollisionGeometry->NumSpheres + flexCollisionGeometry->NumBoxes + flexCollisionGeometry->NumCapsules + flexCollisionGeometry->NumMeshes
+			+ flexCollisionGeometry->NumConvex + flexCollisionGeometry->NumDistanceFields + flexCollisionGeometry->NumMeshInstances));
 
 		// add sphere
 		for (int i = 0; i < flexCollisionGeometry->NumSpheres; i++) {
 			flags[numShapes] = NvFlexMakeShapeFlags(eNvFlexShapeSphere, false);
 			geometry[numShapes].sphere.radius = flexCollisionGeometry->SphereRadii[i];
+			float r = geometry[numShapes].sphere.radius;
+			state->SetColliderLocalBounds(numShapes, -r, -r, -r, r, r, r);
 			positions[numShapes] = float4(
-				flexCollisionGeometry->SphereCenters[i * 3] * stabilityScaling,
-				flexCollisionGeometry->SphereCenters[i * 3 + 1] * stabilityScaling,
-				flexCollisionGeometry->SphereCenters[i * 3 + 2] * stabilityScaling,
+				flexCollisionGeometry->SphereCenters[i * 3] * state->stabilityScaling,
+				flexCollisionGeometry->SphereCenters[i * 3 + 1] * state->stabilityScaling,
+				flexCollisionGeometry->SphereCenters[i * 3 + 2] * state->stabilityScaling,
 				0.0);
 			rotations[numShapes] = float4(0.0f, 0.0f, 0.0f, 0.0f);
 			numShapes++;
@@ -357,13 +689,15 @@ namespace FlexCLI {
 		// add boxes
 		for (int i = 0; i < flexCollisionGeometry->NumBoxes; i++) {
 			flags[numShapes] = NvFlexMakeShapeFlags(eNvFlexShapeBox, false);
-			geometry[numShapes].box.halfExtents[0] = flexCollisionGeometry->BoxHalfHeights[i * 3] * stabilityScaling;
-			geometry[numShapes].box.halfExtents[1] = flexCollisionGeometry->BoxHalfHeights[i * 3 + 1] * stabilityScaling;
-			geometry[numShapes].box.halfExtents[2] = flexCollisionGeometry->BoxHalfHeights[i * 3 + 2] * stabilityScaling;
+			geometry[numShapes].box.halfExtents[0] = flexCollisionGeometry->BoxHalfHeights[i * 3] * state->stabilityScaling;
+			geometry[numShapes].box.halfExtents[1] = flexCollisionGeometry->BoxHalfHeights[i * 3 + 1] * state->stabilityScaling;
+			geometry[numShapes].box.halfExtents[2] = flexCollisionGeometry->BoxHalfHeights[i * 3 + 2] * state->stabilityScaling;
+			float* h = geometry[numShapes].box.halfExtents;
+			state->SetColliderLocalBounds(numShapes, -h[0], -h[1], -h[2], h[0], h[1], h[2]);
 			positions[numShapes] = float4(
-				flexCollisionGeometry->BoxCenters[i * 3] * stabilityScaling,
-				flexCollisionGeometry->BoxCenters[i * 3 + 1] * stabilityScaling,
-				flexCollisionGeometry->BoxCenters[i * 3 + 2] * stabilityScaling,
+				flexCollisionGeometry->BoxCenters[i * 3] * state->stabilityScaling,
+				flexCollisionGeometry->BoxCenters[i * 3 + 1] * state->stabilityScaling,
+				flexCollisionGeometry->BoxCenters[i * 3 + 2] * state->stabilityScaling,
 				0.0);
 
 			rotations[numShapes] = float4(
@@ -377,12 +711,14 @@ namespace FlexCLI {
 		//add capsules
 		for (int i = 0; i < flexCollisionGeometry->NumCapsules; i++) {
 			flags[numShapes] = NvFlexMakeShapeFlags(eNvFlexShapeCapsule, false);
-			geometry[numShapes].capsule.halfHeight = flexCollisionGeometry->CapsuleHalfHeights[i] * stabilityScaling;
-			geometry[numShapes].capsule.radius = flexCollisionGeometry->CapsuleRadii[i] * stabilityScaling;
+			geometry[numShapes].capsule.halfHeight = flexCollisionGeometry->CapsuleHalfHeights[i] * state->stabilityScaling;
+			geometry[numShapes].capsule.radius = flexCollisionGeometry->CapsuleRadii[i] * state->stabilityScaling;
+			float r = geometry[numShapes].capsule.radius, h = geometry[numShapes].capsule.halfHeight;
+			state->SetColliderLocalBounds(numShapes, -h - r, -r, -r, h + r, r, r);
 			positions[numShapes] = float4(
-				flexCollisionGeometry->CapsuleCenters[i * 4] * stabilityScaling,
-				flexCollisionGeometry->CapsuleCenters[i * 4 + 1] * stabilityScaling,
-				flexCollisionGeometry->CapsuleCenters[i * 4 + 2] * stabilityScaling,
+				flexCollisionGeometry->CapsuleCenters[i * 4] * state->stabilityScaling,
+				flexCollisionGeometry->CapsuleCenters[i * 4 + 1] * state->stabilityScaling,
+				flexCollisionGeometry->CapsuleCenters[i * 4 + 2] * state->stabilityScaling,
 				0.0);
 			rotations[numShapes] = float4(
 				flexCollisionGeometry->CapsuleRotations[i * 4], 
@@ -392,45 +728,12 @@ namespace FlexCLI {
 			numShapes++;
 		}
 
-		//add meshes
+		//add meshes, simplified first if requested: surface deviations well below the collision distance are hidden by it anyway
+		float simplificationPadding = maxSimplificationError > 0.0f ? maxSimplificationError : 0.0f;
+		state->firstMeshShape = numShapes;
+		state->numMeshShapes = flexCollisionGeometry->NumMeshes;
 		for (int i = 0; i < flexCollisionGeometry->NumMeshes; i++) {
-			// create a triangle mesh
-			NvFlexTriangleMeshId mesh = NvFlexCreateTriangleMesh(Library);
-
-
-
-			//assign vertex and face lists accordingly
-			float3* vertices = (float3*)NvFlexMap(Buffers.CollisionMeshVertices, 0);
-			int* faces = (int*)NvFlexMap(Buffers.CollisionMeshIndices, 0);
-			array<float>^ v = flexCollisionGeometry->MeshVertices[i];
-			array<int>^ f = flexCollisionGeometry->MeshFaces[i];
-			for (int j = 0; j < v->Length / 3; j++)
-				vertices[j] = float3(
-					-v[j * 3] * stabilityScaling,
-					-v[j * 3 + 1] * stabilityScaling,
-					-v[j * 3 + 2] * stabilityScaling);
-			for (int j = 0; j < f->Length; j++)
-				faces[j] = f[j];
-
-			//get upper and lower bounds of the mesh
-			array<float>^ u = flexCollisionGeometry->MeshUpperBounds[i];
-			array<float>^ l = flexCollisionGeometry->MeshLowerBounds[i];
-			float* upper = new float[3];
-			float* lower = new float[3];
-			for (int j = 0; j < 3; j++) {
-				upper[j] = -u[j] * stabilityScaling;
-				lower[j] = -l[j] * stabilityScaling;
-			}
-			NvFlexUnmap(Buffers.CollisionMeshVertices);
-			NvFlexUnmap(Buffers.CollisionMeshIndices);
-
-			//set mesh
-			NvFlexUpdateTriangleMesh(Library, mesh, Buffers.CollisionMeshVertices, Buffers.CollisionMeshIndices, (int)(v->Length / 3), (int)(f->Length / 3), upper, lower);
-
-			delete(upper);
-			upper = NULL;
-			delete(lower);
-			lower = NULL;
+			NvFlexTriangleMeshId mesh = AcquireTriangleMesh(flexCollisionGeometry->MeshVertices[i], flexCollisionGeometry->MeshFaces[i], flexCollisionGeometry->MeshUpperBounds[i], flexCollisionGeometry->MeshLowerBounds[i], maxSimplificationError, true);
 
 			// add triangle mesh instance
 			flags[numShapes] = NvFlexMakeShapeFlags(eNvFlexShapeTriangleMesh, false);
@@ -440,44 +743,18 @@ namespace FlexCLI {
 			geometry[numShapes].triMesh.scale[2] = 1.0f;
 			positions[numShapes] = float4(0.0f, 0.0f, 0.0f, 0.0f);
 			rotations[numShapes] = float4(0.0f, 0.0f, 0.0f, 0.0f);
+			array<float>^ l = flexCollisionGeometry->MeshLowerBounds[i];
+			array<float>^ u = flexCollisionGeometry->MeshUpperBounds[i];
+			float p = simplificationPadding;
+			state->SetColliderLocalBounds(numShapes, -(u[0] + p) * state->stabilityScaling, -(u[1] + p) * state->stabilityScaling, -(u[2] + p) * state->stabilityScaling,
+				-(l[0] - p) * state->stabilityScaling, -(l[1] - p) * state->stabilityScaling, -(l[2] - p) * state->stabilityScaling);
 
 			numShapes++;
 		}
 
 		//add convex shapes
 		for (int i = 0; i < flexCollisionGeometry->NumConvex; i++) {
-			//create convex mesh
-			NvFlexConvexMeshId mesh = NvFlexCreateConvexMesh(Library);
-
-			//assign planes accordingly
-			float4* planes = (float4*)NvFlexMap(Buffers.CollisionConvexMeshPlanes, 0);
-			array<float>^ p = flexCollisionGeometry->ConvexPlanes[i];
-			for (int j = 0; j < p->Length / 4; j++)
-				planes[j] = float4(
-					p[j * 4], 
-					p[j * 4 + 1], 
-					p[j * 4 + 2], 
-					-p[j * 4 + 3] * stabilityScaling);
-
-			//get upper and lower bounds of the mesh
-			array<float>^ u = flexCollisionGeometry->ConvexUpperBounds[i];
-			array<float>^ l = flexCollisionGeometry->ConvexLowerBounds[i];
-			float* upper = new float[3];
-			float* lower = new float[3];
-			for (int j = 0; j < 3; j++) {
-				upper[j] = -u[j] * stabilityScaling;
-				lower[j] = -l[j] * stabilityScaling;
-			}
-
-			NvFlexUnmap(Buffers.CollisionConvexMeshPlanes);
-
-			//set convex mesh
-			NvFlexUpdateConvexMesh(Library, mesh, Buffers.CollisionConvexMeshPlanes, p->Length / 4, lower, upper);
-
-			delete(upper);
-			upper = NULL;
-			delete(lower);
-			lower = NULL;
+			NvFlexConvexMeshId mesh = AcquireConvexMesh(flexCollisionGeometry->ConvexPlanes[i], flexCollisionGeometry->ConvexUpperBounds[i], flexCollisionGeometry->ConvexLowerBounds[i]);
 
 			flags[numShapes] = NvFlexMakeShapeFlags(eNvFlexShapeConvexMesh, false);
 			geometry[numShapes].convexMesh.mesh = mesh;
@@ -486,82 +763,572 @@ namespace FlexCLI {
 			geometry[numShapes].convexMesh.scale[2] = 1.0f;
 			positions[numShapes] = float4(0.0f, 0.0f, 0.0f, 0.0f);
 			rotations[numShapes] = float4(0.0f, 0.0f, 0.0f, 0.0f);
+			array<float>^ l = flexCollisionGeometry->ConvexLowerBounds[i];
+			array<float>^ u = flexCollisionGeometry->ConvexUpperBounds[i];
+			state->SetColliderLocalBounds(numShapes, -u[0] * state->stabilityScaling, -u[1] * state->stabilityScaling, -u[2] * state->stabilityScaling, -l[0] * state->stabilityScaling, -l[1] * state->stabilityScaling, -l[2] * state->stabilityScaling);
 			numShapes++;
 		}
 
-		//TO DO: add SDF
+		//add signed distance fields. The grid corner is the shape origin, it sits at the corner's position as the rotation is the identity.
+		int firstDistanceField = numShapes;
+		for (int i = 0; i < flexCollisionGeometry->NumDistanceFields; i++) {
+			float lower[3], size;
+			NvFlexDistanceFieldId field = AcquireDistanceField(flexCollisionGeometry->DistanceFieldVertices[i], flexCollisionGeometry->DistanceFieldFaces[i], flexCollisionGeometry->DistanceFieldResolutions[i], lower, &size);
+
+			flags[numShapes] = NvFlexMakeShapeFlags(eNvFlexShapeSDF, false);
+			geometry[numShapes].sdf.field = field;
+			geometry[numShapes].sdf.scale = size;
+			positions[numShapes] = float4(lower[0], lower[1], lower[2], 0.0f);
+			rotations[numShapes] = float4(0.0f, 0.0f, 0.0f, 1.0f);
+			state->SetColliderLocalBounds(numShapes, 0.0f, 0.0f, 0.0f, size, size, size);
+			numShapes++;
+		}
+
+		//add mesh instances. Each instanced mesh is cooked once, unmirrored, so instances can carry real rotations and scales.
+		state->firstMeshInstanceShape = numShapes;
+		state->numMeshInstanceShapes = flexCollisionGeometry->NumMeshInstances;
+		if (flexCollisionGeometry->NumMeshInstances > 0) {
+			std::vector<NvFlexTriangleMeshId> instancedMeshes(flexCollisionGeometry->InstancedMeshVertices->Count);
+			for (int i = 0; i < (int)instancedMeshes.size(); i++)
+				instancedMeshes[i] = AcquireTriangleMesh(flexCollisionGeometry->InstancedMeshVertices[i], flexCollisionGeometry->InstancedMeshFaces[i], flexCollisionGeometry->InstancedMeshUpperBounds[i], flexCollisionGeometry->InstancedMeshLowerBounds[i], maxSimplificationError, false);
+
+			for (int i = 0; i < flexCollisionGeometry->NumMeshInstances; i++) {
+				flags[numShapes] = NvFlexMakeShapeFlags(eNvFlexShapeTriangleMesh, false);
+				geometry[numShapes].triMesh.mesh = instancedMeshes[flexCollisionGeometry->MeshInstanceHandles[i]];
+				geometry[numShapes].triMesh.scale[0] = flexCollisionGeometry->MeshInstanceScales[i * 3];
+				geometry[numShapes].triMesh.scale[1] = flexCollisionGeometry->MeshInstanceScales[i * 3 + 1];
+				geometry[numShapes].triMesh.scale[2] = flexCollisionGeometry->MeshInstanceScales[i * 3 + 2];
+				positions[numShapes] = float4(
+					flexCollisionGeometry->MeshInstancePositions[i * 3] * state->stabilityScaling,
+					flexCollisionGeometry->MeshInstancePositions[i * 3 + 1] * state->stabilityScaling,
+					flexCollisionGeometry->MeshInstancePositions[i * 3 + 2] * state->stabilityScaling,
+					0.0f);
+				rotations[numShapes] = float4(
+					flexCollisionGeometry->MeshInstanceRotations[i * 4],
+					flexCollisionGeometry->MeshInstanceRotations[i * 4 + 1],
+					flexCollisionGeometry->MeshInstanceRotations[i * 4 + 2],
+					flexCollisionGeometry->MeshInstanceRotations[i * 4 + 3]);
+				array<float>^ l = flexCollisionGeometry->InstancedMeshLowerBounds[flexCollisionGeometry->MeshInstanceHandles[i]];
+				array<float>^ u = flexCollisionGeometry->InstancedMeshUpperBounds[flexCollisionGeometry->MeshInstanceHandles[i]];
+				float* scale = geometry[numShapes].triMesh.scale;
+				float p = simplificationPadding;
+				state->SetColliderLocalBounds(numShapes, (l[0] - p) * state->stabilityScaling * scale[0], (l[1] - p) * state->stabilityScaling * scale[1], (l[2] - p) * state->stabilityScaling * scale[2],
+					(u[0] + p) * state->stabilityScaling * scale[0], (u[1] + p) * state->stabilityScaling * scale[1], (u[2] + p) * state->stabilityScaling * scale[2]);
+				numShapes++;
+			}
+		}
+
+		//shape origins relative to the user's origin, UpdateColliderTransforms rotates them along
+		state->colliderOffsets.assign(numShapes, float3(0.0f, 0.0f, 0.0f));
+		for (int i = 0; i < flexCollisionGeometry->NumDistanceFields; i++) {
+			float4 p = positions[firstDistanceField + i];
+			state->colliderOffsets[firstDistanceField + i] = float3(p.x, p.y, p.z);
+		}
+
+		//new shapes start at rest
+		memcpy(prevPositions, positions, sizeof(float4) * numShapes);
+		memcpy(prevRotations, rotations, sizeof(float4) * numShapes);
+		state->numCollisionShapes = numShapes;
+		state->movedColliders.clear();
+
+		//world bounds and broadphase tree, kept up to date even while the broadphase is off so it can be enabled any time
+		state->colliderBounds.resize(6 * numShapes);
+		for (int i = 0; i < numShapes; i++)
+			state->UpdateColliderBounds(i, positions[i], rotations[i]);
+		state->colliderTree.Build(numShapes > 0 ? &state->colliderBounds[0] : nullptr, numShapes);
+		state->colliderTreeStale = false;
 
 		// unmap buffers
-		NvFlexUnmap(Buffers.CollisionGeometry);
-		NvFlexUnmap(Buffers.Position);
-		NvFlexUnmap(Buffers.Rotation);
-		NvFlexUnmap(Buffers.Flags);
+		NvFlexUnmap(state->Buffers.CollisionGeometry);
+		NvFlexUnmap(state->Buffers.Position);
+		NvFlexUnmap(state->Buffers.Rotation);
+		NvFlexUnmap(state->Buffers.PrevPosition);
+		NvFlexUnmap(state->Buffers.PrevRotation);
+		NvFlexUnmap(state->Buffers.Flags);
 
 		// send shapes to Flex
-		NvFlexSetShapes(Solver,
-			Buffers.CollisionGeometry,
-			Buffers.Position,
-			Buffers.Rotation,
-			NULL,
-			NULL,
-			Buffers.Flags, numShapes);
+		SubmitCollisionShapes();
+
+		ReleaseCollisionMeshes(previousMeshes);
+		for (std::map<int, unsigned int>::iterator d = previousDeformed.begin(); d != previousDeformed.end(); d++)
+			NvFlexDestroyTriangleMesh(state->Library, d->second);
+	}
+
+	///<summary>
+	///Moves collision shapes without rebuilding any geometry or mesh. Shape indices follow the order SetCollisionGeometry adds shapes in: spheres, boxes, capsules, meshes, convex shapes, distance fields, mesh instances.
+	///</summary>
+	///<param name="positions">[x, y, z] per shape index</param>
+	///<param name="rotations">Quaternion [x, y, z, w] per shape index</param>
+	///<remarks>Triangle and convex meshes are stored point mirrored under a zero quaternion, pass [0, 0, 0, 0] to translate them. Distance fields and mesh instances take proper rotations.
+	///The old pose becomes the previous pose, so the solver derives the shape velocity from the move. Shapes moved by the last call and not by this one come to rest.
+	///The host work is proportional to the number of moved shapes, NvFlex 1.1 still copies the full pose buffers to the device.
+	///With FlexSolverOptions::BroadphaseInterval set, the shapes near the particles are selected again, so moved shapes enter or leave the solver right away.</remarks>
+	void Flex::UpdateColliderTransforms(array<int>^ shapeIndices, array<float>^ positions, array<float>^ rotations) {
+		if (positions->Length != shapeIndices->Length * 3 || rotations->Length != shapeIndices->Length * 4)
+			throw gcnew Exception("FlexCLI: void Flex::UpdateColliderTransforms(...) ---> Invalid input! Expected 3 position and 4 rotation values per shape index.");
+		for (int i = 0; i < shapeIndices->Length; i++)
+			if (shapeIndices[i] < 0 || shapeIndices[i] >= state->numCollisionShapes)
+				throw gcnew Exception("FlexCLI: void Flex::UpdateColliderTransforms(...) ---> Shape index " + shapeIndices[i] + " out of range! There are " + state->numCollisionShapes + " collision shapes.");
+
+		float4* current = (float4*)NvFlexMap(state->Buffers.Position, 0);
+		float4* currentRotations = (float4*)NvFlexMap(state->Buffers.Rotation, 0);
+		float4* previous = (float4*)NvFlexMap(state->Buffers.PrevPosition, 0);
+		float4* previousRotations = (float4*)NvFlexMap(state->Buffers.PrevRotation, 0);
+
+		//shapes moved last time rest now, unless they are moved again below
+		for (size_t i = 0; i < state->movedColliders.size(); i++) {
+			previous[state->movedColliders[i]] = current[state->movedColliders[i]];
+			previousRotations[state->movedColliders[i]] = currentRotations[state->movedColliders[i]];
+		}
+		state->movedColliders.clear();
+
+		for (int i = 0; i < shapeIndices->Length; i++) {
+			int s = shapeIndices[i];
+			previous[s] = current[s];
+			previousRotations[s] = currentRotations[s];
+			currentRotations[s] = float4(rotations[i * 4], rotations[i * 4 + 1], rotations[i * 4 + 2], rotations[i * 4 + 3]);
+			float3 offset = state->colliderOffsets[s];
+			if (offset.x != 0.0f || offset.y != 0.0f || offset.z != 0.0f)
+				DirectX::XMStoreFloat3(&offset, DirectX::XMVector3Rotate(DirectX::XMLoadFloat3(&offset), DirectX::XMLoadFloat4(&currentRotations[s])));
+			current[s] = float4(positions[i * 3] * state->stabilityScaling + offset.x, positions[i * 3 + 1] * state->stabilityScaling + offset.y, positions[i * 3 + 2] * state->stabilityScaling + offset.z, 0.0f);
+			state->UpdateColliderBounds(s, current[s], currentRotations[s]);
+			state->movedColliders.push_back(s);
+		}
+		state->colliderTreeStale |= shapeIndices->Length > 0;
+
+		NvFlexUnmap(state->Buffers.Position);
+		NvFlexUnmap(state->Buffers.Rotation);
+		NvFlexUnmap(state->Buffers.PrevPosition);
+		NvFlexUnmap(state->Buffers.PrevRotation);
+
+		SubmitCollisionShapes();
+	}
+
+	///<summary>
+	///Replaces the vertices of a triangle mesh shape in place, for colliders deforming every tick. The faces stay the ones the mesh was added with.
+	///No other shape is touched and no mesh is cooked from scratch, the cost only depends on this mesh's size.
+	///</summary>
+	///<param name="shapeIndex">Index of an AddMesh or mesh instance shape, in the order UpdateColliderTransforms lists</param>
+	///<param name="vertices">[x, y, z] per vertex, as many as the mesh was added with. Mesh instances take them in the instance's own frame.</param>
+	///<remarks>A shape sharing its mesh with others gets a private copy on the first call, later calls update that copy. Mesh simplification doesn't apply to deformed meshes.</remarks>
+	void Flex::UpdateColliderMeshVertices(int shapeIndex, array<float>^ vertices) {
+		array<int>^ faces;
+		int numVertices;
+		bool mirrored;
+		if (shapeIndex >= state->firstMeshShape && shapeIndex < state->firstMeshShape + state->numMeshShapes) {
+			faces = collisionGeometry->MeshFaces[shapeIndex - state->firstMeshShape];
+			numVertices = collisionGeometry->MeshVertices[shapeIndex - state->firstMeshShape]->Length / 3;
+			mirrored = true;
+		}
+		else if (shapeIndex >= state->firstMeshInstanceShape && shapeIndex < state->firstMeshInstanceShape + state->numMeshInstanceShapes) {
+			int handle = collisionGeometry->MeshInstanceHandles[shapeIndex - state->firstMeshInstanceShape];
+			faces = collisionGeometry->InstancedMeshFaces[handle];
+			numVertices = collisionGeometry->InstancedMeshVertices[handle]->Length / 3;
+			mirrored = false;
+		}
+		else
+			throw gcnew Exception("FlexCLI: Flex::UpdateColliderMeshVertices(...) --->\nInvalid input: shape " + shapeIndex + " is no triangle mesh of the current collision geometry!");
+		if (vertices->Length != numVertices * 3 || numVertices == 0)
+			throw gcnew Exception("FlexCLI: Flex::UpdateColliderMeshVertices(...) --->\nInvalid input: the mesh has " + numVertices + " vertices, " + vertices->Length / 3 + " were passed!");
+		if (numVertices > state->maxCollisionMeshVertexCount || faces->Length / 3 > state->maxCollisionMeshIndexCount)
+			throw gcnew Exception("FlexCLI: Flex::UpdateColliderMeshVertices(...) --->\nThe mesh exceeds MaxCollisionMeshVertexCount or MaxCollisionMeshIndexCount!");
+
+		std::map<int, unsigned int>::iterator found = state->deformedColliders.find(shapeIndex);
+		bool detach = found == state->deformedColliders.end();
+		NvFlexTriangleMeshId mesh = detach ? NvFlexCreateTriangleMesh(state->Library) : found->second;
+
+		//scale into the upload buffer, then refit the bounds on what was written
+		pin_ptr<float> vPin = &vertices[0];
+		float* v = (float*)NvFlexMap(state->Buffers.CollisionMeshVertices, 0);
+		if (mirrored)
+			FlexKernels::NegateScale(v, vPin, state->stabilityScaling, numVertices * 3);
+		else
+			FlexKernels::Scale(v, vPin, state->stabilityScaling, numVertices * 3);
+		float lower[3], upper[3];
+		FlexKernels::Bounds3(v, numVertices, lower, upper);
+		NvFlexUnmap(state->Buffers.CollisionMeshVertices);
+
+		//the index buffer still holds these faces if this shape was the last mesh uploaded
+		if (state->collisionIndicesShape != shapeIndex) {
+			pin_ptr<int> fPin = faces->Length > 0 ? &faces[0] : nullptr;
+			int* f = (int*)NvFlexMap(state->Buffers.CollisionMeshIndices, 0);
+			if (faces->Length > 0)
+				memcpy(f, fPin, sizeof(int) * faces->Length);
+			NvFlexUnmap(state->Buffers.CollisionMeshIndices);
+			state->collisionIndicesShape = shapeIndex;
+		}
+
+		NvFlexUpdateTriangleMesh(state->Library, mesh, state->Buffers.CollisionMeshVertices, state->Buffers.CollisionMeshIndices, numVertices, faces->Length / 3, lower, upper);
+
+		//new broadphase bounds, the culled shape set follows at the next particle bounds read
+		float scale[3] = { 1.0f, 1.0f, 1.0f };
+		if (!mirrored)
+			for (int j = 0; j < 3; j++)
+				scale[j] = collisionGeometry->MeshInstanceScales[(shapeIndex - state->firstMeshInstanceShape) * 3 + j];
+		state->SetColliderLocalBounds(shapeIndex, lower[0] * scale[0], lower[1] * scale[1], lower[2] * scale[2], upper[0] * scale[0], upper[1] * scale[1], upper[2] * scale[2]);
+		float4* position = (float4*)NvFlexMap(state->Buffers.Position, 0);
+		float4* rotation = (float4*)NvFlexMap(state->Buffers.Rotation, 0);
+		state->UpdateColliderBounds(shapeIndex, position[shapeIndex], rotation[shapeIndex]);
+		NvFlexUnmap(state->Buffers.Position);
+		NvFlexUnmap(state->Buffers.Rotation);
+		state->colliderTreeStale = true;
+
+		//first deformation of this shape: point it to its private mesh. The shared mesh stays referenced until the next SetCollisionGeometry.
+		if (detach) {
+			state->deformedColliders[shapeIndex] = mesh;
+			NvFlexCollisionGeometry* geometry = (NvFlexCollisionGeometry*)NvFlexMap(state->Buffers.CollisionGeometry, 0);
+			geometry[shapeIndex].triMesh.mesh = mesh;
+			NvFlexUnmap(state->Buffers.CollisionGeometry);
+			SubmitCollisionShapes();
+		}
+	}
+
+	///<summary>
+	///Sends the collision shapes to the solver. With the broadphase enabled, only shapes whose bounds overlap the inflated particle bounds of the last read are sent,
+	///gathered into a separate set of buffers so the shape indices of the full set stay valid for UpdateColliderTransforms.
+	///</summary>
+	void Flex::SubmitCollisionShapes() {
+		if (state->broadphaseInterval < 1 || !state->particleBoundsKnown) {
+			NvFlexSetShapes(state->Solver,
+				state->Buffers.CollisionGeometry,
+				state->Buffers.Position,
+				state->Buffers.Rotation,
+				state->Buffers.PrevPosition,
+				state->Buffers.PrevRotation,
+				state->Buffers.Flags, state->numCollisionShapes);
+			return;
+		}
+
+		if (state->colliderTreeStale && state->numCollisionShapes > 0)
+			state->colliderTree.Refit(&state->colliderBounds[0]);
+		state->colliderTreeStale = false;
+		state->culledColliders.clear();
+		if (state->numCollisionShapes > 0)
+			state->colliderTree.Query(&state->colliderBounds[0], state->particleLower, state->particleUpper, state->culledColliders);
+
+		state->Buffers.AllocateBroadphase(*state);
+		float4* geometry = (float4*)NvFlexMap(state->Buffers.CollisionGeometry, 0);
+		float4* positions = (float4*)NvFlexMap(state->Buffers.Position, 0);
+		float4* rotations = (float4*)NvFlexMap(state->Buffers.Rotation, 0);
+		float4* prevPositions = (float4*)NvFlexMap(state->Buffers.PrevPosition, 0);
+		float4* prevRotations = (float4*)NvFlexMap(state->Buffers.PrevRotation, 0);
+		int* flags = (int*)NvFlexMap(state->Buffers.Flags, 0);
+		float4* culledGeometry = (float4*)NvFlexMap(state->Buffers.CulledGeometry, 0);
+		float4* culledPositions = (float4*)NvFlexMap(state->Buffers.CulledPosition, 0);
+		float4* culledRotations = (float4*)NvFlexMap(state->Buffers.CulledRotation, 0);
+		float4* culledPrevPositions = (float4*)NvFlexMap(state->Buffers.CulledPrevPosition, 0);
+		float4* culledPrevRotations = (float4*)NvFlexMap(state->Buffers.CulledPrevRotation, 0);
+		int* culledFlags = (int*)NvFlexMap(state->Buffers.CulledFlags, 0);
+
+		for (int i = 0; i < (int)state->culledColliders.size(); i++) {
+			int c = state->culledColliders[i];
+			culledGeometry[i] = geometry[c];
+			culledPositions[i] = positions[c];
+			culledRotations[i] = rotations[c];
+			culledPrevPositions[i] = prevPositions[c];
+			culledPrevRotations[i] = prevRotations[c];
+			culledFlags[i] = flags[c];
+		}
+
+		NvFlexUnmap(state->Buffers.CollisionGeometry);
+		NvFlexUnmap(state->Buffers.Position);
+		NvFlexUnmap(state->Buffers.Rotation);
+		NvFlexUnmap(state->Buffers.PrevPosition);
+		NvFlexUnmap(state->Buffers.PrevRotation);
+		NvFlexUnmap(state->Buffers.Flags);
+		NvFlexUnmap(state->Buffers.CulledGeometry);
+		NvFlexUnmap(state->Buffers.CulledPosition);
+		NvFlexUnmap(state->Buffers.CulledRotation);
+		NvFlexUnmap(state->Buffers.CulledPrevPosition);
+		NvFlexUnmap(state->Buffers.CulledPrevRotation);
+		NvFlexUnmap(state->Buffers.CulledFlags);
+
+		NvFlexSetShapes(state->Solver,
+			state->Buffers.CulledGeometry,
+			state->Buffers.CulledPosition,
+			state->Buffers.CulledRotation,
+			state->Buffers.CulledPrevPosition,
+			state->Buffers.CulledPrevRotation,
+			state->Buffers.CulledFlags, (int)state->culledColliders.size());
+	}
+
+	///<summary>
+	///Reads the bounds of the active particles from the solver and inflates them into the broadphase query box: by the margin particles may travel until the next read,
+	///plus the distances at which the solver creates shape contacts.
+	///</summary>
+	void Flex::ReadParticleBounds() {
+		state->Buffers.AllocateBroadphase(*state);
+		NvFlexGetBounds(state->Solver, state->Buffers.ParticleLower, state->Buffers.ParticleUpper);
+		float* lower = (float*)NvFlexMap(state->Buffers.ParticleLower, eNvFlexMapWait);
+		float* upper = (float*)NvFlexMap(state->Buffers.ParticleUpper, eNvFlexMapWait);
+		float inflation = state->broadphaseMargin + state->Params.radius + state->Params.collisionDistance + state->Params.shapeCollisionMargin;
+		for (int j = 0; j < 3; j++) {
+			//no active particles: an empty box, no shape is submitted
+			state->particleLower[j] = state->nActive > 0 ? lower[j] - inflation : FLT_MAX;
+			state->particleUpper[j] = state->nActive > 0 ? upper[j] + inflation : -FLT_MAX;
+		}
+		NvFlexUnmap(state->Buffers.ParticleLower);
+		NvFlexUnmap(state->Buffers.ParticleUpper);
+		state->particleBoundsKnown = true;
+	}
+
+	///<summary>Throws if the mesh, simplified if maxSimplificationError > 0, exceeds MaxCollisionMeshVertexCount or MaxCollisionMeshIndexCount.
+	///Simplification never adds vertices or faces, so only meshes over the limits are simplified here, the result is cached for AcquireTriangleMesh.</summary>
+	void Flex::CheckTriangleMeshLimits(array<float>^ v, array<int>^ f, float maxSimplificationError, String^ what) {
+		int numVertices = v->Length / 3;
+		int numFaces = f->Length / 3;
+		if ((numVertices > state->maxCollisionMeshVertexCount || numFaces > state->maxCollisionMeshIndexCount) && maxSimplificationError > 0.0f && numFaces > 0) {
+			pin_ptr<float> vPin = &v[0];
+			pin_ptr<int> fPin = &f[0];
+			std::shared_ptr<const FlexSimplify::Result> simplified = FlexSimplify::Simplify(vPin, numVertices, fPin, numFaces, maxSimplificationError);
+			numVertices = (int)simplified->Vertices.size() / 3;
+			numFaces = (int)simplified->Faces.size() / 3;
+		}
+		if (numVertices > state->maxCollisionMeshVertexCount || numFaces > state->maxCollisionMeshIndexCount)
+			throw gcnew Exception("FlexCLI: Flex::SetCollisionGeometry(...) --->\n" + what + " has " + numVertices + " vertices and " + numFaces + " faces, MaxCollisionMeshVertexCount is " + state->maxCollisionMeshVertexCount + " and MaxCollisionMeshIndexCount " + state->maxCollisionMeshIndexCount + "!");
+	}
+
+	///<summary>Simplifies the mesh first if maxSimplificationError > 0, then acquires it like the overload below.</summary>
+	unsigned int Flex::AcquireTriangleMesh(array<float>^ v, array<int>^ f, array<float>^ u, array<float>^ l, float maxSimplificationError, bool mirrored) {
+		pin_ptr<float> vPin = v->Length > 0 ? &v[0] : nullptr;
+		pin_ptr<int> fPin = f->Length > 0 ? &f[0] : nullptr;
+		pin_ptr<float> uPin = &u[0];
+		pin_ptr<float> lPin = &l[0];
+		if (maxSimplificationError <= 0.0f || f->Length == 0)
+			return AcquireTriangleMesh(vPin, v->Length / 3, fPin, f->Length / 3, uPin, lPin, mirrored);
+
+		std::shared_ptr<const FlexSimplify::Result> simplified = FlexSimplify::Simplify(vPin, v->Length / 3, fPin, f->Length / 3, maxSimplificationError);
+		return AcquireTriangleMesh(simplified->Vertices.empty() ? nullptr : &simplified->Vertices[0], (int)simplified->Vertices.size() / 3,
+			simplified->Faces.empty() ? nullptr : &simplified->Faces[0], (int)simplified->Faces.size() / 3, simplified->Upper, simplified->Lower, mirrored);
+	}
+
+	///<summary>Returns the triangle mesh for these vertices and faces, cooking it only if no identical mesh is cached. Adds a reference to the mesh.</summary>
+	///<param name="mirrored">Store the vertices point mirrored, for shapes placed with a zero quaternion. Instances use unmirrored meshes and proper rotations.</param>
+	unsigned int Flex::AcquireTriangleMesh(const float* v, int numVertices, const int* f, int numFaces, const float* u, const float* l, bool mirrored) {
+		//SetCollisionGeometry checks this up front, the upload buffers hold no more
+		if (numVertices > state->maxCollisionMeshVertexCount || numFaces > state->maxCollisionMeshIndexCount)
+			throw gcnew Exception("FlexCLI: Flex::AcquireTriangleMesh(...) --->\nThe mesh exceeds MaxCollisionMeshVertexCount or MaxCollisionMeshIndexCount!");
+		unsigned long long key = FlexKernels::HashBytes(mirrored ? 0x7472696D657368ull : 0x696E7374616E6365ull, &state->stabilityScaling, sizeof(float));	//"trimesh", "instance"
+		key = FlexKernels::HashBytes(key, v, sizeof(float) * 3 * (long long)numVertices);
+		key = FlexKernels::HashBytes(key, f, sizeof(int) * 3 * (long long)numFaces);
+		key = FlexKernels::HashBytes(key, u, sizeof(float) * 3);
+		key = FlexKernels::HashBytes(key, l, sizeof(float) * 3);
+		state->collisionMeshesInUse.push_back(key);
+
+		std::map<unsigned long long, CollisionMeshEntry>::iterator found = state->collisionMeshes.find(key);
+		if (found != state->collisionMeshes.end()) {
+			state->collisionMeshHits++;
+			found->second.References++;
+			return found->second.Mesh;
+		}
+
+		NvFlexTriangleMeshId mesh = NvFlexCreateTriangleMesh(state->Library);
+		state->collisionIndicesShape = -1;
+
+		//assign vertex and face lists accordingly
+		float* vertices = (float*)NvFlexMap(state->Buffers.CollisionMeshVertices, 0);
+		int* faces = (int*)NvFlexMap(state->Buffers.CollisionMeshIndices, 0);
+		if (mirrored)
+			FlexKernels::NegateScale(vertices, v, state->stabilityScaling, numVertices * 3);
+		else
+			FlexKernels::Scale(vertices, v, state->stabilityScaling, numVertices * 3);
+		if (numFaces > 0)
+			memcpy(faces, f, sizeof(int) * 3 * numFaces);
+		NvFlexUnmap(state->Buffers.CollisionMeshVertices);
+		NvFlexUnmap(state->Buffers.CollisionMeshIndices);
+
+		//upper and lower bounds of the mesh, mirroring swaps them
+		float upper[3], lower[3];
+		for (int j = 0; j < 3; j++) {
+			upper[j] = mirrored ? -l[j] * state->stabilityScaling : u[j] * state->stabilityScaling;
+			lower[j] = mirrored ? -u[j] * state->stabilityScaling : l[j] * state->stabilityScaling;
+		}
+
+		//set mesh
+		NvFlexUpdateTriangleMesh(state->Library, mesh, state->Buffers.CollisionMeshVertices, state->Buffers.CollisionMeshIndices, numVertices, numFaces, lower, upper);
+
+		CollisionMeshEntry entry = { mesh, eNvFlexShapeTriangleMesh, 1, sizeof(float) * 3 * (long long)numVertices + sizeof(int) * 3 * (long long)numFaces };
+		state->collisionMeshes[key] = entry;
+		state->collisionMeshBytes += entry.Bytes;
+		state->collisionMeshMisses++;
+		return mesh;
+	}
+
+	///<summary>Returns the convex mesh for these planes, building it only if no identical mesh is cached. Adds a reference to the mesh.</summary>
+	unsigned int Flex::AcquireConvexMesh(array<float>^ p, array<float>^ u, array<float>^ l) {
+		pin_ptr<float> pPin = p->Length > 0 ? &p[0] : nullptr;
+		pin_ptr<float> uPin = &u[0];
+		pin_ptr<float> lPin = &l[0];
+		unsigned long long key = FlexKernels::HashBytes(0x636F6E766578ull, &state->stabilityScaling, sizeof(float));	//"convex"
+		key = FlexKernels::HashBytes(key, pPin, sizeof(float) * (long long)p->Length);
+		key = FlexKernels::HashBytes(key, uPin, sizeof(float) * 3);
+		key = FlexKernels::HashBytes(key, lPin, sizeof(float) * 3);
+		state->collisionMeshesInUse.push_back(key);
+
+		std::map<unsigned long long, CollisionMeshEntry>::iterator found = state->collisionMeshes.find(key);
+		if (found != state->collisionMeshes.end()) {
+			state->collisionMeshHits++;
+			found->second.References++;
+			return found->second.Mesh;
+		}
+
+		NvFlexConvexMeshId mesh = NvFlexCreateConvexMesh(state->Library);
+
+		//assign planes accordingly
+		float4* planes = (float4*)NvFlexMap(state->Buffers.CollisionConvexMeshPlanes, 0);
+		for (int j = 0; j < p->Length / 4; j++)
+			planes[j] = float4(
+				p[j * 4],
+				p[j * 4 + 1],
+				p[j * 4 + 2],
+				-p[j * 4 + 3] * state->stabilityScaling);
+		NvFlexUnmap(state->Buffers.CollisionConvexMeshPlanes);
+
+		//upper and lower bounds of the mesh
+		float upper[3], lower[3];
+		for (int j = 0; j < 3; j++) {
+			upper[j] = -u[j] * state->stabilityScaling;
+			lower[j] = -l[j] * state->stabilityScaling;
+		}
+
+		//set convex mesh
+		NvFlexUpdateConvexMesh(state->Library, mesh, state->Buffers.CollisionConvexMeshPlanes, p->Length / 4, lower, upper);
+
+		CollisionMeshEntry entry = { mesh, eNvFlexShapeConvexMesh, 1, sizeof(float) * (long long)p->Length };
+		state->collisionMeshes[key] = entry;
+		state->collisionMeshBytes += entry.Bytes;
+		state->collisionMeshMisses++;
+		return mesh;
+	}
+
+	///<summary>Returns the distance field for this mesh and resolution, voxelizing it only if no identical field is cached. Adds a reference to the field.</summary>
+	///<param name="lower">Receives the grid corner, the shape's position</param>
+	///<param name="size">Receives the grid's edge length, the shape's scale</param>
+	unsigned int Flex::AcquireDistanceField(array<float>^ v, array<int>^ f, int resolution, float* lower, float* size) {
+		pin_ptr<float> vPin = &v[0];
+		pin_ptr<int> fPin = &f[0];
+		unsigned long long key = FlexKernels::HashBytes(0x736466ull, &state->stabilityScaling, sizeof(float));	//"sdf"
+		key = FlexKernels::HashBytes(key, &resolution, sizeof(int));
+		key = FlexKernels::HashBytes(key, vPin, sizeof(float) * (long long)v->Length);
+		key = FlexKernels::HashBytes(key, fPin, sizeof(int) * (long long)f->Length);
+		state->collisionMeshesInUse.push_back(key);
+
+		std::map<unsigned long long, CollisionMeshEntry>::iterator found = state->collisionMeshes.find(key);
+		if (found == state->collisionMeshes.end()) {
+			FlexDistanceField::Grid grid = FlexDistanceField::Fit(vPin, v->Length / 3, resolution);
+			int numSamples = grid.Dimension * grid.Dimension * grid.Dimension;
+
+			//voxelize straight into the upload buffer
+			NvFlexBuffer* samples = NvFlexAllocBuffer(state->Library, numSamples, sizeof(float), eNvFlexBufferHost);
+			float* s = (float*)NvFlexMap(samples, eNvFlexMapWait);
+			FlexDistanceField::Build(vPin, v->Length / 3, fPin, f->Length / 3, grid, s);
+			NvFlexUnmap(samples);
+
+			CollisionMeshEntry entry = { NvFlexCreateDistanceField(state->Library), eNvFlexShapeSDF, 0, sizeof(float) * (long long)numSamples };
+			NvFlexUpdateDistanceField(state->Library, entry.Mesh, grid.Dimension, grid.Dimension, grid.Dimension, samples);
+			NvFlexFreeBuffer(samples);
+
+			for (int k = 0; k < 3; k++)
+				entry.Lower[k] = grid.Lower[k] * state->stabilityScaling;
+			entry.Size = grid.Size * state->stabilityScaling;
+			found = state->collisionMeshes.insert(std::make_pair(key, entry)).first;
+			state->collisionMeshBytes += entry.Bytes;
+			state->collisionMeshMisses++;
+		}
+		else
+			state->collisionMeshHits++;
+
+		found->second.References++;
+		for (int k = 0; k < 3; k++)
+			lower[k] = found->second.Lower[k];
+		*size = found->second.Size;
+		return found->second.Mesh;
+	}
+
+	///<summary>Drops one reference per key and destroys meshes no shape references anymore</summary>
+	void Flex::ReleaseCollisionMeshes(std::vector<unsigned long long>& keys) {
+		for (size_t i = 0; i < keys.size(); i++) {
+			std::map<unsigned long long, CollisionMeshEntry>::iterator found = state->collisionMeshes.find(keys[i]);
+			if (found == state->collisionMeshes.end() || --found->second.References > 0)
+				continue;
+			if (found->second.ShapeType == eNvFlexShapeConvexMesh)
+				NvFlexDestroyConvexMesh(state->Library, found->second.Mesh);
+			else if (found->second.ShapeType == eNvFlexShapeSDF)
+				NvFlexDestroyDistanceField(state->Library, found->second.Mesh);
+			else
+				NvFlexDestroyTriangleMesh(state->Library, found->second.Mesh);
+			state->collisionMeshBytes -= found->second.Bytes;
+			state->collisionMeshes.erase(found);
+		}
+		keys.clear();
+	}
+
+	FlexCacheStatistics Flex::GetCollisionMeshCacheStatistics() {
+		FlexCacheStatistics statistics;
+		statistics.Hits = state->collisionMeshHits;
+		statistics.Misses = state->collisionMeshMisses;
+		statistics.Resident = (int)state->collisionMeshes.size();
+		statistics.ResidentBytes = state->collisionMeshBytes;
+		statistics.CapacityBytes = 0;	//meshes are released once no collision geometry uses them
+		return statistics;
 	}
 
 	///<summary>Register simulation parameters using the FlexCLI.FlexParams class</summary>
 	void Flex::SetParams(FlexParams^ flexParams) {
 		if (flexParams->IsValid()) {
+			this->flexParams = flexParams;
 #pragma region set all
-			Params.adhesion = flexParams->Adhesion;
-			Params.anisotropyMax = flexParams->AnisotropyMax;
-			Params.anisotropyMin = flexParams->AnisotropyMin;
-			Params.anisotropyScale = flexParams->AnisotropyScale;
-			Params.buoyancy = flexParams->Buoyancy;
-			Params.cohesion = flexParams->Cohesion;
-			Params.collisionDistance = flexParams->CollisionDistance * stabilityScaling;
-			Params.damping = flexParams->Damping;
-			Params.diffuseBallistic = flexParams->DiffuseBallistic;
-			Params.diffuseBuoyancy = flexParams->DiffuseBuoyancy;
-			Params.diffuseDrag = flexParams->DiffuseDrag;
-			Params.diffuseLifetime = flexParams->DiffuseLifetime;
-			Params.diffuseSortAxis[0] = flexParams->DiffuseSortAxisX;
-			Params.diffuseSortAxis[1] = flexParams->DiffuseSortAxisZ;
-			Params.diffuseSortAxis[2] = flexParams->DiffuseSortAxisY;
-			Params.diffuseThreshold = flexParams->DiffuseThreshold;
-			Params.dissipation = flexParams->Dissipation;
-			Params.drag = flexParams->Drag;
-			Params.dynamicFriction = flexParams->DynamicFriction;
-			Params.fluid = flexParams->Fluid;
-			Params.fluidRestDistance = flexParams->FluidRestDistance;
-			Params.freeSurfaceDrag = flexParams->FreeSurfaceDrag;
-			Params.gravity[0] = flexParams->GravityX;
-			Params.gravity[1] = flexParams->GravityY;
-			Params.gravity[2] = flexParams->GravityZ;
-			Params.lift = flexParams->Lift;
-			Params.maxAcceleration = flexParams->MaxAcceleration;
-			Params.maxSpeed = flexParams->MaxSpeed * stabilityScaling;
-			Params.particleCollisionMargin = flexParams->ParticleCollisionMargin * stabilityScaling;
-			Params.particleFriction = flexParams->ParticleFriction;
-			Params.plasticCreep = flexParams->PlasticCreep;
-			Params.plasticThreshold = flexParams->PlasticThreshold;
-			Params.radius = flexParams->Radius * stabilityScaling;
-			Params.relaxationFactor = flexParams->RelaxationFactor;
-			Params.relaxationMode = NvFlexRelaxationMode(flexParams->RelaxationMode);
-			Params.restitution = flexParams->Restitution;
-			Params.shapeCollisionMargin = flexParams->ShapeCollisionMargin * stabilityScaling;
-			Params.shockPropagation = flexParams->ShockPropagation;
-			Params.sleepThreshold = flexParams->SleepThreshold;
-			Params.smoothing = flexParams->Smoothing;
-			Params.solidPressure = flexParams->SolidPressure;
-			Params.solidRestDistance = flexParams->SolidRestDistance * stabilityScaling;
-			Params.staticFriction = flexParams->StaticFriction;
-			Params.surfaceTension = flexParams->SurfaceTension;
-			Params.viscosity = flexParams->Viscosity;
-			Params.vorticityConfinement = flexParams->VorticityConfinement;
-			Params.wind[0] = flexParams->WindX;
-			Params.wind[1] = flexParams->WindY;
-			Params.wind[2] = flexParams->WindZ;
+			state->Params.adhesion = flexParams->Adhesion;
+			state->Params.anisotropyMax = flexParams->AnisotropyMax;
+			state->Params.anisotropyMin = flexParams->AnisotropyMin;
+			state->Params.anisotropyScale = flexParams->AnisotropyScale;
+			state->Params.buoyancy = flexParams->Buoyancy;
+			state->Params.cohesion = flexParams->Cohesion;
+			state->Params.collisionDistance = flexParams->CollisionDistance * state->stabilityScaling;
+			state->Params.damping = flexParams->Damping;
+			state->Params.diffuseBallistic = flexParams->DiffuseBallistic;
+			state->Params.diffuseBuoyancy = flexParams->DiffuseBuoyancy;
+			state->Params.diffuseDrag = flexParams->DiffuseDrag;
+			state->Params.diffuseLifetime = flexParams->DiffuseLifetime;
+			state->Params.diffuseSortAxis[0] = flexParams->DiffuseSortAxisX;
+			state->Params.diffuseSortAxis[1] = flexParams->DiffuseSortAxisZ;
+			state->Params.diffuseSortAxis[2] = flexParams->DiffuseSortAxisY;
+			state->Params.diffuseThreshold = flexParams->DiffuseThreshold;
+			state->Params.dissipation = flexParams->Dissipation;
+			state->Params.drag = flexParams->Drag;
+			state->Params.dynamicFriction = flexParams->DynamicFriction;
+			state->Params.fluid = flexParams->Fluid;
+			state->Params.fluidRestDistance = flexParams->FluidRestDistance;
+			state->Params.freeSurfaceDrag = flexParams->FreeSurfaceDrag;
+			state->Params.gravity[0] = flexParams->GravityX;
+			state->Params.gravity[1] = flexParams->GravityY;
+			state->Params.gravity[2] = flexParams->GravityZ;
+			state->Params.lift = flexParams->Lift;
+			state->Params.maxAcceleration = flexParams->MaxAcceleration;
+			state->Params.maxSpeed = flexParams->MaxSpeed * state->stabilityScaling;
+			state->Params.particleCollisionMargin = flexParams->ParticleCollisionMargin * state->stabilityScaling;
+			state->Params.particleFriction = flexParams->ParticleFriction;
+			state->Params.plasticCreep = flexParams->PlasticCreep;
+			state->Params.plasticThreshold = flexParams->PlasticThreshold;
+			state->Params.radius = flexParams->Radius * state->stabilityScaling;
+			state->Params.relaxationFactor = flexParams->RelaxationFactor;
+			state->Params.relaxationMode = NvFlexRelaxationMode(flexParams->RelaxationMode);
+			state->Params.restitution = flexParams->Restitution;
+			state->Params.shapeCollisionMargin = flexParams->ShapeCollisionMargin * state->stabilityScaling;
+			state->Params.shockPropagation = flexParams->ShockPropagation;
+			state->Params.sleepThreshold = flexParams->SleepThreshold;
+			state->Params.smoothing = flexParams->Smoothing;
+			state->Params.solidPressure = flexParams->SolidPressure;
+			state->Params.solidRestDistance = flexParams->SolidRestDistance * state->stabilityScaling;
+			state->Params.staticFriction = flexParams->StaticFriction;
+			state->Params.surfaceTension = flexParams->SurfaceTension;
+			state->Params.viscosity = flexParams->Viscosity;
+			state->Params.vorticityConfinement = flexParams->VorticityConfinement;
+			state->Params.wind[0] = flexParams->WindX;
+			state->Params.wind[1] = flexParams->WindY;
+			state->Params.wind[2] = flexParams->WindZ;
 #pragma endregion
-			NvFlexSetParams(Solver, &Params);
+			NvFlexSetParams(state->Solver, &state->Params);
 		}
 		else
 			throw gcnew Exception("FlexCLI: void Flex::SetParams(FlexParams^ flexParams) ---> Invalid flexParams");
@@ -573,73 +1340,168 @@ namespace FlexCLI {
 		FlexScene^ s = flexScene;
 		if (!s->IsValid())
 			return;
+		FinishReadback();
 
-		if (s->Particles->Count > maxParticles)
+		if (s->NumParticles() > state->maxParticles)
 			throw gcnew Exception("void Flex::SetScene() ---> Exceeded maximum particle count. Contact benjamin@felbrich.com for more info.");
-		//set particles
-		SetParticles(s->Particles);
+		//if the solver holds this scene, only upload what AlterScene changed and AppendScene added since
+		bool incremental = s == uploadedScene && s->IncrementalUpload && !s->Changes.Structure && state->n == uploadedParticles &&
+			s->NumParticles() >= uploadedParticles && s->NumRigids() >= uploadedRigids && s->SpringLengths->Count >= uploadedSprings &&
+			s->DynamicTriangleIndices->Count / 3 >= uploadedTriangles && s->InflatableStartIndices->Count >= uploadedInflatables;
+		FlexSceneChanges changes = s->Changes;
+		FlexRange particles = incremental ? changes.Particles.Union(FlexRange(uploadedParticles, s->NumParticles())) : FlexRange(0, s->NumParticles());
+		FlexRange springs = incremental ? changes.Springs.Union(FlexRange(uploadedSprings, s->SpringLengths->Count)) : FlexRange(0, s->SpringLengths->Count);
+		FlexRange inflatables = incremental ? changes.Inflatables.Union(FlexRange(uploadedInflatables, s->InflatableStartIndices->Count)) : FlexRange(0, s->InflatableStartIndices->Count);
+
+		//set particles, straight from the scene's particle pool. Skipped entirely, if only constraint coefficients changed.
+		s->SyncState();
+		if (!particles.IsEmpty) {
+			pin_ptr<FlexParticleData> data = &s->ParticleData[0];
+			int invalid = FlexKernels::FirstInvalidRecord((const FlexKernels::ParticleRecord*)data + particles.First, particles.End - particles.First);
+			if (invalid >= 0) {
+				invalid += particles.First;
+				throw gcnew Exception("FlexCLI: void Flex::SetScene(...) ---> particle nr. " + invalid + " is invalid! Inverse mass = " + s->ParticleData[invalid].InverseMass + ", phase = " + s->ParticleData[invalid].Phase);
+			}
+			if (particles.First > 0 || particles.End < s->NumParticles())
+				UploadParticleRange(data, particles.First, particles.End, s->NumParticles());
+			else
+				UploadParticles(data, s->NumParticles());
+		}
+		s->BuildIndexViews();
 
 		//set constraints
 		//Rigids
-		SetRigids(s->RigidOffsets,
-			s->RigidIndices,
-			s->RigidRestPositions,
-			s->RigidRestNormals,
-			s->RigidStiffnesses,
-			s->RigidRotations,
-			s->RigidTranslations);
+		if (!incremental || s->NumRigids() > uploadedRigids || !changes.RigidStiffnesses.IsEmpty)
+			SetRigids(s->RigidOffsets,
+				s->RigidIndices,
+				s->RigidRestPositions,
+				s->RigidRestNormals,
+				s->RigidStiffnesses,
+				s->RigidRotations,
+				s->RigidTranslations,
+				incremental ? uploadedRigids : 0);
 
 		//Springs
-		SetSprings(s->SpringPairIndices,
-			s->SpringLengths,
-			s->SpringStiffnesses);
+		if (!incremental || !springs.IsEmpty)
+			SetSprings(s->SpringPairIndices,
+				s->SpringLengths,
+				s->SpringStiffnesses,
+				springs.First,
+				springs.End);
 
 		//Dynamic Triangles for cloth inflatable and dynamic collision objects
-		SetDynamicTriangles(
-			s->DynamicTriangleIndices,
-			s->DynamicTriangleNormals
-		);
+		if (!incremental || s->DynamicTriangleIndices->Count / 3 > uploadedTriangles)
+			SetDynamicTriangles(
+				s->DynamicTriangleIndices,
+				s->DynamicTriangleNormals,
+				incremental ? uploadedTriangles : 0
+			);
 
 		//Inflatables
-		SetInflatables(
-			s->InflatableStartIndices,
-			s->InflatableNumTriangles,
-			s->InflatableRestVolumes,
-			s->InflatableOverPressures,
-			s->InflatableConstraintScales);
+		if (!incremental || !inflatables.IsEmpty)
+			SetInflatables(
+				s->InflatableStartIndices,
+				s->InflatableNumTriangles,
+				s->InflatableRestVolumes,
+				s->InflatableOverPressures,
+				s->InflatableConstraintScales,
+				inflatables.First,
+				inflatables.End);
+
+		uploadedScene = s;
+		uploadedParticles = s->NumParticles();
+		uploadedRigids = s->NumRigids();
+		uploadedSprings = s->SpringLengths->Count;
+		uploadedTriangles = s->DynamicTriangleIndices->Count / 3;
+		uploadedInflatables = s->InflatableStartIndices->Count;
+		s->IncrementalUpload = true;
+		s->Changes = FlexSceneChanges();
 
 		//save scene globally
 		Scene = s;
 		Scene->Flex = this;
 	}
 
+	///<summary>Changing any of the Max... limits creates the solver anew and changing the stability scaling factor rescales everything in it.
+	///Both upload params, collision geometry, force fields and the current scene again, starting from the last state read back.</summary>
 	void Flex::SetSolverOptions(FlexSolverOptions^ flexSolverOptions) {
 		if (flexSolverOptions->IsValid()) {
-			dt = flexSolverOptions->dT;
-			subSteps = flexSolverOptions->SubSteps;
-			Params.numIterations = flexSolverOptions->NumIterations;
-			numFixedIter = flexSolverOptions->FixedTotalIterations;
-
-			stabilityScaling = flexSolverOptions->StabilityScalingFactor;
-			invStabScale = 1.0f / stabilityScaling;
-			maxParticles = flexSolverOptions->MaxParticles;
-			maxDiffuseParticles = 0;
-			maxNeighborsPerParticle = flexSolverOptions->MaxNeighborsPerParticle;
-			maxCollisionShapeNumber = flexSolverOptions->MaxCollisionShapeNumber;
-			maxCollisionMeshVertexCount = flexSolverOptions->MaxCollisionMeshVertexCount;
-			maxCollisionMeshIndexCount = flexSolverOptions->MaxCollisionMeshIndexCount;
-			maxCollisionConvexShapePlanes = flexSolverOptions->MaxCollisionConvexShapePlanes;
-			maxRigidBodies = flexSolverOptions->MaxRigidBodies;
-			maxSprings = flexSolverOptions->MaxSprings;
-			maxDynamicTriangles = flexSolverOptions->MaxDynamicTriangles;
+			bool limitsChanged = state->maxParticles != flexSolverOptions->MaxParticles ||
+				state->maxNeighborsPerParticle != flexSolverOptions->MaxNeighborsPerParticle ||
+				state->maxCollisionShapeNumber != flexSolverOptions->MaxCollisionShapeNumber ||
+				state->maxCollisionMeshVertexCount != flexSolverOptions->MaxCollisionMeshVertexCount ||
+				state->maxCollisionMeshIndexCount != flexSolverOptions->MaxCollisionMeshIndexCount ||
+				state->maxCollisionConvexShapePlanes != flexSolverOptions->MaxCollisionConvexShapePlanes ||
+				state->maxRigidBodies != flexSolverOptions->MaxRigidBodies ||
+				state->maxSprings != flexSolverOptions->MaxSprings ||
+				state->maxDynamicTriangles != flexSolverOptions->MaxDynamicTriangles;
+			bool rebuild = state->Solver && (limitsChanged || state->stabilityScaling != flexSolverOptions->StabilityScalingFactor);
+			if (rebuild && Scene && flexSolverOptions->MaxParticles < Scene->NumParticles())
+				throw gcnew Exception("FlexCLI: void Flex::SetSolverOptions(...) ---> MaxParticles is below the particle count of the current scene");
+
+			//the solver's state goes back in with the new scaling or into the new solver, pending scene changes are kept
+			if (rebuild && Scene) {
+				FinishReadback();
+				bool solverHoldsScene = Scene == uploadedScene && !Scene->Changes.Structure && Scene->Changes.Particles.IsEmpty && state->n == uploadedParticles;
+				if (solverHoldsScene && state->n > 0) {
+					ReadSceneState(true);
+					if (Scene->NumRigids() > 0)
+						GetRigidTransformations(Scene->RigidTranslations, Scene->RigidRotations);
+				}
+				else
+					Scene->SyncState();
+			}
+
+			state->dt = flexSolverOptions->dT;
+			state->subSteps = flexSolverOptions->SubSteps;
+			state->Params.numIterations = flexSolverOptions->NumIterations;
+			state->numFixedIter = flexSolverOptions->FixedTotalIterations;
+			state->readbackChannels = (int)flexSolverOptions->Readback;
+			if (state->pipelinedReadback && !flexSolverOptions->PipelinedReadback)
+				FinishReadback();
+			state->pipelinedReadback = flexSolverOptions->PipelinedReadback;
+			state->syncInterval = flexSolverOptions->SyncInterval;
+
+			state->stabilityScaling = flexSolverOptions->StabilityScalingFactor;
+			state->invStabScale = 1.0f / state->stabilityScaling;
+
+			//culling restarts with the full shape set, the next solver step reads the particle bounds
+			bool broadphaseChanged = state->broadphaseInterval != flexSolverOptions->BroadphaseInterval;
+			state->broadphaseInterval = flexSolverOptions->BroadphaseInterval;
+			state->broadphaseMargin = flexSolverOptions->BroadphaseMargin * state->stabilityScaling;
+			if (broadphaseChanged) {
+				state->particleBoundsKnown = false;
+				state->broadphaseSteps = 0;
+				if (state->Solver && state->numCollisionShapes > 0)
+					SubmitCollisionShapes();
+			}
+			state->maxParticles = flexSolverOptions->MaxParticles;
+			state->maxDiffuseParticles = 0;
+			state->maxNeighborsPerParticle = flexSolverOptions->MaxNeighborsPerParticle;
+			state->maxCollisionShapeNumber = flexSolverOptions->MaxCollisionShapeNumber;
+			state->maxCollisionMeshVertexCount = flexSolverOptions->MaxCollisionMeshVertexCount;
+			state->maxCollisionMeshIndexCount = flexSolverOptions->MaxCollisionMeshIndexCount;
+			state->maxCollisionConvexShapePlanes = flexSolverOptions->MaxCollisionConvexShapePlanes;
+			state->maxRigidBodies = flexSolverOptions->MaxRigidBodies;
+			state->maxSprings = flexSolverOptions->MaxSprings;
+			state->maxDynamicTriangles = flexSolverOptions->MaxDynamicTriangles;
+
+			if (rebuild) {
+				if (limitsChanged) {
+					DestroySolver();
+					CreateSolver();
+				}
+				Reupload();
+			}
 		}
 		else
-			throw gcnew Exception("Invalid solver options: Both dt and subSteps have to be > 0");
+			throw gcnew Exception("Invalid solver options: dt, subSteps, numIterations and syncInterval have to be > 0, broadphaseInterval and broadphaseMargin >= 0");
 
 	}
 
 	void Flex::SetForceFields(List<FlexForceField^>^ flexForceFields) {
-
+		//kept, so they can be set again when the solver is rebuilt
+		FlexForceFields = flexForceFields;
 		if (flexForceFields->Count == 0)
 			return;
 		std::vector<NvFlexExtForceField> forceFields(flexForceFields->Count);
@@ -647,10 +1509,10 @@ namespace FlexCLI {
 
 		for (int i = 0; i < flexForceFields->Count; i++) {
 			NvFlexExtForceField ff;
-			ff.mPosition[0] = flexForceFields[i]->Position[0] * stabilityScaling;
-			ff.mPosition[1] = flexForceFields[i]->Position[1] * stabilityScaling;
-			ff.mPosition[2] = flexForceFields[i]->Position[2] * stabilityScaling;
-			ff.mRadius = flexForceFields[i]->Radius * stabilityScaling;
+			ff.mPosition[0] = flexForceFields[i]->Position[0] * state->stabilityScaling;
+			ff.mPosition[1] = flexForceFields[i]->Position[1] * state->stabilityScaling;
+			ff.mPosition[2] = flexForceFields[i]->Position[2] * state->stabilityScaling;
+			ff.mRadius = flexForceFields[i]->Radius * state->stabilityScaling;
 			ff.mStrength = flexForceFields[i]->Strength;
 			if (flexForceFields[i]->Mode == 0)
 				ff.mMode = NvFlexExtForceMode::eNvFlexExtModeForce;
@@ -665,234 +1527,379 @@ namespace FlexCLI {
 			forceFields[i] = ff;
 		}
 
-		NvFlexExtSetForceFields(ForceFieldCallback, &forceFields[0], flexForceFields->Count);
+		NvFlexExtSetForceFields(state->ForceFieldCallback, &forceFields[0], flexForceFields->Count);
 	}
 
 	void Flex::SetParticles(List<FlexParticle^>^ flexParticles) {
-		//create buffers
-		n = flexParticles->Count;
-		if (!n) return;
-		int nActive = 0;
-
-		float4* particles = (float4*)NvFlexMap(Buffers.Particles, eNvFlexMapWait);
-		float3* velocities = (float3*)NvFlexMap(Buffers.Velocities, eNvFlexMapWait);
-		int* phases = (int*)NvFlexMap(Buffers.Phases, eNvFlexMapWait);
-		int* actives = (int*)NvFlexMap(Buffers.Active, eNvFlexMapWait);
-
-		for (int i = 0; i < n; i++) {
-			if (flexParticles[i]->IsValid()) {
-				particles[i] = float4(
-					flexParticles[i]->PositionX * stabilityScaling,
-					flexParticles[i]->PositionY * stabilityScaling,
-					flexParticles[i]->PositionZ * stabilityScaling,
-					flexParticles[i]->InverseMass);
-
-				velocities[i] = float3(
-					flexParticles[i]->VelocityX * stabilityScaling,
-					flexParticles[i]->VelocityY * stabilityScaling,
-					flexParticles[i]->VelocityZ * stabilityScaling);
-
-				phases[i] = flexParticles[i]->Phase;
-				if (flexParticles[i]->IsActive)
-				{
-					actives[i] = i;
-					nActive++;
-				}
+		int count = flexParticles->Count;
+		if (!count)
+			return;
+
+		//flatten the particle objects first, so nothing throws while buffers are mapped
+		std::vector<float> positions(count * 3);
+		std::vector<float> velocities(count * 3);
+		std::vector<float> inverseMasses(count);
+		std::vector<int> phases(count);
+		bool* active = new bool[count];
+
+		for (int i = 0; i < count; i++) {
+			FlexParticle^ p = flexParticles[i];
+			if (!p->IsValid()) {
+				delete[] active;
+				throw gcnew Exception("FlexCLI: void Flex::SetParticles(List<FlexParticle^>^ flexParticles) ---> particle nr. " + i + " is invalid!\n" + p->ToString());
 			}
-			else
-				throw gcnew Exception("FlexCLI: void Flex::SetParticles(array<FlexParticle^>^ flexParticles ---> particle nr. " + i + " is invalid!\n" + flexParticles[i]->ToString());
+			positions[i * 3] = p->PositionX;
+			positions[i * 3 + 1] = p->PositionY;
+			positions[i * 3 + 2] = p->PositionZ;
+			velocities[i * 3] = p->VelocityX;
+			velocities[i * 3 + 1] = p->VelocityY;
+			velocities[i * 3 + 2] = p->VelocityZ;
+			inverseMasses[i] = p->InverseMass;
+			phases[i] = p->Phase;
+			active[i] = p->IsActive;
+		}
+
+		UploadParticles(&positions[0], &velocities[0], &inverseMasses[0], &phases[0], active, count);
+		delete[] active;
+	}
+
+	///<summary>Bulk upload of all particles from flat arrays. Everything is validated before any buffer is touched.</summary>
+	///<param name = 'positions'>Flat array of particle positions [x, y, z]. Must be of length 3 * nr. of particles</param>
+	///<param name = 'velocities'>Flat array of particle velocities [x, y, z]. Must be of same length as 'positions'</param>
+	///<param name = 'inverseMasses'>Inverse mass per particle, each >= 0.0</param>
+	///<param name = 'phases'>Phase per particle, as created by NvFlexMakePhase</param>
+	///<param name = 'active'>Activity per particle. Supply nullptr to activate all particles.</param>
+	void Flex::SetParticles(array<float>^ positions, array<float>^ velocities, array<float>^ inverseMasses, array<int>^ phases, array<bool>^ active) {
+		int count = inverseMasses->Length;
+		if (positions->Length != count * 3 || velocities->Length != count * 3 || phases->Length != count || (active && active->Length != count))
+			throw gcnew Exception("FlexCLI: void Flex::SetParticles(...) ---> Invalid input! Array lengths don't match.");
+		if (count > state->maxParticles)
+			throw gcnew Exception("FlexCLI: void Flex::SetParticles(...) ---> Exceeded maximum particle count.");
+		if (!count)
+			return;
+
+		pin_ptr<float> pos = &positions[0];
+		pin_ptr<float> vel = &velocities[0];
+		pin_ptr<float> im = &inverseMasses[0];
+		pin_ptr<int> ph = &phases[0];
+
+		int invalid = FlexKernels::FirstInvalidParticle(im, ph, count);
+		if (invalid >= 0)
+			throw gcnew Exception("FlexCLI: void Flex::SetParticles(...) ---> particle nr. " + invalid + " is invalid! Inverse mass = " + inverseMasses[invalid] + ", phase = " + phases[invalid]);
+
+		if (active) {
+			pin_ptr<bool> act = &active[0];
+			UploadParticles(pos, vel, im, ph, act, count);
 		}
+		else
+			UploadParticles(pos, vel, im, ph, NULL, count);
+	}
+
+	///Copies already validated particle data into the particle buffers and hands them to the solver
+	void Flex::UploadParticles(const float* positions, const float* velocities, const float* inverseMasses, const int* phases, const bool* active, int count) {
+		state->n = count;
 
-		NvFlexUnmap(Buffers.Particles);
-		NvFlexUnmap(Buffers.Velocities);
-		NvFlexUnmap(Buffers.Phases);
-		NvFlexUnmap(Buffers.Active);
+		float* particles = (float*)NvFlexMap(state->Buffers.Particles, eNvFlexMapWait);
+		float* vel = (float*)NvFlexMap(state->Buffers.Velocities, eNvFlexMapWait);
+		int* ph = (int*)NvFlexMap(state->Buffers.Phases, eNvFlexMapWait);
+		int* actives = (int*)NvFlexMap(state->Buffers.Active, eNvFlexMapWait);
 
-		NvFlexSetParticles(Solver, Buffers.Particles, n);
-		NvFlexSetVelocities(Solver, Buffers.Velocities, n);
-		NvFlexSetPhases(Solver, Buffers.Phases, n);
-		NvFlexSetActive(Solver, Buffers.Active, nActive);
+		FlexKernels::ScalePack3To4(particles, positions, inverseMasses, 0.0f, state->stabilityScaling, state->n);
+		FlexKernels::Scale(vel, velocities, state->stabilityScaling, state->n * 3);
+		memcpy(ph, phases, sizeof(int) * state->n);
+		state->nActive = FlexKernels::CompactActive(actives, active, state->n);
+
+		SubmitParticles();
 	}
 
-	List<FlexParticle^>^ Flex::GetParticles() {
+	///Copies already validated particle records into the particle buffers and hands them to the solver. All particles are active.
+	void Flex::UploadParticles(const FlexParticleData* particles, int count) {
+		state->n = count;
+
+		float* p = (float*)NvFlexMap(state->Buffers.Particles, eNvFlexMapWait);
+		float* vel = (float*)NvFlexMap(state->Buffers.Velocities, eNvFlexMapWait);
+		int* ph = (int*)NvFlexMap(state->Buffers.Phases, eNvFlexMapWait);
+		int* actives = (int*)NvFlexMap(state->Buffers.Active, eNvFlexMapWait);
+
+		//FlexParticleData and FlexKernels::ParticleRecord share the same 32 byte layout
+		FlexKernels::PackRecords(p, vel, ph, (const FlexKernels::ParticleRecord*)particles, state->stabilityScaling, state->n);
+		state->nActive = FlexKernels::CompactActive(actives, NULL, state->n);
+
+		SubmitParticles();
+	}
+
+	///Uploads the particles in [first, end) and keeps the solver's current state of all others. The solver holds 'count' particles afterwards, all of them active.
+	void Flex::UploadParticleRange(const FlexParticleData* particles, int first, int end, int count) {
+		int existing = Math::Min(state->n, count);
+		if (existing > 0) {
+			NvFlexGetParticles(state->Solver, state->Buffers.Particles, existing);
+			NvFlexGetVelocities(state->Solver, state->Buffers.Velocities, existing);
+			NvFlexGetPhases(state->Solver, state->Buffers.Phases, existing);
+		}
+		state->n = count;
+
+		float* p = (float*)NvFlexMap(state->Buffers.Particles, eNvFlexMapWait);
+		float* vel = (float*)NvFlexMap(state->Buffers.Velocities, eNvFlexMapWait);
+		int* ph = (int*)NvFlexMap(state->Buffers.Phases, eNvFlexMapWait);
+		int* actives = (int*)NvFlexMap(state->Buffers.Active, eNvFlexMapWait);
 
-		List<FlexParticle^>^ parts = gcnew List<FlexParticle^>;
-		NvFlexGetParticles(Solver, Buffers.Particles, n);
-		NvFlexGetVelocities(Solver, Buffers.Velocities, n);
-		NvFlexGetPhases(Solver, Buffers.Phases, n);
+		FlexKernels::PackRecords(p + 4 * first, vel + 3 * first, ph + first, (const FlexKernels::ParticleRecord*)particles + first, state->stabilityScaling, end - first);
+		state->nActive = FlexKernels::CompactActive(actives, NULL, state->n);
 
-		float4* particles = (float4*)NvFlexMap(Buffers.Particles, eNvFlexMapWait);
-		float3* velocities = (float3*)NvFlexMap(Buffers.Velocities, eNvFlexMapWait);
-		int* phases = (int*)NvFlexMap(Buffers.Phases, eNvFlexMapWait);
+		SubmitParticles();
+	}
 
-		for (int i = 0; i < n; i++) {
-			array<float>^ pos = gcnew array<float>{
-				particles[i].x * invStabScale, 
-				particles[i].y * invStabScale,
-				particles[i].z * invStabScale};
+	///Unmaps the particle buffers filled by UploadParticles and hands them to the solver
+	void Flex::SubmitParticles() {
+		NvFlexUnmap(state->Buffers.Particles);
+		NvFlexUnmap(state->Buffers.Velocities);
+		NvFlexUnmap(state->Buffers.Phases);
+		NvFlexUnmap(state->Buffers.Active);
+
+		NvFlexSetParticles(state->Solver, state->Buffers.Particles, state->n);
+		NvFlexSetVelocities(state->Solver, state->Buffers.Velocities, state->n);
+		NvFlexSetPhases(state->Solver, state->Buffers.Phases, state->n);
+		NvFlexSetActive(state->Solver, state->Buffers.Active, state->nActive);
+		state->stateSynced = false;
+		//SetScene records its uploads after this, any other upload breaks incremental scene uploads
+		uploadedScene = nullptr;
+		//anything still in flight describes the particles before this upload
+		state->Readback.Discard();
+		//particles may have been placed anywhere, collide with every shape until the next step reads their bounds
+		if (state->broadphaseInterval > 0 && state->particleBoundsKnown) {
+			state->particleBoundsKnown = false;
+			SubmitCollisionShapes();
+		}
+	}
 
-			array<float>^ vel = gcnew array<float>{
-				velocities[i].x * invStabScale,
-				velocities[i].y * invStabScale,
-				velocities[i].z * invStabScale};
+	///<summary>Reads the current particle state into caller owned flat arrays without allocating any managed memory. Any array can be nullptr, if that data is not needed.</summary>
+	///<param name = 'positions'>Receives positions [x, y, z]. Must be at least of length 3 * nr. of particles</param>
+	///<param name = 'velocities'>Receives velocities [x, y, z]. Must be at least of length 3 * nr. of particles</param>
+	///<param name = 'phases'>Receives the phase of each particle. Must be at least of length nr. of particles</param>
+	///<returns>The number of particles written</returns>
+	int Flex::ReadState(array<float>^ positions, array<float>^ velocities, array<int>^ phases) {
+		return ReadState(positions, velocities, nullptr, phases);
+	}
 
-			int gi = 0;
-			bool sc = false;
-			bool fl = false;
+	///<summary>Reads the current particle state into caller owned flat arrays without allocating any managed memory. Any array can be nullptr, if that data is not needed.</summary>
+	///<param name = 'inverseMasses'>Receives the inverse mass of each particle. Must be at least of length nr. of particles</param>
+	///<returns>The number of particles written</returns>
+	int Flex::ReadState(array<float>^ positions, array<float>^ velocities, array<float>^ inverseMasses, array<int>^ phases) {
+		if ((positions && positions->Length < state->n * 3) || (velocities && velocities->Length < state->n * 3) || (inverseMasses && inverseMasses->Length < state->n) || (phases && phases->Length < state->n))
+			throw gcnew Exception("FlexCLI: int Flex::ReadState(...) ---> At least one array is too short to hold " + state->n + " particles!");
+		if (!state->n)
+			return 0;
+
+		bool readParticles = positions || inverseMasses;
+		if (readParticles)
+			NvFlexGetParticles(state->Solver, state->Buffers.Particles, state->n);
+		if (velocities)
+			NvFlexGetVelocities(state->Solver, state->Buffers.Velocities, state->n);
+		if (phases)
+			NvFlexGetPhases(state->Solver, state->Buffers.Phases, state->n);
+
+		if (readParticles) {
+			float* particles = (float*)NvFlexMap(state->Buffers.Particles, eNvFlexMapWait);
+			if (positions) {
+				pin_ptr<float> pos = &positions[0];
+				if (inverseMasses) {
+					pin_ptr<float> im = &inverseMasses[0];
+					FlexKernels::ScaleUnpack4To3(pos, im, particles, state->invStabScale, state->n);
+				}
+				else
+					FlexKernels::ScaleUnpack4To3(pos, NULL, particles, state->invStabScale, state->n);
+			}
+			else {
+				pin_ptr<float> im = &inverseMasses[0];
+				for (int i = 0; i < state->n; i++)
+					im[i] = particles[i * 4 + 3];
+			}
+			NvFlexUnmap(state->Buffers.Particles);
+		}
 
-			DecomposePhase(phases[i], gi, sc, fl);
-			parts->Add(gcnew FlexParticle(pos, vel, particles[i].w, phases[i], true));
+		if (velocities) {
+			float* vel = (float*)NvFlexMap(state->Buffers.Velocities, eNvFlexMapWait);
+			pin_ptr<float> v = &velocities[0];
+			FlexKernels::Scale(v, vel, state->invStabScale, state->n * 3);
+			NvFlexUnmap(state->Buffers.Velocities);
 		}
 
-		NvFlexUnmap(Buffers.Particles);
-		NvFlexUnmap(Buffers.Velocities);
-		NvFlexUnmap(Buffers.Phases);
+		if (phases) {
+			int* ph = (int*)NvFlexMap(state->Buffers.Phases, eNvFlexMapWait);
+			Marshal::Copy(IntPtr(ph), phases, 0, state->n);
+			NvFlexUnmap(state->Buffers.Phases);
+		}
 
-		return parts;
+		return state->n;
 	}
 
-	void Flex::SetRigids(List<int>^ offsets, List<int>^ indices, List<float>^ restPositions, List<float>^ restNormals, List<float>^ stiffnesses, List<float>^ rotations, List<float>^ translations) {
+	///<summary>Uploads rigid shapes. Shapes below 'firstRigid' are already held by the solver and keep their current transforms, only their stiffnesses are rewritten.</summary>
+	void Flex::SetRigids(List<int>^ offsets, List<int>^ indices, List<float>^ restPositions, List<float>^ restNormals, List<float>^ stiffnesses, List<float>^ rotations, List<float>^ translations, int firstRigid) {
 		if (offsets[0] != 0)
 			throw gcnew Exception("FlexCLI: void Flex::SetRigids(...) Invalid input: ");
 		int numRigids = offsets->Count - 1;
 
-		if (indices->Count < 2)
+		if (indices->Count < 2 || numRigids < 1)
 			return;
+		if (firstRigid > numRigids)
+			firstRigid = 0;
+
+		//bulk copies of the new part of the managed lists, so the kernels can work on contiguous memory
+		int firstIndex = offsets[firstRigid];
+		int numIndices = offsets[numRigids];
+		int newRigids = numRigids - firstRigid;
+		int newIndices = numIndices - firstIndex;
+		array<int>^ offArr = gcnew array<int>(newRigids + 1);
+		array<int>^ indArr = gcnew array<int>(Math::Max(indices->Count - firstIndex, 1));
+		array<float>^ restPosArr = gcnew array<float>(Math::Max(newIndices * 3, 1));
+		array<float>^ restNorArr = gcnew array<float>(Math::Max(newIndices * 4, 1));
+		array<float>^ traArr = gcnew array<float>(Math::Max(newRigids * 3, 1));
+		offsets->CopyTo(firstRigid, offArr, 0, newRigids + 1);
+		indices->CopyTo(firstIndex, indArr, 0, indices->Count - firstIndex);
+		restPositions->CopyTo(firstIndex * 3, restPosArr, 0, newIndices * 3);
+		restNormals->CopyTo(firstIndex * 4, restNorArr, 0, newIndices * 4);
+		translations->CopyTo(firstRigid * 3, traArr, 0, newRigids * 3);
+		pin_ptr<int> offPin = &offArr[0];
+		pin_ptr<int> indPin = &indArr[0];
+		pin_ptr<float> restPosPin = &restPosArr[0];
+		pin_ptr<float> restNorPin = &restNorArr[0];
+		pin_ptr<float> traPin = &traArr[0];
+
+		//the solver's transforms of existing shapes are newer than the scene's
+		if (firstRigid > 0)
+			NvFlexGetRigidTransforms(state->Solver, state->Buffers.RigidRotations, state->Buffers.RigidTranslations);
 
 		//create buffers	
-		int* off = (int*)NvFlexMap(Buffers.RigidOffets, eNvFlexMapWait);
-		int* ind = (int*)NvFlexMap(Buffers.RigidIndices, eNvFlexMapWait);
-		float3* restPos = (float3*)NvFlexMap(Buffers.RigidRestPositions, eNvFlexMapWait);
-		float4* restNor = (float4*)NvFlexMap(Buffers.RigidRestNormals, eNvFlexMapWait);
-		float* sti = (float*)NvFlexMap(Buffers.RigidStiffnesses, eNvFlexMapWait);
-		float4* rot = (float4*)NvFlexMap(Buffers.RigidRotations, eNvFlexMapWait);
-		float3* tra = (float3*)NvFlexMap(Buffers.RigidTranslations, eNvFlexMapWait);
-
-		//assign everything
-		off[0] = 0;
-		for (int i = 0; i < numRigids; i++) {
-			off[i + 1] = offsets[i + 1];
-			for (int j = offsets[i]; j < offsets[i + 1]; j++) {
-				restPos[j] = float3(
-					restPositions[j * 3] * stabilityScaling,
-					restPositions[j * 3 + 1] * stabilityScaling,
-					restPositions[j * 3 + 2] * stabilityScaling);
-				restNor[j] = float4(
-					restNormals[j * 4] * stabilityScaling,
-					restNormals[j * 4 + 1] * stabilityScaling,
-					restNormals[j * 4 + 2] * stabilityScaling,
-					restNormals[j * 4 + 3] * stabilityScaling);
-			}
+		int* off = (int*)NvFlexMap(state->Buffers.RigidOffets, eNvFlexMapWait);
+		int* ind = (int*)NvFlexMap(state->Buffers.RigidIndices, eNvFlexMapWait);
+		float* restPos = (float*)NvFlexMap(state->Buffers.RigidRestPositions, eNvFlexMapWait);
+		float* restNor = (float*)NvFlexMap(state->Buffers.RigidRestNormals, eNvFlexMapWait);
+		float* sti = (float*)NvFlexMap(state->Buffers.RigidStiffnesses, eNvFlexMapWait);
+		float4* rot = (float4*)NvFlexMap(state->Buffers.RigidRotations, eNvFlexMapWait);
+		float* tra = (float*)NvFlexMap(state->Buffers.RigidTranslations, eNvFlexMapWait);
+
+		//assign everything from the first new shape on
+		memcpy(off + firstRigid, offPin, sizeof(int) * (newRigids + 1));
+		memcpy(ind + firstIndex, indPin, sizeof(int) * (indices->Count - firstIndex));
+		FlexKernels::Scale(restPos + firstIndex * 3, restPosPin, state->stabilityScaling, newIndices * 3);
+		FlexKernels::Scale(restNor + firstIndex * 4, restNorPin, state->stabilityScaling, newIndices * 4);
+		FlexKernels::Scale(tra + firstRigid * 3, traPin, state->stabilityScaling, newRigids * 3);
+		//stiffnesses are cheap and the only rigid property AlterScene changes, always write all of them
+		for (int i = 0; i < numRigids; i++)
 			sti[i] = stiffnesses[i];
+		for (int i = firstRigid; i < numRigids; i++) {
 			//for some weird reason rotations always returns zeros unless w is initialized with some tvalue from the beginning. if x, y, or z are initialized as non-zero values, intitial rotation is applied which is wrong.
 			if (rotations[i * 4] == 0.0f && rotations[i * 4 + 1] == 0.0f && rotations[i * 4 + 2] == 0.0f && rotations[i * 4 + 3] == 0.0f)
 				rot[i] = float4(rotations[i * 4], rotations[i * 4 + 1], rotations[i * 4 + 2], rotations[i * 4 + 3] + 1);
 			else
 				rot[i] = float4(rotations[i * 4], rotations[i * 4 + 1], rotations[i * 4 + 2], rotations[i * 4 + 3]);
-			tra[i] = float3(
-				translations[i * 3] * stabilityScaling,
-				translations[i * 3 + 1] * stabilityScaling,
-				translations[i * 3 + 2] * stabilityScaling);
 		}
 
-		for (int i = 0; i < indices->Count; i++)
-			ind[i] = indices[i];
-
 		//unmap buffers
-		NvFlexUnmap(Buffers.RigidOffets);
-		NvFlexUnmap(Buffers.RigidIndices);
-		NvFlexUnmap(Buffers.RigidRestPositions);
-		NvFlexUnmap(Buffers.RigidRestNormals);
-		NvFlexUnmap(Buffers.RigidStiffnesses);
-		NvFlexUnmap(Buffers.RigidRotations);
-		NvFlexUnmap(Buffers.RigidTranslations);
+		NvFlexUnmap(state->Buffers.RigidOffets);
+		NvFlexUnmap(state->Buffers.RigidIndices);
+		NvFlexUnmap(state->Buffers.RigidRestPositions);
+		NvFlexUnmap(state->Buffers.RigidRestNormals);
+		NvFlexUnmap(state->Buffers.RigidStiffnesses);
+		NvFlexUnmap(state->Buffers.RigidRotations);
+		NvFlexUnmap(state->Buffers.RigidTranslations);
 
 		//actual Nv function
-		NvFlexSetRigids(Solver, Buffers.RigidOffets, Buffers.RigidIndices, Buffers.RigidRestPositions, Buffers.RigidRestNormals, Buffers.RigidStiffnesses, Buffers.RigidRotations, Buffers.RigidTranslations, numRigids, indices->Count);
+		NvFlexSetRigids(state->Solver, state->Buffers.RigidOffets, state->Buffers.RigidIndices, state->Buffers.RigidRestPositions, state->Buffers.RigidRestNormals, state->Buffers.RigidStiffnesses, state->Buffers.RigidRotations, state->Buffers.RigidTranslations, numRigids, indices->Count);
 	}
 
 	void Flex::GetRigidTransformations(List<float>^ %translations, List<float>^ %rotations) {
-		translations = gcnew List<float>();
-		rotations = gcnew List<float>();
+		int numRigids = Scene->NumRigids();
+		array<float>^ tra = gcnew array<float>(numRigids * 3);
+		array<float>^ rot = gcnew array<float>(numRigids * 4);
 
-		NvFlexGetRigidTransforms(Solver, Buffers.RigidRotations, Buffers.RigidTranslations);
+		if (numRigids > 0) {
+			NvFlexGetRigidTransforms(state->Solver, state->Buffers.RigidRotations, state->Buffers.RigidTranslations);
 
-		float4* rot = (float4*)NvFlexMap(Buffers.RigidRotations, eNvFlexMapWait);
-		float3* trans = (float3*)NvFlexMap(Buffers.RigidTranslations, eNvFlexMapWait);
+			float* r = (float*)NvFlexMap(state->Buffers.RigidRotations, eNvFlexMapWait);
+			float* t = (float*)NvFlexMap(state->Buffers.RigidTranslations, eNvFlexMapWait);
 
-		for (int i = 0; i < Scene->NumRigids(); i++) {
-			rotations->Add(rot[i].x);
-			rotations->Add(rot[i].y);
-			rotations->Add(rot[i].z);
-			rotations->Add(rot[i].w);
-			translations->Add(trans[i].x * invStabScale);
-			translations->Add(trans[i].y * invStabScale);
-			translations->Add(trans[i].z * invStabScale);
+			Marshal::Copy(IntPtr(r), rot, 0, numRigids * 4);
+			pin_ptr<float> traPin = &tra[0];
+			FlexKernels::Scale(traPin, t, state->invStabScale, numRigids * 3);
+
+			NvFlexUnmap(state->Buffers.RigidRotations);
+			NvFlexUnmap(state->Buffers.RigidTranslations);
 		}
 
-		NvFlexUnmap(Buffers.RigidRotations);
-		NvFlexUnmap(Buffers.RigidTranslations);
+		translations = gcnew List<float>(tra);
+		rotations = gcnew List<float>(rot);
 	}
 
-	void Flex::SetSprings(List<int>^ springPairIndices, List<float>^ springLengths, List<float>^ springCoefficients) {
+	///<summary>Uploads springs. Only springs in [first, end) are written, the solver already holds the others.</summary>
+	void Flex::SetSprings(List<int>^ springPairIndices, List<float>^ springLengths, List<float>^ springCoefficients, int first, int end) {
 		if (springPairIndices->Count != 2 * springLengths->Count || springPairIndices->Count != 2 * springCoefficients->Count)
 			throw gcnew Exception("void Flex::SetSprings(...) ---> Invalid input!");
 
-		int* spi = (int*)NvFlexMap(Buffers.SpringPairIndices, eNvFlexMapWait);
-		float* sl = (float*)NvFlexMap(Buffers.SpringLengths, eNvFlexMapWait);
-		float* sc = (float*)NvFlexMap(Buffers.SpringCoefficients, eNvFlexMapWait);
+		int* spi = (int*)NvFlexMap(state->Buffers.SpringPairIndices, eNvFlexMapWait);
+		float* sl = (float*)NvFlexMap(state->Buffers.SpringLengths, eNvFlexMapWait);
+		float* sc = (float*)NvFlexMap(state->Buffers.SpringCoefficients, eNvFlexMapWait);
 
-		for (int i = 0; i < springLengths->Count; i++) {
+		for (int i = Math::Max(first, 0); i < Math::Min(end, springLengths->Count); i++) {
 			spi[i * 2] = springPairIndices[i * 2];
 			spi[i * 2 + 1] = springPairIndices[i * 2 + 1];
 			sl[i] = springLengths[i];
 			sc[i] = springCoefficients[i];
 		}
 
-		NvFlexUnmap(Buffers.SpringPairIndices);
-		NvFlexUnmap(Buffers.SpringLengths);
-		NvFlexUnmap(Buffers.SpringCoefficients);
+		NvFlexUnmap(state->Buffers.SpringPairIndices);
+		NvFlexUnmap(state->Buffers.SpringLengths);
+		NvFlexUnmap(state->Buffers.SpringCoefficients);
 
-		NvFlexSetSprings(Solver, Buffers.SpringPairIndices, Buffers.SpringLengths, Buffers.SpringCoefficients, springLengths->Count);
+		NvFlexSetSprings(state->Solver, state->Buffers.SpringPairIndices, state->Buffers.SpringLengths, state->Buffers.SpringCoefficients, springLengths->Count);
 	}
 
-	void Flex::SetDynamicTriangles(List<int>^ triangleIndices, List<float>^ triangleNormals) {
+	///<summary>Uploads dynamic triangles. Triangles below 'firstTriangle' are already held by the solver.</summary>
+	void Flex::SetDynamicTriangles(List<int>^ triangleIndices, List<float>^ triangleNormals, int firstTriangle) {
 		if (triangleIndices->Count % 3 != 0 || triangleNormals->Count % 3 != 0)
 			throw gcnew Exception("void Flex::SetDynamicTriangles(...) ---> Invalid input!");
 
-		float3* nor = NULL;
+		float* nor = NULL;
+		bool withNormals = triangleNormals->Count == triangleIndices->Count;
+		//normals of the existing triangles are only in the buffer, if they were uploaded before
+		int first = Math::Min(firstTriangle * 3, triangleIndices->Count);
+		if (withNormals && !triangleNormalsSet)
+			first = 0;
 
-		int* tri = (int*)NvFlexMap(Buffers.DynamicTriangleIndices, eNvFlexMapWait);
-		if (triangleNormals->Count == triangleIndices->Count)
-			nor = (float3*)NvFlexMap(Buffers.DynamicTriangleNormals, eNvFlexMapWait);
+		int* tri = (int*)NvFlexMap(state->Buffers.DynamicTriangleIndices, eNvFlexMapWait);
+		if (withNormals)
+			nor = (float*)NvFlexMap(state->Buffers.DynamicTriangleNormals, eNvFlexMapWait);
 
-		for (int i = 0; i < triangleIndices->Count; i++)
-			tri[i] = triangleIndices[i];
+		if (triangleIndices->Count > first) {
+			array<int>^ triArr = triangleIndices->GetRange(first, triangleIndices->Count - first)->ToArray();
+			Marshal::Copy(triArr, 0, IntPtr(tri + first), triArr->Length);
+		}
 
-		if (nor)
-			for (int i = 0; i < triangleNormals->Count / 3; i++)
-				nor[i] = float3(
-					triangleNormals[3 * i] * stabilityScaling, 
-					triangleNormals[3 * i + 1] * stabilityScaling, 
-					triangleNormals[3 * i + 2] * stabilityScaling);
+		if (nor && triangleNormals->Count > first) {
+			array<float>^ norArr = triangleNormals->GetRange(first, triangleNormals->Count - first)->ToArray();
+			pin_ptr<float> norPin = &norArr[0];
+			FlexKernels::Scale(nor + first, norPin, state->stabilityScaling, norArr->Length);
+		}
+		triangleNormalsSet = withNormals;
 
-		NvFlexUnmap(Buffers.DynamicTriangleIndices);
-		if (nor) NvFlexUnmap(Buffers.DynamicTriangleNormals);
+		NvFlexUnmap(state->Buffers.DynamicTriangleIndices);
+		if (nor) NvFlexUnmap(state->Buffers.DynamicTriangleNormals);
 
-		NvFlexSetDynamicTriangles(Solver, Buffers.DynamicTriangleIndices, Buffers.DynamicTriangleNormals, triangleIndices->Count / 3);
+		NvFlexSetDynamicTriangles(state->Solver, state->Buffers.DynamicTriangleIndices, state->Buffers.DynamicTriangleNormals, triangleIndices->Count / 3);
 	}
 
-	void Flex::SetInflatables(List<int>^ startIndices, List<int>^ numTriangles, List<float>^ restVolumes, List<float>^ overPressures, List<float>^ constraintScales) {
+	///<summary>Uploads inflatables. Only inflatables in [first, end) are written, the solver already holds the others.</summary>
+	void Flex::SetInflatables(List<int>^ startIndices, List<int>^ numTriangles, List<float>^ restVolumes, List<float>^ overPressures, List<float>^ constraintScales, int first, int end) {
 		if (startIndices->Count != numTriangles->Count || startIndices->Count != restVolumes->Count || startIndices->Count != overPressures->Count || startIndices->Count != constraintScales->Count)
 			throw gcnew Exception("void Flex::SetInflatables(...) ---> Invalid input!");
 
-		int* si = (int*)NvFlexMap(Buffers.InflatableStartIndices, eNvFlexMapWait);
-		int* nt = (int*)NvFlexMap(Buffers.InflatableNumTriangles, eNvFlexMapWait);
-		float* rv = (float*)NvFlexMap(Buffers.InflatableRestVolumes, eNvFlexMapWait);
-		float* op = (float*)NvFlexMap(Buffers.InflatableOverPressures, eNvFlexMapWait);
-		float* cs = (float*)NvFlexMap(Buffers.InflatableConstraintScales, eNvFlexMapWait);
+		int* si = (int*)NvFlexMap(state->Buffers.InflatableStartIndices, eNvFlexMapWait);
+		int* nt = (int*)NvFlexMap(state->Buffers.InflatableNumTriangles, eNvFlexMapWait);
+		float* rv = (float*)NvFlexMap(state->Buffers.InflatableRestVolumes, eNvFlexMapWait);
+		float* op = (float*)NvFlexMap(state->Buffers.InflatableOverPressures, eNvFlexMapWait);
+		float* cs = (float*)NvFlexMap(state->Buffers.InflatableConstraintScales, eNvFlexMapWait);
 
-		for (int i = 0; i < startIndices->Count; i++) {
+		for (int i = Math::Max(first, 0); i < Math::Min(end, startIndices->Count); i++) {
 			si[i] = startIndices[i];
 			nt[i] = numTriangles[i];
 			rv[i] = restVolumes[i];
@@ -900,44 +1907,257 @@ namespace FlexCLI {
 			cs[i] = constraintScales[i];
 		}
 
-		NvFlexUnmap(Buffers.InflatableStartIndices);
-		NvFlexUnmap(Buffers.InflatableNumTriangles);
-		NvFlexUnmap(Buffers.InflatableRestVolumes);
-		NvFlexUnmap(Buffers.InflatableOverPressures);
-		NvFlexUnmap(Buffers.InflatableConstraintScales);
+		NvFlexUnmap(state->Buffers.InflatableStartIndices);
+		NvFlexUnmap(state->Buffers.InflatableNumTriangles);
+		NvFlexUnmap(state->Buffers.InflatableRestVolumes);
+		NvFlexUnmap(state->Buffers.InflatableOverPressures);
+		NvFlexUnmap(state->Buffers.InflatableConstraintScales);
 
-		NvFlexSetInflatables(Solver, Buffers.InflatableStartIndices, Buffers.InflatableNumTriangles, Buffers.InflatableRestVolumes, Buffers.InflatableOverPressures, Buffers.InflatableConstraintScales, startIndices->Count);
+		NvFlexSetInflatables(state->Solver, state->Buffers.InflatableStartIndices, state->Buffers.InflatableNumTriangles, state->Buffers.InflatableRestVolumes, state->Buffers.InflatableOverPressures, state->Buffers.InflatableConstraintScales, startIndices->Count);
 	}
 
 	void Flex::SetActivity(List<bool>^ activityMask) {
-		int nActive = 0;
+		state->nActive = 0;
 
-		int* actives = (int*)NvFlexMap(Buffers.Active, eNvFlexMapWait);
+		int* actives = (int*)NvFlexMap(state->Buffers.Active, eNvFlexMapWait);
 		
 		for (int i = 0; i < activityMask->Count; i++) {
 			if (activityMask[i]) {
-				actives[nActive] = i;
-				nActive++;
+				actives[state->nActive] = i;
+				state->nActive++;
 			}
 		}
 
-		NvFlexUnmap(Buffers.Active);
-		NvFlexSetActive(Solver, Buffers.Active, nActive);
+		NvFlexUnmap(state->Buffers.Active);
+		NvFlexSetActive(state->Solver, state->Buffers.Active, state->nActive);
 	}
-	//Utils
-	void Flex::UpdateSolver() {
-		if (numFixedIter < 2) {
-			NvFlexUpdateSolver(Solver, dt, subSteps, false);
-			Scene->Particles = GetParticles();
-			GetRigidTransformations(Scene->RigidTranslations, Scene->RigidRotations);
+	///<summary>Pulls the particle state into the particle pool of the current scene. Particle objects are only rebuilt once they are requested.</summary>
+	///<param name = 'allChannels'>If false, only the channels set in FlexSolverOptions::Readback are read. The first readback after each upload always reads all particle channels.</param>
+	void Flex::ReadSceneState(bool allChannels) {
+		FinishReadback();
+		int basic = (int)(FlexReadback::Positions | FlexReadback::Velocities | FlexReadback::Phases);
+		int channels = (allChannels || !state->stateSynced) ? state->readbackChannels | basic : state->readbackChannels;
+
+		Scene->ReserveParticles(state->n);
+		if (state->n > 0) {
+			bool pos = (channels & (int)FlexReadback::Positions) != 0;
+			bool vel = (channels & (int)FlexReadback::Velocities) != 0;
+			bool ph = (channels & (int)FlexReadback::Phases) != 0;
+			if (pos) NvFlexGetParticles(state->Solver, state->Buffers.Particles, state->n);
+			if (vel) NvFlexGetVelocities(state->Solver, state->Buffers.Velocities, state->n);
+			if (ph) NvFlexGetPhases(state->Solver, state->Buffers.Phases, state->n);
+
+			float* particles = pos ? (float*)NvFlexMap(state->Buffers.Particles, eNvFlexMapWait) : NULL;
+			float* velocities = vel ? (float*)NvFlexMap(state->Buffers.Velocities, eNvFlexMapWait) : NULL;
+			int* phases = ph ? (int*)NvFlexMap(state->Buffers.Phases, eNvFlexMapWait) : NULL;
+
+			//skipped channels keep the values already in the pool
+			pin_ptr<FlexParticleData> data = &Scene->ParticleData[0];
+			FlexKernels::UnpackRecords((FlexKernels::ParticleRecord*)data, particles, velocities, phases, state->invStabScale, state->n);
+
+			if (pos) NvFlexUnmap(state->Buffers.Particles);
+			if (vel) NvFlexUnmap(state->Buffers.Velocities);
+			if (ph) NvFlexUnmap(state->Buffers.Phases);
+		}
+		Scene->ParticleCount = state->n;
+		Scene->StateChanged();
+
+		if (channels & (int)(FlexReadback::Normals | FlexReadback::Densities | FlexReadback::Contacts)) {
+			state->Buffers.AllocateReadback(*state, channels);
+			Scene->ReserveOptionalState(state->n, (FlexReadback)channels);
+			ReadOptionalState(channels);
+		}
+
+		//phases are left out on purpose, they only change on upload
+		Scene->StateIsPartial = (channels & (int)(FlexReadback::Positions | FlexReadback::Velocities)) != (int)(FlexReadback::Positions | FlexReadback::Velocities);
+		if ((channels & basic) == basic)
+			state->stateSynced = true;
+	}
+
+	///Reads normals, densities and contacts into the state arrays of the current scene, depending on 'channels'
+	void Flex::ReadOptionalState(int channels) {
+		if (!state->n)
+			return;
+
+		if (channels & (int)FlexReadback::Normals)
+			NvFlexGetNormals(state->Solver, state->Buffers.Normals, state->n);
+		if (channels & (int)FlexReadback::Densities)
+			NvFlexGetDensities(state->Solver, state->Buffers.Densities, state->n);
+		if (channels & (int)FlexReadback::Contacts)
+			NvFlexGetContacts(state->Solver, state->Buffers.ContactPlanes, state->Buffers.ContactVelocities, state->Buffers.ContactIndices, state->Buffers.ContactCounts);
+
+		if (channels & (int)FlexReadback::Normals) {
+			float* nor = (float*)NvFlexMap(state->Buffers.Normals, eNvFlexMapWait);
+			pin_ptr<float> norPin = &Scene->StateNormals[0];
+			FlexKernels::ScaleUnpack4To3(norPin, NULL, nor, 1.0f, state->n);
+			NvFlexUnmap(state->Buffers.Normals);
+		}
+
+		if (channels & (int)FlexReadback::Densities) {
+			float* den = (float*)NvFlexMap(state->Buffers.Densities, eNvFlexMapWait);
+			Marshal::Copy(IntPtr(den), Scene->StateDensities, 0, state->n);
+			NvFlexUnmap(state->Buffers.Densities);
+		}
+
+		if (channels & (int)FlexReadback::Contacts) {
+			float* planes = (float*)NvFlexMap(state->Buffers.ContactPlanes, eNvFlexMapWait);
+			float* velocities = (float*)NvFlexMap(state->Buffers.ContactVelocities, eNvFlexMapWait);
+			int* indices = (int*)NvFlexMap(state->Buffers.ContactIndices, eNvFlexMapWait);
+			unsigned int* counts = (unsigned int*)NvFlexMap(state->Buffers.ContactCounts, eNvFlexMapWait);
+			int* actives = (int*)NvFlexMap(state->Buffers.Active, eNvFlexMapWait);
+
+			pin_ptr<int> cc = &Scene->StateContactCounts[0];
+			pin_ptr<float> cp = &Scene->StateContactPlanes[0];
+			pin_ptr<float> cv = &Scene->StateContactVelocities[0];
+			memset(cc, 0, sizeof(int) * state->n);
+
+			//contacts are only reported for active particles, sorted by the solver's internal order
+			for (int a = 0; a < state->nActive; a++) {
+				int p = actives[a];
+				if (p < 0 || p >= state->n)
+					continue;
+				int c = indices[p];
+				int count = (int)counts[c] < maxContactsPerParticle ? (int)counts[c] : maxContactsPerParticle;
+				cc[p] = count;
+				for (int k = 0; k < count; k++) {
+					const float* src = planes + (c * maxContactsPerParticle + k) * 4;
+					float* dst = cp + (p * maxContactsPerParticle + k) * 4;
+					dst[0] = src[0];
+					dst[1] = src[1];
+					dst[2] = src[2];
+					dst[3] = src[3] * state->invStabScale;
+					src = velocities + (c * maxContactsPerParticle + k) * 4;
+					dst = cv + (p * maxContactsPerParticle + k) * 4;
+					dst[0] = src[0] * state->invStabScale;
+					dst[1] = src[1] * state->invStabScale;
+					dst[2] = src[2] * state->invStabScale;
+					dst[3] = src[3];
+				}
+			}
+
+			NvFlexUnmap(state->Buffers.ContactPlanes);
+			NvFlexUnmap(state->Buffers.ContactVelocities);
+			NvFlexUnmap(state->Buffers.ContactIndices);
+			NvFlexUnmap(state->Buffers.ContactCounts);
+			NvFlexUnmap(state->Buffers.Active);
+		}
+	}
+
+	///<summary>Pipelined counterpart of ReadSceneState. Requests this step's state into one buffer set, then hands the previous step's set to a worker thread for conversion. The scene therefore lags one step behind the solver.</summary>
+	void Flex::ReadSceneStateAsync() {
+		FinishReadback();
+		NvFlexReadbackDevice device = state->ReadbackDevice();
+		if (!state->Readback.IsAllocated())
+			state->Readback.Allocate(device, state->maxParticles, state->maxRigidBodies);
+
+		int basic = (int)(FlexReadback::Positions | FlexReadback::Velocities | FlexReadback::Phases);
+		int channels = state->stateSynced ? state->readbackChannels : state->readbackChannels | basic;
+
+		//queue copies of this step's state and get the previous step back, which the solver has most likely finished copying by now
+		FlexPipeline::BufferSet<NvFlexReadbackDevice>* previous = state->Readback.Request(device, state->n, Scene->NumRigids(), channels);
+		if ((channels & basic) == basic)
+			state->stateSynced = true;
+
+		//convert the previous step on a worker thread
+		if (previous) {
+			Scene->ReserveParticles(previous->Count);
+			Scene->ParticleCount = previous->Count;
+			Scene->StateChanged();
+			Scene->StateIsPartial = (previous->Channels & (int)(FlexReadback::Positions | FlexReadback::Velocities)) != (int)(FlexReadback::Positions | FlexReadback::Velocities);
+			readbackSet = state->Readback.Converting;
+			readbackScene = Scene;
+			readbackTask = System::Threading::Tasks::Task::Factory->StartNew(gcnew Action(this, &Flex::ConvertReadback));
+		}
+
+		//normals, densities and contacts are rarely requested and stay synchronous
+		if (state->readbackChannels & (int)(FlexReadback::Normals | FlexReadback::Densities | FlexReadback::Contacts)) {
+			state->Buffers.AllocateReadback(*state, state->readbackChannels);
+			Scene->ReserveOptionalState(state->n, (FlexReadback)state->readbackChannels);
+			ReadOptionalState(state->readbackChannels);
+		}
+	}
+
+	///Runs on a worker thread: converts the mapped buffer set 'readbackSet' into the particle pool of 'readbackScene'
+	void Flex::ConvertReadback() {
+		FlexPipeline::BufferSet<NvFlexReadbackDevice>& set = state->Readback.Sets[readbackSet];
+		FlexScene^ scene = readbackScene;
+		int numRigids = set.MappedRotations ? set.NumRigids : 0;
+		//staging arrays are kept between steps and only reallocated when the number of rigids changes
+		if (numRigids > 0 && (!readbackTranslations || readbackTranslations->Length != numRigids * 3)) {
+			readbackTranslations = gcnew array<float>(numRigids * 3);
+			readbackRotations = gcnew array<float>(numRigids * 4);
+		}
+		array<float>^ tra = readbackTranslations;
+		array<float>^ rot = readbackRotations;
+
+		{
+			pin_ptr<FlexParticleData> data = nullptr;
+			pin_ptr<float> traPin = nullptr;
+			pin_ptr<float> rotPin = nullptr;
+			if (set.Count > 0)
+				data = &scene->ParticleData[0];
+			if (numRigids > 0) {
+				traPin = &tra[0];
+				rotPin = &rot[0];
+			}
+			FlexPipeline::Readback<NvFlexReadbackDevice>::Convert(set, (FlexKernels::ParticleRecord*)data, traPin, rotPin, state->invStabScale);
+		}
+
+		//refilled in place, AddRange copies into the existing capacity
+		if (numRigids > 0) {
+			if (!scene->RigidTranslations)
+				scene->RigidTranslations = gcnew List<float>(tra->Length);
+			if (!scene->RigidRotations)
+				scene->RigidRotations = gcnew List<float>(rot->Length);
+			scene->RigidTranslations->Clear();
+			scene->RigidTranslations->AddRange(tra);
+			scene->RigidRotations->Clear();
+			scene->RigidRotations->AddRange(rot);
 		}
+	}
+
+	///<summary>Blocks until the pending pipelined conversion is done and releases its buffers. Called before anything touches the scene's state.</summary>
+	void Flex::FinishReadback() {
+		if (!readbackTask)
+			return;
+		readbackTask->Wait();
+		readbackTask = nullptr;
+		readbackScene = nullptr;
+		NvFlexReadbackDevice device = state->ReadbackDevice();
+		state->Readback.Finish(device);
+	}
+
+	///Copies back whatever is needed after a solver step
+	void Flex::ReadbackAfterStep(bool pipelined) {
+		if (pipelined)
+			ReadSceneStateAsync();
 		else {
-			for (int i = 0; i < numFixedIter; i++) {
-				NvFlexUpdateSolver(Solver, dt, subSteps, false);
-				Scene->Particles = GetParticles();
+			ReadSceneState(false);
+			if (state->readbackChannels & (int)FlexReadback::RigidTransforms)
 				GetRigidTransformations(Scene->RigidTranslations, Scene->RigidRotations);
+		}
+	}
+
+	//Utils
+	///<summary>Advances the solver by 'SyncInterval' steps, or by 'FixedTotalIterations' steps if set, and copies the state back to the host once at the end.
+	///With 'BroadphaseInterval' set, the collision shapes near the particles are selected anew once that many steps have passed.</summary>
+	void Flex::UpdateSolver() {
+		int steps = state->numFixedIter < 2 ? state->syncInterval : state->numFixedIter;
+		for (int i = 0; i < steps; i++)
+			NvFlexUpdateSolver(state->Solver, state->dt, state->subSteps, false);
+
+		//broadphase: the culled shape set follows the particles every 'BroadphaseInterval' steps
+		if (state->broadphaseInterval > 0) {
+			state->broadphaseSteps += steps;
+			if (!state->particleBoundsKnown || state->broadphaseSteps >= state->broadphaseInterval) {
+				ReadParticleBounds();
+				SubmitCollisionShapes();
+				state->broadphaseSteps = 0;
 			}
 		}
+
+		//the result of fixed iterations is needed right away, a pipelined readback would only deliver it on the next call
+		ReadbackAfterStep(state->numFixedIter < 2 && state->pipelinedReadback);
 	}
 
 	void Flex::DecomposePhase(int phase, int %groupIndex, bool %selfCollision, bool %fluid) {
@@ -975,17 +2195,38 @@ namespace FlexCLI {
 
 	void Flex::Destroy()
 	{
-		NvFlexFlush(Library);
-		Buffers.Destroy();
-		Params.numPlanes = 0;
-
-		if (Solver) {
-			NvFlexDestroySolver(Solver);
-			Solver = 0;
-		}
-		if (Library) {
-			NvFlexShutdown(Library);
-			Library = 0;
+		if (!state)
+			return;
+		DestroySolver();
+		state->Params.numPlanes = 0;
+
+		//meshes live in the library, destroy them before it shuts down
+		if (state->Library)
+			ReleaseCollisionMeshes(state->collisionMeshesInUse);
+		state->collisionMeshes.clear();
+		state->collisionMeshBytes = 0;
+		state->collisionMeshHits = 0;
+		state->collisionMeshMisses = 0;
+		state->numCollisionShapes = 0;
+		state->movedColliders.clear();
+		state->colliderOffsets.clear();
+		state->colliderLocalBounds.clear();
+		state->colliderBounds.clear();
+		state->colliderTree.Build(nullptr, 0);
+		if (state->Library)
+			for (std::map<int, unsigned int>::iterator d = state->deformedColliders.begin(); d != state->deformedColliders.end(); d++)
+				NvFlexDestroyTriangleMesh(state->Library, d->second);
+		state->deformedColliders.clear();
+		state->numMeshShapes = 0;
+		state->numMeshInstanceShapes = 0;
+		state->collisionIndicesShape = -1;
+		collisionGeometry = nullptr;
+		flexParams = nullptr;
+
+		//the library itself is shut down with the last Flex object
+		if (state->Library) {
+			ReleaseLibrary();
+			state->Library = 0;
 		}
 	}
 }
\ No newline at end of file
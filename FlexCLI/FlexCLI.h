@@ -7,6 +7,7 @@
 #include <map>
 #include <iostream>
 #include <stdio.h>
+#include <string.h>
 #include <DirectXMath.h>
 
 using namespace System;
@@ -27,35 +28,173 @@ namespace FlexCLI {
 	ref struct FlexSolverOptions;
 	ref class FlexUtils;
 	ref class FlexForceField;
+	ref class FlexBatch;
+	struct FlexState;
+
+	///<summary>Channels copied back to the host after each solver step. Channels can be combined with |.</summary>
+	[System::Flags]
+	public enum class FlexReadback {
+		None = 0,
+		Positions = 1,			//positions and inverse masses
+		Velocities = 2,
+		Phases = 4,				//read every step. If not set, phases are only read once after each upload, as they don't change during simulation
+		RigidTransforms = 8,
+		Normals = 16,
+		Densities = 32,
+		Contacts = 64,
+		Default = Positions | Velocities | RigidTransforms
+	};
+
+	///<summary>Particle categories of a FlexScene, used to query its cached index views</summary>
+	public enum class FlexParticleCategory {
+		All = 0,
+		Fluid = 1,
+		Rigid = 2,
+		Soft = 3,
+		Spring = 4,
+		Cloth = 5,
+		Inflatable = 6
+	};
+
+	///<summary>Index range [First, End) into one of a scene's arrays. Empty, if First >= End.</summary>
+	public value struct FlexRange {
+		int First, End;
+		FlexRange(int first, int end) : First(first), End(end) {}
+		property bool IsEmpty { bool get() { return First >= End; } }
+		///<summary>Smallest range covering both ranges</summary>
+		FlexRange Union(FlexRange other) {
+			if (IsEmpty) return other;
+			if (other.IsEmpty) return *this;
+			return FlexRange(Math::Min(First, other.First), Math::Max(End, other.End));
+		}
+	};
+
+	///<summary>Changes FlexScene::AlterScene made since the scene was last handed to the solver, as dirty ranges per array</summary>
+	public value struct FlexSceneChanges {
+		FlexRange Particles;
+		FlexRange RigidStiffnesses;
+		FlexRange Springs;
+		FlexRange Inflatables;
+		///<summary>True, if the length of any array changed. The next Flex::SetScene uploads everything then.</summary>
+		bool Structure;
+		///<summary>True, if only constraint coefficients changed, so the particles don't need to be uploaded again</summary>
+		property bool OnlyCoefficients { bool get() { return !Structure && Particles.IsEmpty; } }
+	};
+
+	///<summary>Registry entry of one group index in a FlexScene. Ranges are [offset, offset + count) into the scene's particles, rigid shapes, springs and dynamic triangles.</summary>
+	public value struct FlexGroupInfo {
+		int GroupIndex;
+		FlexParticleCategory Category;
+		int ParticleOffset, ParticleCount;
+		int ShapeOffset, ShapeCount;
+		int SpringOffset, SpringCount;
+		int TriangleOffset, TriangleCount;
+		///<summary>False, if the group was registered by several separate calls. Counts are totals then, offsets refer to the first registration.</summary>
+		bool IsContiguous;
+	};
+
+	///<summary>Blittable particle record of 32 bytes, as FlexScene stores its particles. The first 16 bytes match an NvFlex particle [x, y, z, 1/m].</summary>
+	public value struct FlexParticleData {
+		float PositionX, PositionY, PositionZ, InverseMass;
+		float VelocityX, VelocityY, VelocityZ;
+		int Phase;
+
+		property int GroupIndex { int get() { return Phase & eNvFlexPhaseGroupMask; } }
+		property bool SelfCollision { bool get() { return (Phase & eNvFlexPhaseSelfCollide) != 0; } }
+		property bool IsFluid { bool get() { return (Phase & eNvFlexPhaseFluid) != 0; } }
+		bool IsValid() { return InverseMass >= 0.0f && Phase >= 0; }
+	};
+
+	///<summary>Counters of a content hash cache</summary>
+	public value struct FlexCacheStatistics {
+		int Hits;
+		int Misses;
+		int Resident;				//entries currently held
+		long long ResidentBytes;	//host side size of the data the resident entries were built from
+		long long CapacityBytes;	//cap on ResidentBytes, 0 if the cache only holds entries in use
+		virtual String^ ToString() override {
+			return Resident + " resident (" + ResidentBytes + (CapacityBytes > 0 ? " of " + CapacityBytes.ToString() : String::Empty) + " bytes), " + Hits + " hits, " + Misses + " misses";
+		}
+	};
 
 	public ref class Flex
 	{
 		// public: Everything accessible from FlexHopper
 	public:
 		Flex();
+		Flex(FlexSolverOptions^ flexSolverOptions);
+		~Flex();
+		!Flex();
 		FlexScene^ Scene;
 		void SetCollisionGeometry(FlexCollisionGeometry^ flexCollisionGeometry);
+		void UpdateColliderTransforms(array<int>^ shapeIndices, array<float>^ positions, array<float>^ rotations);
+		void UpdateColliderMeshVertices(int shapeIndex, array<float>^ vertices);
 		void SetParams(FlexParams^ flexParams);
 		void SetScene(FlexScene^ flexScene);
 		void SetSolverOptions(FlexSolverOptions^ flexSolverOptions);
 		void SetForceFields(List<FlexForceField^>^ flexForceFields);
+		void SetParticles(array<float>^ positions, array<float>^ velocities, array<float>^ inverseMasses, array<int>^ phases, array<bool>^ active);
 		bool IsReady();
 		void UpdateSolver();
 		void Destroy();
+		///<summary>Counters of the collision mesh cache. Meshes are shared by content hash and destroyed once no collision shape uses them.</summary>
+		FlexCacheStatistics GetCollisionMeshCacheStatistics();
+
+		//Allocation free readback into caller owned flat arrays
+		int ReadState(array<float>^ positions, array<float>^ velocities, array<int>^ phases);
+		int ReadState(array<float>^ positions, array<float>^ velocities, array<float>^ inverseMasses, array<int>^ phases);
 	internal:
 		void SetParticles(List<FlexParticle^>^ flexParticles);
-		void SetRigids(List<int>^ offsets, List<int>^ indices, List<float>^ restPositions, List<float>^ restNormals, List<float>^ stiffnesses, List<float>^ rotations, List<float>^ translations);
-		void SetSprings(List<int>^ springPairIndices, List<float>^ springLengths, List<float>^ springCoefficients);
-		void SetDynamicTriangles(List<int>^ triangleIndices, List<float>^ normals);
-		void SetInflatables(List<int>^ startIndices, List<int>^ numTriangles, List<float>^ restVolumes, List<float>^ overPressures, List<float>^ constraintScales);
+		void UploadParticles(const float* positions, const float* velocities, const float* inverseMasses, const int* phases, const bool* active, int count);
+		void UploadParticles(const FlexParticleData* particles, int count);
+		void UploadParticleRange(const FlexParticleData* particles, int first, int end, int count);
+		void SubmitParticles();
+		void SetRigids(List<int>^ offsets, List<int>^ indices, List<float>^ restPositions, List<float>^ restNormals, List<float>^ stiffnesses, List<float>^ rotations, List<float>^ translations, int firstRigid);
+		void SetSprings(List<int>^ springPairIndices, List<float>^ springLengths, List<float>^ springCoefficients, int first, int end);
+		void SetDynamicTriangles(List<int>^ triangleIndices, List<float>^ normals, int firstTriangle);
+		void SetInflatables(List<int>^ startIndices, List<int>^ numTriangles, List<float>^ restVolumes, List<float>^ overPressures, List<float>^ constraintScales, int first, int end);
 		void SetActivity(List<bool>^ activityMask);
 
 		static void DecomposePhase(int phase, int %groupIndex, bool %selfCollision, bool %fluid);
 
 		//called in each update cycle
-		List<FlexParticle^>^ GetParticles();
+		void ReadSceneState(bool allChannels);
+		void ReadOptionalState(int channels);
+		void ReadbackAfterStep(bool pipelined);
+		//pipelined readback, see FlexSolverOptions::PipelinedReadback
+		void ReadSceneStateAsync();
+		void FinishReadback();
 		List<FlexForceField^>^ FlexForceFields;
 		void GetRigidTransformations(List<float>^ %translations, List<float>^ %rotations);
+	private:
+		unsigned int AcquireTriangleMesh(array<float>^ vertices, array<int>^ faces, array<float>^ upperBounds, array<float>^ lowerBounds, float maxSimplificationError, bool mirrored);
+		unsigned int AcquireTriangleMesh(const float* vertices, int numVertices, const int* faces, int numFaces, const float* upperBounds, const float* lowerBounds, bool mirrored);
+		void CheckTriangleMeshLimits(array<float>^ vertices, array<int>^ faces, float maxSimplificationError, String^ what);
+		unsigned int AcquireConvexMesh(array<float>^ planes, array<float>^ upperBounds, array<float>^ lowerBounds);
+		unsigned int AcquireDistanceField(array<float>^ vertices, array<int>^ faces, int resolution, float* lower, float* size);
+		void ReleaseCollisionMeshes(std::vector<unsigned long long>& keys);
+		void ConvertReadback();
+		void Initialize(FlexSolverOptions^ flexSolverOptions);
+		void CreateSolver();
+		void DestroySolver();
+		void Reupload();
+		void SubmitCollisionShapes();
+		void ReadParticleBounds();
+		FlexCollisionGeometry^ collisionGeometry;	//geometry of the last SetCollisionGeometry call, UpdateColliderMeshVertices reads the mesh faces from it
+		FlexParams^ flexParams;						//params of the last SetParams call, applied again when the stability scaling changes
+		FlexState* state;							//solver, buffers and parameters of this instance, see FlexCLI.cpp
+		static NvFlexLibrary* AcquireLibrary();
+		static void ReleaseLibrary();
+		static Object^ libraryLock = gcnew Object();
+		System::Threading::Tasks::Task^ readbackTask;
+		FlexScene^ readbackScene;
+		int readbackSet;
+		array<float>^ readbackTranslations;			//rigid transforms of the last conversion, reused while the number of rigids stays the same
+		array<float>^ readbackRotations;
+		//what the last SetScene uploaded, so SetScene after AppendScene only uploads the appended tail
+		FlexScene^ uploadedScene;
+		int uploadedParticles, uploadedRigids, uploadedSprings, uploadedTriangles, uploadedInflatables;
+		bool triangleNormalsSet;
 	};
 
 	// Structs as they is presented to .Net
@@ -147,7 +286,16 @@ namespace FlexCLI {
 		void AddBox(array<float>^ halfHeightsXYZ, array<float>^ centerXYZ, array<float>^ rotationABCD);
 		void AddCapsule(float halfHeightX, float radius, array<float>^ centerXYZ, array<float>^ rotationABCD);
 		void AddMesh(array<float>^ vertices, array<int>^ faces);
+		int RegisterInstancedMesh(array<float>^ vertices, array<int>^ faces);
+		void AddMeshInstance(int meshHandle, array<float>^ centerXYZ, array<float>^ rotationQuat, array<float>^ scaleXYZ);
 		void AddConvexShape(array<float>^ planes, array<float>^ upperLimit, array<float>^ lowerLimit);
+		void AddConvexHull(array<float>^ points);
+		void AddConvexHulls(array<float>^ points, array<int>^ pointCounts);
+		void AddDistanceField(array<float>^ vertices, array<int>^ faces, int resolution);
+		void SimplifyMeshes(float tolerance);
+		static void ClearSimplificationCache();
+		static void SetSimplificationCacheCapacity(long long bytes);
+		static FlexCacheStatistics GetSimplificationCacheStatistics();
 
 		int TimeStamp;
 	internal:
@@ -175,11 +323,27 @@ namespace FlexCLI {
 		List<array<int>^>^ MeshFaces;
 		List<array<float>^>^ MeshLowerBounds;
 		List<array<float>^>^ MeshUpperBounds;
+		float MeshSimplification;			//fraction of the collision distance, 0: meshes are uploaded as they are
+		//Mesh instance properties
+		List<array<float>^>^ InstancedMeshVertices;
+		List<array<int>^>^ InstancedMeshFaces;
+		List<array<float>^>^ InstancedMeshLowerBounds;
+		List<array<float>^>^ InstancedMeshUpperBounds;
+		int NumMeshInstances;
+		List<int>^ MeshInstanceHandles;
+		List<float>^ MeshInstancePositions;
+		List<float>^ MeshInstanceRotations;
+		List<float>^ MeshInstanceScales;
 		//ConvexShape properties
 		int NumConvex;
 		List<array<float>^>^ ConvexPlanes;
 		List<array<float>^>^ ConvexLowerBounds;
 		List<array<float>^>^ ConvexUpperBounds;
+		//Signed distance field properties
+		int NumDistanceFields;
+		List<array<float>^>^ DistanceFieldVertices;
+		List<array<int>^>^ DistanceFieldFaces;
+		List<int>^ DistanceFieldResolutions;
 	};
 
 	public ref class FlexScene {
@@ -188,12 +352,16 @@ namespace FlexCLI {
 		FlexScene();
 
 		///<summary>Number of all particles in the scene</summary>
-		int NumParticles() { return Particles->Count; };
+		int NumParticles() { return ParticleCount; };
 		int NumRigidBodies() { 
 			return NumActualRigids; 
 		};
 
-		List<FlexParticle^>^ Particles;
+		///<summary>Particle objects of the scene. Compatibility view of the pooled particle data, only rebuilt when requested after the particles changed. Changes to the returned objects don't affect the scene.</summary>
+		property List<FlexParticle^>^ Particles {
+			List<FlexParticle^>^ get();
+			void set(List<FlexParticle^>^ value);
+		}
 		List<FlexParticle^>^ GetAllParticles();
 
 		//Particles in general
@@ -207,14 +375,17 @@ namespace FlexCLI {
 		int NumRigids() { return RigidOffsets->Count - 1; };
 		void RegisterRigidBody(array<float>^ vertices, array<float>^ vertexNormals, array<float>^ velocity, array<float>^ inverseMasses, float stiffness, int groupIndex);
 		List<FlexParticle^>^ GetRigidParticles();
-		List<float>^ GetRigidRotations() { return RigidRotations; };
-		List<float>^ GetRigidTranslations() { return RigidTranslations; };
+		List<float>^ GetRigidRotations() { WaitForReadback(); return RigidRotations; };
+		List<float>^ GetRigidTranslations() { WaitForReadback(); return RigidTranslations; };
 		List<float>^ GetShapeMassCenters() { return ShapeMassCenters; }
 
 		//Softs
 		static void InitSoftBodyFromMesh(void*% asset, array<float>^ vertices, array<int>^ triangles, float particleSpacing, float volumeSampling, float surfaceSampling, float clusterSpacing, float clusterRadius, float clusterStiffness, float linkRadius, float linkStiffness, float globalStiffness);
 		static void UnwrapSoftBody(void* asset, array<float>^% particles, array<int>^% springIndices, array<array<int>^>^% shapeIndices);
 		static void DestroySoftBody(NvFlexExtAsset* asset);
+		static void SetAssetCacheDirectory(String^ directory);
+		static void ClearAssetCache();
+		static String^ AssetCacheStatistics();
 		List<List<FlexParticle^>^>^ GetSoftParticles();
 
 		//Springs
@@ -233,6 +404,17 @@ namespace FlexCLI {
 		void RegisterInflatable(array<float>^ positions, array<float>^ velocities, array<float>^ inverseMasses, array<int>^ triangles, array<float>^ triangleNormals, float stretchStiffness, float bendingStiffness, float preTensionFactor, float restVolume, float overPressure, float constraintScale, array<int>^ anchorIndices, bool selfCollision, int groupIndex);
 		List<FlexParticle^>^ GetInflatableParticles();
 
+		//Group registry, O(1) per query
+		bool HasGroup(int groupIndex) { return Groups->ContainsKey(groupIndex); };
+		bool TryGetGroup(int groupIndex, FlexGroupInfo% info) { return Groups->TryGetValue(groupIndex, info); };
+		array<int>^ GetRegisteredGroups();
+
+		//Cached index views, built once when the scene is handed to the solver. The returned segments share one immutable index array, don't write to them.
+		ArraySegment<int> GetIndices(FlexParticleCategory category);
+		ArraySegment<int> GetGroupIndices(int groupIndex);
+		int ReadPositions(ArraySegment<int> indices, array<float>^ positions);
+		int ReadVelocities(ArraySegment<int> indices, array<float>^ velocities);
+
 		//Custom Constraints
 		bool RegisterCustomConstraints(array<int>^ anchorIndices, array<int>^ shapeMatchingIndices, float shapeStiffness, array<int>^ springPairIndices, array<float>^ springStiffnesses, array<float>^ springDefaultLengths, array<int>^ triangleIndices, array<float>^ triangleNormals);
 
@@ -243,15 +425,50 @@ namespace FlexCLI {
 		String^ ToString() override;
 		int TimeStamp;
 
+		//Binary snapshots, see FlexSnapshot.h
+		void Save(String^ path);
+		static FlexScene^ Load(String^ path);
+
 		FlexScene^ AppendScene(FlexScene^ newScene);
 		FlexScene^ AlterScene(FlexScene^ alteredScene, bool includeAllParticles);
+		///<summary>Changes made by AlterScene that the solver hasn't received yet</summary>
+		FlexSceneChanges GetPendingChanges() { return Changes; };
 
 		//Define which particles are active and which aren't
 		void SetActivity(List<bool>^ activityMask);
 
+		//Optional readback channels, only filled when enabled in FlexSolverOptions::Readback
+		array<float>^ GetParticleNormals();
+		array<float>^ GetParticleDensities();
+		int GetParticleContacts(array<int>^% contactCounts, array<float>^% contactPlanes, array<float>^% contactVelocities);
+
 	internal:
 		//reference to flex class
 		Flex^ Flex;
+		//Pooled particle storage, 32 contiguous bytes per particle. Registration appends here and solver readbacks write straight into it.
+		array<FlexParticleData>^ ParticleData;
+		int ParticleCount;
+		void ReserveParticles(int count);
+		void AddParticle(float positionX, float positionY, float positionZ, float velocityX, float velocityY, float velocityZ, float inverseMass, int phase);
+		void ParticlesChanged() { particleCache = nullptr; indexViewsValid = false; };
+		FlexScene^ CloneShared();
+		void StateChanged() { particleCache = nullptr; };
+		void BuildIndexViews();
+		Dictionary<int, FlexGroupInfo>^ Groups;
+		void RegisterGroup(int groupIndex, FlexParticleCategory category, int particleOffset, int particleCount, int shapeOffset, int shapeCount, int springOffset, int springCount);
+		void RebuildGroups();
+		bool StateIsPartial; //true, if the last readback skipped some of the particle channels
+		bool IncrementalUpload; //true, as long as the scene was only appended to or altered in the ranges recorded in Changes since Flex::SetScene uploaded it
+		FlexSceneChanges Changes;
+		//optional readback channels
+		array<float>^ StateNormals;
+		array<float>^ StateDensities;
+		array<int>^ StateContactCounts;
+		array<float>^ StateContactPlanes;
+		array<float>^ StateContactVelocities;
+		void ReserveOptionalState(int count, FlexReadback channels);
+		void WaitForReadback();
+		void SyncState();
 		void RegisterAsset(NvFlexExtAsset* asset, array<float>^ velocity, float invMass, int groupIndex, bool isSoftBody);
 		//Fluids
 		List<int>^ FluidIndices;
@@ -284,12 +501,25 @@ namespace FlexCLI {
 		List<float>^ InflatableRestVolumes;
 		List<float>^ InflatableOverPressures;
 		List<float>^ InflatableConstraintScales;
+	private:
+		List<FlexParticle^>^ particleCache;
+		List<FlexParticle^>^ GatherParticles(ArraySegment<int> indices);
+		void BuildGroupSpans();
+		//particle indices of all categories back to back, category c spans [categoryOffsets[c], categoryOffsets[c + 1])
+		array<int>^ categoryIndices;
+		array<int>^ categoryOffsets;
+		//particle indices sorted by group index, only built if some group isn't contiguous
+		array<int>^ groupIndices;
+		Dictionary<int, ArraySegment<int>>^ groupSpans;
+		bool indexViewsValid;
 	};
 
 	public ref class FlexParticle {
 	public:
 		FlexParticle(array<float>^ position, array<float>^ velocity, float inverseMass, bool selfCollision, bool isFluid, int groupIndex, bool isActive);
 		FlexParticle(array<float>^ position, array<float>^ velocity, float inverseMass, int phase, bool isActive);
+		FlexParticle(FlexParticleData data);
+		FlexParticleData ToData();
 		float PositionX, PositionY, PositionZ, InverseMass, VelocityX, VelocityY, VelocityZ;
 		int GroupIndex;
 		bool SelfCollision;
@@ -331,11 +561,23 @@ namespace FlexCLI {
 		int MaxRigidBodies = 65536;						//max nr. of rigid bodies
 		int MaxSprings = 196608;						//max nr. of springs
 		int MaxDynamicTriangles = 131072;				//needed for cloth
+		FlexReadback Readback = FlexReadback::Default;	//what Flex::UpdateSolver copies back to the host after each step
+		bool PipelinedReadback = false;					//overlap readback with the next solver step, results lag one step behind
+		int SyncInterval = 1;							//solver steps per Flex::UpdateSolver call, the state is only copied back after the last one
+		int BroadphaseInterval = 0;						//solver steps between particle bounds reads for collision shape culling, 0 submits every shape
+		float BroadphaseMargin = 1.0f;					//distance particles may travel within BroadphaseInterval steps, shapes farther from the particle bounds are culled
 		bool IsValid();
 		String^ ToString() override;
 		int TimeStamp;
 	};
 
+	public ref class FlexUtils {
+	public:
+		static String^ KernelInstructionSet();
+		static String^ BenchmarkKernels(int numParticles, int repetitions);
+		static String^ BenchmarkDistanceFields(int resolution);
+	};
+
 	public ref class FlexForceField {
 	public:
 		FlexForceField(array<float>^ position, float radius, float strength, bool linearFallOff, int mode);
@@ -348,4 +590,49 @@ namespace FlexCLI {
 
 		String^ ToString() override;
 	};
+
+	///<summary>Final state and metrics of one FlexBatch variant</summary>
+	public ref class FlexBatchResult {
+	public:
+		int Variant;						//index of the variant, in the order they were added
+		FlexParams^ Params;
+		FlexSolverOptions^ Options;
+		FlexScene^ Scene;					//final state. Shares its constraint lists with the base scene, don't append to or alter it.
+		int Updates;						//Flex::UpdateSolver calls
+		bool Converged;						//true, if MaxSpeed dropped to FlexBatch::ConvergenceSpeed before MaxUpdates were reached
+		float MaxSpeed;
+		float MeanSpeed;
+		float KineticEnergy;				//of all particles with finite mass
+		float MaxDisplacement;				//largest particle distance from its position in the base scene
+		double Seconds;						//wall time including solver setup and teardown
+		String^ Error;						//message of the exception that stopped the variant, null if it ran through
+		String^ ToString() override;
+	};
+
+	///<summary>Runs variants of one base scene with different FlexParams and FlexSolverOptions, each on a Flex instance of its own, concurrently on the thread pool.
+	///The variants share the base scene's constraint lists, only the particle pool and rigid transforms are copied per variant.</summary>
+	public ref class FlexBatch {
+	public:
+		FlexBatch(FlexScene^ baseScene, FlexParams^ baseParams, FlexSolverOptions^ baseOptions, FlexCollisionGeometry^ collisionGeometry);
+		///<summary>Adds a variant and returns its index. Null falls back to the base params or options.</summary>
+		int AddVariant(FlexParams^ flexParams, FlexSolverOptions^ flexSolverOptions);
+		int NumVariants() { return variantParams->Count; };
+		///<summary>Runs all variants for at most maxUpdates Flex::UpdateSolver calls each. Results are in the order the variants were added.</summary>
+		array<FlexBatchResult^>^ Run(int maxUpdates);
+
+		List<FlexForceField^>^ ForceFields;
+		int MaxConcurrency;					//solvers alive at the same time, defaults to the number of cores. Lower it if the GPU runs out of memory.
+		float ConvergenceSpeed;				//a variant stops early once no particle is faster, 0 always runs MaxUpdates
+	private:
+		void RunVariant(int variant);
+		FlexScene^ baseScene;
+		FlexParams^ baseParams;
+		FlexSolverOptions^ baseOptions;
+		FlexCollisionGeometry^ collisionGeometry;
+		List<FlexParams^>^ variantParams;
+		List<FlexSolverOptions^>^ variantOptions;
+		//state of the current Run
+		array<FlexBatchResult^>^ results;
+		int maxUpdates;
+	};
 }
\ No newline at end of file
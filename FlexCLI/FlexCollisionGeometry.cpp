@@ -1,5 +1,8 @@
 #include "stdafx.h"
 #include "FlexCLI.h"
+#include "FlexDistanceField.h"
+#include "FlexConvexHull.h"
+#include "FlexSimplify.h"
 
 //using namespace FlexCLI;
 using namespace System::Runtime::InteropServices;
@@ -9,6 +12,7 @@ namespace FlexCLI {
 	FlexCollisionGeometry::FlexCollisionGeometry() {
 		NumPlanes = 0;
 		Planes = gcnew array<float>(0);
+		MeshSimplification = 0.0f;
 		TimeStamp = 0;
 	};
 
@@ -92,8 +96,11 @@ namespace FlexCLI {
 	/// Add a triangle mesh by its vertex position and faces both as flattened arrays. Make sure front face CCW is pointing outward otherwise results are unforeseen.
 	///</summary>
 	void FlexCollisionGeometry::AddMesh(array<float>^ vertices, array<int>^ faces) {
-		if (vertices->Length % 3 != 0 || faces->Length % 3 != 0)
-			throw gcnew Exception("FlexCollisionGeometry::AddMesh(...) --->\nInvalid input: at least one array is not of length n * 3!");
+		if (vertices->Length == 0 || vertices->Length % 3 != 0 || faces->Length % 3 != 0)
+			throw gcnew Exception("FlexCollisionGeometry::AddMesh(...) --->\nInvalid input: vertices are empty or at least one array is not of length n * 3!");
+		for (int i = 0; i < faces->Length; i++)
+			if (faces[i] < 0 || faces[i] >= vertices->Length / 3)
+				throw gcnew Exception("FlexCollisionGeometry::AddMesh(...) --->\nInvalid input: face index " + faces[i] + " out of range!");
 		if (!NumMeshes) {
 			MeshVertices = gcnew List<array<float>^>();
 			MeshFaces = gcnew List<array<int>^>();
@@ -128,6 +135,66 @@ namespace FlexCLI {
 		TimeStamp = System::DateTime::Now.Minute * 60000 + System::DateTime::Now.Second * 1000 + System::DateTime::Now.Millisecond;
 	}
 
+	///<summary>
+	///Register a triangle mesh for instancing, without adding a shape. Returns the handle AddMeshInstance takes. The mesh is uploaded once, however many instances use it.
+	///</summary>
+	int FlexCollisionGeometry::RegisterInstancedMesh(array<float>^ vertices, array<int>^ faces) {
+		if (vertices->Length == 0 || vertices->Length % 3 != 0 || faces->Length % 3 != 0)
+			throw gcnew Exception("FlexCollisionGeometry::RegisterInstancedMesh(...) --->\nInvalid input: vertices are empty or at least one array is not of length n * 3!");
+		for (int i = 0; i < faces->Length; i++)
+			if (faces[i] < 0 || faces[i] >= vertices->Length / 3)
+				throw gcnew Exception("FlexCollisionGeometry::RegisterInstancedMesh(...) --->\nInvalid input: face index " + faces[i] + " out of range!");
+		if (!InstancedMeshVertices) {
+			InstancedMeshVertices = gcnew List<array<float>^>();
+			InstancedMeshFaces = gcnew List<array<int>^>();
+			InstancedMeshLowerBounds = gcnew List<array<float>^>();
+			InstancedMeshUpperBounds = gcnew List<array<float>^>();
+		}
+
+		array<float>^ lower = gcnew array<float>{ vertices[0], vertices[1], vertices[2] };
+		array<float>^ upper = gcnew array<float>{ vertices[0], vertices[1], vertices[2] };
+		for (int i = 1; i < vertices->Length / 3; i++)
+			for (int j = 0; j < 3; j++) {
+				lower[j] = Math::Min(lower[j], vertices[i * 3 + j]);
+				upper[j] = Math::Max(upper[j], vertices[i * 3 + j]);
+			}
+
+		InstancedMeshVertices->Add(vertices);
+		InstancedMeshFaces->Add(faces);
+		InstancedMeshLowerBounds->Add(lower);
+		InstancedMeshUpperBounds->Add(upper);
+		TimeStamp = System::DateTime::Now.Minute * 60000 + System::DateTime::Now.Second * 1000 + System::DateTime::Now.Millisecond;
+		return InstancedMeshVertices->Count - 1;
+	}
+
+	///<summary>
+	///Add a shape placing a mesh registered by RegisterInstancedMesh. The mesh is scaled, then rotated, then moved to the center.
+	///</summary>
+	///<param name="scaleXYZ">Scale along the mesh's own axes, negative values mirror the mesh</param>
+	void FlexCollisionGeometry::AddMeshInstance(int meshHandle, array<float>^ centerXYZ, array<float>^ rotationQuat, array<float>^ scaleXYZ) {
+		if (!InstancedMeshVertices || meshHandle < 0 || meshHandle >= InstancedMeshVertices->Count)
+			throw gcnew Exception("FlexCollisionGeometry::AddMeshInstance(...) --->\nInvalid input: mesh handle " + meshHandle + " was not returned by RegisterInstancedMesh!");
+		if (centerXYZ->Length != 3
+			|| rotationQuat->Length != 4
+			|| scaleXYZ->Length != 3
+			|| scaleXYZ[0] == 0.0f
+			|| scaleXYZ[1] == 0.0f
+			|| scaleXYZ[2] == 0.0f)
+			throw gcnew Exception("FlexCollisionGeometry::AddMeshInstance(...) --->\nInvalid input: one array is not of correct length or at least one scale is 0.0!");
+		if (!NumMeshInstances) {
+			MeshInstanceHandles = gcnew List<int>();
+			MeshInstancePositions = gcnew List<float>();
+			MeshInstanceRotations = gcnew List<float>();
+			MeshInstanceScales = gcnew List<float>();
+		}
+		MeshInstanceHandles->Add(meshHandle);
+		MeshInstancePositions->AddRange(centerXYZ);
+		MeshInstanceRotations->AddRange(rotationQuat);
+		MeshInstanceScales->AddRange(scaleXYZ);
+		NumMeshInstances++;
+		TimeStamp = System::DateTime::Now.Minute * 60000 + System::DateTime::Now.Second * 1000 + System::DateTime::Now.Millisecond;
+	}
+
 	///<summary>
 	///Add a convex mesh by the plane of each mesh face in the form ABCD (z+ should point inward) in a flattened array. upper and lower limits (float[3]) refer to vertex positions
 	///</summary>
@@ -149,4 +216,106 @@ namespace FlexCLI {
 		NumConvex++;
 		TimeStamp = System::DateTime::Now.Minute * 60000 + System::DateTime::Now.Second * 1000 + System::DateTime::Now.Millisecond;
 	}
+
+	///<summary>
+	///Simplifies all triangle meshes of this geometry before they are uploaded, by quadric edge collapse. Meshes deviate from the input by at most tolerance * collision distance, as set by Flex::SetParams.
+	///Large meshes are simplified in parallel, results are cached by mesh content, so unchanged meshes are simplified once.
+	///</summary>
+	///<param name="tolerance">Fraction of the collision distance, 0 to upload meshes unaltered. Around 0.5 keeps collisions visually unchanged.</param>
+	void FlexCollisionGeometry::SimplifyMeshes(float tolerance) {
+		if (tolerance < 0.0f)
+			throw gcnew Exception("FlexCollisionGeometry::SimplifyMeshes(float tolerance) --->\nInvalid input: tolerance must not be negative!");
+		MeshSimplification = tolerance;
+		TimeStamp = System::DateTime::Now.Minute * 60000 + System::DateTime::Now.Second * 1000 + System::DateTime::Now.Millisecond;
+	}
+
+	///<summary>Frees all cached mesh simplifications</summary>
+	void FlexCollisionGeometry::ClearSimplificationCache() {
+		FlexSimplify::ClearCache();
+	}
+
+	///<summary>Caps the memory held by cached mesh simplifications, 256 MB by default. Least recently used ones are freed first.</summary>
+	void FlexCollisionGeometry::SetSimplificationCacheCapacity(long long bytes) {
+		if (bytes < 0)
+			throw gcnew Exception("FlexCollisionGeometry::SetSimplificationCacheCapacity(long long bytes) --->\nInvalid input: bytes must not be negative!");
+		FlexSimplify::SetCapacity(bytes);
+	}
+
+	FlexCacheStatistics FlexCollisionGeometry::GetSimplificationCacheStatistics() {
+		FlexSimplify::Statistics s = FlexSimplify::GetStatistics();
+		FlexCacheStatistics statistics;
+		statistics.Hits = s.Hits;
+		statistics.Misses = s.Misses;
+		statistics.Resident = s.Resident;
+		statistics.ResidentBytes = s.ResidentBytes;
+		statistics.CapacityBytes = s.CapacityBytes;
+		return statistics;
+	}
+
+	///<summary>Adds the convex hull of a point cloud as convex shape. Coplanar hull faces share one plane.</summary>
+	///<param name="points">[x, y, z] per point, at least four points not lying in one plane</param>
+	void FlexCollisionGeometry::AddConvexHull(array<float>^ points) {
+		AddConvexHulls(points, gcnew array<int>(1) { points->Length / 3 });
+	}
+
+	///<summary>Adds one convex shape per point set, the hulls are computed in parallel.</summary>
+	///<param name="points">[x, y, z] per point, all point sets after another</param>
+	///<param name="pointCounts">Number of points per set</param>
+	void FlexCollisionGeometry::AddConvexHulls(array<float>^ points, array<int>^ pointCounts) {
+		long long total = 0;
+		for (int i = 0; i < pointCounts->Length; i++) {
+			if (pointCounts[i] < 4)
+				throw gcnew Exception("FlexCollisionGeometry::AddConvexHulls(...) --->\nInvalid input: point set " + i + " has less than four points!");
+			total += pointCounts[i];
+		}
+		if (points->Length % 3 != 0 || total * 3 != points->Length)
+			throw gcnew Exception("FlexCollisionGeometry::AddConvexHulls(...) --->\nInvalid input: point array length must equal the sum of point counts * 3!");
+		if (pointCounts->Length == 0)
+			return;
+
+		std::vector<FlexConvexHull::Hull> hulls(pointCounts->Length);
+		{
+			pin_ptr<float> pPin = &points[0];
+			pin_ptr<int> cPin = &pointCounts[0];
+			FlexConvexHull::BuildBatch(pPin, cPin, pointCounts->Length, &hulls[0]);
+		}
+
+		for (int i = 0; i < pointCounts->Length; i++)
+			if (!hulls[i].Valid)
+				throw gcnew Exception("FlexCollisionGeometry::AddConvexHulls(...) --->\nInvalid input: the points of set " + i + " are coplanar, they don't enclose a volume!");
+
+		for (int i = 0; i < pointCounts->Length; i++) {
+			array<float>^ planes = gcnew array<float>((int)hulls[i].Planes.size());
+			Marshal::Copy(IntPtr(&hulls[i].Planes[0]), planes, 0, planes->Length);
+			AddConvexShape(planes,
+				gcnew array<float>(3) { hulls[i].Upper[0], hulls[i].Upper[1], hulls[i].Upper[2] },
+				gcnew array<float>(3) { hulls[i].Lower[0], hulls[i].Lower[1], hulls[i].Lower[2] });
+		}
+	}
+
+	///<summary>
+	///Add a closed triangle mesh as signed distance field with 'resolution' samples along each axis. Cheaper to collide with than a dense triangle mesh and doesn't leak particles through thin shells.
+	///The field is voxelized natively when the geometry is handed to the solver and cached, so unchanged meshes are only voxelized once.
+	///</summary>
+	void FlexCollisionGeometry::AddDistanceField(array<float>^ vertices, array<int>^ faces, int resolution) {
+		if (vertices->Length == 0 || vertices->Length % 3 != 0 || faces->Length == 0 || faces->Length % 3 != 0)
+			throw gcnew Exception("FlexCollisionGeometry::AddDistanceField(...) --->\nInvalid input: at least one array is empty or not of length n * 3!");
+		if (resolution < FlexDistanceField::MinDimension)
+			throw gcnew Exception("FlexCollisionGeometry::AddDistanceField(...) --->\nInvalid input: resolution must be at least " + FlexDistanceField::MinDimension + "!");
+		for (int i = 0; i < faces->Length; i++)
+			if (faces[i] < 0 || faces[i] >= vertices->Length / 3)
+				throw gcnew Exception("FlexCollisionGeometry::AddDistanceField(...) --->\nInvalid input: face index " + faces[i] + " out of range!");
+		if (!NumDistanceFields) {
+			DistanceFieldVertices = gcnew List<array<float>^>();
+			DistanceFieldFaces = gcnew List<array<int>^>();
+			DistanceFieldResolutions = gcnew List<int>();
+		}
+
+		DistanceFieldVertices->Add(vertices);
+		DistanceFieldFaces->Add(faces);
+		DistanceFieldResolutions->Add(resolution);
+
+		NumDistanceFields++;
+		TimeStamp = System::DateTime::Now.Minute * 60000 + System::DateTime::Now.Second * 1000 + System::DateTime::Now.Millisecond;
+	}
 }
\ No newline at end of file
@@ -0,0 +1,359 @@
+// FlexConvexHull.cpp
+// Native translation unit (compiled without /clr and without the precompiled header), see FlexConvexHull.h
+#include "FlexConvexHull.h"
+#include "FlexParallel.h"
+#include <math.h>
+#include <float.h>
+#include <stdint.h>
+#include <mutex>
+#include <unordered_map>
+
+namespace FlexConvexHull {
+
+	//point loops only fork for large clouds, below this thread start up costs more than the loop
+	static const int minPointsPerThread = 32768;
+
+#pragma region vector math
+	struct Vec {
+		double x, y, z;
+	};
+
+	static inline Vec Sub(const Vec& a, const Vec& b) { Vec r = { a.x - b.x, a.y - b.y, a.z - b.z }; return r; }
+	static inline Vec Cross(const Vec& a, const Vec& b) { Vec r = { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; return r; }
+	static inline double Dot(const Vec& a, const Vec& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	static inline double Length(const Vec& a) { return sqrt(Dot(a, a)); }
+#pragma endregion
+
+	///Index of the point with the highest score, ties go to the lower index
+	template<typename Score>
+	static int ArgMax(int count, bool parallel, Score score) {
+		int best = -1;
+		double bestScore = -DBL_MAX;
+		std::mutex lock;
+		auto work = [&](int begin, int end) {
+			int b = -1;
+			double s = -DBL_MAX;
+			for (int i = begin; i < end; i++) {
+				double v = score(i);
+				if (v > s) {
+					s = v;
+					b = i;
+				}
+			}
+			std::lock_guard<std::mutex> guard(lock);
+			if (b >= 0 && (s > bestScore || (s == bestScore && b < best))) {
+				bestScore = s;
+				best = b;
+			}
+		};
+		if (parallel)
+			FlexParallel::ParallelFor(count, minPointsPerThread, work);
+		else
+			work(0, count);
+		return best;
+	}
+
+	class Builder {
+	public:
+		Builder(const float* points, int numPoints, bool parallel) : numPoints(numPoints), parallel(parallel) {
+			p.resize(numPoints);
+			for (int i = 0; i < numPoints; i++) {
+				Vec v = { points[i * 3], points[i * 3 + 1], points[i * 3 + 2] };
+				p[i] = v;
+			}
+		}
+
+		Hull Run() {
+			Hull hull;
+			hull.Valid = false;
+			for (int k = 0; k < 3; k++)
+				hull.Lower[k] = hull.Upper[k] = 0.0f;
+			if (numPoints < 4)
+				return hull;
+
+			//extreme points along the axes give the bounds and the first simplex edge
+			int extremes[6];
+			for (int k = 0; k < 3; k++) {
+				extremes[k * 2] = ArgMax(numPoints, parallel, [&](int i) { return -Coordinate(p[i], k); });
+				extremes[k * 2 + 1] = ArgMax(numPoints, parallel, [&](int i) { return Coordinate(p[i], k); });
+				hull.Lower[k] = (float)Coordinate(p[extremes[k * 2]], k);
+				hull.Upper[k] = (float)Coordinate(p[extremes[k * 2 + 1]], k);
+			}
+			Vec diagonal = { (double)hull.Upper[0] - hull.Lower[0], (double)hull.Upper[1] - hull.Lower[1], (double)hull.Upper[2] - hull.Lower[2] };
+			scale = Length(diagonal);
+			//the input is float, planes closer than float precision can't be told apart anyway
+			eps = scale * 1.0e-7;
+
+			if (!InitialSimplex(extremes))
+				return hull;
+			Partition();
+
+			//every face with outside points is visible from its farthest point, so processing it once retires it
+			for (size_t f = 0; f < faces.size(); f++)
+				if (faces[f].Alive && !faces[f].Outside.empty())
+					AddPoint((int)f);
+
+			MergeCoplanar(hull.Planes);
+			hull.Valid = !hull.Planes.empty();
+			return hull;
+		}
+
+	private:
+		struct Face {
+			int V[3];
+			Vec N;					//outward unit normal
+			double D;				//N . x = D on the face
+			std::vector<int> Outside;
+			bool Alive;
+			bool Visible;
+		};
+
+		int numPoints;
+		bool parallel;
+		std::vector<Vec> p;
+		std::vector<Face> faces;
+		std::unordered_map<uint64_t, int> edges;	//directed edge a -> b to the face it belongs to, the neighbor across is edges[b -> a]
+		double scale, eps;
+
+		static inline double Coordinate(const Vec& v, int k) { return k == 0 ? v.x : k == 1 ? v.y : v.z; }
+		static inline uint64_t EdgeKey(int a, int b) { return ((uint64_t)(uint32_t)a << 32) | (uint32_t)b; }
+		inline double Distance(const Face& f, int i) const { return Dot(f.N, p[i]) - f.D; }
+
+		int AddFace(int a, int b, int c) {
+			Face f;
+			f.V[0] = a;
+			f.V[1] = b;
+			f.V[2] = c;
+			Vec n = Cross(Sub(p[b], p[a]), Sub(p[c], p[a]));
+			double length = Length(n);
+			//degenerate slivers keep a zero normal: nothing is ever outside of them and the merge skips them
+			if (length > 0.0) {
+				n.x /= length;
+				n.y /= length;
+				n.z /= length;
+			}
+			f.N = n;
+			f.D = Dot(n, p[a]);
+			f.Alive = true;
+			f.Visible = false;
+			int index = (int)faces.size();
+			faces.push_back(f);
+			edges[EdgeKey(a, b)] = index;
+			edges[EdgeKey(b, c)] = index;
+			edges[EdgeKey(c, a)] = index;
+			return index;
+		}
+
+		bool InitialSimplex(const int* extremes) {
+			//most distant pair of extreme points
+			int i0 = extremes[0], i1 = extremes[1];
+			double longest = -1.0;
+			for (int a = 0; a < 6; a++)
+				for (int b = a + 1; b < 6; b++) {
+					double l = Length(Sub(p[extremes[a]], p[extremes[b]]));
+					if (l > longest) {
+						longest = l;
+						i0 = extremes[a];
+						i1 = extremes[b];
+					}
+				}
+			if (longest <= eps)
+				return false;
+
+			//farthest point from that line
+			Vec axis = Sub(p[i1], p[i0]);
+			int i2 = ArgMax(numPoints, parallel, [&](int i) { return Length(Cross(axis, Sub(p[i], p[i0]))); });
+			Vec normal = Cross(axis, Sub(p[i2], p[i0]));
+			double area = Length(normal);
+			if (area / longest <= eps)
+				return false;
+
+			//farthest point from that plane
+			normal.x /= area;
+			normal.y /= area;
+			normal.z /= area;
+			int i3 = ArgMax(numPoints, parallel, [&](int i) { return fabs(Dot(normal, Sub(p[i], p[i0]))); });
+			double height = Dot(normal, Sub(p[i3], p[i0]));
+			if (fabs(height) <= eps)
+				return false;
+
+			//orient the base away from the apex, then all faces point outwards
+			if (height > 0.0) {
+				int t = i1;
+				i1 = i2;
+				i2 = t;
+			}
+			AddFace(i0, i1, i2);
+			AddFace(i0, i3, i1);
+			AddFace(i1, i3, i2);
+			AddFace(i2, i3, i0);
+			return true;
+		}
+
+		///Assigns every point to the face it is farthest outside of. Points inside the simplex are dropped.
+		void Partition() {
+			std::vector<int> owner(numPoints);
+			auto work = [&](int begin, int end) {
+				for (int i = begin; i < end; i++) {
+					int best = -1;
+					double bestDistance = eps;
+					for (int f = 0; f < 4; f++) {
+						double d = Distance(faces[f], i);
+						if (d > bestDistance) {
+							bestDistance = d;
+							best = f;
+						}
+					}
+					owner[i] = best;
+				}
+			};
+			if (parallel)
+				FlexParallel::ParallelFor(numPoints, minPointsPerThread, work);
+			else
+				work(0, numPoints);
+			for (int i = 0; i < numPoints; i++)
+				if (owner[i] >= 0)
+					faces[owner[i]].Outside.push_back(i);
+		}
+
+		void AddPoint(int start) {
+			//apex: the farthest outside point of the start face
+			std::vector<int>& outside = faces[start].Outside;
+			int apex = outside[0];
+			for (size_t i = 1; i < outside.size(); i++)
+				if (Distance(faces[start], outside[i]) > Distance(faces[start], apex))
+					apex = outside[i];
+
+			//flood the faces visible from the apex, the edges towards faces that are not visible form the horizon
+			std::vector<int> visible(1, start);
+			std::vector<int> horizon;	//pairs a, b, oriented like the visible face they belong to
+			faces[start].Visible = true;
+			for (size_t k = 0; k < visible.size(); k++) {
+				Face& f = faces[visible[k]];
+				for (int e = 0; e < 3; e++) {
+					int a = f.V[e], b = f.V[(e + 1) % 3];
+					int neighbor = edges[EdgeKey(b, a)];
+					if (faces[neighbor].Visible)
+						continue;
+					if (Distance(faces[neighbor], apex) > eps) {
+						faces[neighbor].Visible = true;
+						visible.push_back(neighbor);
+					}
+					else {
+						horizon.push_back(a);
+						horizon.push_back(b);
+					}
+				}
+			}
+
+			//retire the visible faces, their outside points are redistributed onto the new cone
+			std::vector<int> orphans;
+			for (size_t k = 0; k < visible.size(); k++) {
+				Face& f = faces[visible[k]];
+				for (size_t i = 0; i < f.Outside.size(); i++)
+					if (f.Outside[i] != apex)
+						orphans.push_back(f.Outside[i]);
+				std::vector<int>().swap(f.Outside);
+				f.Alive = false;
+				for (int e = 0; e < 3; e++) {
+					std::unordered_map<uint64_t, int>::iterator found = edges.find(EdgeKey(f.V[e], f.V[(e + 1) % 3]));
+					if (found != edges.end() && found->second == visible[k])
+						edges.erase(found);
+				}
+			}
+
+			int firstNew = (int)faces.size();
+			for (size_t h = 0; h < horizon.size(); h += 2)
+				AddFace(horizon[h], horizon[h + 1], apex);
+
+			for (size_t i = 0; i < orphans.size(); i++) {
+				int best = -1;
+				double bestDistance = eps;
+				for (int f = firstNew; f < (int)faces.size(); f++) {
+					double d = Distance(faces[f], orphans[i]);
+					if (d > bestDistance) {
+						bestDistance = d;
+						best = f;
+					}
+				}
+				if (best >= 0)
+					faces[best].Outside.push_back(orphans[i]);
+			}
+		}
+
+		///Floods adjacent faces lying in the same plane and emits one plane per such group.
+		///The group's normal is the area weighted mean, its offset is pushed out to the group's outermost vertex so no point ends up outside.
+		void MergeCoplanar(std::vector<float>& planes) {
+			double cosTolerance = cos(CoplanarAngle);
+			double distanceTolerance = CoplanarDistance * scale;
+			std::vector<char> merged(faces.size(), 0);
+			std::vector<int> group, groupVertices;
+			for (size_t seed = 0; seed < faces.size(); seed++) {
+				if (!faces[seed].Alive || merged[seed] || Dot(faces[seed].N, faces[seed].N) == 0.0)
+					continue;
+				const Face& s = faces[seed];
+				group.assign(1, (int)seed);
+				merged[seed] = 1;
+				Vec sum = { 0.0, 0.0, 0.0 };
+				for (size_t k = 0; k < group.size(); k++) {
+					const Face& f = faces[group[k]];
+					Vec areaNormal = Cross(Sub(p[f.V[1]], p[f.V[0]]), Sub(p[f.V[2]], p[f.V[0]]));
+					sum.x += areaNormal.x;
+					sum.y += areaNormal.y;
+					sum.z += areaNormal.z;
+					for (int e = 0; e < 3; e++) {
+						int neighbor = edges[EdgeKey(f.V[(e + 1) % 3], f.V[e])];
+						const Face& n = faces[neighbor];
+						if (merged[neighbor] || !n.Alive)
+							continue;
+						if (Dot(n.N, s.N) >= cosTolerance && fabs(n.D - s.D) <= distanceTolerance) {
+							merged[neighbor] = 1;
+							group.push_back(neighbor);
+						}
+					}
+				}
+
+				double length = Length(sum);
+				Vec n = s.N;
+				if (length > 0.0) {
+					n.x = sum.x / length;
+					n.y = sum.y / length;
+					n.z = sum.z / length;
+				}
+				double d = -DBL_MAX;
+				for (size_t k = 0; k < group.size(); k++)
+					for (int v = 0; v < 3; v++)
+						d = fmax(d, Dot(n, p[faces[group[k]].V[v]]));
+
+				//inward normal and offset, like a plane built from the face center and the flipped face normal
+				planes.push_back((float)-n.x);
+				planes.push_back((float)-n.y);
+				planes.push_back((float)-n.z);
+				planes.push_back((float)d);
+			}
+		}
+	};
+
+	Hull Build(const float* points, int numPoints) {
+		Builder builder(points, numPoints, true);
+		return builder.Run();
+	}
+
+	void BuildBatch(const float* points, const int* counts, int numHulls, Hull* hulls) {
+		std::vector<long long> offsets(numHulls + 1, 0);
+		for (int i = 0; i < numHulls; i++)
+			offsets[i + 1] = offsets[i] + counts[i];
+
+		//a single hull parallelizes over its points, several hulls over the hulls
+		if (numHulls == 1) {
+			hulls[0] = Build(points, counts[0]);
+			return;
+		}
+		FlexParallel::ParallelFor(numHulls, 1, [&](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				Builder builder(points + offsets[i] * 3, counts[i], false);
+				hulls[i] = builder.Run();
+			}
+		});
+	}
+}
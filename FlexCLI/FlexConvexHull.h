@@ -0,0 +1,29 @@
+// FlexConvexHull.h
+// Native 3D quickhull for convex collision shapes. FlexConvexHull.cpp is compiled without /clr: the extreme point search and
+// the initial point partition of large point sets run multithreaded, batches of hulls are built in parallel.
+// Coplanar hull triangles are merged, so each face of the hull costs exactly one plane.
+#pragma once
+#include <vector>
+
+namespace FlexConvexHull {
+
+	///Hull triangles are merged into one plane, if their normals deviate less than this (radians) ...
+	const double CoplanarAngle = 1.0e-3;
+	///... and their offsets less than this fraction of the point cloud's bounding box diagonal
+	const double CoplanarDistance = 1.0e-5;
+
+	struct Hull {
+		///[A, B, C, D] per hull face in the form FlexCollisionGeometry::AddConvexShape expects: Ax + By + Cz + D = 0 with [A, B, C] the inward unit normal
+		std::vector<float> Planes;
+		float Lower[3];
+		float Upper[3];
+		///False if the points are coplanar, colinear or fewer than four. Planes stay empty then.
+		bool Valid;
+	};
+
+	///Computes the convex hull of 'numPoints' points [x, y, z]
+	Hull Build(const float* points, int numPoints);
+
+	///Computes one hull per point set. Point set i starts after the points of sets 0 to i - 1 and contains 'counts[i]' points.
+	void BuildBatch(const float* points, const int* counts, int numHulls, Hull* hulls);
+}
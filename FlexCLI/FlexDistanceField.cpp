@@ -0,0 +1,312 @@
+// FlexDistanceField.cpp
+// Native translation unit (compiled without /clr and without the precompiled header), see FlexDistanceField.h
+#include "FlexDistanceField.h"
+#include "FlexParallel.h"
+#include <math.h>
+#include <float.h>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+namespace FlexDistanceField {
+
+	struct Vec3 {
+		float x, y, z;
+	};
+
+	static inline Vec3 Load(const float* v, int i) { Vec3 r = { v[3 * i], v[3 * i + 1], v[3 * i + 2] }; return r; }
+	static inline Vec3 Sub(Vec3 a, Vec3 b) { Vec3 r = { a.x - b.x, a.y - b.y, a.z - b.z }; return r; }
+	static inline Vec3 Add(Vec3 a, Vec3 b) { Vec3 r = { a.x + b.x, a.y + b.y, a.z + b.z }; return r; }
+	static inline Vec3 Mul(Vec3 a, float s) { Vec3 r = { a.x * s, a.y * s, a.z * s }; return r; }
+	static inline float Dot(Vec3 a, Vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+	Grid Fit(const float* vertices, int numVertices, int dimension) {
+		Grid grid;
+		grid.Dimension = std::max(dimension, MinDimension);
+		float lower[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+		float upper[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		for (int i = 0; i < numVertices; i++)
+			for (int k = 0; k < 3; k++) {
+				lower[k] = std::min(lower[k], vertices[3 * i + k]);
+				upper[k] = std::max(upper[k], vertices[3 * i + k]);
+			}
+		if (numVertices == 0)
+			for (int k = 0; k < 3; k++)
+				lower[k] = upper[k] = 0.0f;
+		float extent = std::max(std::max(upper[0] - lower[0], upper[1] - lower[1]), std::max(upper[2] - lower[2], 1e-6f));
+		float cell = extent / (grid.Dimension - 4);
+		grid.Size = cell * grid.Dimension;
+		for (int k = 0; k < 3; k++)
+			grid.Lower[k] = 0.5f * (lower[k] + upper[k]) - 0.5f * grid.Size;
+		return grid;
+	}
+
+#pragma region distance
+	//squared distance from p to triangle abc, closest point by voronoi regions (Ericson, Real-Time Collision Detection 5.1.5)
+	static inline float TriangleDistanceSq(Vec3 p, Vec3 a, Vec3 b, Vec3 c) {
+		Vec3 ab = Sub(b, a), ac = Sub(c, a), ap = Sub(p, a);
+		float d1 = Dot(ab, ap), d2 = Dot(ac, ap);
+		Vec3 q;
+		if (d1 <= 0.0f && d2 <= 0.0f)
+			q = a;
+		else {
+			Vec3 bp = Sub(p, b);
+			float d3 = Dot(ab, bp), d4 = Dot(ac, bp);
+			Vec3 cp = Sub(p, c);
+			float d5 = Dot(ab, cp), d6 = Dot(ac, cp);
+			float vc = d1 * d4 - d3 * d2;
+			float vb = d5 * d2 - d1 * d6;
+			float va = d3 * d6 - d5 * d4;
+			if (d3 >= 0.0f && d4 <= d3)
+				q = b;
+			else if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+				q = Add(a, Mul(ab, d1 / (d1 - d3)));
+			else if (d6 >= 0.0f && d5 <= d6)
+				q = c;
+			else if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+				q = Add(a, Mul(ac, d2 / (d2 - d6)));
+			else if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+				q = Add(b, Mul(Sub(c, b), (d4 - d3) / ((d4 - d3) + (d5 - d6))));
+			else {
+				float denom = 1.0f / (va + vb + vc);
+				q = Add(a, Add(Mul(ab, vb * denom), Mul(ac, vc * denom)));
+			}
+		}
+		Vec3 d = Sub(p, q);
+		return Dot(d, d);
+	}
+
+	//first order upwind solution of |grad d| = 1 from the smallest neighbor along each axis
+	static inline float EikonalUpdate(float a, float b, float c, float h) {
+		if (a > b) std::swap(a, b);
+		if (b > c) std::swap(b, c);
+		if (a > b) std::swap(a, b);
+		float u = a + h;
+		if (u <= b)
+			return u;
+		u = 0.5f * (a + b + sqrtf(std::max(2.0f * h * h - (a - b) * (a - b), 0.0f)));
+		if (u <= c)
+			return u;
+		float sum = a + b + c;
+		return (sum + sqrtf(std::max(sum * sum - 3.0f * (a * a + b * b + c * c - h * h), 0.0f))) / 3.0f;
+	}
+
+	//fills all samples not fixed by the narrow band, 8 sweeps cover every direction of characteristics
+	static void FastSweep(float* d, const std::vector<unsigned char>& fixed, int dim, float h) {
+		for (int sweep = 0; sweep < 8; sweep++) {
+			int sx = (sweep & 1) ? -1 : 1, sy = (sweep & 2) ? -1 : 1, sz = (sweep & 4) ? -1 : 1;
+			for (int iz = 0; iz < dim; iz++) {
+				int z = sz > 0 ? iz : dim - 1 - iz;
+				for (int iy = 0; iy < dim; iy++) {
+					int y = sy > 0 ? iy : dim - 1 - iy;
+					for (int ix = 0; ix < dim; ix++) {
+						int x = sx > 0 ? ix : dim - 1 - ix;
+						size_t i = ((size_t)z * dim + y) * dim + x;
+						if (fixed[i])
+							continue;
+						float a = std::min(x > 0 ? d[i - 1] : FLT_MAX, x < dim - 1 ? d[i + 1] : FLT_MAX);
+						float b = std::min(y > 0 ? d[i - dim] : FLT_MAX, y < dim - 1 ? d[i + dim] : FLT_MAX);
+						float c = std::min(z > 0 ? d[i - (size_t)dim * dim] : FLT_MAX, z < dim - 1 ? d[i + (size_t)dim * dim] : FLT_MAX);
+						if (a == FLT_MAX && b == FLT_MAX && c == FLT_MAX)
+							continue;
+						d[i] = std::min(d[i], EikonalUpdate(a, b, c, h));
+					}
+				}
+			}
+		}
+	}
+#pragma endregion
+
+#pragma region sign
+	//true, if the yz projection of the triangle covers (y, z). Ties on edges and vertices are broken by a top-left rule,
+	//so a row through a shared edge or vertex of a closed mesh crosses exactly one of the adjacent triangles.
+	static inline bool EdgeIncludes(double e, double dy, double dz) {
+		return e > 0.0 || (e == 0.0 && (dz < 0.0 || (dz == 0.0 && dy > 0.0)));
+	}
+
+	static bool RowCrossing(Vec3 a, Vec3 b, Vec3 c, double y, double z, float& x) {
+		double area = ((double)b.y - a.y) * ((double)c.z - a.z) - ((double)b.z - a.z) * ((double)c.y - a.y);
+		if (area == 0.0)
+			return false;
+		if (area < 0.0)
+			std::swap(b, c);
+		double w0 = ((double)c.y - b.y) * (z - b.z) - ((double)c.z - b.z) * (y - b.y);
+		double w1 = ((double)a.y - c.y) * (z - c.z) - ((double)a.z - c.z) * (y - c.y);
+		double w2 = ((double)b.y - a.y) * (z - a.z) - ((double)b.z - a.z) * (y - a.y);
+		if (!EdgeIncludes(w0, (double)c.y - b.y, (double)c.z - b.z) ||
+			!EdgeIncludes(w1, (double)a.y - c.y, (double)a.z - c.z) ||
+			!EdgeIncludes(w2, (double)b.y - a.y, (double)b.z - a.z))
+			return false;
+		double sum = w0 + w1 + w2;
+		x = (float)((w0 * a.x + w1 * b.x + w2 * c.x) / sum);
+		return true;
+	}
+#pragma endregion
+
+	//samples within this many cells of the surface get exact distances, the rest is swept
+	static const int band = 2;
+
+	//range of sample indices whose centers lie within [lo - margin, hi + margin], widened by one against rounding
+	static inline void SampleRange(float lo, float hi, float origin, float cell, float margin, int dim, int& first, int& last) {
+		first = std::max((int)ceilf((lo - margin - origin) / cell - 0.5f) - 1, 0);
+		last = std::min((int)floorf((hi + margin - origin) / cell - 0.5f) + 1, dim - 1);
+	}
+
+	void Build(const float* vertices, int numVertices, const int* faces, int numFaces, const Grid& grid, float* field) {
+		const int dim = grid.Dimension;
+		const float cell = grid.Size / dim;
+		const float invSize = 1.0f / grid.Size;
+		const float bandWidth = band * cell;
+		const size_t numSamples = (size_t)dim * dim * dim;
+		std::fill(field, field + numSamples, FLT_MAX);
+		if (numFaces == 0) {
+			std::fill(field, field + numSamples, 1.0f);
+			return;
+		}
+
+		//triangles by the z slices of samples they may reach, once with and once without the band
+		std::vector<Vec3> corners(3 * (size_t)numFaces);
+		std::vector<std::vector<int> > bandSlices(dim), rowSlices(dim);
+		for (int i = 0; i < numFaces; i++) {
+			for (int c = 0; c < 3; c++)
+				corners[3 * i + c] = Load(vertices, faces[3 * i + c]);
+			const Vec3* t = &corners[3 * i];
+			float zMin = std::min(std::min(t[0].z, t[1].z), t[2].z), zMax = std::max(std::max(t[0].z, t[1].z), t[2].z);
+			int first, last;
+			SampleRange(zMin, zMax, grid.Lower[2], cell, bandWidth, dim, first, last);
+			for (int z = first; z <= last; z++)
+				bandSlices[z].push_back(i);
+			SampleRange(zMin, zMax, grid.Lower[2], cell, 0.0f, dim, first, last);
+			for (int z = first; z <= last; z++)
+				rowSlices[z].push_back(i);
+		}
+
+		//exact unsigned distances in the narrow band, one task per range of z slices
+		std::vector<unsigned char> fixed(numSamples, 0);
+		FlexParallel::ParallelFor(dim, 1, [&](int zBegin, int zEnd) {
+			for (int z = zBegin; z < zEnd; z++) {
+				float pz = grid.Lower[2] + (z + 0.5f) * cell;
+				float* slice = field + (size_t)z * dim * dim;
+				for (size_t j = 0; j < bandSlices[z].size(); j++) {
+					const Vec3* t = &corners[3 * bandSlices[z][j]];
+					Vec3 lo = { std::min(std::min(t[0].x, t[1].x), t[2].x), std::min(std::min(t[0].y, t[1].y), t[2].y), std::min(std::min(t[0].z, t[1].z), t[2].z) };
+					Vec3 hi = { std::max(std::max(t[0].x, t[1].x), t[2].x), std::max(std::max(t[0].y, t[1].y), t[2].y), std::max(std::max(t[0].z, t[1].z), t[2].z) };
+					int x0, x1, y0, y1;
+					SampleRange(lo.x, hi.x, grid.Lower[0], cell, bandWidth, dim, x0, x1);
+					SampleRange(lo.y, hi.y, grid.Lower[1], cell, bandWidth, dim, y0, y1);
+					float dz = std::max(std::max(lo.z - pz, pz - hi.z), 0.0f);
+					for (int y = y0; y <= y1; y++) {
+						float* row = slice + (size_t)y * dim;
+						float py = grid.Lower[1] + (y + 0.5f) * cell;
+						float dy = std::max(std::max(lo.y - py, py - hi.y), 0.0f);
+						for (int x = x0; x <= x1; x++) {
+							Vec3 p = { grid.Lower[0] + (x + 0.5f) * cell, py, pz };
+							//the triangle's bounds are a cheap lower bound of its distance
+							float dx = std::max(std::max(lo.x - p.x, p.x - hi.x), 0.0f);
+							if (dx * dx + dy * dy + dz * dz < row[x])
+								row[x] = std::min(row[x], TriangleDistanceSq(p, t[0], t[1], t[2]));
+						}
+					}
+				}
+				for (int i = 0; i < dim * dim; i++) {
+					if (slice[i] <= bandWidth * bandWidth) {
+						slice[i] = sqrtf(slice[i]);
+						fixed[(size_t)z * dim * dim + i] = 1;
+					}
+					else
+						slice[i] = FLT_MAX;
+				}
+			}
+		});
+
+		//everything else from the band outwards
+		FastSweep(field, fixed, dim, cell);
+
+		//signs by crossing parity along each row, every triangle of a slice is rasterized into the rows it covers
+		FlexParallel::ParallelFor(dim, 1, [&](int zBegin, int zEnd) {
+			std::vector<std::vector<float> > crossings(dim);
+			for (int z = zBegin; z < zEnd; z++) {
+				float pz = grid.Lower[2] + (z + 0.5f) * cell;
+				for (int y = 0; y < dim; y++)
+					crossings[y].clear();
+				for (size_t j = 0; j < rowSlices[z].size(); j++) {
+					const Vec3* t = &corners[3 * rowSlices[z][j]];
+					int first, last;
+					SampleRange(std::min(std::min(t[0].y, t[1].y), t[2].y), std::max(std::max(t[0].y, t[1].y), t[2].y), grid.Lower[1], cell, 0.0f, dim, first, last);
+					for (int y = first; y <= last; y++) {
+						float cx;
+						if (RowCrossing(t[0], t[1], t[2], grid.Lower[1] + (y + 0.5f) * cell, pz, cx))
+							crossings[y].push_back(cx);
+					}
+				}
+				for (int y = 0; y < dim; y++) {
+					float* row = field + ((size_t)z * dim + y) * dim;
+					std::sort(crossings[y].begin(), crossings[y].end());
+					size_t passed = 0;
+					for (int x = 0; x < dim; x++) {
+						float px = grid.Lower[0] + (x + 0.5f) * cell;
+						while (passed < crossings[y].size() && crossings[y][passed] < px)
+							passed++;
+						row[x] *= (passed & 1) ? -invSize : invSize;
+					}
+				}
+			}
+		});
+	}
+
+#pragma region benchmark
+	//closed uv sphere with 2 * rings * segments triangles
+	static void Sphere(int rings, int segments, std::vector<float>& vertices, std::vector<int>& faces) {
+		vertices.clear();
+		faces.clear();
+		vertices.push_back(0.0f); vertices.push_back(0.0f); vertices.push_back(-1.0f);
+		for (int r = 1; r < rings; r++) {
+			float theta = 3.14159265f * r / rings;
+			for (int s = 0; s < segments; s++) {
+				float phi = 6.28318531f * s / segments;
+				vertices.push_back(sinf(theta) * cosf(phi));
+				vertices.push_back(sinf(theta) * sinf(phi));
+				vertices.push_back(-cosf(theta));
+			}
+		}
+		vertices.push_back(0.0f); vertices.push_back(0.0f); vertices.push_back(1.0f);
+		int top = (int)vertices.size() / 3 - 1;
+		for (int s = 0; s < segments; s++) {
+			int s1 = (s + 1) % segments;
+			faces.push_back(0); faces.push_back(1 + s1); faces.push_back(1 + s);
+			for (int r = 0; r < rings - 2; r++) {
+				int a = 1 + r * segments + s, b = 1 + r * segments + s1;
+				int c = a + segments, d = b + segments;
+				faces.push_back(a); faces.push_back(b); faces.push_back(d);
+				faces.push_back(a); faces.push_back(d); faces.push_back(c);
+			}
+			int last = 1 + (rings - 2) * segments;
+			faces.push_back(last + s); faces.push_back(last + s1); faces.push_back(top);
+		}
+	}
+
+	int Benchmark(int dimension, BenchmarkResult* results, int maxResults) {
+		static const int sizes[] = { 16, 64, 256, 512 };
+		int numResults = 0;
+		std::vector<float> vertices;
+		std::vector<int> faces;
+		for (int i = 0; i < 4 && numResults < maxResults; i++) {
+			Sphere(sizes[i], 2 * sizes[i], vertices, faces);
+			int numFaces = (int)faces.size() / 3;
+			Grid grid = Fit(&vertices[0], (int)vertices.size() / 3, dimension);
+			std::vector<float> field((size_t)grid.Dimension * grid.Dimension * grid.Dimension);
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			Build(&vertices[0], (int)vertices.size() / 3, &faces[0], numFaces, grid, &field[0]);
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			BenchmarkResult& r = results[numResults++];
+			r.Triangles = numFaces;
+			r.Dimension = grid.Dimension;
+			r.Milliseconds = ms;
+			r.SamplesPerSecond = ms > 0.0 ? field.size() / (ms * 0.001) : 0.0;
+		}
+		return numResults;
+	}
+#pragma endregion
+}
@@ -0,0 +1,37 @@
+// FlexDistanceField.h
+// Native mesh to signed distance field voxelizer for SDF collision shapes. FlexDistanceField.cpp is compiled without /clr
+// and runs multithreaded: exact distances in a narrow band around the surface, fast sweeping for the rest of the grid
+// and signs from ray parity along the grid rows.
+#pragma once
+
+namespace FlexDistanceField {
+
+	///Placement of a distance field grid. NvFlex maps the grid onto the unit cube, the shape scales it by 'Size' and moves it to 'Lower'.
+	struct Grid {
+		int Dimension;		//samples per axis, the grid is cubic
+		float Lower[3];		//corner of the grid in mesh space
+		float Size;			//edge length of the grid in mesh space
+	};
+
+	///Smallest supported dimension, two samples of padding on each side need room
+	const int MinDimension = 8;
+
+	///Computes the grid placement for a mesh: a cube around the mesh bounds with two samples of padding on each side
+	Grid Fit(const float* vertices, int numVertices, int dimension);
+
+	///Writes dimension^3 signed distances into 'field', x fastest, sample centers at Lower + (i + 0.5) * Size / Dimension.
+	///Distances are divided by grid.Size, as NvFlex expects them relative to the unit cube. Negative inside.
+	///Samples within two cells of the surface are exact, farther ones are first order approximations.
+	///The mesh should be closed, for open meshes the inside is decided by ray parity and may be wrong.
+	void Build(const float* vertices, int numVertices, const int* faces, int numFaces, const Grid& grid, float* field);
+
+	struct BenchmarkResult {
+		int Triangles;
+		int Dimension;
+		double Milliseconds;
+		double SamplesPerSecond;
+	};
+
+	///Voxelizes spheres of increasing triangle count at the given dimension. Returns the number of results written.
+	int Benchmark(int dimension, BenchmarkResult* results, int maxResults);
+}
@@ -0,0 +1,493 @@
+// FlexKernels.cpp
+// Native translation unit (compiled without /clr and without the precompiled header), see FlexKernels.h
+#include "FlexKernels.h"
+#include <intrin.h>
+#include <immintrin.h>
+#include <string.h>
+#include <vector>
+
+namespace FlexKernels {
+
+#pragma region dispatch
+	static int activeSet = -1;
+
+	InstructionSet SupportedInstructionSet() {
+		int info[4];
+		__cpuid(info, 0);
+		int maxLeaf = info[0];
+		__cpuid(info, 1);
+		bool sse2 = (info[3] & (1 << 26)) != 0;
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		if (!sse2)
+			return Scalar;
+		//AVX2 needs the CPU flag and the OS saving the ymm registers on context switches
+		if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6) {
+			__cpuidex(info, 7, 0);
+			if (info[1] & (1 << 5))
+				return AVX2;
+		}
+		return SSE;
+	}
+
+	InstructionSet ActiveInstructionSet() {
+		if (activeSet < 0)
+			activeSet = SupportedInstructionSet();
+		return (InstructionSet)activeSet;
+	}
+
+	void SetInstructionSet(InstructionSet set) {
+		InstructionSet supported = SupportedInstructionSet();
+		activeSet = set > supported ? supported : set;
+	}
+
+	const char* InstructionSetName(InstructionSet set) {
+		switch (set) {
+		case AVX2: return "AVX2";
+		case SSE: return "SSE";
+		default: return "Scalar";
+		}
+	}
+#pragma endregion
+
+#pragma region scalar
+	static void ScalePack3To4Scalar(float* dst4, const float* src3, const float* w, float wValue, float scale, int begin, int count) {
+		for (int i = begin; i < count; i++) {
+			dst4[i * 4] = src3[i * 3] * scale;
+			dst4[i * 4 + 1] = src3[i * 3 + 1] * scale;
+			dst4[i * 4 + 2] = src3[i * 3 + 2] * scale;
+			dst4[i * 4 + 3] = w ? w[i] : wValue;
+		}
+	}
+
+	static void ScaleUnpack4To3Scalar(float* dst3, const float* src4, float scale, int begin, int count) {
+		for (int i = begin; i < count; i++) {
+			dst3[i * 3] = src4[i * 4] * scale;
+			dst3[i * 3 + 1] = src4[i * 4 + 1] * scale;
+			dst3[i * 3 + 2] = src4[i * 4 + 2] * scale;
+		}
+	}
+
+	static void ScaleScalar(float* dst, const float* src, float scale, int begin, int count) {
+		for (int i = begin; i < count; i++)
+			dst[i] = src[i] * scale;
+	}
+
+	static void PackRecordsScalar(float* particles4, float* velocities3, int* phases, const ParticleRecord* src, float scale, int begin, int count) {
+		for (int i = begin; i < count; i++) {
+			particles4[i * 4] = src[i].PositionX * scale;
+			particles4[i * 4 + 1] = src[i].PositionY * scale;
+			particles4[i * 4 + 2] = src[i].PositionZ * scale;
+			particles4[i * 4 + 3] = src[i].InverseMass;
+			velocities3[i * 3] = src[i].VelocityX * scale;
+			velocities3[i * 3 + 1] = src[i].VelocityY * scale;
+			velocities3[i * 3 + 2] = src[i].VelocityZ * scale;
+			phases[i] = src[i].Phase;
+		}
+	}
+
+	static void UnpackRecordsScalar(ParticleRecord* dst, const float* particles4, const float* velocities3, const int* phases, float scale, int begin, int count) {
+		for (int i = begin; i < count; i++) {
+			if (particles4) {
+				dst[i].PositionX = particles4[i * 4] * scale;
+				dst[i].PositionY = particles4[i * 4 + 1] * scale;
+				dst[i].PositionZ = particles4[i * 4 + 2] * scale;
+				dst[i].InverseMass = particles4[i * 4 + 3];
+			}
+			if (velocities3) {
+				dst[i].VelocityX = velocities3[i * 3] * scale;
+				dst[i].VelocityY = velocities3[i * 3 + 1] * scale;
+				dst[i].VelocityZ = velocities3[i * 3 + 2] * scale;
+			}
+			if (phases)
+				dst[i].Phase = phases[i];
+		}
+	}
+
+	static void Bounds3Scalar(const float* src3, int begin, int count, float* lower, float* upper) {
+		for (int i = begin; i < count; i++)
+			for (int k = 0; k < 3; k++) {
+				float v = src3[i * 3 + k];
+				lower[k] = v < lower[k] ? v : lower[k];
+				upper[k] = v > upper[k] ? v : upper[k];
+			}
+	}
+
+	static int FirstInvalidParticleScalar(const float* inverseMasses, const int* phases, int begin, int count) {
+		for (int i = begin; i < count; i++)
+			if (inverseMasses[i] < 0.0f || phases[i] < 0)
+				return i;
+		return -1;
+	}
+#pragma endregion
+
+#pragma region SSE
+	///Replaces lane 3 of v by lane 3 of w
+	static inline __m128 InsertW(__m128 v, __m128 w) {
+		__m128 hi = _mm_unpackhi_ps(v, w);	//[z, w, ?, w]
+		return _mm_shuffle_ps(v, hi, _MM_SHUFFLE(1, 0, 1, 0));
+	}
+
+	static void ScalePack3To4SSE(float* dst4, const float* src3, const float* w, float wValue, float scale, int count) {
+		__m128 s = _mm_set1_ps(scale);
+		__m128 wc = _mm_set1_ps(wValue);
+		int i = 0;
+		//every load reads one float past its particle, so the last group is left to the scalar tail
+		for (; i + 4 < count; i += 4) {
+			const float* p = src3 + i * 3;
+			float* d = dst4 + i * 4;
+			__m128 wq = w ? _mm_loadu_ps(w + i) : wc;
+			_mm_storeu_ps(d, InsertW(_mm_mul_ps(_mm_loadu_ps(p), s), _mm_shuffle_ps(wq, wq, _MM_SHUFFLE(0, 0, 0, 0))));
+			_mm_storeu_ps(d + 4, InsertW(_mm_mul_ps(_mm_loadu_ps(p + 3), s), _mm_shuffle_ps(wq, wq, _MM_SHUFFLE(1, 1, 1, 1))));
+			_mm_storeu_ps(d + 8, InsertW(_mm_mul_ps(_mm_loadu_ps(p + 6), s), _mm_shuffle_ps(wq, wq, _MM_SHUFFLE(2, 2, 2, 2))));
+			_mm_storeu_ps(d + 12, InsertW(_mm_mul_ps(_mm_loadu_ps(p + 9), s), _mm_shuffle_ps(wq, wq, _MM_SHUFFLE(3, 3, 3, 3))));
+		}
+		ScalePack3To4Scalar(dst4, src3, w, wValue, scale, i, count);
+	}
+
+	static void ScaleUnpack4To3SSE(float* dst3, const float* src4, float scale, int count) {
+		__m128 s = _mm_set1_ps(scale);
+		int i = 0;
+		//overlapping stores: each one writes a garbage w, which is overwritten by the next store
+		for (; i + 4 < count; i += 4) {
+			const float* p = src4 + i * 4;
+			float* d = dst3 + i * 3;
+			_mm_storeu_ps(d, _mm_mul_ps(_mm_loadu_ps(p), s));
+			_mm_storeu_ps(d + 3, _mm_mul_ps(_mm_loadu_ps(p + 4), s));
+			_mm_storeu_ps(d + 6, _mm_mul_ps(_mm_loadu_ps(p + 8), s));
+			_mm_storeu_ps(d + 9, _mm_mul_ps(_mm_loadu_ps(p + 12), s));
+		}
+		ScaleUnpack4To3Scalar(dst3, src4, scale, i, count);
+	}
+
+	static void ScaleSSE(float* dst, const float* src, float scale, int count) {
+		__m128 s = _mm_set1_ps(scale);
+		int i = 0;
+		for (; i + 8 <= count; i += 8) {
+			_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_loadu_ps(src + i), s));
+			_mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_loadu_ps(src + i + 4), s));
+		}
+		ScaleScalar(dst, src, scale, i, count);
+	}
+
+	//Records are 32 bytes: one aligned quad [x y z 1/m] and one quad [vx vy vz phase]
+	static void PackRecordsSSE(float* particles4, float* velocities3, int* phases, const ParticleRecord* src, float scale, int count) {
+		__m128 s = _mm_setr_ps(scale, scale, scale, 1.0f);
+		__m128 sv = _mm_set1_ps(scale);
+		int i = 0;
+		//the velocity store writes one float into the next particle, so the last particle is left to the scalar tail
+		for (; i + 1 < count; i++) {
+			const float* r = &src[i].PositionX;
+			_mm_storeu_ps(particles4 + i * 4, _mm_mul_ps(_mm_loadu_ps(r), s));
+			_mm_storeu_ps(velocities3 + i * 3, _mm_mul_ps(_mm_loadu_ps(r + 4), sv));
+			phases[i] = src[i].Phase;
+		}
+		PackRecordsScalar(particles4, velocities3, phases, src, scale, i, count);
+	}
+
+	static void UnpackRecordsSSE(ParticleRecord* dst, const float* particles4, const float* velocities3, const int* phases, float scale, int count) {
+		__m128 s = _mm_setr_ps(scale, scale, scale, 1.0f);
+		__m128 sv = _mm_set1_ps(scale);
+		int i = 0;
+		//the velocity load reads one float of the next particle, so the last particle is left to the scalar tail
+		for (; i + 1 < count; i++) {
+			float* r = &dst[i].PositionX;
+			if (particles4)
+				_mm_storeu_ps(r, _mm_mul_ps(_mm_loadu_ps(particles4 + i * 4), s));
+			if (velocities3) {
+				//the store clobbers the phase, restore it right after
+				int phase = phases ? phases[i] : dst[i].Phase;
+				_mm_storeu_ps(r + 4, _mm_mul_ps(_mm_loadu_ps(velocities3 + i * 3), sv));
+				dst[i].Phase = phase;
+			}
+			else if (phases)
+				dst[i].Phase = phases[i];
+		}
+		UnpackRecordsScalar(dst, particles4, velocities3, phases, scale, i, count);
+	}
+
+	//Four points are three quads. Lanes keep their component from quad to quad, lane j of quad k holds component (4k + j) % 3.
+	static void Bounds3SSE(const float* src3, int count, float* lower, float* upper) {
+		__m128 lo[3], hi[3];
+		for (int k = 0; k < 3; k++) {
+			lo[k] = _mm_setr_ps(lower[(4 * k) % 3], lower[(4 * k + 1) % 3], lower[(4 * k + 2) % 3], lower[(4 * k + 3) % 3]);
+			hi[k] = _mm_setr_ps(upper[(4 * k) % 3], upper[(4 * k + 1) % 3], upper[(4 * k + 2) % 3], upper[(4 * k + 3) % 3]);
+		}
+		int i = 0;
+		for (; i + 4 <= count; i += 4)
+			for (int k = 0; k < 3; k++) {
+				__m128 v = _mm_loadu_ps(src3 + i * 3 + k * 4);
+				lo[k] = _mm_min_ps(lo[k], v);
+				hi[k] = _mm_max_ps(hi[k], v);
+			}
+		float l[12], u[12];
+		for (int k = 0; k < 3; k++) {
+			_mm_storeu_ps(l + k * 4, lo[k]);
+			_mm_storeu_ps(u + k * 4, hi[k]);
+		}
+		for (int j = 0; j < 12; j++) {
+			lower[j % 3] = l[j] < lower[j % 3] ? l[j] : lower[j % 3];
+			upper[j % 3] = u[j] > upper[j % 3] ? u[j] : upper[j % 3];
+		}
+		Bounds3Scalar(src3, i, count, lower, upper);
+	}
+
+	static int FirstInvalidParticleSSE(const float* inverseMasses, const int* phases, int count) {
+		__m128 zero = _mm_setzero_ps();
+		__m128i zeroi = _mm_setzero_si128();
+		__m128 invalid = zero;
+		int i = 0;
+		for (; i + 4 <= count; i += 4) {
+			invalid = _mm_or_ps(invalid, _mm_cmplt_ps(_mm_loadu_ps(inverseMasses + i), zero));
+			invalid = _mm_or_ps(invalid, _mm_castsi128_ps(_mm_cmplt_epi32(_mm_loadu_si128((const __m128i*)(phases + i)), zeroi)));
+		}
+		if (_mm_movemask_ps(invalid))
+			return FirstInvalidParticleScalar(inverseMasses, phases, 0, i);
+		return FirstInvalidParticleScalar(inverseMasses, phases, i, count);
+	}
+#pragma endregion
+
+#pragma region AVX2
+	static void ScalePack3To4AVX2(float* dst4, const float* src3, const float* w, float wValue, float scale, int count) {
+		__m256 s = _mm256_set1_ps(scale);
+		__m256 wc = _mm256_set1_ps(wValue);
+		//[x0 y0 z0 x1 y1 z1 x2 y2] -> [x0 y0 z0 _ x1 y1 z1 _]
+		__m256i spread = _mm256_setr_epi32(0, 1, 2, 2, 3, 4, 5, 5);
+		__m256i w01 = _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1);
+		__m256i w23 = _mm256_setr_epi32(2, 2, 2, 2, 3, 3, 3, 3);
+		__m256i w45 = _mm256_setr_epi32(4, 4, 4, 4, 5, 5, 5, 5);
+		__m256i w67 = _mm256_setr_epi32(6, 6, 6, 6, 7, 7, 7, 7);
+		int i = 0;
+		//the last load reads two floats past the group, so the last group is left to the scalar tail
+		for (; i + 8 < count; i += 8) {
+			const float* p = src3 + i * 3;
+			float* d = dst4 + i * 4;
+			__m256 wq = w ? _mm256_loadu_ps(w + i) : wc;
+			__m256 v0 = _mm256_mul_ps(_mm256_permutevar8x32_ps(_mm256_loadu_ps(p), spread), s);
+			__m256 v1 = _mm256_mul_ps(_mm256_permutevar8x32_ps(_mm256_loadu_ps(p + 6), spread), s);
+			__m256 v2 = _mm256_mul_ps(_mm256_permutevar8x32_ps(_mm256_loadu_ps(p + 12), spread), s);
+			__m256 v3 = _mm256_mul_ps(_mm256_permutevar8x32_ps(_mm256_loadu_ps(p + 18), spread), s);
+			_mm256_storeu_ps(d, _mm256_blend_ps(v0, _mm256_permutevar8x32_ps(wq, w01), 0x88));
+			_mm256_storeu_ps(d + 8, _mm256_blend_ps(v1, _mm256_permutevar8x32_ps(wq, w23), 0x88));
+			_mm256_storeu_ps(d + 16, _mm256_blend_ps(v2, _mm256_permutevar8x32_ps(wq, w45), 0x88));
+			_mm256_storeu_ps(d + 24, _mm256_blend_ps(v3, _mm256_permutevar8x32_ps(wq, w67), 0x88));
+		}
+		_mm256_zeroupper();
+		ScalePack3To4Scalar(dst4, src3, w, wValue, scale, i, count);
+	}
+
+	static void ScaleUnpack4To3AVX2(float* dst3, const float* src4, float scale, int count) {
+		__m256 s = _mm256_set1_ps(scale);
+		//[x0 y0 z0 w0 x1 y1 z1 w1] -> [x0 y0 z0 x1 y1 z1 _ _]
+		__m256i pack = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+		int i = 0;
+		//overlapping stores: each one writes two garbage floats, which are overwritten by the next store
+		for (; i + 8 < count; i += 8) {
+			const float* p = src4 + i * 4;
+			float* d = dst3 + i * 3;
+			_mm256_storeu_ps(d, _mm256_permutevar8x32_ps(_mm256_mul_ps(_mm256_loadu_ps(p), s), pack));
+			_mm256_storeu_ps(d + 6, _mm256_permutevar8x32_ps(_mm256_mul_ps(_mm256_loadu_ps(p + 8), s), pack));
+			_mm256_storeu_ps(d + 12, _mm256_permutevar8x32_ps(_mm256_mul_ps(_mm256_loadu_ps(p + 16), s), pack));
+			_mm256_storeu_ps(d + 18, _mm256_permutevar8x32_ps(_mm256_mul_ps(_mm256_loadu_ps(p + 24), s), pack));
+		}
+		_mm256_zeroupper();
+		ScaleUnpack4To3Scalar(dst3, src4, scale, i, count);
+	}
+
+	//Eight points are three octets, lane j of octet k holds component (8k + j) % 3
+	static void Bounds3AVX2(const float* src3, int count, float* lower, float* upper) {
+		__m256 lo[3], hi[3];
+		for (int k = 0; k < 3; k++) {
+			float l[8], u[8];
+			for (int j = 0; j < 8; j++) {
+				l[j] = lower[(8 * k + j) % 3];
+				u[j] = upper[(8 * k + j) % 3];
+			}
+			lo[k] = _mm256_loadu_ps(l);
+			hi[k] = _mm256_loadu_ps(u);
+		}
+		int i = 0;
+		for (; i + 8 <= count; i += 8)
+			for (int k = 0; k < 3; k++) {
+				__m256 v = _mm256_loadu_ps(src3 + i * 3 + k * 8);
+				lo[k] = _mm256_min_ps(lo[k], v);
+				hi[k] = _mm256_max_ps(hi[k], v);
+			}
+		float l[24], u[24];
+		for (int k = 0; k < 3; k++) {
+			_mm256_storeu_ps(l + k * 8, lo[k]);
+			_mm256_storeu_ps(u + k * 8, hi[k]);
+		}
+		_mm256_zeroupper();
+		for (int j = 0; j < 24; j++) {
+			lower[j % 3] = l[j] < lower[j % 3] ? l[j] : lower[j % 3];
+			upper[j % 3] = u[j] > upper[j % 3] ? u[j] : upper[j % 3];
+		}
+		Bounds3Scalar(src3, i, count, lower, upper);
+	}
+
+	static void ScaleAVX2(float* dst, const float* src, float scale, int count) {
+		__m256 s = _mm256_set1_ps(scale);
+		int i = 0;
+		for (; i + 16 <= count; i += 16) {
+			_mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_loadu_ps(src + i), s));
+			_mm256_storeu_ps(dst + i + 8, _mm256_mul_ps(_mm256_loadu_ps(src + i + 8), s));
+		}
+		_mm256_zeroupper();
+		ScaleScalar(dst, src, scale, i, count);
+	}
+#pragma endregion
+
+	void ScalePack3To4(float* dst4, const float* src3, const float* w, float wValue, float scale, int count) {
+		switch (ActiveInstructionSet()) {
+		case AVX2: ScalePack3To4AVX2(dst4, src3, w, wValue, scale, count); break;
+		case SSE: ScalePack3To4SSE(dst4, src3, w, wValue, scale, count); break;
+		default: ScalePack3To4Scalar(dst4, src3, w, wValue, scale, 0, count); break;
+		}
+	}
+
+	void ScaleUnpack4To3(float* dst3, float* w, const float* src4, float scale, int count) {
+		switch (ActiveInstructionSet()) {
+		case AVX2: ScaleUnpack4To3AVX2(dst3, src4, scale, count); break;
+		case SSE: ScaleUnpack4To3SSE(dst3, src4, scale, count); break;
+		default: ScaleUnpack4To3Scalar(dst3, src4, scale, 0, count); break;
+		}
+		if (w)
+			for (int i = 0; i < count; i++)
+				w[i] = src4[i * 4 + 3];
+	}
+
+	void Scale(float* dst, const float* src, float scale, int count) {
+		if (scale == 1.0f) {
+			if (dst != src)
+				memcpy(dst, src, sizeof(float) * count);
+			return;
+		}
+		switch (ActiveInstructionSet()) {
+		case AVX2: ScaleAVX2(dst, src, scale, count); break;
+		case SSE: ScaleSSE(dst, src, scale, count); break;
+		default: ScaleScalar(dst, src, scale, 0, count); break;
+		}
+	}
+
+	void NegateScale(float* dst, const float* src, float scale, int count) {
+		switch (ActiveInstructionSet()) {
+		case AVX2: ScaleAVX2(dst, src, -scale, count); break;
+		case SSE: ScaleSSE(dst, src, -scale, count); break;
+		default: ScaleScalar(dst, src, -scale, 0, count); break;
+		}
+	}
+
+	void Bounds3(const float* src3, int count, float* lower, float* upper) {
+		for (int k = 0; k < 3; k++) {
+			lower[k] = count > 0 ? src3[k] : 0.0f;
+			upper[k] = lower[k];
+		}
+		switch (ActiveInstructionSet()) {
+		case AVX2: Bounds3AVX2(src3, count, lower, upper); break;
+		case SSE: Bounds3SSE(src3, count, lower, upper); break;
+		default: Bounds3Scalar(src3, 0, count, lower, upper); break;
+		}
+	}
+
+	int FirstInvalidParticle(const float* inverseMasses, const int* phases, int count) {
+		if (ActiveInstructionSet() == Scalar)
+			return FirstInvalidParticleScalar(inverseMasses, phases, 0, count);
+		return FirstInvalidParticleSSE(inverseMasses, phases, count);
+	}
+
+	//There is no dedicated AVX2 version of the record kernels, a record is exactly two SSE quads
+	void PackRecords(float* particles4, float* velocities3, int* phases, const ParticleRecord* src, float scale, int count) {
+		if (ActiveInstructionSet() == Scalar)
+			PackRecordsScalar(particles4, velocities3, phases, src, scale, 0, count);
+		else
+			PackRecordsSSE(particles4, velocities3, phases, src, scale, count);
+	}
+
+	void UnpackRecords(ParticleRecord* dst, const float* particles4, const float* velocities3, const int* phases, float scale, int count) {
+		if (ActiveInstructionSet() == Scalar)
+			UnpackRecordsScalar(dst, particles4, velocities3, phases, scale, 0, count);
+		else
+			UnpackRecordsSSE(dst, particles4, velocities3, phases, scale, count);
+	}
+
+	int FirstInvalidRecord(const ParticleRecord* src, int count) {
+		for (int i = 0; i < count; i++)
+			if (src[i].InverseMass < 0.0f || src[i].Phase < 0)
+				return i;
+		return -1;
+	}
+
+	int CompactActive(int* dst, const bool* active, int count) {
+		int nActive = 0;
+		for (int i = 0; i < count; i++) {
+			dst[nActive] = i;
+			nActive += active ? (int)active[i] : 1;
+		}
+		return nActive;
+	}
+
+	static inline unsigned long long HashMix(unsigned long long h, unsigned long long word) {
+		h ^= word * 0x9E3779B97F4A7C15ull;
+		h = (h << 27) | (h >> 37);
+		return h * 0xFF51AFD7ED558CCDull + 0xC4CEB9FE1A85EC53ull;
+	}
+
+	unsigned long long HashBytes(unsigned long long seed, const void* data, long long size) {
+		const unsigned char* bytes = (const unsigned char*)data;
+		unsigned long long h = seed;
+		long long i = 0;
+		for (; i + 8 <= size; i += 8) {
+			unsigned long long word;
+			memcpy(&word, bytes + i, 8);
+			h = HashMix(h, word);
+		}
+		unsigned long long tail = 0;
+		if (i < size)
+			memcpy(&tail, bytes + i, (size_t)(size - i));
+		return HashMix(HashMix(h, tail), (unsigned long long)size);
+	}
+
+#pragma region benchmark
+	int Benchmark(int count, int repetitions, BenchmarkResult* results, int maxResults) {
+		if (count < 1 || repetitions < 1)
+			return 0;
+
+		std::vector<float> src3(count * 3, 1.0f);
+		std::vector<float> src4(count * 4, 1.0f);
+		std::vector<float> w(count, 1.0f);
+		std::vector<float> dst3(count * 3);
+		std::vector<float> dst4(count * 4);
+
+		int previous = ActiveInstructionSet();
+		int supported = SupportedInstructionSet();
+		int numResults = 0;
+
+		for (int set = Scalar; set <= supported; set++) {
+			SetInstructionSet((InstructionSet)set);
+			for (int kernel = 0; kernel < 3 && numResults < maxResults; kernel++) {
+				unsigned __int64 start = __rdtsc();
+				for (int r = 0; r < repetitions; r++) {
+					if (kernel == 0)
+						ScalePack3To4(&dst4[0], &src3[0], &w[0], 0.0f, 0.5f, count);
+					else if (kernel == 1)
+						ScaleUnpack4To3(&dst3[0], NULL, &src4[0], 0.5f, count);
+					else
+						NegateScale(&dst3[0], &src3[0], 0.5f, count * 3);
+				}
+				unsigned __int64 cycles = __rdtsc() - start;
+
+				//bytes read plus bytes written per call
+				double bytes = kernel == 0 ? count * 16.0 + count * 16.0 : kernel == 1 ? count * 16.0 + count * 12.0 : count * 24.0;
+				results[numResults].Kernel = kernel == 0 ? "ScalePack3To4" : kernel == 1 ? "ScaleUnpack4To3" : "NegateScale";
+				results[numResults].Set = (InstructionSet)set;
+				results[numResults].BytesPerCycle = cycles ? bytes * repetitions / (double)cycles : 0.0;
+				numResults++;
+			}
+		}
+
+		activeSet = previous;
+		return numResults;
+	}
+#pragma endregion
+}
@@ -0,0 +1,63 @@
+// FlexKernels.h
+// Native conversion kernels used by all upload and readback paths. FlexKernels.cpp is compiled without /clr,
+// every kernel has a scalar, an SSE and an AVX2 implementation. The fastest one supported by the CPU is picked at runtime.
+#pragma once
+
+namespace FlexKernels {
+
+	enum InstructionSet {
+		Scalar = 0,
+		SSE = 1,
+		AVX2 = 2
+	};
+
+	///Best instruction set supported by this CPU and OS
+	InstructionSet SupportedInstructionSet();
+	///Instruction set currently used by the kernels
+	InstructionSet ActiveInstructionSet();
+	///Force the kernels to a specific instruction set. Requests above the supported set are clamped.
+	void SetInstructionSet(InstructionSet set);
+	const char* InstructionSetName(InstructionSet set);
+
+	///dst4[i] = { src3[i].xyz * scale, w ? w[i] : wValue }
+	void ScalePack3To4(float* dst4, const float* src3, const float* w, float wValue, float scale, int count);
+	///dst3[i] = src4[i].xyz * scale, w[i] = src4[i].w if w is not NULL
+	void ScaleUnpack4To3(float* dst3, float* w, const float* src4, float scale, int count);
+	///dst[i] = src[i] * scale for 'count' floats
+	void Scale(float* dst, const float* src, float scale, int count);
+	///dst[i] = -src[i] * scale for 'count' floats, used for collision mesh vertices
+	void NegateScale(float* dst, const float* src, float scale, int count);
+	///Component-wise min and max of 'count' points [x, y, z]. Both are zero for count == 0.
+	void Bounds3(const float* src3, int count, float* lower, float* upper);
+
+	///Particle record as stored by FlexScene, same layout as FlexCLI::FlexParticleData. The first 16 bytes match an NvFlex particle.
+	struct ParticleRecord {
+		float PositionX, PositionY, PositionZ, InverseMass;
+		float VelocityX, VelocityY, VelocityZ;
+		int Phase;
+	};
+
+	///particles4[i] = { src[i].position * scale, src[i].InverseMass }, velocities3[i] = src[i].velocity * scale, phases[i] = src[i].Phase
+	void PackRecords(float* particles4, float* velocities3, int* phases, const ParticleRecord* src, float scale, int count);
+	///Inverse of PackRecords. Any source can be NULL, the corresponding fields of dst are left untouched then.
+	void UnpackRecords(ParticleRecord* dst, const float* particles4, const float* velocities3, const int* phases, float scale, int count);
+	///Returns the index of the first record with a negative inverse mass or phase, -1 if all records are valid
+	int FirstInvalidRecord(const ParticleRecord* src, int count);
+
+	///Returns the index of the first particle with a negative inverse mass or phase, -1 if all particles are valid
+	int FirstInvalidParticle(const float* inverseMasses, const int* phases, int count);
+	///Writes the indices of all active particles and returns their number. If 'active' is NULL, all particles are active.
+	int CompactActive(int* dst, const bool* active, int count);
+
+	///64 bit content hash of 'size' bytes, chained through 'seed'. Used as key by the asset and collision mesh caches.
+	unsigned long long HashBytes(unsigned long long seed, const void* data, long long size);
+
+	struct BenchmarkResult {
+		const char* Kernel;
+		InstructionSet Set;
+		double BytesPerCycle;
+	};
+
+	///Runs every kernel on every supported instruction set. Returns the number of results written.
+	int Benchmark(int count, int repetitions, BenchmarkResult* results, int maxResults);
+}
@@ -0,0 +1,47 @@
+// FlexParallel.h
+// Minimal fork/join helpers for the native translation units. Only include this from files compiled without /clr,
+// managed code can't use <thread>.
+#pragma once
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+
+namespace FlexParallel {
+
+	///Number of threads ParallelFor uses at most
+	inline int MaxThreads() {
+		return std::max((int)std::thread::hardware_concurrency(), 1);
+	}
+
+	///Splits [0, count) into chunks and runs 'work(begin, end)' on each, on the calling thread for small counts
+	template<typename Work>
+	void ParallelFor(int count, int minPerThread, Work work) {
+		int numThreads = std::min(MaxThreads(), std::max(count / std::max(minPerThread, 1), 1));
+		if (numThreads <= 1) {
+			work(0, count);
+			return;
+		}
+		std::vector<std::thread> threads;
+		int chunk = (count + numThreads - 1) / numThreads;
+		for (int t = 1; t < numThreads; t++) {
+			int begin = t * chunk;
+			int end = std::min(count, begin + chunk);
+			if (begin < end)
+				threads.push_back(std::thread(work, begin, end));
+		}
+		work(0, std::min(count, chunk));
+		for (size_t t = 0; t < threads.size(); t++)
+			threads[t].join();
+	}
+
+	///Runs 'work(i)' for every i in [0, count). Each worker pulls the next index when done with its last, so items of uneven cost balance out.
+	template<typename Work>
+	void ForEach(int count, Work work) {
+		std::atomic<int> next(0);
+		ParallelFor(std::min(count, MaxThreads()), 1, [&](int, int) {
+			for (int i = next++; i < count; i = next++)
+				work(i);
+		});
+	}
+}
@@ -45,6 +45,35 @@ namespace FlexCLI {
 		}
 	}
 
+	///<summary>Wraps a pooled particle record. No validation, records are validated when they are registered.</summary>
+	FlexParticle::FlexParticle(FlexParticleData data) {
+		PositionX = data.PositionX;
+		PositionY = data.PositionY;
+		PositionZ = data.PositionZ;
+		VelocityX = data.VelocityX;
+		VelocityY = data.VelocityY;
+		VelocityZ = data.VelocityZ;
+		InverseMass = data.InverseMass;
+		Phase = data.Phase;
+		GroupIndex = data.GroupIndex;
+		SelfCollision = data.SelfCollision;
+		IsFluid = data.IsFluid;
+		IsActive = true;
+	}
+
+	FlexParticleData FlexParticle::ToData() {
+		FlexParticleData data;
+		data.PositionX = PositionX;
+		data.PositionY = PositionY;
+		data.PositionZ = PositionZ;
+		data.InverseMass = InverseMass;
+		data.VelocityX = VelocityX;
+		data.VelocityY = VelocityY;
+		data.VelocityZ = VelocityZ;
+		data.Phase = Phase;
+		return data;
+	}
+
 	bool FlexParticle::IsValid() {
 		return InverseMass >= 0.0f && GroupIndex >= 0 && Phase >= 0;
 	}
@@ -0,0 +1,184 @@
+// FlexPipeline.h
+// Double buffered state readback behind Flex::ReadSceneStateAsync, written against a device instead of NvFlex itself.
+// FlexCLI.cpp plugs in the NvFlex solver, FlexTests a stub device that simulates copy latency. Header only, it is included from /clr and native code.
+#pragma once
+#include <string.h>
+#include "FlexKernels.h"
+
+namespace FlexPipeline {
+
+	//channel bits, same values as FlexCLI::FlexReadback
+	const int Positions = 1;
+	const int Velocities = 2;
+	const int Phases = 4;
+	const int RigidTransforms = 8;
+
+	//A device provides:
+	//	typedef ... Buffer;
+	//	Buffer* Alloc(int count, int stride); void Free(Buffer* buffer);
+	//	void GetParticles(Buffer* particles4, int count); void GetVelocities(Buffer* velocities3, int count); void GetPhases(Buffer* phases, int count);
+	//	void GetRigidTransforms(Buffer* rotations4, Buffer* translations3);
+	//	void* Map(Buffer* buffer, bool wait);	returns NULL if 'wait' is false and the copy into the buffer hasn't finished yet
+	//	void Unmap(Buffer* buffer);
+	//The Get... calls only queue copies of the solver state, they must not block.
+
+	///One set of buffers the solver state is copied into
+	template<class Device>
+	struct BufferSet {
+		typename Device::Buffer* Particles;
+		typename Device::Buffer* Velocities;
+		typename Device::Buffer* Phases;
+		typename Device::Buffer* RigidRotations;
+		typename Device::Buffer* RigidTranslations;
+		//what was requested from the solver into this set
+		int Count;
+		int NumRigids;
+		int Channels;
+		bool Pending;
+		//host pointers while mapped
+		float* MappedParticles;
+		float* MappedVelocities;
+		int* MappedPhases;
+		float* MappedRotations;
+		float* MappedTranslations;
+
+		void Allocate(Device& device, int maxParticles, int maxRigidBodies) {
+			Particles = device.Alloc(maxParticles, 4 * sizeof(float));
+			Velocities = device.Alloc(maxParticles, 3 * sizeof(float));
+			Phases = device.Alloc(maxParticles, sizeof(int));
+			RigidRotations = device.Alloc(maxRigidBodies, 4 * sizeof(float));
+			RigidTranslations = device.Alloc(maxRigidBodies, 3 * sizeof(float));
+			Pending = false;
+		}
+
+		///Maps every buffer holding requested data. A buffer the solver hasn't finished copying into yet is waited for.
+		void Map(Device& device) {
+			MappedParticles = (Channels & FlexPipeline::Positions) ? (float*)MapWhenReady(device, Particles) : NULL;
+			MappedVelocities = (Channels & FlexPipeline::Velocities) ? (float*)MapWhenReady(device, Velocities) : NULL;
+			MappedPhases = (Channels & FlexPipeline::Phases) ? (int*)MapWhenReady(device, Phases) : NULL;
+			MappedRotations = NumRigids > 0 && (Channels & FlexPipeline::RigidTransforms) ? (float*)MapWhenReady(device, RigidRotations) : NULL;
+			MappedTranslations = MappedRotations ? (float*)MapWhenReady(device, RigidTranslations) : NULL;
+		}
+
+		void Unmap(Device& device) {
+			if (MappedParticles) device.Unmap(Particles);
+			if (MappedVelocities) device.Unmap(Velocities);
+			if (MappedPhases) device.Unmap(Phases);
+			if (MappedRotations) device.Unmap(RigidRotations);
+			if (MappedTranslations) device.Unmap(RigidTranslations);
+			MappedParticles = MappedVelocities = MappedRotations = MappedTranslations = NULL;
+			MappedPhases = NULL;
+		}
+
+		static void* MapWhenReady(Device& device, typename Device::Buffer* buffer) {
+			void* ptr = device.Map(buffer, false);
+			return ptr ? ptr : device.Map(buffer, true);
+		}
+
+		void Destroy(Device& device) {
+			if (Particles) {
+				device.Free(Particles);
+				Particles = NULL;
+			}
+			if (Velocities) {
+				device.Free(Velocities);
+				Velocities = NULL;
+			}
+			if (Phases) {
+				device.Free(Phases);
+				Phases = NULL;
+			}
+			if (RigidRotations) {
+				device.Free(RigidRotations);
+				RigidRotations = NULL;
+			}
+			if (RigidTranslations) {
+				device.Free(RigidTranslations);
+				RigidTranslations = NULL;
+			}
+			Pending = false;
+		}
+	};
+
+	///Two buffer sets used alternately: while one is converted on a worker thread, the solver copies the next step into the other.
+	///Per step: Finish once the worker of the last step is done, then Request, then Convert the returned set on a worker.
+	template<class Device>
+	struct Readback {
+		BufferSet<Device> Sets[2];
+		int Front;			//the set the solver copies into next
+		int Converting;		//the mapped set handed out by the last Request, -1 if none
+
+		Readback() : Sets(), Front(0), Converting(-1) {}
+
+		bool IsAllocated() const { return Sets[0].Particles != NULL; }
+
+		void Allocate(Device& device, int maxParticles, int maxRigidBodies) {
+			Sets[0].Allocate(device, maxParticles, maxRigidBodies);
+			Sets[1].Allocate(device, maxParticles, maxRigidBodies);
+			Front = 0;
+			Converting = -1;
+		}
+
+		///Queues copies of this step's state into the front set, none of them blocks. Returns the set of the previous Request mapped for conversion, NULL if there is none.
+		///The set handed out before must have been released by Finish, the solver would copy into it otherwise.
+		BufferSet<Device>* Request(Device& device, int count, int numRigids, int channels) {
+			BufferSet<Device>& current = Sets[Front];
+			current.Count = count;
+			current.NumRigids = numRigids;
+			current.Channels = channels;
+			if (count > 0) {
+				if (channels & Positions)
+					device.GetParticles(current.Particles, count);
+				if (channels & Velocities)
+					device.GetVelocities(current.Velocities, count);
+				if (channels & Phases)
+					device.GetPhases(current.Phases, count);
+			}
+			if (numRigids > 0 && (channels & RigidTransforms))
+				device.GetRigidTransforms(current.RigidRotations, current.RigidTranslations);
+			current.Pending = true;
+
+			//the previous step, which the solver has most likely finished copying by now
+			Front = 1 - Front;
+			BufferSet<Device>& previous = Sets[Front];
+			if (!previous.Pending)
+				return NULL;
+			previous.Pending = false;
+			previous.Map(device);
+			Converting = Front;
+			return &previous;
+		}
+
+		///Releases the set handed out by the last Request. Only call once its conversion has finished.
+		void Finish(Device& device) {
+			if (Converting < 0)
+				return;
+			Sets[Converting].Unmap(device);
+			Converting = -1;
+		}
+
+		///Forgets requests still in flight, they describe particles that were replaced since
+		void Discard() {
+			Sets[0].Pending = false;
+			Sets[1].Pending = false;
+		}
+
+		void Destroy(Device& device) {
+			Finish(device);
+			Sets[0].Destroy(device);
+			Sets[1].Destroy(device);
+			Front = 0;
+		}
+
+		///Unpacks a mapped set into particle records, skipped channels keep their values. Rigid transforms go to 'translations' [x, y, z] and 'rotations' [x, y, z, w] per rigid,
+		///if they were requested. Positions, velocities and translations are multiplied by 'invScale'. Touches nothing but its arguments, so it runs on any thread.
+		static void Convert(const BufferSet<Device>& set, FlexKernels::ParticleRecord* records, float* translations, float* rotations, float invScale) {
+			if (set.Count > 0)
+				FlexKernels::UnpackRecords(records, set.MappedParticles, set.MappedVelocities, set.MappedPhases, invScale, set.Count);
+			if (set.MappedRotations) {
+				memcpy(rotations, set.MappedRotations, sizeof(float) * 4 * set.NumRigids);
+				FlexKernels::Scale(translations, set.MappedTranslations, invScale, set.NumRigids * 3);
+			}
+		}
+	};
+}
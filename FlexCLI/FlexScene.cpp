@@ -1,12 +1,23 @@
 #include "stdafx.h"
 #include "FlexCLI.h"
+#include "FlexTopology.h"
+#include "FlexAssetCache.h"
+#include "FlexKernels.h"
+#include "FlexSnapshot.h"
+#include <vcclr.h>
 
 namespace FlexCLI {
 
 	///<summary>Empty constructor</summary>
 	FlexScene::FlexScene() {
 		//general
-		Particles = gcnew List<FlexParticle^>();
+		ParticleData = gcnew array<FlexParticleData>(0);
+		ParticleCount = 0;
+		particleCache = nullptr;
+		StateIsPartial = false;
+		IncrementalUpload = false;
+		indexViewsValid = false;
+		Groups = gcnew Dictionary<int, FlexGroupInfo>();
 		//fluids
 		FluidIndices = gcnew List<int>();
 		//rigids
@@ -44,19 +55,60 @@ namespace FlexCLI {
 		TimeStamp = TimeStamp = System::DateTime::Now.Minute * 60000 + System::DateTime::Now.Second * 1000 + System::DateTime::Now.Millisecond;
 	}
 
+	///Copy that owns its particle pool and rigid transforms, the arrays readback writes to, and shares all constraint lists and the group registry with this scene.
+	///Used by FlexBatch to hand one scene to several solvers at once. Neither scene may be appended to or altered while the copy is in use.
+	FlexScene^ FlexScene::CloneShared() {
+		SyncState();
+		FlexScene^ clone = gcnew FlexScene();
+		clone->ParticleData = gcnew array<FlexParticleData>(Math::Max(ParticleCount, 1));
+		Array::Copy(ParticleData, clone->ParticleData, ParticleCount);
+		clone->ParticleCount = ParticleCount;
+		clone->Groups = Groups;
+		clone->FluidIndices = FluidIndices;
+		clone->RigidIndices = RigidIndices;
+		clone->RigidOffsets = RigidOffsets;
+		clone->NumActualRigids = NumActualRigids;
+		clone->SoftBodyOffsets = SoftBodyOffsets;
+		clone->ShapeMassCenters = ShapeMassCenters;
+		clone->RigidRestPositions = RigidRestPositions;
+		clone->RigidRestNormals = RigidRestNormals;
+		clone->RigidStiffnesses = RigidStiffnesses;
+		clone->RigidRotations = gcnew List<float>(RigidRotations);
+		clone->RigidTranslations = gcnew List<float>(RigidTranslations);
+		clone->SpringIndices = SpringIndices;
+		clone->SpringPairIndices = SpringPairIndices;
+		clone->SpringLengths = SpringLengths;
+		clone->SpringStiffnesses = SpringStiffnesses;
+		clone->NumCloths = NumCloths;
+		clone->ClothIndices = ClothIndices;
+		clone->DynamicTriangleIndices = DynamicTriangleIndices;
+		clone->DynamicTriangleNormals = DynamicTriangleNormals;
+		clone->NumInflatables = NumInflatables;
+		clone->InflatableIndices = InflatableIndices;
+		clone->InflatableStartIndices = InflatableStartIndices;
+		clone->InflatableNumTriangles = InflatableNumTriangles;
+		clone->InflatableRestVolumes = InflatableRestVolumes;
+		clone->InflatableOverPressures = InflatableOverPressures;
+		clone->InflatableConstraintScales = InflatableConstraintScales;
+		clone->TimeStamp = TimeStamp;
+		return clone;
+	}
+
 	void FlexScene::RegisterAsset(NvFlexExtAsset* asset, array<float>^ velocity, float invMass, int groupIndex, bool isSoftBody) {
 
 		if (asset->numParticles == 0)
 			return;
+		if (velocity->Length != 3 || invMass < 0.0f || groupIndex < 0)
+			throw gcnew Exception("FlexScene::RegisterAsset(...) Invalid input!");
+		SyncState();
 
 		int oldNumParticles = NumParticles();
-		List<FlexParticle^>^ parts = gcnew List<FlexParticle^>();
-
-		for (int i = 0; i < asset->numParticles; i++) {
-			array<float>^ pos = gcnew array<float>{asset->particles[4 * i], asset->particles[4 * i + 1], asset->particles[4 * i + 2]};
-			parts->Add(gcnew FlexParticle(pos, velocity, invMass, NvFlexMakePhase(groupIndex, 0), true));
-		}
-		Particles->AddRange(parts);
+		RegisterGroup(groupIndex, isSoftBody ? FlexParticleCategory::Soft : FlexParticleCategory::Rigid, oldNumParticles, asset->numParticles, NumRigids(), asset->numShapes, SpringLengths->Count, asset->numSprings);
+		int phase = NvFlexMakePhase(groupIndex, 0);
+		ReserveParticles(oldNumParticles + asset->numParticles);
+		for (int i = 0; i < asset->numParticles; i++)
+			AddParticle(asset->particles[4 * i], asset->particles[4 * i + 1], asset->particles[4 * i + 2], velocity[0], velocity[1], velocity[2], invMass, phase);
+		ParticlesChanged();
 		if (isSoftBody) {
 			if (SoftBodyOffsets->Count == 0)
 				SoftBodyOffsets->Add(oldNumParticles);
@@ -94,9 +146,9 @@ namespace FlexCLI {
 			shapeCoefficients[i] = asset->shapeCoefficients[i];
 			for (int j = shapeOffsets[i]; j < shapeOffsets[i + 1]; j++)
 			{
-				RigidRestPositions->Add(parts[shapeIndices[j]]->PositionX - asset->shapeCenters[3 * i]);
-				RigidRestPositions->Add(parts[shapeIndices[j]]->PositionY - asset->shapeCenters[3 * i + 1]);
-				RigidRestPositions->Add(parts[shapeIndices[j]]->PositionZ - asset->shapeCenters[3 * i + 2]);
+				RigidRestPositions->Add(asset->particles[4 * shapeIndices[j]] - asset->shapeCenters[3 * i]);
+				RigidRestPositions->Add(asset->particles[4 * shapeIndices[j] + 1] - asset->shapeCenters[3 * i + 1]);
+				RigidRestPositions->Add(asset->particles[4 * shapeIndices[j] + 2] - asset->shapeCenters[3 * i + 2]);
 				RigidRestNormals->Add(0.0f);
 				RigidRestNormals->Add(0.0f);
 				RigidRestNormals->Add(0.0f);
@@ -111,15 +163,23 @@ namespace FlexCLI {
 	void FlexScene::RegisterParticles(array<float>^ positions, array<float>^ velocities, array<float>^ inverseMasses, bool isFluid, bool selfCollision, int groupIndex) {
 		if (positions->Length % 3 != 0 || velocities->Length % 3 != 0 || positions->Length != velocities->Length || positions->Length / 3 != inverseMasses->Length)
 			throw gcnew Exception("FlexScene::RegisterParticles(...) Invalid input!");
+		if (groupIndex < 0)
+			throw gcnew Exception("FlexScene::RegisterParticles(...) Invalid input! Group index must be >= 0.");
+		for each(float im in inverseMasses)
+			if (im < 0.0f)
+				throw gcnew Exception("FlexScene::RegisterParticles(...) Invalid input! Inverse mass must be >= 0.0.");
+		SyncState();
 
 		int currentNumParticles = positions->Length / 3;
+		int phase = NvFlexMakePhase(groupIndex, eNvFlexPhaseFluid * isFluid | eNvFlexPhaseSelfCollide * selfCollision);
+		RegisterGroup(groupIndex, FlexParticleCategory::All, NumParticles(), currentNumParticles, 0, 0, 0, 0);
+		ReserveParticles(NumParticles() + currentNumParticles);
 
 		for (int i = 0; i < currentNumParticles; i++) {
-			//Add each particle to the scene global Particles list
-			array<float>^ pos = gcnew array<float>(3) { positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2] };
-			array<float>^ vel = gcnew array<float>(3) { velocities[i * 3], velocities[i * 3 + 1], velocities[i * 3 + 2] };
-			Particles->Add(gcnew FlexParticle(pos, vel, inverseMasses[i], selfCollision, isFluid, groupIndex, true));
+			//Add each particle to the scene's particle pool
+			AddParticle(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2], velocities[i * 3], velocities[i * 3 + 1], velocities[i * 3 + 2], inverseMasses[i], phase);
 		}
+		ParticlesChanged();
 
 		TimeStamp = TimeStamp = System::DateTime::Now.Minute * 60000 + System::DateTime::Now.Second * 1000 + System::DateTime::Now.Millisecond;
 	}
@@ -133,22 +193,27 @@ namespace FlexCLI {
 	///<param name = 'groupIndex'>A uniquely used index between 0 and 2^24. All particles in this group will be identified by the group index in the future.</param>
 	void FlexScene::RegisterFluid(array<float>^ positions, array<float>^ velocities, array<float>^ inverseMasses, int groupIndex) {
 #pragma region check everything
-		for each (FlexParticle^ p in Particles)
-			if (p->GroupIndex == groupIndex)
-				throw gcnew Exception("Fluid: Group index " + groupIndex + " already in use!");
-		if (positions->Length % 3 != 0 || velocities->Length % 3 != 0 || positions->Length != velocities->Length)
+		if (HasGroup(groupIndex))
+			throw gcnew Exception("Fluid: Group index " + groupIndex + " already in use!");
+		if (positions->Length % 3 != 0 || velocities->Length % 3 != 0 || positions->Length != velocities->Length || inverseMasses->Length < positions->Length / 3 || groupIndex < 0)
 			throw gcnew Exception("FlexScene::RegisterFluid(...) Invalid input!");
+		for each(float im in inverseMasses)
+			if (im < 0.0f)
+				throw gcnew Exception("FlexScene::RegisterFluid(...) Invalid input! Inverse mass must be >= 0.0.");
 #pragma endregion
+		SyncState();
 
 		int currentNumParticles = positions->Length / 3;
+		int phase = NvFlexMakePhase(groupIndex, eNvFlexPhaseSelfCollide | eNvFlexPhaseFluid);
+		RegisterGroup(groupIndex, FlexParticleCategory::Fluid, NumParticles(), currentNumParticles, 0, 0, 0, 0);
+		ReserveParticles(NumParticles() + currentNumParticles);
 
 		for (int i = 0; i < currentNumParticles; i++) {
-			//Add each particle to the scene global Particles list
-			array<float>^ pos = gcnew array<float>(3) { positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2] };
-			array<float>^ vel = gcnew array<float>(3) { velocities[i * 3], velocities[i * 3 + 1], velocities[i * 3 + 2] };
+			//Add each particle to the scene's particle pool
 			FluidIndices->Add(NumParticles());
-			Particles->Add(gcnew FlexParticle(pos, vel, inverseMasses[i], NvFlexMakePhase(groupIndex, eNvFlexPhaseSelfCollide | eNvFlexPhaseFluid), true));
+			AddParticle(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2], velocities[i * 3], velocities[i * 3 + 1], velocities[i * 3 + 2], inverseMasses[i], phase);
 		}
+		ParticlesChanged();
 
 		TimeStamp = TimeStamp = System::DateTime::Now.Minute * 60000 + System::DateTime::Now.Second * 1000 + System::DateTime::Now.Millisecond;
 	}
@@ -164,10 +229,9 @@ namespace FlexCLI {
 	///<param name = 'groupIndex'>A uniquely used index between 0 and 2^24. All particles in this object will be identified by the group index in the future.</param>
 	void FlexScene::RegisterRigidBody(array<float>^ vertices, array<float>^ vertexNormals, array<float>^ velocity, array<float>^ inverseMasses, float stiffness, int groupIndex) {
 #pragma region check everything
-		for each (FlexParticle^ p in Particles)
-			if (p->GroupIndex == groupIndex)
-				throw gcnew Exception("Rigid Body: Group index " + groupIndex + " already in use!");
-		if (vertices->Length % 3 != 0 || vertexNormals->Length % 3 != 0 || velocity->Length != 3 || stiffness < 0.0f || stiffness > 1.0f)
+		if (HasGroup(groupIndex))
+			throw gcnew Exception("Rigid Body: Group index " + groupIndex + " already in use!");
+		if (vertices->Length % 3 != 0 || vertexNormals->Length % 3 != 0 || velocity->Length != 3 || stiffness < 0.0f || stiffness > 1.0f || groupIndex < 0)
 			throw gcnew Exception("FlexScene::RegisterRigidBody(...) Invalid input!");
 
 		if (inverseMasses->Length == 1)
@@ -183,21 +247,23 @@ namespace FlexCLI {
 				throw gcnew Exception("FlexScene::RegisterRigidBody(...) Invalid input! Inverse mass must be >= 0.0.");
 #pragma endregion
 
+		SyncState();
 		int currentNumParticles = vertices->Length / 3;
 
-		array<float>^ vel = gcnew array<float>(3) { velocity[0], velocity[1], velocity[2] };
+		int phase = NvFlexMakePhase(groupIndex, 0);
 		float3 massCenter = float3(0.0f, 0.0f, 0.0f);
+		RegisterGroup(groupIndex, FlexParticleCategory::Rigid, NumParticles(), currentNumParticles, NumRigids(), 1, 0, 0);
+		ReserveParticles(NumParticles() + currentNumParticles);
 
 		for (int i = 0; i < currentNumParticles; i++) {
-			//Add each particle to the scene global Particles list
-			array<float>^ pos = gcnew array<float>(3) { vertices[i * 3], vertices[i * 3 + 1], vertices[i * 3 + 2] };
-
+			//Add each particle to the scene's particle pool
 			RigidIndices->Add(NumParticles());
-			Particles->Add(gcnew FlexParticle(pos, vel, inverseMasses[i], NvFlexMakePhase(groupIndex, 0), true));
+			AddParticle(vertices[i * 3], vertices[i * 3 + 1], vertices[i * 3 + 2], velocity[0], velocity[1], velocity[2], inverseMasses[i], phase);
 			massCenter.x += vertices[i * 3];
 			massCenter.y += vertices[i * 3 + 1];
 			massCenter.z += vertices[i * 3 + 2];
 		}
+		ParticlesChanged();
 		massCenter.x /= (float)currentNumParticles;
 		massCenter.y /= (float)currentNumParticles;
 		massCenter.z /= (float)currentNumParticles;
@@ -234,22 +300,18 @@ namespace FlexCLI {
 		TimeStamp = TimeStamp = System::DateTime::Now.Minute * 60000 + System::DateTime::Now.Second * 1000 + System::DateTime::Now.Millisecond;
 	}
 
+	///<summary>Creates a soft body asset from a mesh. Identical meshes and parameters share one asset from the asset cache, which is only generated once.</summary>
+	///<remarks>The asset is owned by the cache, DestroySoftBody ignores it. It stays valid until ClearAssetCache is called.</remarks>
 	void FlexScene::InitSoftBodyFromMesh(void*% asset, array<float>^ vertices, array<int>^ triangles, float particleSpacing, float volumeSampling, float surfaceSampling, float clusterSpacing, float clusterRadius, float clusterStiffness, float linkRadius, float linkStiffness, float globalStiffness) {
-		std::vector<float> vt(vertices->Length);
-		for (int i = 0; i < vertices->Length; i++) vt[i] = vertices[i];
-
-		std::vector<int> tr(triangles->Length);
-		for (int i = 0; i < triangles->Length; i++) tr[i] = triangles[i];
-
-		asset = (void*)NvFlexExtCreateSoftFromMesh(&vt[0], vertices->Length / 3, &tr[0], triangles->Length, particleSpacing, volumeSampling, surfaceSampling, clusterSpacing, clusterRadius, clusterStiffness, linkRadius, linkStiffness, globalStiffness);
-		
-		//sometimes the last shape in the generated asset contains all particles. this bug is removed here
-		NvFlexExtAsset* a = (NvFlexExtAsset*)asset;
-		if (a->numParticles == a->shapeOffsets[a->numShapes - 1] - a->shapeOffsets[a->numShapes - 2])
-		{
-			a->numShapes = a->numShapes - 1;
-			a->numShapeIndices -= a->numParticles;
-		}
+		if (vertices->Length < 3 || vertices->Length % 3 != 0 || triangles->Length < 3 || triangles->Length % 3 != 0)
+			throw gcnew Exception("FlexCLI: void FlexScene::InitSoftBodyFromMesh(...) ---> Invalid input!");
+
+		FlexAssetCache::SoftBodyParams p = { particleSpacing, volumeSampling, surfaceSampling, clusterSpacing, clusterRadius, clusterStiffness, linkRadius, linkStiffness, globalStiffness };
+		pin_ptr<float> vt = &vertices[0];
+		pin_ptr<int> tr = &triangles[0];
+		asset = (void*)FlexAssetCache::GetSoftBody(vt, vertices->Length / 3, tr, triangles->Length, p);
+		if (asset == nullptr)
+			throw gcnew Exception("FlexCLI: void FlexScene::InitSoftBodyFromMesh(...) ---> Soft body generation failed!");
 	}
 
 	void FlexScene::UnwrapSoftBody(void* asset, array<float>^% particles, array<int>^% springIndices, array<array<int>^>^% shapeIndices) {
@@ -282,7 +344,30 @@ namespace FlexCLI {
 	}
 
 	void FlexScene::DestroySoftBody(NvFlexExtAsset* asset) {
-		NvFlexExtDestroyAsset(asset);
+		if (!FlexAssetCache::Contains(asset))
+			NvFlexExtDestroyAsset(asset);
+	}
+
+	///<summary>Persist soft body assets in this directory, so reopened documents skip asset generation. Null or empty disables persistence.</summary>
+	void FlexScene::SetAssetCacheDirectory(String^ directory) {
+		if (String::IsNullOrEmpty(directory)) {
+			FlexAssetCache::SetDirectory(NULL);
+			return;
+		}
+		if (!System::IO::Directory::Exists(directory))
+			System::IO::Directory::CreateDirectory(directory);
+		pin_ptr<const wchar_t> dir = PtrToStringChars(directory);
+		FlexAssetCache::SetDirectory(dir);
+	}
+
+	///<summary>Destroys all cached soft body assets. Assets returned by InitSoftBodyFromMesh before must not be used afterwards.</summary>
+	void FlexScene::ClearAssetCache() {
+		FlexAssetCache::Clear();
+	}
+
+	String^ FlexScene::AssetCacheStatistics() {
+		FlexAssetCache::Statistics s = FlexAssetCache::GetStatistics();
+		return "FlexAssetCache: " + s.Resident + " resident, " + s.MemoryHits + " memory hits, " + s.DiskHits + " disk hits, " + s.Misses + " generated";
 	}
 
 	///<summary>
@@ -291,51 +376,50 @@ namespace FlexCLI {
 	///<returns>The offset in spring indices resulting from previously registered spring systems. Use this to redraw the spring lines correctly later on.</returns>
 	int FlexScene::RegisterSpringSystem(array<float>^ positions, array<float>^ velocities, array<float>^ inverseMasses, array<int>^ springPairIndices, array<float>^ stiffnesses, array<float>^ defaultLengths, bool selfCollision, array<int>^ anchorIndices, int groupIndex) {
 #pragma region check everything
-		for each (FlexParticle^ p in Particles)
-			if (p->GroupIndex == groupIndex)
-				throw gcnew Exception("Spring System: Group index " + groupIndex + " already in use!");
-		if (positions->Length % 3 != 0 || velocities->Length % 3 != 0 || positions->Length != velocities->Length || springPairIndices->Length % 2 != 0)
-			throw gcnew Exception("FlexScene::RegisterFluid(...) Invalid input!");
+		if (HasGroup(groupIndex))
+			throw gcnew Exception("Spring System: Group index " + groupIndex + " already in use!");
+		if (positions->Length % 3 != 0 || velocities->Length % 3 != 0 || positions->Length != velocities->Length || springPairIndices->Length % 2 != 0 || groupIndex < 0)
+			throw gcnew Exception("FlexScene::RegisterSpringSystem(...) Invalid input!");
+		int currentNumParticles = positions->Length / 3;
+		if (inverseMasses->Length < currentNumParticles)
+			throw gcnew Exception("FlexScene::RegisterSpringSystem(...) Invalid input! Less inverse masses than particles.");
+		for (int i = 0; i < currentNumParticles; i++)
+			if (inverseMasses[i] < 0.0f)
+				throw gcnew Exception("FlexScene::RegisterSpringSystem(...) Invalid input! Inverse mass must be >= 0.0.");
+		if (stiffnesses->Length != springPairIndices->Length / 2 || defaultLengths->Length != springPairIndices->Length / 2)
+			throw gcnew Exception("FlexScene::RegisterSpringSystem(...) Invalid input! Stiffnesses and default lengths must hold one value per spring.");
+		for (int i = 0; i < springPairIndices->Length; i++)
+			if (springPairIndices[i] < 0 || springPairIndices[i] >= currentNumParticles)
+				throw gcnew Exception("FlexCLI: void FlexScene::RegisterSpringSystem(...) ---> Spring index " + springPairIndices[i] + " out of range.");
 #pragma endregion
+		SyncState();
 
-		int maxIndex = 0;
+		int springOffset = SpringLengths->Count;
 		for (int i = 0; i < springPairIndices->Length / 2; i++) {
-			int ind0 = springPairIndices[2 * i] + NumParticles();
-			int ind1 = springPairIndices[2 * i + 1] + NumParticles();
-			if (ind0 > maxIndex)
-				maxIndex = ind0;
-			if (ind1 > maxIndex)
-				maxIndex = ind1;
-			SpringPairIndices->Add(ind0);
-			SpringPairIndices->Add(ind1);
+			SpringPairIndices->Add(springPairIndices[2 * i] + NumParticles());
+			SpringPairIndices->Add(springPairIndices[2 * i + 1] + NumParticles());
 			SpringStiffnesses->Add(stiffnesses[i]);
 			SpringLengths->Add(defaultLengths[i]);
 		}
 
-		int currentNumParticles = positions->Length / 3;
-
-		if (maxIndex - NumParticles() >= currentNumParticles)
-			throw gcnew Exception("FlexCLI: void FlexScene::RegisterSpringSystem(...) ---> At least one spring index is too high.");
-
 		int toReturn = SpringIndices->Count;
 
 		int anchorCounter = 0;
 		anchorIndices->Sort(anchorIndices);
+		int phase = NvFlexMakePhase(groupIndex, eNvFlexPhaseSelfCollide * selfCollision);
+		RegisterGroup(groupIndex, FlexParticleCategory::Spring, NumParticles(), currentNumParticles, 0, 0, springOffset, springPairIndices->Length / 2);
+		ReserveParticles(NumParticles() + currentNumParticles);
 		for (int i = 0; i < currentNumParticles; i++) {
-			//Add each particle to the scene global Particles list
-			array<float>^ pos = gcnew array<float>(3) { positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2] };
-			array<float>^ vel = gcnew array<float>(3) { velocities[i * 3], velocities[i * 3 + 1], velocities[i * 3 + 2] };
+			//Add each particle to the scene's particle pool
 			float iM = inverseMasses[i];
 			if (anchorIndices->Length > anchorCounter && anchorIndices[anchorCounter] == i) {
 				iM = 0.0f;
 				anchorCounter++;
 			}
 			SpringIndices->Add(NumParticles());
-			Particles->Add(gcnew FlexParticle(pos, vel, iM, selfCollision, false, groupIndex, true));
-
-
-			//NumParticles++;
+			AddParticle(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2], velocities[i * 3], velocities[i * 3 + 1], velocities[i * 3 + 2], iM, phase);
 		}
+		ParticlesChanged();
 		TimeStamp = TimeStamp = System::DateTime::Now.Minute * 60000 + System::DateTime::Now.Second * 1000 + System::DateTime::Now.Millisecond;
 		return toReturn;
 	}
@@ -347,139 +431,60 @@ namespace FlexCLI {
 #pragma region check everything
 		if (triangles->Length % 3 != 0 || positions->Length % 3 != 0 || velocities->Length % 3 != 0 || inverseMasses->Length * 3 != positions->Length || positions->Length != velocities->Length || stretchStiffness < 0.0f || bendingStiffness < 0.0f)
 			throw gcnew Exception("void FlexScene::RegisterCloth(...) ---> Invalid input!");
-		for each (FlexParticle^ p in Particles)
-			if (p->GroupIndex == groupIndex)
-				throw gcnew Exception("Cloth: Group index " + groupIndex + " already in use!");
+		if (HasGroup(groupIndex))
+			throw gcnew Exception("Cloth: Group index " + groupIndex + " already in use!");
+		int numVertices = positions->Length / 3;
+		int numTriangles = triangles->Length / 3;
+		for (int i = 0; i < triangles->Length; i++)
+			if (triangles[i] < 0 || triangles[i] >= numVertices)
+				throw gcnew Exception("void FlexScene::RegisterCloth(...) ---> Invalid input! Triangle index " + triangles[i] + " out of range.");
+		//RegisterSpringSystem checks these as well, but only after the triangles were added
+		for each(float im in inverseMasses)
+			if (im < 0.0f)
+				throw gcnew Exception("void FlexScene::RegisterCloth(...) ---> Invalid input! Inverse mass must be >= 0.0.");
 #pragma endregion
 
-		List<int>^ springPairIndices = gcnew List<int>();
-		List<float>^ lengths = gcnew List<float>();
-		List<float>^ stretchStiffnesses = gcnew List<float>();
-
-		for (int i = 0; i < triangles->Length / 3; i++)
-		{
-			//assign triangle indices
-			DynamicTriangleIndices->Add(triangles[i * 3] + NumParticles());
-			DynamicTriangleIndices->Add(triangles[i * 3 + 1] + NumParticles());
-			DynamicTriangleIndices->Add(triangles[i * 3 + 2] + NumParticles());
-
-
-			//only use unique lines and points
-			int alreadyExistsAs = -1;
-			int candStart = triangles[3 * i];
-			int candEnd = triangles[3 * i + 1];
-			for (int j = 0; j < springPairIndices->Count / 2; j++) {
-				if ((candStart == springPairIndices[j * 2] && candEnd == springPairIndices[j * 2 + 1]) ||
-					(candStart == springPairIndices[j * 2 + 1] && candEnd == springPairIndices[j * 2])) {
-					alreadyExistsAs = j;
-					break;
-				}
-			}
-			if (alreadyExistsAs == -1) {
-				springPairIndices->Add(candStart);
-				springPairIndices->Add(candEnd);
-				stretchStiffnesses->Add(stretchStiffness);
-				float newLength = Math::Sqrt(
-					(positions[candStart * 3] - positions[candEnd * 3]) * (positions[candStart * 3] - positions[candEnd * 3]) +
-					(positions[candStart * 3 + 1] - positions[candEnd * 3 + 1]) * (positions[candStart * 3 + 1] - positions[candEnd * 3 + 1]) +
-					(positions[candStart * 3 + 2] - positions[candEnd * 3 + 2]) * (positions[candStart * 3 + 2] - positions[candEnd * 3 + 2])
-				);
-				lengths->Add(preTensionFactor * newLength);
-			}
-
-			alreadyExistsAs = -1;
-			candStart = triangles[3 * i + 1];
-			candEnd = triangles[3 * i + 2];
-			for (int j = 0; j < springPairIndices->Count / 2; j++) {
-				if ((candStart == springPairIndices[j * 2] && candEnd == springPairIndices[j * 2 + 1]) ||
-					(candStart == springPairIndices[j * 2 + 1] && candEnd == springPairIndices[j * 2])) {
-					alreadyExistsAs = j;
-					break;
-				}
-			}
-			if (alreadyExistsAs == -1) {
-				springPairIndices->Add(candStart);
-				springPairIndices->Add(candEnd);
-				stretchStiffnesses->Add(stretchStiffness);
-				float newLength = Math::Sqrt(
-					(positions[candStart * 3] - positions[candEnd * 3]) * (positions[candStart * 3] - positions[candEnd * 3]) +
-					(positions[candStart * 3 + 1] - positions[candEnd * 3 + 1]) * (positions[candStart * 3 + 1] - positions[candEnd * 3 + 1]) +
-					(positions[candStart * 3 + 2] - positions[candEnd * 3 + 2]) * (positions[candStart * 3 + 2] - positions[candEnd * 3 + 2])
-				);
-				lengths->Add(preTensionFactor * newLength);
-			}
-
-			alreadyExistsAs = -1;
-			candStart = triangles[3 * i + 2];
-			candEnd = triangles[3 * i];
-			for (int j = 0; j < springPairIndices->Count / 2; j++) {
-				if ((candStart == springPairIndices[j * 2] && candEnd == springPairIndices[j * 2 + 1]) ||
-					(candStart == springPairIndices[j * 2 + 1] && candEnd == springPairIndices[j * 2])) {
-					alreadyExistsAs = j;
-					break;
-				}
-			}
-			if (alreadyExistsAs == -1) {
-				springPairIndices->Add(candStart);
-				springPairIndices->Add(candEnd);
-				stretchStiffnesses->Add(stretchStiffness);
-				float newLength = Math::Sqrt(
-					(positions[candStart * 3] - positions[candEnd * 3]) * (positions[candStart * 3] - positions[candEnd * 3]) +
-					(positions[candStart * 3 + 1] - positions[candEnd * 3 + 1]) * (positions[candStart * 3 + 1] - positions[candEnd * 3 + 1]) +
-					(positions[candStart * 3 + 2] - positions[candEnd * 3 + 2]) * (positions[candStart * 3 + 2] - positions[candEnd * 3 + 2])
-				);
-				lengths->Add(preTensionFactor * newLength);
-			}
+		//assign triangle indices
+		int triangleOffset = DynamicTriangleIndices->Count / 3;
+		for (int i = 0; i < triangles->Length; i++)
+			DynamicTriangleIndices->Add(triangles[i] + NumParticles());
+
+		//unique edges become stretch springs, the opposite vertices of two adjacent triangles bending springs
+		//edges take at most 6 ints per triangle, bending springs at most as many again
+		array<int>^ springPairIndices = gcnew array<int>(numTriangles * 12 + 2);
+		int numEdges = 0;
+		int numBending = 0;
+		if (numTriangles > 0) {
+			pin_ptr<int> tri = &triangles[0];
+			pin_ptr<int> pairPin = &springPairIndices[0];
+			int* pairs = pairPin;
+			numEdges = FlexTopology::UniqueEdges(tri, numTriangles, pairs);
+			if (bendingStiffness > 0.0f)
+				numBending = FlexTopology::BendingSprings(pairs, numEdges, numVertices, pairs + 2 * numEdges);
 		}
-
-		List<int>^ bendingSprings = gcnew List<int>();
-		if (bendingStiffness > 0.0f) {
-			for (int i = 0; i < springPairIndices->Count / 2; i++) {
-				int startIndex = springPairIndices[2 * i];
-				int endIndex = springPairIndices[2 * i + 1];
-
-				List<int>^ neighborsOfStart = gcnew List<int>();
-				List<int>^ neighborsOfEnd = gcnew List<int>();
-				for (int j = 0; j < springPairIndices->Count / 2; j++) {
-					if (springPairIndices[2 * j] == startIndex && springPairIndices[2 * j + 1] != endIndex)
-						neighborsOfStart->Add(springPairIndices[2 * j + 1]);
-					else if (springPairIndices[2 * j + 1] == startIndex && springPairIndices[2 * j] != endIndex)
-						neighborsOfStart->Add(springPairIndices[2 * j]);
-
-					if (springPairIndices[2 * j] == endIndex && springPairIndices[2 * j + 1] != startIndex)
-						neighborsOfEnd->Add(springPairIndices[2 * j + 1]);
-					else if (springPairIndices[2 * j + 1] == endIndex && springPairIndices[2 * j] != startIndex)
-						neighborsOfEnd->Add(springPairIndices[2 * j]);
-				}
-
-
-				List<int>^ commonNeighbors = gcnew List<int>();
-				for (int j = 0; j < neighborsOfStart->Count; j++) {
-					for (int k = 0; k < neighborsOfEnd->Count; k++) {
-						if (neighborsOfStart[j] == neighborsOfEnd[k])
-							commonNeighbors->Add(neighborsOfStart[j]);
-					}
-				}
-
-				if (commonNeighbors->Count == 2) {
-					bendingSprings->AddRange(commonNeighbors);
-					stretchStiffnesses->Add(bendingStiffness);
-					float newLength = Math::Sqrt(
-						(positions[commonNeighbors[0] * 3] - positions[commonNeighbors[1] * 3]) * (positions[commonNeighbors[0] * 3] - positions[commonNeighbors[1] * 3]) +
-						(positions[commonNeighbors[0] * 3 + 1] - positions[commonNeighbors[1] * 3 + 1]) * (positions[commonNeighbors[0] * 3 + 1] - positions[commonNeighbors[1] * 3 + 1]) +
-						(positions[commonNeighbors[0] * 3 + 2] - positions[commonNeighbors[1] * 3 + 2]) * (positions[commonNeighbors[0] * 3 + 2] - positions[commonNeighbors[1] * 3 + 2])
-					);
-					lengths->Add(preTensionFactor * newLength);
-				}
-			}
-
-			springPairIndices->AddRange(bendingSprings);
+		Array::Resize(springPairIndices, 2 * (numEdges + numBending));
+
+		array<float>^ stretchStiffnesses = gcnew array<float>(numEdges + numBending);
+		for (int i = 0; i < numEdges + numBending; i++)
+			stretchStiffnesses[i] = i < numEdges ? stretchStiffness : bendingStiffness;
+
+		array<float>^ lengths = gcnew array<float>(numEdges + numBending);
+		if (lengths->Length > 0) {
+			pin_ptr<float> pos = &positions[0];
+			pin_ptr<int> pairs = &springPairIndices[0];
+			pin_ptr<float> len = &lengths[0];
+			FlexTopology::PairLengths(pos, pairs, numEdges + numBending, preTensionFactor, len);
 		}
 
 		//Assign springs
-		int oldNumParticles = RegisterSpringSystem(positions, velocities, inverseMasses, springPairIndices->ToArray(), stretchStiffnesses->ToArray(), lengths->ToArray(), selfCollision, anchorIndices, groupIndex);
+		int oldNumParticles = RegisterSpringSystem(positions, velocities, inverseMasses, springPairIndices, stretchStiffnesses, lengths, selfCollision, anchorIndices, groupIndex);
 		ClothIndices->AddRange(SpringIndices->GetRange(oldNumParticles, positions->Length / 3));
 		SpringIndices->RemoveRange(oldNumParticles, positions->Length / 3);
+		FlexGroupInfo info = Groups[groupIndex];
+		info.Category = FlexParticleCategory::Cloth;
+		info.TriangleOffset = triangleOffset;
+		info.TriangleCount = numTriangles;
+		Groups[groupIndex] = info;
 
 		if (triangles->Length == triangleNormals->Length)
 			DynamicTriangleNormals->AddRange(triangleNormals);
@@ -492,16 +497,20 @@ namespace FlexCLI {
 #pragma region check everything
 		if (triangles->Length % 3 != 0 || positions->Length % 3 != 0 || velocities->Length % 3 != 0 || inverseMasses->Length * 3 != positions->Length || positions->Length != velocities->Length || triangleNormals->Length != triangles->Length || restVolume < 0.0f || constraintScale < 0.0f)
 			throw gcnew Exception("void FlexScene::RegisterInflatable(...) ---> Invalid input!");
-		for each (FlexParticle^ p in Particles)
-			if (p->GroupIndex == groupIndex)
-				throw gcnew Exception("Inflatable: Group index " + groupIndex + "already in use!");
+		if (HasGroup(groupIndex))
+			throw gcnew Exception("Inflatable: Group index " + groupIndex + "already in use!");
 #pragma endregion
 
-		InflatableStartIndices->Add(NumParticles());
+		//RegisterCloth validates the rest, nothing is added before it returns
+		int startIndex = NumParticles();
 		int oldNumParticles = ClothIndices->Count;
 		RegisterCloth(positions, velocities, inverseMasses, triangles, triangleNormals, stretchStiffness, bendingStiffness, preTensionFactor, anchorIndices, selfCollision, groupIndex);
+		InflatableStartIndices->Add(startIndex);
 		InflatableIndices->AddRange(ClothIndices->GetRange(oldNumParticles, positions->Length / 3));
 		ClothIndices->RemoveRange(oldNumParticles, positions->Length / 3);
+		FlexGroupInfo info = Groups[groupIndex];
+		info.Category = FlexParticleCategory::Inflatable;
+		Groups[groupIndex] = info;
 
 		InflatableConstraintScales->Add(constraintScale);
 		InflatableOverPressures->Add(overPressure);
@@ -520,30 +529,32 @@ namespace FlexCLI {
 			throw gcnew Exception("void FlexScene::RegisterCustomConstraints(...) ---> Invalid input!");
 
 		for each(int i in anchorIndices)
-			if (i >= Particles->Count)
+			if (i >= ParticleCount)
 				return false;
 		for each(int i in shapeMatchingIndices)
-			if (i >= Particles->Count)
+			if (i >= ParticleCount)
 				return false;
 		for each(int i in springPairIndices)
-			if (i >= Particles->Count)
+			if (i >= ParticleCount)
 				return false;
 		for each(int i in triangleIndices)
-			if (i >= Particles->Count)
+			if (i >= ParticleCount)
 				return false;
 #pragma endregion
-
+		SyncState();
 
 		for (int i = 0; i < anchorIndices->Length; i++)
-			Particles[anchorIndices[i]]->InverseMass = 0.0f;
+			ParticleData[anchorIndices[i]].InverseMass = 0.0f;
+		ParticlesChanged();
+		IncrementalUpload = false;
 
 		if (shapeMatchingIndices->Length > 0) {
 			RigidIndices->AddRange(shapeMatchingIndices);
 			float3 massCenter = float3(0.0f, 0.0f, 0.0f);
 			for (int i = 0; i < shapeMatchingIndices->Length; i++) {
-				massCenter.x += Particles[shapeMatchingIndices[i]]->PositionX;
-				massCenter.y += Particles[shapeMatchingIndices[i]]->PositionY;
-				massCenter.z += Particles[shapeMatchingIndices[i]]->PositionZ;
+				massCenter.x += ParticleData[shapeMatchingIndices[i]].PositionX;
+				massCenter.y += ParticleData[shapeMatchingIndices[i]].PositionY;
+				massCenter.z += ParticleData[shapeMatchingIndices[i]].PositionZ;
 			}
 			massCenter.x /= shapeMatchingIndices->Length;
 			massCenter.y /= shapeMatchingIndices->Length;
@@ -558,9 +569,9 @@ namespace FlexCLI {
 				RigidRestNormals->Add(0.0f);
 				RigidRestNormals->Add(0.0f);
 				RigidRestNormals->Add(-0.5f);
-				RigidRestPositions->Add(Particles[shapeMatchingIndices[i]]->PositionX - massCenter.x);
-				RigidRestPositions->Add(Particles[shapeMatchingIndices[i]]->PositionY - massCenter.y);
-				RigidRestPositions->Add(Particles[shapeMatchingIndices[i]]->PositionZ - massCenter.z);
+				RigidRestPositions->Add(ParticleData[shapeMatchingIndices[i]].PositionX - massCenter.x);
+				RigidRestPositions->Add(ParticleData[shapeMatchingIndices[i]].PositionY - massCenter.y);
+				RigidRestPositions->Add(ParticleData[shapeMatchingIndices[i]].PositionZ - massCenter.z);
 				RigidRotations->Add(0.0f);
 				RigidRotations->Add(0.0f);
 				RigidRotations->Add(0.0f);
@@ -583,9 +594,9 @@ namespace FlexCLI {
 				if (springDefaultLengths[i] >= 0.0f)
 					SpringLengths->Add(springDefaultLengths[i]);
 				else {
-					float distX = Particles[springPairIndices[2 * i]]->PositionX - Particles[springPairIndices[2 * i + 1]]->PositionX;
-					float distY = Particles[springPairIndices[2 * i]]->PositionY - Particles[springPairIndices[2 * i + 1]]->PositionY;
-					float distZ = Particles[springPairIndices[2 * i]]->PositionZ - Particles[springPairIndices[2 * i + 1]]->PositionZ;
+					float distX = ParticleData[springPairIndices[2 * i]].PositionX - ParticleData[springPairIndices[2 * i + 1]].PositionX;
+					float distY = ParticleData[springPairIndices[2 * i]].PositionY - ParticleData[springPairIndices[2 * i + 1]].PositionY;
+					float distZ = ParticleData[springPairIndices[2 * i]].PositionZ - ParticleData[springPairIndices[2 * i + 1]].PositionZ;
 
 					float distance = Math::Sqrt(distX * distX + distY * distY + distZ * distZ);
 
@@ -613,66 +624,331 @@ namespace FlexCLI {
 		return true;
 	}
 
-	List<FlexParticle^>^ FlexScene::GetAllParticles() {
-		return Particles;
+	List<FlexParticle^>^ FlexScene::Particles::get() {
+		SyncState();
+		if (!particleCache) {
+			//materialize particle objects from the particle pool
+			List<FlexParticle^>^ parts = gcnew List<FlexParticle^>(ParticleCount);
+			for (int i = 0; i < ParticleCount; i++)
+				parts->Add(gcnew FlexParticle(ParticleData[i]));
+			particleCache = parts;
+		}
+		return particleCache;
 	}
 
-	List<FlexParticle^>^ FlexScene::GetFluidParticles() {
-		List<FlexParticle^>^ particles = gcnew List<FlexParticle^>();
+	void FlexScene::Particles::set(List<FlexParticle^>^ value) {
+		//an invalid particle leaves the pool as it was
+		for (int i = 0; i < value->Count; i++)
+			if (!value[i]->IsValid())
+				throw gcnew Exception("FlexCLI: FlexScene::Particles::set ---> particle nr. " + i + " is invalid!\n" + value[i]->ToString());
+		WaitForReadback();
+		ParticleCount = 0;
+		ReserveParticles(value->Count);
+		for (int i = 0; i < value->Count; i++)
+			ParticleData[ParticleCount++] = value[i]->ToData();
+		StateIsPartial = false;
+		IncrementalUpload = false;
+		RebuildGroups();
+		ParticlesChanged();
+	}
+
+	///<summary>Makes sure the particle pool can hold at least 'count' particles. The pool grows geometrically and keeps its contents.</summary>
+	void FlexScene::ReserveParticles(int count) {
+		if (ParticleData->Length >= count)
+			return;
+		int capacity = Math::Max(count, Math::Max(ParticleData->Length * 2, 64));
+		array<FlexParticleData>^ data = gcnew array<FlexParticleData>(capacity);
+		Array::Copy(ParticleData, data, ParticleCount);
+		ParticleData = data;
+	}
 
-		for (int i = 0; i < FluidIndices->Count; i++)
-			particles->Add(Particles[FluidIndices[i]]);
+	///Appends one particle to the pool. Callers validate and call ParticlesChanged() once they are done.
+	void FlexScene::AddParticle(float positionX, float positionY, float positionZ, float velocityX, float velocityY, float velocityZ, float inverseMass, int phase) {
+		ReserveParticles(ParticleCount + 1);
+		FlexParticleData% p = ParticleData[ParticleCount++];
+		p.PositionX = positionX;
+		p.PositionY = positionY;
+		p.PositionZ = positionZ;
+		p.InverseMass = inverseMass;
+		p.VelocityX = velocityX;
+		p.VelocityY = velocityY;
+		p.VelocityZ = velocityZ;
+		p.Phase = phase;
+	}
 
-		return particles;
+	///Adds a group to the registry. Registering an existing group again extends its entry and marks it as not contiguous, unless the new ranges directly follow the old ones.
+	void FlexScene::RegisterGroup(int groupIndex, FlexParticleCategory category, int particleOffset, int particleCount, int shapeOffset, int shapeCount, int springOffset, int springCount) {
+		FlexGroupInfo info;
+		if (!Groups->TryGetValue(groupIndex, info)) {
+			info.GroupIndex = groupIndex;
+			info.Category = category;
+			info.ParticleOffset = particleOffset;
+			info.ParticleCount = particleCount;
+			info.ShapeOffset = shapeOffset;
+			info.ShapeCount = shapeCount;
+			info.SpringOffset = springOffset;
+			info.SpringCount = springCount;
+			info.TriangleOffset = 0;
+			info.TriangleCount = 0;
+			info.IsContiguous = true;
+		}
+		else {
+			if (info.ParticleOffset + info.ParticleCount != particleOffset || (shapeCount > 0 && info.ShapeCount > 0) || (springCount > 0 && info.SpringCount > 0))
+				info.IsContiguous = false;
+			info.ParticleCount += particleCount;
+			if (info.ShapeCount == 0)
+				info.ShapeOffset = shapeOffset;
+			info.ShapeCount += shapeCount;
+			if (info.SpringCount == 0)
+				info.SpringOffset = springOffset;
+			info.SpringCount += springCount;
+		}
+		Groups[groupIndex] = info;
 	}
 
-	List<FlexParticle^>^ FlexScene::GetRigidParticles() {
-		List<FlexParticle^>^ particles = gcnew List<FlexParticle^>();
+	///Rebuilds the registry from the particle pool after the particles were replaced as a whole. Constraint ranges are lost then.
+	void FlexScene::RebuildGroups() {
+		Groups->Clear();
+		int runStart = 0;
+		for (int i = 1; i <= ParticleCount; i++) {
+			if (i == ParticleCount || ParticleData[i].GroupIndex != ParticleData[runStart].GroupIndex) {
+				RegisterGroup(ParticleData[runStart].GroupIndex, FlexParticleCategory::All, runStart, i - runStart, 0, 0, 0, 0);
+				runStart = i;
+			}
+		}
+	}
+
+	array<int>^ FlexScene::GetRegisteredGroups() {
+		array<int>^ groups = gcnew array<int>(Groups->Count);
+		Groups->Keys->CopyTo(groups, 0);
+		return groups;
+	}
+
+	///<summary>Brings the particle pool up to date before it is read or changed: joins a pending pipelined readback and fetches channels the last readback skipped</summary>
+	void FlexScene::SyncState() {
+		WaitForReadback();
+		if (StateIsPartial && Flex && Flex->IsReady() && Flex->Scene == this)
+			Flex->ReadSceneState(true);
+	}
 
-		for (int numRigid = 0; numRigid < NumActualRigids; numRigid++) {
-			for (int j = RigidOffsets[numRigid]; j < RigidOffsets[numRigid + 1]; j++)
-				particles->Add(Particles[RigidIndices[j]]);
+	///<summary>Makes sure a pipelined readback of the owning Flex instance has finished writing into this scene</summary>
+	void FlexScene::WaitForReadback() {
+		if (Flex)
+			Flex->FinishReadback();
+	}
+
+	void FlexScene::ReserveOptionalState(int count, FlexReadback channels) {
+		int capacity = Math::Max(count, 1);
+		if ((channels & FlexReadback::Normals) == FlexReadback::Normals && (!StateNormals || StateNormals->Length < capacity * 3))
+			StateNormals = gcnew array<float>(capacity * 3);
+		if ((channels & FlexReadback::Densities) == FlexReadback::Densities && (!StateDensities || StateDensities->Length < capacity))
+			StateDensities = gcnew array<float>(capacity);
+		if ((channels & FlexReadback::Contacts) == FlexReadback::Contacts && (!StateContactCounts || StateContactCounts->Length < capacity)) {
+			StateContactCounts = gcnew array<int>(capacity);
+			StateContactPlanes = gcnew array<float>(capacity * 24);
+			StateContactVelocities = gcnew array<float>(capacity * 24);
 		}
+	}
 
-		return particles;
+	///<summary>Particle normals [x, y, z] as of the last solver update. Requires FlexReadback::Normals.</summary>
+	array<float>^ FlexScene::GetParticleNormals() {
+		if (!StateNormals)
+			return gcnew array<float>(0);
+		array<float>^ normals = gcnew array<float>(ParticleCount * 3);
+		Array::Copy(StateNormals, normals, normals->Length);
+		return normals;
+	}
+
+	///<summary>Particle densities as of the last solver update. Requires FlexReadback::Densities.</summary>
+	array<float>^ FlexScene::GetParticleDensities() {
+		if (!StateDensities)
+			return gcnew array<float>(0);
+		array<float>^ densities = gcnew array<float>(ParticleCount);
+		Array::Copy(StateDensities, densities, densities->Length);
+		return densities;
+	}
+
+	///<summary>Contacts of each particle with collision shapes as of the last solver update. Requires FlexReadback::Contacts.</summary>
+	///<param name = 'contactCounts'>Number of contacts per particle, at most 6</param>
+	///<param name = 'contactPlanes'>6 contact planes [nx, ny, nz, d] per particle</param>
+	///<param name = 'contactVelocities'>6 velocities of the contacted shapes [x, y, z, w] per particle</param>
+	///<returns>The number of particles</returns>
+	int FlexScene::GetParticleContacts(array<int>^% contactCounts, array<float>^% contactPlanes, array<float>^% contactVelocities) {
+		int count = StateContactCounts ? ParticleCount : 0;
+		contactCounts = gcnew array<int>(count);
+		contactPlanes = gcnew array<float>(count * 24);
+		contactVelocities = gcnew array<float>(count * 24);
+		if (count > 0) {
+			Array::Copy(StateContactCounts, contactCounts, count);
+			Array::Copy(StateContactPlanes, contactPlanes, count * 24);
+			Array::Copy(StateContactVelocities, contactVelocities, count * 24);
+		}
+		return count;
+	}
+
+	List<FlexParticle^>^ FlexScene::GetAllParticles() {
+		return Particles;
+	}
+
+	List<FlexParticle^>^ FlexScene::GetFluidParticles() {
+		return GatherParticles(GetIndices(FlexParticleCategory::Fluid));
+	}
+
+	List<FlexParticle^>^ FlexScene::GetRigidParticles() {
+		return GatherParticles(GetIndices(FlexParticleCategory::Rigid));
 	}
 
 	List<List<FlexParticle^>^>^ FlexScene::GetSoftParticles() {
+		List<FlexParticle^>^ all = Particles;
 		List<List<FlexParticle^>^>^ particles = gcnew List<List<FlexParticle^>^>();
 		for (int i = 1; i < SoftBodyOffsets->Count; i++) {
 			List<FlexParticle^>^ part = gcnew List<FlexParticle^>();
 			for (int j = SoftBodyOffsets[i - 1]; j < SoftBodyOffsets[i]; j++)
-				part->Add(Particles[j]);
+				part->Add(all[j]);
 			particles->Add(part);
 		}
 		return particles;
 	}
 
 	List<FlexParticle^>^ FlexScene::GetSpringParticles() {
-		List<FlexParticle^>^ particles = gcnew List<FlexParticle^>();
+		return GatherParticles(GetIndices(FlexParticleCategory::Spring));
+	}
 
-		for (int i = 0; i < SpringIndices->Count; i++)
-			particles->Add(Particles[SpringIndices[i]]);
+	List<FlexParticle^>^ FlexScene::GetClothParticles() {
+		return GatherParticles(GetIndices(FlexParticleCategory::Cloth));
+	}
 
+	List<FlexParticle^>^ FlexScene::GetInflatableParticles() {
+		return GatherParticles(GetIndices(FlexParticleCategory::Inflatable));
+	}
+
+	List<FlexParticle^>^ FlexScene::GatherParticles(ArraySegment<int> indices) {
+		List<FlexParticle^>^ all = Particles;
+		List<FlexParticle^>^ particles = gcnew List<FlexParticle^>(indices.Count);
+		for (int i = 0; i < indices.Count; i++)
+			particles->Add(all[indices.Array[indices.Offset + i]]);
 		return particles;
 	}
 
-	List<FlexParticle^>^ FlexScene::GetClothParticles() {
-		List<FlexParticle^>^ particles = gcnew List<FlexParticle^>();
+	///<summary>Builds the index views of all particle categories and groups. O(n) once after the scene changed, the views are reused until the next registration.</summary>
+	void FlexScene::BuildIndexViews() {
+		if (indexViewsValid)
+			return;
 
-		for (int i = 0; i < ClothIndices->Count; i++)
-			particles->Add(Particles[ClothIndices[i]]);
+		//categories, back to back in the order of FlexParticleCategory
+		List<int>^ indices = gcnew List<int>(2 * ParticleCount);
+		categoryOffsets = gcnew array<int>((int)FlexParticleCategory::Inflatable + 2);
+		for (int i = 0; i < ParticleCount; i++)
+			indices->Add(i);
+		categoryOffsets[(int)FlexParticleCategory::Fluid] = indices->Count;
+		indices->AddRange(FluidIndices);
+		categoryOffsets[(int)FlexParticleCategory::Rigid] = indices->Count;
+		for (int j = RigidOffsets[0]; j < RigidOffsets[NumActualRigids]; j++)
+			indices->Add(RigidIndices[j]);
+		categoryOffsets[(int)FlexParticleCategory::Soft] = indices->Count;
+		if (SoftBodyOffsets->Count > 1)
+			for (int j = SoftBodyOffsets[0]; j < SoftBodyOffsets[SoftBodyOffsets->Count - 1]; j++)
+				indices->Add(j);
+		categoryOffsets[(int)FlexParticleCategory::Spring] = indices->Count;
+		indices->AddRange(SpringIndices);
+		categoryOffsets[(int)FlexParticleCategory::Cloth] = indices->Count;
+		indices->AddRange(ClothIndices);
+		categoryOffsets[(int)FlexParticleCategory::Inflatable] = indices->Count;
+		indices->AddRange(InflatableIndices);
+		categoryOffsets[(int)FlexParticleCategory::Inflatable + 1] = indices->Count;
+		categoryIndices = indices->ToArray();
+
+		//contiguous groups are answered straight from the registry, a counting sort by group index is only needed for the others
+		groupIndices = nullptr;
+		groupSpans = nullptr;
+		bool scattered = false;
+		for each (FlexGroupInfo info in Groups->Values)
+			scattered |= !info.IsContiguous;
+		if (scattered)
+			BuildGroupSpans();
+
+		indexViewsValid = true;
+	}
 
-		return particles;
+	void FlexScene::BuildGroupSpans() {
+		Dictionary<int, int>^ counts = gcnew Dictionary<int, int>();
+		for (int i = 0; i < ParticleCount; i++) {
+			int count = 0;
+			counts->TryGetValue(ParticleData[i].GroupIndex, count);
+			counts[ParticleData[i].GroupIndex] = count + 1;
+		}
+		Dictionary<int, int>^ next = gcnew Dictionary<int, int>(counts->Count);
+		groupSpans = gcnew Dictionary<int, ArraySegment<int>>(counts->Count);
+		groupIndices = gcnew array<int>(ParticleCount);
+		int offset = 0;
+		for each (KeyValuePair<int, int> kvp in counts) {
+			next->Add(kvp.Key, offset);
+			groupSpans->Add(kvp.Key, ArraySegment<int>(groupIndices, offset, kvp.Value));
+			offset += kvp.Value;
+		}
+		for (int i = 0; i < ParticleCount; i++) {
+			int g = ParticleData[i].GroupIndex;
+			int pos = next[g];
+			groupIndices[pos] = i;
+			next[g] = pos + 1;
+		}
 	}
 
-	List<FlexParticle^>^ FlexScene::GetInflatableParticles() {
-		List<FlexParticle^>^ particles = gcnew List<FlexParticle^>();
+	///<summary>Indices of all particles of a category. No allocation, unless the scene changed since the views were built.</summary>
+	ArraySegment<int> FlexScene::GetIndices(FlexParticleCategory category) {
+		int c = (int)category;
+		if (c < 0 || c > (int)FlexParticleCategory::Inflatable)
+			throw gcnew Exception("FlexCLI: FlexScene::GetIndices(...) ---> Invalid category " + c);
+		BuildIndexViews();
+		return ArraySegment<int>(categoryIndices, categoryOffsets[c], categoryOffsets[c + 1] - categoryOffsets[c]);
+	}
 
-		for (int i = 0; i < InflatableIndices->Count; i++)
-			particles->Add(Particles[InflatableIndices[i]]);
+	///<summary>Indices of all particles with the given group index, in ascending order. Empty, if the group doesn't exist.</summary>
+	ArraySegment<int> FlexScene::GetGroupIndices(int groupIndex) {
+		BuildIndexViews();
+		FlexGroupInfo info;
+		if (!Groups->TryGetValue(groupIndex, info))
+			return ArraySegment<int>(categoryIndices, 0, 0);
+		//the first span of the category indices is the identity 0..n-1
+		if (info.IsContiguous)
+			return ArraySegment<int>(categoryIndices, info.ParticleOffset, info.ParticleCount);
+		return groupSpans[groupIndex];
+	}
 
-		return particles;
+	///<summary>Writes the positions [x, y, z] of the particles in 'indices' into a caller owned array, without allocating</summary>
+	///<param name = 'indices'>Index view, as returned by GetIndices or GetGroupIndices</param>
+	///<param name = 'positions'>Must be at least of length 3 * indices.Count</param>
+	///<returns>The number of particles written</returns>
+	int FlexScene::ReadPositions(ArraySegment<int> indices, array<float>^ positions) {
+		if (positions->Length < indices.Count * 3)
+			throw gcnew Exception("FlexCLI: int FlexScene::ReadPositions(...) ---> Array is too short to hold " + indices.Count + " positions!");
+		SyncState();
+		array<int>^ idx = indices.Array;
+		for (int i = 0; i < indices.Count; i++) {
+			FlexParticleData% p = ParticleData[idx[indices.Offset + i]];
+			positions[3 * i] = p.PositionX;
+			positions[3 * i + 1] = p.PositionY;
+			positions[3 * i + 2] = p.PositionZ;
+		}
+		return indices.Count;
+	}
+
+	///<summary>Writes the velocities [x, y, z] of the particles in 'indices' into a caller owned array, without allocating</summary>
+	///<param name = 'indices'>Index view, as returned by GetIndices or GetGroupIndices</param>
+	///<param name = 'velocities'>Must be at least of length 3 * indices.Count</param>
+	///<returns>The number of particles written</returns>
+	int FlexScene::ReadVelocities(ArraySegment<int> indices, array<float>^ velocities) {
+		if (velocities->Length < indices.Count * 3)
+			throw gcnew Exception("FlexCLI: int FlexScene::ReadVelocities(...) ---> Array is too short to hold " + indices.Count + " velocities!");
+		SyncState();
+		array<int>^ idx = indices.Array;
+		for (int i = 0; i < indices.Count; i++) {
+			FlexParticleData% p = ParticleData[idx[indices.Offset + i]];
+			velocities[3 * i] = p.VelocityX;
+			velocities[3 * i + 1] = p.VelocityY;
+			velocities[3 * i + 2] = p.VelocityZ;
+		}
+		return indices.Count;
 	}
 
 	List<int>^ FlexScene::GetSpringPairIndices() {
@@ -680,10 +956,31 @@ namespace FlexCLI {
 	}
 
 	FlexScene^ FlexScene::AppendScene(FlexScene^ newScene) {
+		SyncState();
+		newScene->SyncState();
 
-		//general particle stuff
+		//group registry, shifted behind the existing ranges
 		int oldNumParticles = this->NumParticles();
-		this->Particles->AddRange(newScene->Particles);
+		int oldNumShapes = this->NumRigids();
+		int oldNumSprings = this->SpringLengths->Count;
+		int oldNumTriangles = this->DynamicTriangleIndices->Count / 3;
+		for each (FlexGroupInfo info in newScene->Groups->Values) {
+			FlexGroupInfo shifted = info;
+			shifted.ParticleOffset += oldNumParticles;
+			shifted.ShapeOffset += oldNumShapes;
+			shifted.SpringOffset += oldNumSprings;
+			shifted.TriangleOffset += oldNumTriangles;
+			if (Groups->ContainsKey(shifted.GroupIndex))
+				RegisterGroup(shifted.GroupIndex, shifted.Category, shifted.ParticleOffset, shifted.ParticleCount, shifted.ShapeOffset, shifted.ShapeCount, shifted.SpringOffset, shifted.SpringCount);
+			else
+				Groups->Add(shifted.GroupIndex, shifted);
+		}
+
+		//general particle stuff
+		ReserveParticles(oldNumParticles + newScene->ParticleCount);
+		Array::Copy(newScene->ParticleData, 0, ParticleData, oldNumParticles, newScene->ParticleCount);
+		ParticleCount += newScene->ParticleCount;
+		ParticlesChanged();
 
 		//fluids
 		for each(int fi in newScene->FluidIndices)
@@ -737,16 +1034,84 @@ namespace FlexCLI {
 		return this;
 	};
 
+	//hull of all indices where the lists differ, divided by 'stride'. 'stride' consecutive entries belong to one constraint.
+	template<typename T>
+	static FlexRange DirtyRange(List<T>^ current, List<T>^ altered, int stride) {
+		if (current == altered)
+			return FlexRange(0, altered->Count / stride);
+		int first = -1, last = -1;
+		for (int i = 0; i < altered->Count; i++)
+			if (current[i] != altered[i]) {
+				if (first < 0) first = i;
+				last = i;
+			}
+		return first < 0 ? FlexRange() : FlexRange(first / stride, last / stride + 1);
+	}
+
+	template<typename T>
+	static bool SameCount(List<T>^ current, List<T>^ altered) {
+		return current->Count == altered->Count;
+	}
+
+	static bool SameParticle(FlexParticleData% a, FlexParticleData% b) {
+		return a.PositionX == b.PositionX && a.PositionY == b.PositionY && a.PositionZ == b.PositionZ && a.InverseMass == b.InverseMass &&
+			a.VelocityX == b.VelocityX && a.VelocityY == b.VelocityY && a.VelocityZ == b.VelocityZ && a.Phase == b.Phase;
+	}
+
 	FlexScene^ FlexScene::AlterScene(FlexScene^ alteredScene, bool includeAllParticles) {
-		if (includeAllParticles)
-			this->Particles = alteredScene->Particles;
+		SyncState();
+		alteredScene->SyncState();
+
+		//a changed array length can't be uploaded as range, the next Flex::SetScene uploads everything
+		bool structure = (includeAllParticles && ParticleCount != alteredScene->ParticleCount) ||
+			!SameCount(RigidStiffnesses, alteredScene->RigidStiffnesses) ||
+			!SameCount(SpringIndices, alteredScene->SpringIndices) ||
+			!SameCount(SpringPairIndices, alteredScene->SpringPairIndices) ||
+			!SameCount(SpringLengths, alteredScene->SpringLengths) ||
+			!SameCount(SpringStiffnesses, alteredScene->SpringStiffnesses) ||
+			!SameCount(InflatableConstraintScales, alteredScene->InflatableConstraintScales) ||
+			!SameCount(InflatableOverPressures, alteredScene->InflatableOverPressures) ||
+			!SameCount(InflatableRestVolumes, alteredScene->InflatableRestVolumes);
+
+		//particles, only records that actually differ are written and marked dirty
+		int first = -1, last = -1;
+		if (includeAllParticles && structure) {
+			ParticleCount = 0;
+			ReserveParticles(alteredScene->ParticleCount);
+			Array::Copy(alteredScene->ParticleData, ParticleData, alteredScene->ParticleCount);
+			ParticleCount = alteredScene->ParticleCount;
+			first = 0;
+			last = ParticleCount - 1;
+		}
 		else
-			for (int i = 0; i < this->NumParticles(); i++) {
-				if (alteredScene->Particles[i]->InverseMass == 0.0f  || this->Particles[i]->InverseMass == 0.0f)// && this->Particles[i]->InverseMass != 0.0f)
-					this->Particles[i] = alteredScene->Particles[i];
-				//else if(this->Particles[i]->InverseMass == 0.0f && alteredScene->Particles[i]->InverseMass != 0.0f)
-
+			for (int i = 0; i < Math::Min(this->NumParticles(), alteredScene->NumParticles()); i++) {
+				if (!includeAllParticles && alteredScene->ParticleData[i].InverseMass != 0.0f && this->ParticleData[i].InverseMass != 0.0f)
+					continue;
+				if (SameParticle(this->ParticleData[i], alteredScene->ParticleData[i]))
+					continue;
+				this->ParticleData[i] = alteredScene->ParticleData[i];
+				if (first < 0) first = i;
+				last = i;
 			}
+		if (includeAllParticles)
+			Groups = gcnew Dictionary<int, FlexGroupInfo>(alteredScene->Groups);
+		if (first >= 0 || includeAllParticles)
+			ParticlesChanged();
+
+		if (structure) {
+			IncrementalUpload = false;
+			Changes.Structure = true;
+		}
+		else {
+			Changes.Particles = Changes.Particles.Union(first < 0 ? FlexRange() : FlexRange(first, last + 1));
+			Changes.RigidStiffnesses = Changes.RigidStiffnesses.Union(DirtyRange(RigidStiffnesses, alteredScene->RigidStiffnesses, 1));
+			Changes.Springs = Changes.Springs.Union(DirtyRange(SpringPairIndices, alteredScene->SpringPairIndices, 2))
+				.Union(DirtyRange(SpringLengths, alteredScene->SpringLengths, 1))
+				.Union(DirtyRange(SpringStiffnesses, alteredScene->SpringStiffnesses, 1));
+			Changes.Inflatables = Changes.Inflatables.Union(DirtyRange(InflatableConstraintScales, alteredScene->InflatableConstraintScales, 1))
+				.Union(DirtyRange(InflatableOverPressures, alteredScene->InflatableOverPressures, 1))
+				.Union(DirtyRange(InflatableRestVolumes, alteredScene->InflatableRestVolumes, 1));
+		}
 
 		this->RigidStiffnesses = alteredScene->RigidStiffnesses;
 
@@ -763,12 +1128,197 @@ namespace FlexCLI {
 		return this;
 	}
 
+#pragma region snapshots
+	template<typename T>
+	static void WriteChunk(FlexSnapshot::Writer& writer, unsigned int id, List<T>^ list) {
+		array<T>^ data = list->ToArray();
+		pin_ptr<T> src = data->Length > 0 ? &data[0] : nullptr;
+		writer.Add(id, src, sizeof(T), data->Length);
+	}
+
+	//copies a chunk out of the mapped file, missing chunks read as empty lists
+	template<typename T>
+	static List<T>^ ReadChunk(FlexSnapshot::Reader& reader, unsigned int id) {
+		long long count;
+		const void* src = reader.Find(id, sizeof(T), count);
+		if (count > Int32::MaxValue)
+			throw gcnew Exception("FlexCLI: FlexScene^ FlexScene::Load(...) ---> Chunk too large!");
+		array<T>^ data = gcnew array<T>((int)count);
+		if (count > 0) {
+			pin_ptr<T> dst = &data[0];
+			memcpy(dst, src, (size_t)count * sizeof(T));
+		}
+		return gcnew List<T>(data);
+	}
+
+	//throws unless every index of a loaded chunk refers to one of 'count' particles
+	static void CheckIndices(List<int>^ indices, int count, String^ path, String^ what) {
+		for (int i = 0; i < indices->Count; i++)
+			if (indices[i] < 0 || indices[i] >= count)
+				throw gcnew Exception("FlexCLI: FlexScene^ FlexScene::Load(...) ---> " + path + ": " + what + " index " + indices[i] + " out of range!");
+	}
+
+	///<summary>Writes the scene into a versioned, chunked binary snapshot with one chunk per array. Load it with FlexScene::Load.</summary>
+	void FlexScene::Save(String^ path) {
+		SyncState();
+		FlexSnapshot::Writer writer;
+		pin_ptr<const wchar_t> p = PtrToStringChars(path);
+		if (!writer.Open(p))
+			throw gcnew Exception("FlexCLI: void FlexScene::Save(...) ---> Could not open " + path + " for writing!");
+
+		array<int>^ scalars = { TimeStamp, NumActualRigids, NumCloths, NumInflatables };
+		pin_ptr<int> s = &scalars[0];
+		writer.Add(FlexSnapshot::Scalars, s, sizeof(int), scalars->Length);
+
+		//particles go out straight from the pool
+		pin_ptr<FlexParticleData> particles = ParticleCount > 0 ? &ParticleData[0] : nullptr;
+		writer.Add(FlexSnapshot::Particles, particles, sizeof(FlexKernels::ParticleRecord), ParticleCount);
+
+		array<int>^ groups = gcnew array<int>(Groups->Count * 11);
+		int g = 0;
+		for each(FlexGroupInfo info in Groups->Values) {
+			array<int>^ record = { info.GroupIndex, (int)info.Category, info.ParticleOffset, info.ParticleCount, info.ShapeOffset, info.ShapeCount,
+				info.SpringOffset, info.SpringCount, info.TriangleOffset, info.TriangleCount, info.IsContiguous ? 1 : 0 };
+			record->CopyTo(groups, 11 * g++);
+		}
+		pin_ptr<int> gr = groups->Length > 0 ? &groups[0] : nullptr;
+		writer.Add(FlexSnapshot::Groups, gr, sizeof(int), groups->Length);
+
+		WriteChunk(writer, FlexSnapshot::FluidIndices, FluidIndices);
+		WriteChunk(writer, FlexSnapshot::RigidIndices, RigidIndices);
+		WriteChunk(writer, FlexSnapshot::RigidOffsets, RigidOffsets);
+		WriteChunk(writer, FlexSnapshot::SoftBodyOffsets, SoftBodyOffsets);
+		WriteChunk(writer, FlexSnapshot::ShapeMassCenters, ShapeMassCenters);
+		WriteChunk(writer, FlexSnapshot::RigidRestPositions, RigidRestPositions);
+		WriteChunk(writer, FlexSnapshot::RigidRestNormals, RigidRestNormals);
+		WriteChunk(writer, FlexSnapshot::RigidStiffnesses, RigidStiffnesses);
+		WriteChunk(writer, FlexSnapshot::RigidRotations, RigidRotations);
+		WriteChunk(writer, FlexSnapshot::RigidTranslations, RigidTranslations);
+		WriteChunk(writer, FlexSnapshot::SpringIndices, SpringIndices);
+		WriteChunk(writer, FlexSnapshot::SpringPairIndices, SpringPairIndices);
+		WriteChunk(writer, FlexSnapshot::SpringLengths, SpringLengths);
+		WriteChunk(writer, FlexSnapshot::SpringStiffnesses, SpringStiffnesses);
+		WriteChunk(writer, FlexSnapshot::ClothIndices, ClothIndices);
+		WriteChunk(writer, FlexSnapshot::DynamicTriangleIndices, DynamicTriangleIndices);
+		WriteChunk(writer, FlexSnapshot::DynamicTriangleNormals, DynamicTriangleNormals);
+		WriteChunk(writer, FlexSnapshot::InflatableIndices, InflatableIndices);
+		WriteChunk(writer, FlexSnapshot::InflatableStartIndices, InflatableStartIndices);
+		WriteChunk(writer, FlexSnapshot::InflatableNumTriangles, InflatableNumTriangles);
+		WriteChunk(writer, FlexSnapshot::InflatableRestVolumes, InflatableRestVolumes);
+		WriteChunk(writer, FlexSnapshot::InflatableOverPressures, InflatableOverPressures);
+		WriteChunk(writer, FlexSnapshot::InflatableConstraintScales, InflatableConstraintScales);
+
+		if (!writer.Close())
+			throw gcnew Exception("FlexCLI: void FlexScene::Save(...) ---> Writing " + path + " failed!");
+	}
+
+	///<summary>Reads a snapshot written by FlexScene::Save. The file is memory-mapped and the particle chunk is copied straight into the particle pool.</summary>
+	FlexScene^ FlexScene::Load(String^ path) {
+		FlexSnapshot::Reader reader;
+		pin_ptr<const wchar_t> p = PtrToStringChars(path);
+		const char* error = reader.Open(p);
+		if (error)
+			throw gcnew Exception("FlexCLI: FlexScene^ FlexScene::Load(...) ---> " + path + ": " + gcnew String(error));
+
+		FlexScene^ scene = gcnew FlexScene();
+		List<int>^ scalars = ReadChunk<int>(reader, FlexSnapshot::Scalars);
+		if (scalars->Count >= 4) {
+			scene->TimeStamp = scalars[0];
+			scene->NumActualRigids = scalars[1];
+			scene->NumCloths = scalars[2];
+			scene->NumInflatables = scalars[3];
+		}
+
+		long long count;
+		const void* particles = reader.Find(FlexSnapshot::Particles, sizeof(FlexKernels::ParticleRecord), count);
+		if (count > Int32::MaxValue)
+			throw gcnew Exception("FlexCLI: FlexScene^ FlexScene::Load(...) ---> " + path + " holds too many particles!");
+		int invalid = count > 0 ? FlexKernels::FirstInvalidRecord((const FlexKernels::ParticleRecord*)particles, (int)count) : -1;
+		if (invalid >= 0)
+			throw gcnew Exception("FlexCLI: FlexScene^ FlexScene::Load(...) ---> " + path + ": particle " + invalid + " has a negative inverse mass or phase!");
+		scene->ReserveParticles((int)count);
+		if (count > 0) {
+			pin_ptr<FlexParticleData> dst = &scene->ParticleData[0];
+			memcpy(dst, particles, (size_t)count * sizeof(FlexKernels::ParticleRecord));
+		}
+		scene->ParticleCount = (int)count;
+
+		List<int>^ groups = ReadChunk<int>(reader, FlexSnapshot::Groups);
+		if (groups->Count == 0)
+			scene->RebuildGroups();
+		for (int i = 0; i + 11 <= groups->Count; i += 11) {
+			FlexGroupInfo info;
+			info.GroupIndex = groups[i];
+			info.Category = (FlexParticleCategory)groups[i + 1];
+			info.ParticleOffset = groups[i + 2];
+			info.ParticleCount = groups[i + 3];
+			info.ShapeOffset = groups[i + 4];
+			info.ShapeCount = groups[i + 5];
+			info.SpringOffset = groups[i + 6];
+			info.SpringCount = groups[i + 7];
+			info.TriangleOffset = groups[i + 8];
+			info.TriangleCount = groups[i + 9];
+			info.IsContiguous = groups[i + 10] != 0;
+			scene->Groups[info.GroupIndex] = info;
+		}
+
+		scene->FluidIndices = ReadChunk<int>(reader, FlexSnapshot::FluidIndices);
+		scene->RigidIndices = ReadChunk<int>(reader, FlexSnapshot::RigidIndices);
+		scene->RigidOffsets = ReadChunk<int>(reader, FlexSnapshot::RigidOffsets);
+		if (scene->RigidOffsets->Count == 0)
+			scene->RigidOffsets->Add(0);
+		scene->SoftBodyOffsets = ReadChunk<int>(reader, FlexSnapshot::SoftBodyOffsets);
+		scene->ShapeMassCenters = ReadChunk<float>(reader, FlexSnapshot::ShapeMassCenters);
+		scene->RigidRestPositions = ReadChunk<float>(reader, FlexSnapshot::RigidRestPositions);
+		scene->RigidRestNormals = ReadChunk<float>(reader, FlexSnapshot::RigidRestNormals);
+		scene->RigidStiffnesses = ReadChunk<float>(reader, FlexSnapshot::RigidStiffnesses);
+		scene->RigidRotations = ReadChunk<float>(reader, FlexSnapshot::RigidRotations);
+		scene->RigidTranslations = ReadChunk<float>(reader, FlexSnapshot::RigidTranslations);
+		scene->SpringIndices = ReadChunk<int>(reader, FlexSnapshot::SpringIndices);
+		scene->SpringPairIndices = ReadChunk<int>(reader, FlexSnapshot::SpringPairIndices);
+		scene->SpringLengths = ReadChunk<float>(reader, FlexSnapshot::SpringLengths);
+		scene->SpringStiffnesses = ReadChunk<float>(reader, FlexSnapshot::SpringStiffnesses);
+		scene->ClothIndices = ReadChunk<int>(reader, FlexSnapshot::ClothIndices);
+		scene->DynamicTriangleIndices = ReadChunk<int>(reader, FlexSnapshot::DynamicTriangleIndices);
+		scene->DynamicTriangleNormals = ReadChunk<float>(reader, FlexSnapshot::DynamicTriangleNormals);
+		scene->InflatableIndices = ReadChunk<int>(reader, FlexSnapshot::InflatableIndices);
+		scene->InflatableStartIndices = ReadChunk<int>(reader, FlexSnapshot::InflatableStartIndices);
+		scene->InflatableNumTriangles = ReadChunk<int>(reader, FlexSnapshot::InflatableNumTriangles);
+		scene->InflatableRestVolumes = ReadChunk<float>(reader, FlexSnapshot::InflatableRestVolumes);
+		scene->InflatableOverPressures = ReadChunk<float>(reader, FlexSnapshot::InflatableOverPressures);
+		scene->InflatableConstraintScales = ReadChunk<float>(reader, FlexSnapshot::InflatableConstraintScales);
+
+		//a corrupt or foreign file must not reach the solver, which would index out of its buffers
+		int numParticles = scene->ParticleCount;
+		CheckIndices(scene->FluidIndices, numParticles, path, "fluid");
+		CheckIndices(scene->RigidIndices, numParticles, path, "rigid");
+		CheckIndices(scene->SpringIndices, numParticles, path, "spring");
+		CheckIndices(scene->SpringPairIndices, numParticles, path, "spring pair");
+		CheckIndices(scene->ClothIndices, numParticles, path, "cloth");
+		CheckIndices(scene->DynamicTriangleIndices, numParticles, path, "triangle");
+		CheckIndices(scene->InflatableIndices, numParticles, path, "inflatable");
+		CheckIndices(scene->InflatableStartIndices, numParticles, path, "inflatable start");
+		if (scene->SpringPairIndices->Count % 2 != 0 || scene->SpringLengths->Count != scene->SpringPairIndices->Count / 2 || scene->SpringStiffnesses->Count != scene->SpringLengths->Count)
+			throw gcnew Exception("FlexCLI: FlexScene^ FlexScene::Load(...) ---> " + path + ": spring chunks don't match!");
+		if (scene->DynamicTriangleIndices->Count % 3 != 0)
+			throw gcnew Exception("FlexCLI: FlexScene^ FlexScene::Load(...) ---> " + path + ": triangle chunk is not of length n * 3!");
+		if (scene->RigidOffsets[0] != 0 || scene->RigidOffsets[scene->RigidOffsets->Count - 1] != scene->RigidIndices->Count)
+			throw gcnew Exception("FlexCLI: FlexScene^ FlexScene::Load(...) ---> " + path + ": rigid offsets don't match the rigid indices!");
+		for (int i = 1; i < scene->RigidOffsets->Count; i++)
+			if (scene->RigidOffsets[i] < scene->RigidOffsets[i - 1])
+				throw gcnew Exception("FlexCLI: FlexScene^ FlexScene::Load(...) ---> " + path + ": rigid offsets are not ascending!");
+
+		scene->ParticlesChanged();
+		return scene;
+	}
+#pragma endregion
+
 	void FlexScene::SetActivity(List<bool>^ activityMask) {
 		Flex->SetActivity(activityMask);
 	}
 
 	bool FlexScene::IsValid() {
-		return Particles->Count > 0;
+		return NumParticles() > 0;
 	}
 
 	String^ FlexScene::ToString() {
@@ -0,0 +1,561 @@
+// FlexSimplify.cpp
+// Native translation unit (compiled without /clr and without the precompiled header), see FlexSimplify.h
+#include "FlexSimplify.h"
+#include "FlexParallel.h"
+#include "FlexKernels.h"
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <mutex>
+#include <list>
+#include <unordered_map>
+
+namespace FlexSimplify {
+
+	//meshes above twice this size are cut into cells, one cell is the unit of work for a worker
+	static const int facesPerCell = 32768;
+	//a collapse may tilt a surrounding triangle's normal by at most acos(minNormalDot)
+	static const double minNormalDot = 0.3;
+	//most neighbors a vertex may end up with
+	static const int maxValence = 16;
+
+#pragma region vector math
+	struct Vec {
+		double x, y, z;
+	};
+
+	static inline Vec MakeVec(double x, double y, double z) { Vec r = { x, y, z }; return r; }
+	static inline Vec Sub(const Vec& a, const Vec& b) { return MakeVec(a.x - b.x, a.y - b.y, a.z - b.z); }
+	static inline Vec Cross(const Vec& a, const Vec& b) { return MakeVec(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x); }
+	static inline double Dot(const Vec& a, const Vec& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	static inline double Length(const Vec& a) { return sqrt(Dot(a, a)); }
+
+	///Sum of squared distances to a set of planes, stored as the symmetric 4x4 matrix [a b c d]^T [a b c d]
+	struct Quadric {
+		double q[10];	//aa ab ac ad bb bc bd cc cd dd
+
+		void AddPlane(const Vec& n, double d) {
+			q[0] += n.x * n.x; q[1] += n.x * n.y; q[2] += n.x * n.z; q[3] += n.x * d;
+			q[4] += n.y * n.y; q[5] += n.y * n.z; q[6] += n.y * d;
+			q[7] += n.z * n.z; q[8] += n.z * d;
+			q[9] += d * d;
+		}
+
+		void Add(const Quadric& o) {
+			for (int i = 0; i < 10; i++)
+				q[i] += o.q[i];
+		}
+
+		double Evaluate(const Vec& v) const {
+			return q[0] * v.x * v.x + 2.0 * q[1] * v.x * v.y + 2.0 * q[2] * v.x * v.z + 2.0 * q[3] * v.x
+				+ q[4] * v.y * v.y + 2.0 * q[5] * v.y * v.z + 2.0 * q[6] * v.y
+				+ q[7] * v.z * v.z + 2.0 * q[8] * v.z + q[9];
+		}
+
+		///Position minimizing the error, false if the planes don't pin down a point
+		bool Minimum(Vec& v) const {
+			double a = q[0], b = q[1], c = q[2], e = q[4], f = q[5], i = q[7];
+			double det = a * (e * i - f * f) - b * (b * i - f * c) + c * (b * f - e * c);
+			double trace = a + e + i;
+			if (fabs(det) <= 1.0e-9 * trace * trace * trace)
+				return false;
+			double rx = -q[3], ry = -q[6], rz = -q[8];
+			v.x = (rx * (e * i - f * f) - b * (ry * i - f * rz) + c * (ry * f - e * rz)) / det;
+			v.y = (a * (ry * i - f * rz) - rx * (b * i - f * c) + c * (b * rz - ry * c)) / det;
+			v.z = (a * (e * rz - ry * f) - b * (b * rz - ry * c) + rx * (b * f - e * c)) / det;
+			return true;
+		}
+	};
+#pragma endregion
+
+	class Simplifier {
+	public:
+		Simplifier(const float* vertices, int numVertices, const int* faces, int numFaces, float maxError)
+			: threshold((double)maxError * maxError) {
+			Weld(vertices, numVertices, faces, numFaces);
+			BuildQuadrics();
+		}
+
+		void Run() {
+			int numFaces = (int)tri.size() / 3;
+			std::vector<std::vector<int> > cells = Partition(numFaces);
+			if (cells.size() <= 1) {
+				std::vector<int> all(numFaces);
+				for (int f = 0; f < numFaces; f++)
+					all[f] = f;
+				Collapse(-1, all);
+				return;
+			}
+
+			//cells only touch vertices all of whose triangles they own, so they can't interfere
+			FlexParallel::ForEach((int)cells.size(), [&](int c) { Collapse(c, cells[c]); });
+
+			//then the seams, the only triangles left at full resolution
+			std::vector<int> seams;
+			for (int f = 0; f < numFaces; f++)
+				if (faceAlive[f] && (cellOf[tri[f * 3]] < 0 || cellOf[tri[f * 3 + 1]] < 0 || cellOf[tri[f * 3 + 2]] < 0))
+					seams.push_back(f);
+			Collapse(-1, seams);
+		}
+
+		std::shared_ptr<Result> Output() const {
+			std::shared_ptr<Result> r = std::make_shared<Result>();
+			std::vector<int> remap(pos.size(), -1);
+			for (int k = 0; k < 3; k++) {
+				r->Lower[k] = 0.0f;
+				r->Upper[k] = 0.0f;
+			}
+			for (size_t f = 0; f < faceAlive.size(); f++) {
+				if (!faceAlive[f])
+					continue;
+				for (int k = 0; k < 3; k++) {
+					int v = tri[f * 3 + k];
+					if (remap[v] < 0) {
+						remap[v] = (int)(r->Vertices.size() / 3);
+						float x[3] = { (float)pos[v].x, (float)pos[v].y, (float)pos[v].z };
+						for (int j = 0; j < 3; j++) {
+							r->Lower[j] = remap[v] == 0 ? x[j] : fminf(r->Lower[j], x[j]);
+							r->Upper[j] = remap[v] == 0 ? x[j] : fmaxf(r->Upper[j], x[j]);
+							r->Vertices.push_back(x[j]);
+						}
+					}
+					r->Faces.push_back(remap[v]);
+				}
+			}
+			return r;
+		}
+
+	private:
+		struct Candidate {
+			double Cost;
+			int U, V;
+			unsigned int VersionU, VersionV;
+			Vec Position;
+			bool operator<(const Candidate& o) const { return Cost > o.Cost; }	//min heap
+		};
+
+		double threshold;				//squared error bound
+		std::vector<Vec> pos;
+		std::vector<Quadric> quadrics;
+		std::vector<int> tri;			//three vertices per face
+		std::vector<char> faceAlive;
+		std::vector<std::vector<int> > fans;	//faces per vertex, may contain dead faces, which are skipped
+		std::vector<unsigned int> version;	//bumped whenever a vertex moves or dies, outdates its heap entries
+		std::vector<int> cellOf;		//cell owning all faces of a vertex, -1 if the vertex sits on a cell border
+
+#pragma region setup
+		void Weld(const float* vertices, int numVertices, const int* faces, int numFaces) {
+			struct Key {
+				uint32_t x, y, z;
+				bool operator==(const Key& o) const { return x == o.x && y == o.y && z == o.z; }
+			};
+			struct KeyHash {
+				size_t operator()(const Key& k) const { return (size_t)(k.x * 73856093u ^ k.y * 19349663u ^ k.z * 83492791u); }
+			};
+			std::unordered_map<Key, int, KeyHash> welded;
+			welded.reserve(numVertices);
+			std::vector<int> remap(numVertices);
+			for (int i = 0; i < numVertices; i++) {
+				//+0.0f folds -0.0f onto 0.0f
+				float x = vertices[i * 3] + 0.0f, y = vertices[i * 3 + 1] + 0.0f, z = vertices[i * 3 + 2] + 0.0f;
+				Key k;
+				memcpy(&k.x, &x, 4);
+				memcpy(&k.y, &y, 4);
+				memcpy(&k.z, &z, 4);
+				std::unordered_map<Key, int, KeyHash>::iterator found = welded.find(k);
+				if (found == welded.end()) {
+					remap[i] = (int)pos.size();
+					welded[k] = remap[i];
+					pos.push_back(MakeVec(x, y, z));
+				}
+				else
+					remap[i] = found->second;
+			}
+
+			tri.reserve((size_t)numFaces * 3);
+			for (int f = 0; f < numFaces; f++) {
+				//callers validate the faces, a face with an index out of range is dropped rather than read out of bounds
+				if ((unsigned)faces[f * 3] >= (unsigned)numVertices || (unsigned)faces[f * 3 + 1] >= (unsigned)numVertices || (unsigned)faces[f * 3 + 2] >= (unsigned)numVertices)
+					continue;
+				int a = remap[faces[f * 3]], b = remap[faces[f * 3 + 1]], c = remap[faces[f * 3 + 2]];
+				if (a == b || b == c || c == a)
+					continue;
+				tri.push_back(a);
+				tri.push_back(b);
+				tri.push_back(c);
+			}
+			faceAlive.assign(tri.size() / 3, 1);
+			version.assign(pos.size(), 0);
+
+			fans.resize(pos.size());
+			for (size_t f = 0; f < tri.size() / 3; f++)
+				for (int k = 0; k < 3; k++)
+					fans[tri[f * 3 + k]].push_back((int)f);
+		}
+
+		///Face planes, plus planes perpendicular to the face along open edges, so borders only move as far as the surface may
+		void BuildQuadrics() {
+			int numFaces = (int)tri.size() / 3;
+			Quadric zero;
+			memset(&zero, 0, sizeof(zero));
+			quadrics.assign(pos.size(), zero);
+
+			//undirected edges sorted by key, edges found once are open
+			std::vector<uint64_t> edges;
+			edges.reserve(tri.size());
+			for (int f = 0; f < numFaces; f++)
+				for (int k = 0; k < 3; k++) {
+					uint32_t a = tri[f * 3 + k], b = tri[f * 3 + (k + 1) % 3];
+					edges.push_back(a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a);
+				}
+			std::sort(edges.begin(), edges.end());
+
+			for (int f = 0; f < numFaces; f++) {
+				const Vec& a = pos[tri[f * 3]];
+				Vec n = Cross(Sub(pos[tri[f * 3 + 1]], a), Sub(pos[tri[f * 3 + 2]], a));
+				double length = Length(n);
+				if (length == 0.0)
+					continue;
+				n = MakeVec(n.x / length, n.y / length, n.z / length);
+				double d = -Dot(n, a);
+				for (int k = 0; k < 3; k++)
+					quadrics[tri[f * 3 + k]].AddPlane(n, d);
+
+				for (int k = 0; k < 3; k++) {
+					uint32_t i = tri[f * 3 + k], j = tri[f * 3 + (k + 1) % 3];
+					uint64_t key = i < j ? ((uint64_t)i << 32) | j : ((uint64_t)j << 32) | i;
+					std::vector<uint64_t>::iterator e = std::lower_bound(edges.begin(), edges.end(), key);
+					bool open = (e == edges.begin() || *(e - 1) != key) && (e + 1 == edges.end() || *(e + 1) != key);
+					if (!open)
+						continue;
+					Vec side = Cross(Sub(pos[j], pos[i]), n);
+					double sideLength = Length(side);
+					if (sideLength == 0.0)
+						continue;
+					side = MakeVec(side.x / sideLength, side.y / sideLength, side.z / sideLength);
+					quadrics[i].AddPlane(side, -Dot(side, pos[i]));
+					quadrics[j].AddPlane(side, -Dot(side, pos[i]));
+				}
+			}
+		}
+
+		///Bins faces into grid cells by their centroid. Returns one face list per non-empty cell, a single list for small meshes.
+		std::vector<std::vector<int> > Partition(int numFaces) {
+			std::vector<std::vector<int> > cells;
+			cellOf.assign(pos.size(), -1);
+			int target = numFaces / facesPerCell;
+			if (target < 2)
+				return cells;
+
+			Vec lower = pos[tri[0]], upper = pos[tri[0]];
+			for (size_t i = 0; i < tri.size(); i++) {
+				const Vec& p = pos[tri[i]];
+				lower = MakeVec(fmin(lower.x, p.x), fmin(lower.y, p.y), fmin(lower.z, p.z));
+				upper = MakeVec(fmax(upper.x, p.x), fmax(upper.y, p.y), fmax(upper.z, p.z));
+			}
+			Vec extent = Sub(upper, lower);
+			//shrink the cell edge until the grid has about 'target' cells, flat meshes only get cut along their large axes
+			double edge = fmax(extent.x, fmax(extent.y, extent.z));
+			int n[3] = { 1, 1, 1 };
+			while (edge > 0.0 && n[0] * n[1] * n[2] < target) {
+				edge *= 0.8;
+				n[0] = (int)fmin(extent.x / edge + 1.0, 256.0);
+				n[1] = (int)fmin(extent.y / edge + 1.0, 256.0);
+				n[2] = (int)fmin(extent.z / edge + 1.0, 256.0);
+				if (n[0] == 256 && n[1] == 256 && n[2] == 256)
+					break;
+			}
+
+			std::unordered_map<int, int> cellIndex;
+			std::vector<int> faceCell(numFaces);
+			for (int f = 0; f < numFaces; f++) {
+				Vec c = pos[tri[f * 3]];
+				for (int k = 1; k < 3; k++)
+					c = MakeVec(c.x + pos[tri[f * 3 + k]].x, c.y + pos[tri[f * 3 + k]].y, c.z + pos[tri[f * 3 + k]].z);
+				int ix = (int)fmin((c.x / 3.0 - lower.x) / edge, n[0] - 1.0);
+				int iy = (int)fmin((c.y / 3.0 - lower.y) / edge, n[1] - 1.0);
+				int iz = (int)fmin((c.z / 3.0 - lower.z) / edge, n[2] - 1.0);
+				int id = (iz * n[1] + iy) * n[0] + ix;
+				std::unordered_map<int, int>::iterator found = cellIndex.find(id);
+				if (found == cellIndex.end()) {
+					found = cellIndex.insert(std::make_pair(id, (int)cells.size())).first;
+					cells.push_back(std::vector<int>());
+				}
+				faceCell[f] = found->second;
+				cells[found->second].push_back(f);
+			}
+
+			//a vertex belongs to a cell only if all of its faces do
+			for (size_t v = 0; v < pos.size(); v++) {
+				if (fans[v].empty())
+					continue;
+				int c = faceCell[fans[v][0]];
+				for (size_t k = 1; k < fans[v].size() && c >= 0; k++)
+					if (faceCell[fans[v][k]] != c)
+						c = -1;
+				cellOf[v] = c;
+			}
+			return cells;
+		}
+#pragma endregion
+
+#pragma region collapse
+		inline bool Allowed(int cell, int u, int v) const {
+			return cell < 0 || (cellOf[u] == cell && cellOf[v] == cell);
+		}
+
+		void Push(std::vector<Candidate>& heap, int u, int v) {
+			Quadric q = quadrics[u];
+			q.Add(quadrics[v]);
+			Candidate c;
+			c.U = u;
+			c.V = v;
+			c.VersionU = version[u];
+			c.VersionV = version[v];
+
+			//the optimum, unless the endpoints or the midpoint do better
+			Vec options[4] = { pos[u], pos[v], MakeVec((pos[u].x + pos[v].x) * 0.5, (pos[u].y + pos[v].y) * 0.5, (pos[u].z + pos[v].z) * 0.5), pos[u] };
+			int numOptions = q.Minimum(options[3]) ? 4 : 3;
+			c.Cost = q.Evaluate(options[0]);
+			c.Position = options[0];
+			for (int i = 1; i < numOptions; i++) {
+				double cost = q.Evaluate(options[i]);
+				if (cost < c.Cost) {
+					c.Cost = cost;
+					c.Position = options[i];
+				}
+			}
+			c.Cost = fmax(c.Cost, 0.0);
+			if (c.Cost > threshold)
+				return;
+			heap.push_back(c);
+			std::push_heap(heap.begin(), heap.end());
+		}
+
+		///Neighbors of 'v' over its alive faces, each listed once per face, and whether 'v' sits on an open border
+		void Neighbors(int v, std::vector<int>& out, bool& border) const {
+			out.clear();
+			for (size_t k = 0; k < fans[v].size(); k++) {
+				int f = fans[v][k];
+				if (!faceAlive[f])
+					continue;
+				for (int j = 0; j < 3; j++)
+					if (tri[f * 3 + j] != v)
+						out.push_back(tri[f * 3 + j]);
+			}
+			std::sort(out.begin(), out.end());
+			//on a closed fan every neighbor is shared by exactly two faces
+			border = false;
+			for (size_t i = 0; i < out.size(); ) {
+				size_t j = i;
+				while (j < out.size() && out[j] == out[i])
+					j++;
+				if (j - i == 1)
+					border = true;
+				i = j;
+			}
+			out.erase(std::unique(out.begin(), out.end()), out.end());
+		}
+
+		///Topology and geometry checks: the collapse must keep the mesh manifold and must not fold any surrounding triangle over
+		bool CanCollapse(int u, int v, const Vec& p, std::vector<int>& nu, std::vector<int>& nv) const {
+			bool borderU, borderV;
+			Neighbors(u, nu, borderU);
+			Neighbors(v, nv, borderV);
+
+			int opposite = 0;
+			for (size_t k = 0; k < fans[u].size(); k++) {
+				int f = fans[u][k];
+				if (faceAlive[f] && (tri[f * 3] == v || tri[f * 3 + 1] == v || tri[f * 3 + 2] == v))
+					opposite++;
+			}
+			if (opposite == 0)
+				return false;
+			//two border vertices joined by an inner edge would pinch the mesh
+			if (opposite == 2 && borderU && borderV)
+				return false;
+
+			//link condition: u and v may only share the neighbors opposite to their common edge
+			int common = 0;
+			for (size_t i = 0, j = 0; i < nu.size() && j < nv.size(); ) {
+				if (nu[i] < nv[j])
+					i++;
+				else if (nu[i] > nv[j])
+					j++;
+				else {
+					common++;
+					i++;
+					j++;
+				}
+			}
+			if (common != opposite)
+				return false;
+			//bounded valence keeps the fans short, flat regions would otherwise collapse into few vertices with huge fans
+			if ((int)(nu.size() + nv.size()) - common - 2 > maxValence)
+				return false;
+
+			for (int side = 0; side < 2; side++) {
+				int moved = side == 0 ? u : v, other = side == 0 ? v : u;
+				for (size_t k = 0; k < fans[moved].size(); k++) {
+					int f = fans[moved][k];
+					if (!faceAlive[f])
+						continue;
+					const int* t = &tri[f * 3];
+					if (t[0] == other || t[1] == other || t[2] == other)
+						continue;
+					Vec before[3], after[3];
+					for (int j = 0; j < 3; j++) {
+						before[j] = pos[t[j]];
+						after[j] = t[j] == moved ? p : pos[t[j]];
+					}
+					Vec n0 = Cross(Sub(before[1], before[0]), Sub(before[2], before[0]));
+					Vec n1 = Cross(Sub(after[1], after[0]), Sub(after[2], after[0]));
+					double l0 = Length(n0), l1 = Length(n1);
+					if (l1 == 0.0 || (l0 > 0.0 && Dot(n0, n1) < minNormalDot * l0 * l1))
+						return false;
+				}
+			}
+			return true;
+		}
+
+		void Apply(int u, int v, const Vec& p) {
+			quadrics[u].Add(quadrics[v]);
+			pos[u] = p;
+			version[u]++;
+			version[v]++;
+			for (size_t k = 0; k < fans[v].size(); k++) {
+				int f = fans[v][k];
+				if (!faceAlive[f])
+					continue;
+				int* t = &tri[f * 3];
+				if (t[0] == u || t[1] == u || t[2] == u)
+					faceAlive[f] = 0;
+				else {
+					for (int j = 0; j < 3; j++)
+						if (t[j] == v)
+							t[j] = u;
+					fans[u].push_back(f);
+				}
+			}
+			std::vector<int>().swap(fans[v]);
+
+			std::vector<int>& fan = fans[u];
+			size_t kept = 0;
+			for (size_t k = 0; k < fan.size(); k++)
+				if (faceAlive[fan[k]])
+					fan[kept++] = fan[k];
+			fan.resize(kept);
+		}
+
+		///Greedy collapses of the cheapest edges of 'faces' until the error bound is hit.
+		///With cell >= 0 only edges between vertices owned by that cell are touched, which makes cells independent.
+		void Collapse(int cell, const std::vector<int>& faces) {
+			std::vector<Candidate> heap;
+			heap.reserve(faces.size() * 3 / 2);
+			for (size_t i = 0; i < faces.size(); i++) {
+				const int* t = &tri[faces[i] * 3];
+				for (int k = 0; k < 3; k++) {
+					//inner edges are pushed from both faces, the second entry is dropped as outdated once the first is applied
+					if (Allowed(cell, t[k], t[(k + 1) % 3]))
+						Push(heap, std::min(t[k], t[(k + 1) % 3]), std::max(t[k], t[(k + 1) % 3]));
+				}
+			}
+
+			std::vector<int> nu, nv;
+			while (!heap.empty()) {
+				std::pop_heap(heap.begin(), heap.end());
+				Candidate c = heap.back();
+				heap.pop_back();
+				if (c.VersionU != version[c.U] || c.VersionV != version[c.V] || fans[c.U].empty() || fans[c.V].empty())
+					continue;
+				if (!CanCollapse(c.U, c.V, c.Position, nu, nv))
+					continue;
+				Apply(c.U, c.V, c.Position);
+				bool border;
+				Neighbors(c.U, nu, border);
+				for (size_t k = 0; k < nu.size(); k++)
+					if (Allowed(cell, c.U, nu[k]))
+						Push(heap, c.U, nu[k]);
+			}
+		}
+#pragma endregion
+	};
+
+#pragma region cache
+	struct Entry {
+		std::shared_ptr<const Result> Value;
+		std::list<uint64_t>::iterator Use;	//position in 'recent'
+		long long Bytes;
+	};
+
+	static std::mutex lock;
+	static std::unordered_map<uint64_t, Entry> cache;
+	static std::list<uint64_t> recent;	//keys, most recently used first
+	static Statistics statistics = { 0, 0, 0, 0, 256ll << 20 };
+
+	//drops least recently used entries until the cache fits its capacity, call with the lock held
+	static void Evict() {
+		while (statistics.ResidentBytes > statistics.CapacityBytes && !recent.empty()) {
+			std::unordered_map<uint64_t, Entry>::iterator last = cache.find(recent.back());
+			statistics.ResidentBytes -= last->second.Bytes;
+			cache.erase(last);
+			recent.pop_back();
+		}
+		statistics.Resident = (int)cache.size();
+	}
+
+	std::shared_ptr<const Result> Simplify(const float* vertices, int numVertices, const int* faces, int numFaces, float maxError) {
+		uint64_t key = FlexKernels::HashBytes(0x73696D706C696679ull, &maxError, sizeof(float));	//"simplify"
+		key = FlexKernels::HashBytes(key, vertices, sizeof(float) * 3 * (long long)numVertices);
+		key = FlexKernels::HashBytes(key, faces, sizeof(int) * 3 * (long long)numFaces);
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			std::unordered_map<uint64_t, Entry>::iterator found = cache.find(key);
+			if (found != cache.end()) {
+				statistics.Hits++;
+				recent.splice(recent.begin(), recent, found->second.Use);
+				return found->second.Value;
+			}
+		}
+
+		//simplify outside the lock, other meshes may be looked up meanwhile
+		Simplifier simplifier(vertices, numVertices, faces, numFaces, maxError);
+		simplifier.Run();
+		std::shared_ptr<const Result> result = simplifier.Output();
+
+		std::lock_guard<std::mutex> guard(lock);
+		statistics.Misses++;
+		//another thread may have simplified the same mesh meanwhile
+		if (cache.find(key) == cache.end()) {
+			Entry entry;
+			entry.Value = result;
+			entry.Use = recent.insert(recent.begin(), key);
+			entry.Bytes = (long long)(result->Vertices.size() * sizeof(float) + result->Faces.size() * sizeof(int));
+			cache[key] = entry;
+			statistics.ResidentBytes += entry.Bytes;
+			Evict();
+		}
+		return result;
+	}
+
+	Statistics GetStatistics() {
+		std::lock_guard<std::mutex> guard(lock);
+		return statistics;
+	}
+
+	void ClearCache() {
+		std::lock_guard<std::mutex> guard(lock);
+		cache.clear();
+		recent.clear();
+		statistics.Resident = 0;
+		statistics.ResidentBytes = 0;
+	}
+
+	void SetCapacity(long long bytes) {
+		std::lock_guard<std::mutex> guard(lock);
+		statistics.CapacityBytes = bytes > 0 ? bytes : 0;
+		Evict();
+	}
+#pragma endregion
+}
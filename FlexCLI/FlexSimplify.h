@@ -0,0 +1,35 @@
+// FlexSimplify.h
+// Native quadric edge collapse simplification for triangle collision meshes. FlexSimplify.cpp is compiled without /clr.
+// Large meshes are cut into grid cells that are simplified in parallel with their shared vertices locked,
+// a final pass then collapses along the cell borders. Results are cached by mesh content and error bound, least recently used first out.
+#pragma once
+#include <vector>
+#include <memory>
+
+namespace FlexSimplify {
+
+	struct Result {
+		std::vector<float> Vertices;	//[x, y, z] per vertex
+		std::vector<int> Faces;			//three vertex indices per triangle
+		float Lower[3];
+		float Upper[3];
+	};
+
+	///Simplifies a triangle mesh until collapsing any further edge would move the surface farther than 'maxError'.
+	///Vertices at identical positions are welded first, degenerate triangles dropped. Open borders are preserved up to 'maxError' as well.
+	std::shared_ptr<const Result> Simplify(const float* vertices, int numVertices, const int* faces, int numFaces, float maxError);
+
+	struct Statistics {
+		int Hits;
+		int Misses;
+		int Resident;
+		long long ResidentBytes;
+		long long CapacityBytes;	//ResidentBytes is kept at or below this
+	};
+
+	Statistics GetStatistics();
+	///Drops all cached results. Results handed out before stay valid as long as they are referenced.
+	void ClearCache();
+	///Sets the byte cap of the cache, 256 MB by default. Least recently used results are dropped once it is exceeded.
+	void SetCapacity(long long bytes);
+}
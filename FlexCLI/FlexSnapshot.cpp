@@ -0,0 +1,137 @@
+// FlexSnapshot.cpp
+// Native translation unit (compiled without /clr and without the precompiled header), see FlexSnapshot.h
+#include "FlexSnapshot.h"
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <string.h>
+
+namespace FlexSnapshot {
+
+	static const long long alignment = 16;
+
+#pragma region writer
+	bool Writer::Open(const wchar_t* path) {
+		Close();
+		file = _wfopen(path, L"wb");
+		if (!file)
+			return false;
+		failed = false;
+		position = 0;
+		table.clear();
+		//placeholder, the final header is written by Close
+		FileHeader header;
+		memset(&header, 0, sizeof(header));
+		return WriteBytes(&header, sizeof(header));
+	}
+
+	bool Writer::WriteBytes(const void* data, long long size) {
+		if (failed)
+			return false;
+		if (size > 0 && fwrite(data, 1, (size_t)size, file) != (size_t)size)
+			failed = true;
+		position += size;
+		return !failed;
+	}
+
+	bool Writer::Add(unsigned int id, const void* data, unsigned int elementSize, long long count) {
+		if (!file || count < 0)
+			return false;
+		static const char zeros[alignment] = { 0 };
+		WriteBytes(zeros, (alignment - position % alignment) % alignment);
+		ChunkEntry entry = { id, elementSize, count, position };
+		table.push_back(entry);
+		return WriteBytes(data, count * elementSize);
+	}
+
+	bool Writer::Close() {
+		if (!file)
+			return false;
+		static const char zeros[alignment] = { 0 };
+		WriteBytes(zeros, (alignment - position % alignment) % alignment);
+		FileHeader header = { Magic, Version, (unsigned int)table.size(), 0, position, 0 };
+		if (!table.empty())
+			WriteBytes(&table[0], (long long)(table.size() * sizeof(ChunkEntry)));
+		if (!failed && (fseek(file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, file) != 1))
+			failed = true;
+		if (fclose(file) != 0)
+			failed = true;
+		file = NULL;
+		table.clear();
+		return !failed;
+	}
+#pragma endregion
+
+#pragma region reader
+	const char* Reader::Open(const wchar_t* path) {
+		Close();
+		HANDLE f = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (f == INVALID_HANDLE_VALUE)
+			return "file could not be opened";
+		file = f;
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(f, &fileSize) || fileSize.QuadPart < (long long)sizeof(FileHeader)) {
+			Close();
+			return "file is too small to be a snapshot";
+		}
+		size = fileSize.QuadPart;
+		mapping = CreateFileMappingW(f, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping)
+			view = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!view) {
+			Close();
+			return "file could not be mapped";
+		}
+
+		header = (const FileHeader*)view;
+		const char* error = NULL;
+		if (header->Magic != Magic)
+			error = "not a FlexCLI scene snapshot";
+		else if (header->Version == 0 || header->Version > Version)
+			error = "unsupported snapshot version";
+		else if (header->TableOffset < (long long)sizeof(FileHeader) || header->TableOffset + (long long)header->NumChunks * (long long)sizeof(ChunkEntry) > size)
+			error = "chunk table is truncated";
+		else {
+			table = (const ChunkEntry*)(view + header->TableOffset);
+			for (unsigned int i = 0; i < header->NumChunks && !error; i++) {
+				const ChunkEntry& c = table[i];
+				if (c.Count < 0 || c.Offset < (long long)sizeof(FileHeader) || c.Offset % alignment != 0 ||
+					(c.ElementSize > 0 && c.Count > (size - c.Offset) / c.ElementSize))
+					error = "chunk is truncated";
+			}
+		}
+		if (error)
+			Close();
+		return error;
+	}
+
+	void Reader::Close() {
+		if (view)
+			UnmapViewOfFile(view);
+		if (mapping)
+			CloseHandle((HANDLE)mapping);
+		if (file)
+			CloseHandle((HANDLE)file);
+		file = NULL;
+		mapping = NULL;
+		view = NULL;
+		size = 0;
+		header = NULL;
+		table = NULL;
+	}
+
+	const void* Reader::Find(unsigned int id, unsigned int elementSize, long long& count) const {
+		count = 0;
+		if (!table)
+			return NULL;
+		for (unsigned int i = 0; i < header->NumChunks; i++) {
+			if (table[i].Id != id)
+				continue;
+			if (table[i].ElementSize != elementSize)
+				return NULL;
+			count = table[i].Count;
+			return view + table[i].Offset;
+		}
+		return NULL;
+	}
+#pragma endregion
+}
@@ -0,0 +1,101 @@
+// FlexSnapshot.h
+// Versioned, chunked binary scene snapshots. A snapshot is a header, one chunk per array and a chunk table at the end.
+// Chunk data is 16 byte aligned, so the reader can memory-map the file and hand out pointers straight into the mapping.
+// Unknown chunks are skipped, missing chunks read as empty. FlexSnapshot.cpp is compiled without /clr.
+#pragma once
+#include <stdio.h>
+#include <vector>
+
+#define FLEX_FOURCC(a, b, c, d) ((unsigned int)(a) | ((unsigned int)(b) << 8) | ((unsigned int)(c) << 16) | ((unsigned int)(d) << 24))
+
+namespace FlexSnapshot {
+
+	const unsigned int Magic = FLEX_FOURCC('F', 'X', 'S', 'N');
+	const unsigned int Version = 1;
+
+	enum ChunkId : unsigned int {
+		//[int] x 4: TimeStamp, NumActualRigids, NumCloths, NumInflatables
+		Scalars = FLEX_FOURCC('S', 'C', 'A', 'L'),
+		//ParticleRecord (32 bytes) per particle
+		Particles = FLEX_FOURCC('P', 'A', 'R', 'T'),
+		//[int] x 11 per group: index, category, particle/shape/spring/triangle offset and count, contiguous
+		Groups = FLEX_FOURCC('G', 'R', 'P', 'S'),
+		FluidIndices = FLEX_FOURCC('F', 'I', 'D', 'X'),
+		RigidIndices = FLEX_FOURCC('R', 'I', 'D', 'X'),
+		RigidOffsets = FLEX_FOURCC('R', 'O', 'F', 'F'),
+		SoftBodyOffsets = FLEX_FOURCC('S', 'O', 'F', 'F'),
+		ShapeMassCenters = FLEX_FOURCC('S', 'M', 'C', 'N'),
+		RigidRestPositions = FLEX_FOURCC('R', 'R', 'P', 'S'),
+		RigidRestNormals = FLEX_FOURCC('R', 'R', 'N', 'M'),
+		RigidStiffnesses = FLEX_FOURCC('R', 'S', 'T', 'F'),
+		RigidRotations = FLEX_FOURCC('R', 'R', 'O', 'T'),
+		RigidTranslations = FLEX_FOURCC('R', 'T', 'R', 'A'),
+		SpringIndices = FLEX_FOURCC('S', 'I', 'D', 'X'),
+		SpringPairIndices = FLEX_FOURCC('S', 'P', 'R', 'P'),
+		SpringLengths = FLEX_FOURCC('S', 'L', 'E', 'N'),
+		SpringStiffnesses = FLEX_FOURCC('S', 'S', 'T', 'F'),
+		ClothIndices = FLEX_FOURCC('C', 'I', 'D', 'X'),
+		DynamicTriangleIndices = FLEX_FOURCC('T', 'I', 'D', 'X'),
+		DynamicTriangleNormals = FLEX_FOURCC('T', 'N', 'R', 'M'),
+		InflatableIndices = FLEX_FOURCC('I', 'I', 'D', 'X'),
+		InflatableStartIndices = FLEX_FOURCC('I', 'S', 'T', 'A'),
+		InflatableNumTriangles = FLEX_FOURCC('I', 'N', 'T', 'R'),
+		InflatableRestVolumes = FLEX_FOURCC('I', 'V', 'O', 'L'),
+		InflatableOverPressures = FLEX_FOURCC('I', 'P', 'R', 'S'),
+		InflatableConstraintScales = FLEX_FOURCC('I', 'S', 'C', 'L')
+	};
+
+	struct FileHeader {
+		unsigned int Magic;
+		unsigned int Version;
+		unsigned int NumChunks;
+		unsigned int Reserved;
+		long long TableOffset;
+		long long Reserved2;
+	};
+
+	struct ChunkEntry {
+		unsigned int Id;
+		unsigned int ElementSize;
+		long long Count;
+		long long Offset;
+	};
+
+	///Streams chunks to a file. Each chunk is written when added, the chunk table when closing.
+	class Writer {
+	public:
+		Writer() : file(NULL), position(0), failed(false) {}
+		~Writer() { Close(); }
+		bool Open(const wchar_t* path);
+		///Writes 'count' elements of 'elementSize' bytes. Returns false on write errors.
+		bool Add(unsigned int id, const void* data, unsigned int elementSize, long long count);
+		///Writes the chunk table and closes the file. Returns false, if anything failed since Open.
+		bool Close();
+	private:
+		bool WriteBytes(const void* data, long long size);
+		FILE* file;
+		long long position;
+		bool failed;
+		std::vector<ChunkEntry> table;
+	};
+
+	///Memory-maps a snapshot and hands out pointers into the mapping. The pointers stay valid until Close or destruction.
+	class Reader {
+	public:
+		Reader() : file(NULL), mapping(NULL), view(NULL), size(0), header(NULL), table(NULL) {}
+		~Reader() { Close(); }
+		///Returns NULL on success, a description of the problem otherwise
+		const char* Open(const wchar_t* path);
+		void Close();
+		unsigned int FileVersion() const { return header ? header->Version : 0; }
+		///Data of the chunk with this id or NULL if there is none. Also NULL, if the chunk's element size differs.
+		const void* Find(unsigned int id, unsigned int elementSize, long long& count) const;
+	private:
+		void* file;
+		void* mapping;
+		const unsigned char* view;
+		long long size;
+		const FileHeader* header;
+		const ChunkEntry* table;
+	};
+}
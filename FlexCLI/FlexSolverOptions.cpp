@@ -20,6 +20,11 @@ namespace FlexCLI {
 		MaxRigidBodies = 65536;						//max nr. of rigid bodies
 		MaxSprings = 196608;						//max nr. of springs
 		MaxDynamicTriangles = 131072;				//needed for cloth
+		Readback = FlexReadback::Default;
+		PipelinedReadback = false;
+		SyncInterval = 1;
+		BroadphaseInterval = 0;
+		BroadphaseMargin = 1.0f;
 	}
 	
 	FlexSolverOptions::FlexSolverOptions(float dt, int subSteps, int numIterations, int sceneMode, int fixedNumTotalIterations, array<int>^ memoryRequirements, float stabilityScalingFactor)
@@ -39,11 +44,16 @@ namespace FlexCLI {
 		MaxRigidBodies = memoryRequirements[6];						//max nr. of rigid bodies
 		MaxSprings = memoryRequirements[7];							//max nr. of springs
 		MaxDynamicTriangles = memoryRequirements[8];				//needed for cloth
+		Readback = FlexReadback::Default;
+		PipelinedReadback = false;
+		SyncInterval = 1;
+		BroadphaseInterval = 0;
+		BroadphaseMargin = 1.0f;
 		TimeStamp = System::DateTime::Now.Minute * 60000 + System::DateTime::Now.Second * 1000 + System::DateTime::Now.Millisecond;
 	}
 
 	bool FlexSolverOptions::IsValid() {
-		return dT > 0.0f && SubSteps > 0 && NumIterations > 0;
+		return dT > 0.0f && SubSteps > 0 && NumIterations > 0 && SyncInterval > 0 && BroadphaseInterval >= 0 && BroadphaseMargin >= 0.0f;
 	}
 
 	String^ FlexSolverOptions::ToString() {
@@ -62,6 +72,11 @@ namespace FlexCLI {
 		str += "\nMaxRigidBodies = " + MaxRigidBodies.ToString();
 		str += "\nMaxSprings = " + MaxSprings.ToString();
 		str += "\nMaxDynamicTriangles = " + MaxDynamicTriangles.ToString();
+		str += "\nReadback = " + Readback.ToString();
+		str += "\nPipelinedReadback = " + PipelinedReadback.ToString();
+		str += "\nSyncInterval = " + SyncInterval.ToString();
+		str += "\nBroadphaseInterval = " + BroadphaseInterval.ToString();
+		str += "\nBroadphaseMargin = " + BroadphaseMargin.ToString();
 		str += "\n\nTimeStamp = " + TimeStamp.ToString();
 		return str;
 	}
@@ -0,0 +1,140 @@
+// FlexTopology.cpp
+// Native translation unit (compiled without /clr and without the precompiled header), see FlexTopology.h
+#include "FlexTopology.h"
+#include "FlexParallel.h"
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+
+namespace FlexTopology {
+
+	//below this many edges, spawning threads costs more than it saves
+	static const int minEdgesPerThread = 8192;
+
+#pragma region edges
+	//open addressing hash set of undirected edges, sized for the worst case of 3 edges per triangle
+	struct EdgeHash {
+		std::vector<uint64_t> keys;
+		uint64_t mask;
+
+		explicit EdgeHash(int maxEdges) {
+			size_t capacity = 16;
+			while (capacity < (size_t)maxEdges * 2)
+				capacity <<= 1;
+			keys.assign(capacity, ~0ull);
+			mask = capacity - 1;
+		}
+
+		static uint64_t Key(int a, int b) {
+			uint32_t lo = (uint32_t)std::min(a, b);
+			uint32_t hi = (uint32_t)std::max(a, b);
+			return ((uint64_t)hi << 32) | lo;
+		}
+
+		//returns true, if the edge wasn't in the set yet
+		bool Insert(int a, int b) {
+			uint64_t key = Key(a, b);
+			uint64_t slot = (key * 0x9E3779B97F4A7C15ull) >> 20 & mask;
+			while (true) {
+				if (keys[slot] == key)
+					return false;
+				if (keys[slot] == ~0ull) {
+					keys[slot] = key;
+					return true;
+				}
+				slot = (slot + 1) & mask;
+			}
+		}
+	};
+
+	int UniqueEdges(const int* triangles, int numTriangles, int* edges) {
+		EdgeHash hash(numTriangles * 3);
+		int numEdges = 0;
+		for (int i = 0; i < numTriangles; i++) {
+			for (int k = 0; k < 3; k++) {
+				int a = triangles[3 * i + k];
+				int b = triangles[3 * i + (k + 1) % 3];
+				if (hash.Insert(a, b)) {
+					edges[2 * numEdges] = a;
+					edges[2 * numEdges + 1] = b;
+					numEdges++;
+				}
+			}
+		}
+		return numEdges;
+	}
+#pragma endregion
+
+#pragma region bending
+	int BendingSprings(const int* edges, int numEdges, int numVertices, int* bendingPairs) {
+		//vertex adjacency in compressed rows, neighbors appear in edge order
+		std::vector<int> offsets(numVertices + 1, 0);
+		for (int i = 0; i < numEdges; i++) {
+			offsets[edges[2 * i] + 1]++;
+			//degenerate edges from collapsed triangles list their vertex once
+			if (edges[2 * i + 1] != edges[2 * i])
+				offsets[edges[2 * i + 1] + 1]++;
+		}
+		for (int v = 0; v < numVertices; v++)
+			offsets[v + 1] += offsets[v];
+		std::vector<int> neighbors(2 * numEdges);
+		std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+		for (int i = 0; i < numEdges; i++) {
+			int a = edges[2 * i];
+			int b = edges[2 * i + 1];
+			neighbors[fill[a]++] = b;
+			if (a != b)
+				neighbors[fill[b]++] = a;
+		}
+
+		//per edge: common neighbors of both end points, a bending spring if there are exactly two
+		std::vector<int> candidates(2 * numEdges);
+		FlexParallel::ParallelFor(numEdges, minEdgesPerThread, [&](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				int start = edges[2 * i];
+				int stop = edges[2 * i + 1];
+				int common[2];
+				int numCommon = 0;
+				for (int j = offsets[start]; j < offsets[start + 1] && numCommon <= 2; j++) {
+					int n = neighbors[j];
+					if (n == stop || n == start)
+						continue;
+					for (int k = offsets[stop]; k < offsets[stop + 1]; k++) {
+						if (neighbors[k] == n) {
+							if (numCommon < 2)
+								common[numCommon] = n;
+							numCommon++;
+							break;
+						}
+					}
+				}
+				candidates[2 * i] = numCommon == 2 ? common[0] : -1;
+				candidates[2 * i + 1] = numCommon == 2 ? common[1] : -1;
+			}
+		});
+
+		//compact in edge order
+		int numBending = 0;
+		for (int i = 0; i < numEdges; i++) {
+			if (candidates[2 * i] < 0)
+				continue;
+			bendingPairs[2 * numBending] = candidates[2 * i];
+			bendingPairs[2 * numBending + 1] = candidates[2 * i + 1];
+			numBending++;
+		}
+		return numBending;
+	}
+#pragma endregion
+
+	void PairLengths(const float* positions, const int* pairs, int numPairs, float factor, float* lengths) {
+		for (int i = 0; i < numPairs; i++) {
+			const float* a = positions + 3 * pairs[2 * i];
+			const float* b = positions + 3 * pairs[2 * i + 1];
+			float dx = a[0] - b[0];
+			float dy = a[1] - b[1];
+			float dz = a[2] - b[2];
+			lengths[i] = factor * sqrtf(dx * dx + dy * dy + dz * dz);
+		}
+	}
+}
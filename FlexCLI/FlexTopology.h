@@ -0,0 +1,19 @@
+// FlexTopology.h
+// Native mesh topology builders used while registering scene objects. FlexTopology.cpp is compiled without /clr,
+// so it can use FlexParallel for the passes that parallelize well.
+#pragma once
+
+namespace FlexTopology {
+
+	///Writes the unique edges of a triangle mesh as index pairs into 'edges', in order of first appearance and with the orientation
+	///they were first seen with. 'edges' must hold 6 * numTriangles ints. Returns the number of edges. O(triangles) using an edge hash.
+	int UniqueEdges(const int* triangles, int numTriangles, int* edges);
+
+	///For every edge (in order) whose end points share exactly two neighbors, writes the pair of these neighbors as bending spring
+	///into 'bendingPairs', which must hold 2 * numEdges ints. Returns the number of bending springs.
+	///Uses a vertex adjacency built from the edges, runs in parallel for large meshes.
+	int BendingSprings(const int* edges, int numEdges, int numVertices, int* bendingPairs);
+
+	///lengths[i] = factor * distance between the two particles of pair i. 'positions' are [x, y, z] per particle.
+	void PairLengths(const float* positions, const int* pairs, int numPairs, float factor, float* lengths);
+}
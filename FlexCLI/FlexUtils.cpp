@@ -1,7 +1,42 @@
 #include "stdafx.h"
 #include "FlexCLI.h"
+#include "FlexKernels.h"
+#include "FlexDistanceField.h"
 
-/*namespace FlexCLI {
+namespace FlexCLI {
 
-	
-}*/
\ No newline at end of file
+	///<summary>Name of the instruction set used by the native conversion kernels on this machine</summary>
+	String^ FlexUtils::KernelInstructionSet() {
+		return gcnew String(FlexKernels::InstructionSetName(FlexKernels::ActiveInstructionSet()));
+	}
+
+	///<summary>Micro benchmark of the native conversion kernels. Runs every kernel on every instruction set supported by this machine.</summary>
+	///<returns>One line per kernel and instruction set, throughput in bytes per cycle (time stamp counter cycles)</returns>
+	String^ FlexUtils::BenchmarkKernels(int numParticles, int repetitions) {
+		if (numParticles < 1 || repetitions < 1)
+			throw gcnew Exception("FlexCLI: String^ FlexUtils::BenchmarkKernels(...) ---> Invalid input! Both numParticles and repetitions have to be > 0.");
+
+		FlexKernels::BenchmarkResult results[9];
+		int numResults = FlexKernels::Benchmark(numParticles, repetitions, results, 9);
+
+		String^ str = gcnew String("FlexKernels benchmark (" + numParticles + " particles, " + repetitions + " repetitions):");
+		for (int i = 0; i < numResults; i++)
+			str += "\n" + gcnew String(results[i].Kernel) + " [" + gcnew String(FlexKernels::InstructionSetName(results[i].Set)) + "] = " + results[i].BytesPerCycle.ToString("F2") + " bytes/cycle";
+		return str;
+	}
+
+	///<summary>Voxelizes spheres of increasing triangle count into distance fields with 'resolution' samples per axis</summary>
+	///<returns>One line per mesh size, build time and samples per second</returns>
+	String^ FlexUtils::BenchmarkDistanceFields(int resolution) {
+		if (resolution < FlexDistanceField::MinDimension)
+			throw gcnew Exception("FlexCLI: String^ FlexUtils::BenchmarkDistanceFields(...) ---> Invalid input! resolution has to be >= " + FlexDistanceField::MinDimension + ".");
+
+		FlexDistanceField::BenchmarkResult results[4];
+		int numResults = FlexDistanceField::Benchmark(resolution, results, 4);
+
+		String^ str = gcnew String("FlexDistanceField benchmark (" + resolution + "^3 samples):");
+		for (int i = 0; i < numResults; i++)
+			str += "\n" + results[i].Triangles + " triangles = " + results[i].Milliseconds.ToString("F1") + " ms, " + (results[i].SamplesPerSecond / 1e6).ToString("F2") + " M samples/s";
+		return str;
+	}
+}
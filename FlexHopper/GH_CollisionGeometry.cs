@@ -31,6 +31,7 @@ namespace FlexHopper
             pManager.AddBoxParameter("Collision Boxes", "Boxes", "If you have spheres to register, use this input rather than meshes.", GH_ParamAccess.list);
             pManager.AddMeshParameter("Collision Meshes", "Meshes", "Make sure the mesh is triangulated and clean. Particles only collide with mesh faces who's normal vectors point away from the particle. E.g. if you want particles to stay outside of the mesh, make all mesh face normals point inward.", GH_ParamAccess.list);
             pManager.AddMeshParameter("Convex Meshes", "CMeshes", "Meshes that are known to be convex are being recognized faster. Add them here. (Currently only supports meshes with up to 64 faces)", GH_ParamAccess.list);
+            pManager.AddNumberParameter("Mesh Simplification", "Simplify", "Simplify collision meshes before upload. Meshes deviate from the input by at most this fraction of the collision distance. 0 keeps meshes as they are, around 0.5 keeps collisions visually unchanged. Results are cached, so unchanged meshes are only simplified once.", GH_ParamAccess.item, 0.0);
             pManager[0].Optional = true;
             pManager[1].Optional = true;
             pManager[2].Optional = true;
@@ -71,6 +72,10 @@ namespace FlexHopper
             DA.GetDataList(3, meshes);
             DA.GetDataList(4, cmeshes);
 
+            double simplification = 0.0;
+            DA.GetData(5, ref simplification);
+            geom.SimplifyMeshes((float)simplification);
+
             foreach (Plane p in planes)
             {
                 double[] pe = p.GetPlaneEquation();
@@ -158,47 +163,53 @@ namespace FlexHopper
                 }
             }
             
+            //convex shapes: hulls of all mesh vertices, computed natively in one batch
+            List<float[]> hullPoints = new List<float[]>();
             foreach(Mesh m in cmeshes)
             {
-                if (!m.IsClosed || !m.IsValid)
+                if (!m.IsValid)
                     AddRuntimeMessage(GH_RuntimeMessageLevel.Error, "Invalid mesh!");
+                else if (m.Vertices.Count < 4)
+                    AddRuntimeMessage(GH_RuntimeMessageLevel.Warning, "Convex mesh with less than four vertices skipped, it doesn't enclose a volume.");
                 else
                 {
-                    int planeCount = m.Faces.Count;
-
-                    m.FaceNormals.ComputeFaceNormals();
-
-                    float[] cPlanes = new float[planeCount * 4];
-                    float[] upperLimit = new float[3] { (float)m.Vertices[0].X, (float)m.Vertices[0].Y, (float)m.Vertices[0].Z };
-                    float[] lowerLimit = new float[3] { (float)m.Vertices[0].X, (float)m.Vertices[0].Y, (float)m.Vertices[0].Z };
-
-                    foreach(Point3d v in m.Vertices)
+                    float[] points = new float[m.Vertices.Count * 3];
+                    for (int i = 0; i < m.Vertices.Count; i++)
                     {
-                        if (v.X > upperLimit[0]) upperLimit[0] = (float)v.X;
-                        if (v.Y > upperLimit[1]) upperLimit[1] = (float)v.Y;
-                        if (v.Z > upperLimit[2]) upperLimit[2] = (float)v.Z;
-                        if (v.X < lowerLimit[0]) lowerLimit[0] = (float)v.X;
-                        if (v.Y < lowerLimit[1]) lowerLimit[1] = (float)v.Y;
-                        if (v.Z < lowerLimit[2]) lowerLimit[2] = (float)v.Z;
+                        points[i * 3] = m.Vertices[i].X;
+                        points[i * 3 + 1] = m.Vertices[i].Y;
+                        points[i * 3 + 2] = m.Vertices[i].Z;
                     }
-
-                    for (int i = 0; i < planeCount; i++)
+                    hullPoints.Add(points);
+                }
+            }
+            if (hullPoints.Count > 0)
+            {
+                List<float> allPoints = new List<float>();
+                List<int> pointCounts = new List<int>();
+                foreach (float[] points in hullPoints)
+                {
+                    allPoints.AddRange(points);
+                    pointCounts.Add(points.Length / 3);
+                }
+                try
+                {
+                    geom.AddConvexHulls(allPoints.ToArray(), pointCounts.ToArray());
+                }
+                catch (Exception)
+                {
+                    //the batch validates all sets before adding any, so retry one by one and only skip the degenerate ones
+                    foreach (float[] points in hullPoints)
                     {
-                        Point3d faceCenter = new Point3d((m.Vertices[m.Faces[i].A].X + m.Vertices[m.Faces[i].B].X + m.Vertices[m.Faces[i].C].X) / 3.0,
-                            (m.Vertices[m.Faces[i].A].Y + m.Vertices[m.Faces[i].B].Y + m.Vertices[m.Faces[i].C].Y) / 3.0,
-                            (m.Vertices[m.Faces[i].A].Z + m.Vertices[m.Faces[i].B].Z + m.Vertices[m.Faces[i].C].Z) / 3.0);
-                        Plane p = new Plane(faceCenter, m.FaceNormals[i] *-1);
-
-                        double[] ABCD = p.GetPlaneEquation();
-
-                        cPlanes[i * 4] = (float)ABCD[0];
-                        cPlanes[i * 4 + 1] = (float)ABCD[1];
-                        cPlanes[i * 4 + 2] = (float)ABCD[2];
-                        cPlanes[i * 4 + 3] = (float)ABCD[3];
+                        try
+                        {
+                            geom.AddConvexHull(points);
+                        }
+                        catch (Exception e)
+                        {
+                            AddRuntimeMessage(GH_RuntimeMessageLevel.Warning, "Convex mesh skipped: " + e.Message);
+                        }
                     }
-
-                    //add convex mesh
-                    geom.AddConvexShape(cPlanes, upperLimit, lowerLimit);
                 }
             }
 
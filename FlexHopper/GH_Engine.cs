@@ -118,8 +118,8 @@ namespace FlexHopper
                 if(flex != null)
                     flex.Destroy();
 
-                //Create new instance and assign everything
-                flex = new Flex();
+                //Create new instance and assign everything. The solver is sized by the options, params and geometry are scaled by their stability scaling factor.
+                flex = new Flex(options);
                 
                 flex.SetParams(param);
                 flex.SetCollisionGeometry(geom);
@@ -138,7 +138,6 @@ namespace FlexHopper
                     constraintTimeStamps.Add(c.TimeStamp);
                 }
                 flex.SetScene(scene);
-                flex.SetSolverOptions(options);
 
             }
             else if (go && flex != null && flex.IsReady())
@@ -33,6 +33,11 @@ namespace FlexHopper
             pManager.AddIntegerParameter("Fixed Number of Iteration", "fIter", "When positive, the solver will perform the supplied number of calculation cycles, before outputting. Useful, when you don't need to see the system converge, but want only one output after n iterations. Also faster, than normal mode. CAUTION: This might take a while to compute.", GH_ParamAccess.item, -1);
             pManager.AddIntegerParameter("Memory Requirements", "memQ", "Flex needs to reserve memory on GPU and RAM for your simulation. By telling the engine up front how detailed your simulation will be, you can avoid using excessive amounts of memory, or request more memory for big scenes. Normally default vals should be fine. Supply a list containing:\n[0] max nr. of particles (default 131072)\n[1] max nr. of neighbors per particle (default: 96)\n[2] max nr. of collision body entries (default: 65536)\n[3] max nr. of mesh vertices in collision meshes (default: 65536)\n[4] max nr. of mesh faces in collision meshes (default: 65536)\n[5] max nr. of mesh faces in convex meshes (default: 65536)\n[6] max nr. of rigid bodies (default: 65536)\n[7] max nr. of springs (default: 196608)\n[8] max nr. of cloth triangles (default: 131072)\nIMPORTANT NOTE: For input nr. [2] max nr. of collision body entries: This is not the number of collision objects but the number of memory entries the engine needs to make per collision objects. Planes require 0 entries, spheres require 1 entry, boxes require 3 entries, meshes and convex meshes require 4 entries.\nSo if you have a scene of 5 planes, 1000 spheres, 100 boxes and 10 meshes, you should set this value to 5*0 + 1000*1 + 100*3 + 10*4", GH_ParamAccess.list, defaultMemq);
             pManager.AddNumberParameter("Stability Scale", "stabS", "Due to some instability issues, particle systems of very large x,y,z values (e.g. when working in millimeter scale), sometimes drift sideways without any reason. Stability scale helps resolving this issue. It simply scales the x,y,z-values of your entire scene before it enters the engine and scales them back again afterwards. If objects in your scene start to drift and you have very large or very small x,y,z values, apply this scaling factor, so you have x,y,z values in the approximate range of -10 to 10. Parameter values like radius or collision margins are scaled automatically too, so you don't have to adjust them yourself.", GH_ParamAccess.item, 1.0);
+            pManager.AddIntegerParameter("Readback", "rBack", "Defines which data the engine copies back from the solver after each step. Skipping unneeded data makes large simulations faster. Supply the sum of:\n1 - positions\n2 - velocities\n4 - phases (otherwise phases are only read once after each scene update)\n8 - rigid body transformations\n16 - particle normals\n32 - particle densities\n64 - particle contacts\nDefault is 11 (positions, velocities and rigid body transformations).", GH_ParamAccess.item, 11);
+            pManager.AddBooleanParameter("Pipelined Readback", "pRead", "If true, copying results back from the solver overlaps with the next time step. This is faster for large scenes, but all outputs lag one time step behind the solver.", GH_ParamAccess.item, false);
+            pManager.AddIntegerParameter("Sync Interval", "sync", "Number of time steps the solver performs per engine iteration. Results are only copied back from the solver after the last one. Useful for form finding, when you don't need to see every time step.", GH_ParamAccess.item, 1);
+            pManager.AddIntegerParameter("Broadphase Interval", "bInt", "If positive, only collision objects near the particles are passed to the solver. Every this many time steps the engine looks up which objects overlap the particles' bounding box, grown by the broadphase margin. Speeds up large site models with many collision objects of which only a few are near the particles. 0 turns culling off.", GH_ParamAccess.item, 0);
+            pManager.AddNumberParameter("Broadphase Margin", "bMar", "Distance by which the particles' bounding box is grown before culling collision objects. Must cover the distance particles can travel within one broadphase interval, otherwise particles may pass through objects that were culled.", GH_ParamAccess.item, 1.0);
         }
 
         /// <summary>
@@ -57,6 +62,11 @@ namespace FlexHopper
             int sM = 0;
             int fI = -1;
             double stabS = 1.0;
+            int rBack = 11;
+            bool pRead = false;
+            int sync = 1;
+            int bInt = 0;
+            double bMar = 1.0;
             var memq = new List<int>();
 
             DA.GetData(0, ref dt);
@@ -66,10 +76,21 @@ namespace FlexHopper
             DA.GetData(4, ref fI);
             DA.GetDataList(5, memq);
             DA.GetData(6, ref stabS);
+            DA.GetData(7, ref rBack);
+            DA.GetData(8, ref pRead);
+            DA.GetData(9, ref sync);
+            DA.GetData(10, ref bInt);
+            DA.GetData(11, ref bMar);
 
             if (dt == 0.0 || sS == 0)
                 throw new Exception("Neither dt nor SubSteps can be zero!");
 
+            if (sync < 1)
+                throw new Exception("Sync interval must be at least 1!");
+
+            if (bInt < 0 || bMar < 0.0)
+                throw new Exception("Broadphase interval and margin can't be negative!");
+
             if(memq.Count == 0 || memq.Count != 9)
             {
                 if(memq.Count > 0)
@@ -77,7 +98,13 @@ namespace FlexHopper
                 memq = defaultMemq;
             }
 
-            DA.SetData(0, new FlexSolverOptions((float)dt, sS, nI, sM, fI, memq.ToArray(), (float)Math.Max(stabS, 0.0001)));
+            FlexSolverOptions opts = new FlexSolverOptions((float)dt, sS, nI, sM, fI, memq.ToArray(), (float)Math.Max(stabS, 0.0001));
+            opts.Readback = (FlexReadback)rBack;
+            opts.PipelinedReadback = pRead;
+            opts.SyncInterval = sync;
+            opts.BroadphaseInterval = bInt;
+            opts.BroadphaseMargin = (float)bMar;
+            DA.SetData(0, opts);
         }
 
         /// <summary>
@@ -0,0 +1,174 @@
+#include "FlexRun.h"
+
+using namespace System::Diagnostics;
+using namespace System::Globalization;
+
+namespace FlexRun {
+
+	Settings^ Settings::Parse(array<String^>^ args) {
+		Settings^ s = gcnew Settings();
+		s->Ticks = 0;
+		s->FrameInterval = 1;
+		s->ConvergenceSpeed = 0.0f;
+		for (int i = 0; i < args->Length; i++) {
+			String^ arg = args[i];
+			if (arg == "--quiet") {
+				s->Quiet = true;
+				continue;
+			}
+			if (i + 1 >= args->Length)
+				throw gcnew Exception("Missing value after " + arg);
+			String^ value = args[++i];
+			if (arg == "--scene")
+				s->ScenePath = value;
+			else if (arg == "--params")
+				s->ParamsPath = value;
+			else if (arg == "--options")
+				s->OptionsPath = value;
+			else if (arg == "--geometry")
+				s->GeometryPath = value;
+			else if (arg == "--frames")
+				s->FramesPath = value;
+			else if (arg == "--out")
+				s->OutputPath = value;
+			else if (arg == "--ticks")
+				s->Ticks = Int32::Parse(value, CultureInfo::InvariantCulture);
+			else if (arg == "--every")
+				s->FrameInterval = Int32::Parse(value, CultureInfo::InvariantCulture);
+			else if (arg == "--converged")
+				s->ConvergenceSpeed = Single::Parse(value, CultureInfo::InvariantCulture);
+			else
+				throw gcnew Exception("Unknown argument " + arg);
+		}
+
+		if (!s->ScenePath)
+			throw gcnew Exception("No scene given");
+		if (s->Ticks < 0 || s->FrameInterval < 1 || s->ConvergenceSpeed < 0.0f)
+			throw gcnew Exception("--ticks and --converged have to be >= 0, --every > 0");
+		if (s->Ticks == 0 && s->ConvergenceSpeed == 0.0f)
+			throw gcnew Exception("Give --ticks, --converged or both");
+		if (s->Ticks == 0)
+			s->Ticks = Int32::MaxValue;
+		return s;
+	}
+
+	String^ Settings::Usage() {
+		return
+			"Usage: FlexRun --scene <snapshot> [options]\n"
+			"  --scene <file>       scene snapshot written by FlexScene::Save\n"
+			"  --params <file>      FlexParams xml, same format as the FlexHopper params file\n"
+			"  --options <file>     FlexSolverOptions xml, one element per field\n"
+			"  --geometry <file>    collision geometry xml\n"
+			"  --ticks <n>          run n ticks (Flex::UpdateSolver calls) at most\n"
+			"  --converged <speed>  stop as soon as no particle is faster than speed\n"
+			"  --frames <file>      stream positions and velocities to a binary frame file\n"
+			"  --every <n>          ticks between two frames, default 1. The last tick is always written.\n"
+			"  --out <file>         save the final state as scene snapshot\n"
+			"  --quiet              only print errors";
+	}
+
+	static float MaxSpeed(array<float>^ velocities, int count) {
+		float maxSpeedSquared = 0.0f;
+		for (int i = 0; i < count * 3; i += 3) {
+			float speedSquared = velocities[i] * velocities[i] + velocities[i + 1] * velocities[i + 1] + velocities[i + 2] * velocities[i + 2];
+			if (speedSquared > maxSpeedSquared)
+				maxSpeedSquared = speedSquared;
+		}
+		return (float)Math::Sqrt(maxSpeedSquared);
+	}
+
+	static int Run(Settings^ settings) {
+		FlexScene^ scene = FlexScene::Load(settings->ScenePath);
+		FlexParams^ flexParams = gcnew FlexParams();
+		if (settings->ParamsPath)
+			Files::ReadFields(flexParams, settings->ParamsPath);
+		FlexSolverOptions^ options = gcnew FlexSolverOptions();
+		if (settings->OptionsPath)
+			Files::ReadFields(options, settings->OptionsPath);
+		FlexCollisionGeometry^ geometry = settings->GeometryPath ? Files::ReadCollisionGeometry(settings->GeometryPath) : gcnew FlexCollisionGeometry();
+
+		if (scene->NumParticles() > options->MaxParticles)
+			throw gcnew Exception("The scene has " + scene->NumParticles() + " particles, MaxParticles in the solver options is " + options->MaxParticles);
+
+		//the solver is sized by the options, params and collision geometry are scaled by their stability scaling factor
+		Flex^ flex = gcnew Flex(options);
+		FrameWriter^ frames = nullptr;
+		try {
+			flex->SetParams(flexParams);
+			flex->SetCollisionGeometry(geometry);
+			flex->SetScene(scene);
+			if (!flex->IsReady())
+				throw gcnew Exception("The solver could not be created");
+
+			int numParticles = scene->NumParticles();
+			array<float>^ positions = gcnew array<float>(Math::Max(numParticles * 3, 3));
+			array<float>^ velocities = gcnew array<float>(Math::Max(numParticles * 3, 3));
+			if (settings->FramesPath)
+				frames = gcnew FrameWriter(settings->FramesPath, numParticles);
+
+			Stopwatch^ watch = Stopwatch::StartNew();
+			int tick = 0;
+			bool converged = false;
+			while (tick < settings->Ticks && !converged) {
+				flex->UpdateSolver();
+				tick++;
+
+				//state is only copied when the convergence test or a frame needs it. The last tick is always written, also when the run stops early.
+				bool check = settings->ConvergenceSpeed > 0.0f;
+				bool frame = frames && (tick % settings->FrameInterval == 0 || tick == settings->Ticks);
+				if (!check && !frame)
+					continue;
+				int count = flex->ReadState(frames ? positions : nullptr, velocities, nullptr);
+				converged = check && MaxSpeed(velocities, count) <= settings->ConvergenceSpeed;
+				if (frame || (frames && converged))
+					frames->Write(tick, positions, velocities, count);
+			}
+			double seconds = watch->Elapsed.TotalSeconds;
+			if (frames)
+				frames->Close();
+
+			if (settings->OutputPath)
+				flex->Scene->Save(settings->OutputPath);
+
+			if (!settings->Quiet) {
+				String^ status = "";
+				if (settings->ConvergenceSpeed > 0.0f && converged)
+					status = ", converged";
+				else if (settings->ConvergenceSpeed > 0.0f)
+					status = ", not converged";
+				Console::WriteLine("{0} particles, {1} ticks in {2:F3} s ({3:F1} ticks/s){4}", numParticles, tick, seconds, seconds > 0.0 ? tick / seconds : 0.0, status);
+				if (frames)
+					Console::WriteLine("{0} frames written to {1}", frames->NumFrames, settings->FramesPath);
+				if (settings->OutputPath)
+					Console::WriteLine("Final state saved to {0}", settings->OutputPath);
+			}
+			//exit code 3 tells batch scripts that the run ended without converging
+			return settings->ConvergenceSpeed > 0.0f && !converged ? 3 : 0;
+		}
+		finally {
+			if (frames)
+				frames->Close();
+			delete flex;
+		}
+	}
+}
+
+int main(array<String^>^ args) {
+	FlexRun::Settings^ settings;
+	try {
+		settings = FlexRun::Settings::Parse(args);
+	}
+	catch (Exception^ e) {
+		Console::Error->WriteLine("FlexRun: " + e->Message);
+		Console::Error->WriteLine(FlexRun::Settings::Usage());
+		return 2;
+	}
+
+	try {
+		return FlexRun::Run(settings);
+	}
+	catch (Exception^ e) {
+		Console::Error->WriteLine("FlexRun: " + e->Message);
+		return 1;
+	}
+}
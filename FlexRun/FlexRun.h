@@ -0,0 +1,58 @@
+// FlexRun.h
+// Headless command line driver for FlexCLI. Loads a scene snapshot (FlexScene::Save), params, solver options and collision geometry
+// from files, runs the solver for a number of ticks or until it converged and writes frames and the final state to disk.
+#pragma once
+
+using namespace System;
+using namespace System::IO;
+using namespace FlexCLI;
+
+namespace FlexRun {
+
+	///<summary>Command line settings, see Usage()</summary>
+	ref struct Settings {
+		String^ ScenePath;
+		String^ ParamsPath;
+		String^ OptionsPath;
+		String^ GeometryPath;
+		String^ FramesPath;
+		String^ OutputPath;
+		int Ticks;						//Flex::UpdateSolver calls at most, each one runs FlexSolverOptions::SyncInterval solver steps
+		int FrameInterval;				//ticks between two frames
+		float ConvergenceSpeed;			//stop once no particle is faster, 0 always runs all ticks
+		bool Quiet;
+
+		static Settings^ Parse(array<String^>^ args);
+		static String^ Usage();
+	};
+
+	///<summary>Readers for the input files</summary>
+	ref class Files abstract sealed {
+	public:
+		///<summary>Sets the public fields of 'target' from an xml file with one element per field, named like the field. Same format as the FlexHopper params file.</summary>
+		static void ReadFields(Object^ target, String^ path);
+		///<summary>Reads collision shapes from an xml file, see the example in 'Example files/FlexRun'</summary>
+		static FlexCollisionGeometry^ ReadCollisionGeometry(String^ path);
+	private:
+		static array<float>^ ParseFloats(String^ text, int count, String^ what);
+		static array<int>^ ParseInts(String^ text, String^ what);
+		static String^ RequiredAttribute(Xml::XmlElement^ element, String^ name);
+		static void ReadMesh(Xml::XmlElement^ element, String^ folder, array<float>^% vertices, array<int>^% faces);
+		static void ReadObj(String^ path, array<float>^% vertices, array<int>^% faces);
+	};
+
+	///<summary>Streams particle positions and velocities into one binary file.
+	///Layout: [int magic 'FXFR', int version, int nr. of particles, int reserved], then per frame [int tick, int nr. of particles, float positions [x, y, z] per particle, float velocities [x, y, z] per particle]</summary>
+	ref class FrameWriter {
+	public:
+		FrameWriter(String^ path, int numParticles);
+		void Write(int tick, array<float>^ positions, array<float>^ velocities, int count);
+		void Close();
+		int NumFrames;
+		static const int Magic = 'F' | ('X' << 8) | ('F' << 16) | ('R' << 24);
+		static const int Version = 1;
+	private:
+		BinaryWriter^ writer;
+		array<Byte>^ bytes;		//reused staging buffer, writing a frame doesn't allocate
+	};
+}
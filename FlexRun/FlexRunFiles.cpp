@@ -0,0 +1,174 @@
+#include "FlexRun.h"
+
+using namespace System::Collections::Generic;
+using namespace System::Globalization;
+using namespace System::Reflection;
+using namespace System::Xml;
+
+namespace FlexRun {
+
+	void Files::ReadFields(Object^ target, String^ path) {
+		XmlDocument^ doc = gcnew XmlDocument();
+		doc->Load(path);
+		Type^ type = target->GetType();
+		for each (XmlNode^ node in doc->DocumentElement->ChildNodes) {
+			if (node->NodeType != XmlNodeType::Element)
+				continue;
+			FieldInfo^ field = type->GetField(node->Name);
+			if (!field)
+				throw gcnew Exception(path + ": " + type->Name + " has no field " + node->Name);
+			String^ text = node->InnerText->Trim();
+			try {
+				//enums take their names, flags are separated by commas, e.g. "Positions, Velocities"
+				Object^ value = field->FieldType->IsEnum ? Enum::Parse(field->FieldType, text) : Convert::ChangeType(text, field->FieldType, CultureInfo::InvariantCulture);
+				field->SetValue(target, value);
+			}
+			catch (Exception^) {
+				throw gcnew Exception(path + ": '" + text + "' is not a valid value for " + node->Name);
+			}
+		}
+	}
+
+	///<summary>Root element with one child per shape. Vectors are numbers separated by spaces or commas, rotations are quaternions [x, y, z, w].
+	///Plane: "a b c d". Sphere: center, radius. Box: halfHeights, center, rotation. Capsule: halfHeight, radius, center, rotation.
+	///Mesh, ConvexHull and DistanceField (+ resolution) take either an 'obj' file, relative to the xml, or 'vertices' and 'faces'. Simplification: tolerance for FlexCollisionGeometry::SimplifyMeshes.</summary>
+	FlexCollisionGeometry^ Files::ReadCollisionGeometry(String^ path) {
+		XmlDocument^ doc = gcnew XmlDocument();
+		doc->Load(path);
+		String^ folder = Path::GetDirectoryName(Path::GetFullPath(path));
+		FlexCollisionGeometry^ geometry = gcnew FlexCollisionGeometry();
+
+		for each (XmlNode^ node in doc->DocumentElement->ChildNodes) {
+			XmlElement^ e = dynamic_cast<XmlElement^>(node);
+			if (!e)
+				continue;
+			if (e->Name == "Plane") {
+				array<float>^ p = ParseFloats(e->InnerText, 4, "Plane");
+				geometry->AddPlane(p[0], p[1], p[2], p[3]);
+			}
+			else if (e->Name == "Sphere")
+				geometry->AddSphere(ParseFloats(RequiredAttribute(e, "center"), 3, "Sphere center"), ParseFloats(RequiredAttribute(e, "radius"), 1, "Sphere radius")[0]);
+			else if (e->Name == "Box")
+				geometry->AddBox(ParseFloats(RequiredAttribute(e, "halfHeights"), 3, "Box halfHeights"), ParseFloats(RequiredAttribute(e, "center"), 3, "Box center"), ParseFloats(RequiredAttribute(e, "rotation"), 4, "Box rotation"));
+			else if (e->Name == "Capsule")
+				geometry->AddCapsule(ParseFloats(RequiredAttribute(e, "halfHeight"), 1, "Capsule halfHeight")[0], ParseFloats(RequiredAttribute(e, "radius"), 1, "Capsule radius")[0],
+					ParseFloats(RequiredAttribute(e, "center"), 3, "Capsule center"), ParseFloats(RequiredAttribute(e, "rotation"), 4, "Capsule rotation"));
+			else if (e->Name == "Mesh" || e->Name == "ConvexHull" || e->Name == "DistanceField") {
+				array<float>^ vertices;
+				array<int>^ faces;
+				ReadMesh(e, folder, vertices, faces);
+				if (e->Name == "Mesh")
+					geometry->AddMesh(vertices, faces);
+				else if (e->Name == "ConvexHull")
+					geometry->AddConvexHull(vertices);
+				else
+					geometry->AddDistanceField(vertices, faces, ParseInts(RequiredAttribute(e, "resolution"), "DistanceField resolution")[0]);
+			}
+			else if (e->Name == "Simplification")
+				geometry->SimplifyMeshes(ParseFloats(e->InnerText, 1, "Simplification")[0]);
+			else
+				throw gcnew Exception(path + ": unknown collision shape " + e->Name);
+		}
+		return geometry;
+	}
+
+	array<float>^ Files::ParseFloats(String^ text, int count, String^ what) {
+		array<String^>^ parts = text->Split(gcnew array<wchar_t>{ ' ', ',', '\t', '\r', '\n' }, StringSplitOptions::RemoveEmptyEntries);
+		if (count > 0 && parts->Length != count)
+			throw gcnew Exception(what + ": expected " + count + " numbers, got " + parts->Length);
+		array<float>^ values = gcnew array<float>(parts->Length);
+		for (int i = 0; i < parts->Length; i++)
+			values[i] = Single::Parse(parts[i], CultureInfo::InvariantCulture);
+		return values;
+	}
+
+	array<int>^ Files::ParseInts(String^ text, String^ what) {
+		array<String^>^ parts = text->Split(gcnew array<wchar_t>{ ' ', ',', '\t', '\r', '\n' }, StringSplitOptions::RemoveEmptyEntries);
+		if (parts->Length == 0)
+			throw gcnew Exception(what + ": expected at least one number");
+		array<int>^ values = gcnew array<int>(parts->Length);
+		for (int i = 0; i < parts->Length; i++)
+			values[i] = Int32::Parse(parts[i], CultureInfo::InvariantCulture);
+		return values;
+	}
+
+	String^ Files::RequiredAttribute(XmlElement^ element, String^ name) {
+		if (!element->HasAttribute(name))
+			throw gcnew Exception(element->Name + " is missing the attribute '" + name + "'");
+		return element->GetAttribute(name);
+	}
+
+	void Files::ReadMesh(XmlElement^ element, String^ folder, array<float>^% vertices, array<int>^% faces) {
+		if (element->HasAttribute("obj")) {
+			ReadObj(Path::Combine(folder, element->GetAttribute("obj")), vertices, faces);
+			return;
+		}
+		vertices = ParseFloats(RequiredAttribute(element, "vertices"), 0, element->Name + " vertices");
+		faces = element->Name == "ConvexHull" ? gcnew array<int>(0) : ParseInts(RequiredAttribute(element, "faces"), element->Name + " faces");
+		if (vertices->Length % 3 != 0 || faces->Length % 3 != 0)
+			throw gcnew Exception(element->Name + ": vertices and faces have to come in triples");
+	}
+
+	///Vertices and faces of a Wavefront .obj file. Polygons are split into triangle fans, texture and normal indices are ignored.
+	void Files::ReadObj(String^ path, array<float>^% vertices, array<int>^% faces) {
+		List<float>^ v = gcnew List<float>();
+		List<int>^ f = gcnew List<int>();
+		List<int>^ polygon = gcnew List<int>();
+		array<wchar_t>^ separators = { ' ', '\t' };
+		for each (String^ line in File::ReadLines(path)) {
+			array<String^>^ parts = line->Trim()->Split(separators, StringSplitOptions::RemoveEmptyEntries);
+			if (parts->Length == 0)
+				continue;
+			if (parts[0] == "v" && parts->Length >= 4) {
+				for (int i = 1; i < 4; i++)
+					v->Add(Single::Parse(parts[i], CultureInfo::InvariantCulture));
+			}
+			else if (parts[0] == "f" && parts->Length >= 4) {
+				polygon->Clear();
+				for (int i = 1; i < parts->Length; i++) {
+					//"v/vt/vn", indices start at 1, negative ones count back from the last vertex
+					int index = Int32::Parse(parts[i]->Split('/')[0], CultureInfo::InvariantCulture);
+					polygon->Add(index < 0 ? v->Count / 3 + index : index - 1);
+				}
+				for (int i = 1; i + 1 < polygon->Count; i++) {
+					f->Add(polygon[0]);
+					f->Add(polygon[i]);
+					f->Add(polygon[i + 1]);
+				}
+			}
+		}
+		vertices = v->ToArray();
+		faces = f->ToArray();
+	}
+
+	FrameWriter::FrameWriter(String^ path, int numParticles) {
+		FileStream^ stream = gcnew FileStream(path, FileMode::Create, FileAccess::Write, FileShare::Read, 1 << 20);
+		writer = gcnew BinaryWriter(stream);
+		bytes = gcnew array<Byte>(Math::Max(numParticles * 3 * (int)sizeof(float), 1));
+		writer->Write(Magic);
+		writer->Write(Version);
+		writer->Write(numParticles);
+		writer->Write(0);
+		NumFrames = 0;
+	}
+
+	void FrameWriter::Write(int tick, array<float>^ positions, array<float>^ velocities, int count) {
+		int size = count * 3 * (int)sizeof(float);
+		if (size > bytes->Length)
+			bytes = gcnew array<Byte>(size);
+		writer->Write(tick);
+		writer->Write(count);
+		Buffer::BlockCopy(positions, 0, bytes, 0, size);
+		writer->Write(bytes, 0, size);
+		Buffer::BlockCopy(velocities, 0, bytes, 0, size);
+		writer->Write(bytes, 0, size);
+		NumFrames++;
+	}
+
+	void FrameWriter::Close() {
+		if (writer) {
+			writer->Close();
+			writer = nullptr;
+		}
+	}
+}
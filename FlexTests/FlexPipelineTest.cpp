@@ -0,0 +1,364 @@
+// FlexPipelineTest.cpp
+// Tests the pipelined readback of FlexPipeline.h against a stub device instead of the NvFlex solver. The stub queues copies that only land
+// after a latency, like device to host copies, and records every ordering violation. The conversion runs on a worker thread, as in Flex::ConvertReadback.
+// Returns 0 if all tests pass.
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include "../FlexCLI/FlexPipeline.h"
+
+using namespace std::chrono;
+
+namespace {
+
+	int failures = 0;
+
+#define CHECK(condition) do { if (!(condition)) { printf("  FAILED %s:%d: %s\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+	///Stands in for the NvFlex solver. Its state is a function of 'Step', so every value tells which step it was copied from.
+	///A Get... call snapshots the state right away but the copy only lands in the buffer 'Latency' later.
+	struct StubDevice {
+		struct Buffer {
+			std::vector<unsigned char> Data;
+			std::vector<unsigned char> InFlight;
+			steady_clock::time_point Ready;
+			bool Copying;
+			bool Mapped;
+		};
+
+		std::mutex Lock;
+		milliseconds Latency;
+		int Step;
+		int NumRigids;
+
+		//ordering violations
+		int CopiesIntoMapped;		//the solver wrote into a set the worker may be reading
+		int DoubleMaps;
+		int UnmapsOfUnmapped;
+		//statistics
+		int Waits;					//maps that found the copy still in flight
+		int Allocated;
+
+		StubDevice(milliseconds latency) : Latency(latency), Step(0), NumRigids(0), CopiesIntoMapped(0), DoubleMaps(0), UnmapsOfUnmapped(0), Waits(0), Allocated(0) {}
+
+		static float Position(int step, int i, int k) { return 1000.0f * step + 10.0f * i + k; }
+		static float Velocity(int step, int i, int k) { return -1000.0f * step - 10.0f * i - k; }
+		static int Phase(int step, int i) { return step * 100 + i; }
+
+		Buffer* Alloc(int count, int stride) {
+			Buffer* b = new Buffer();
+			b->Data.resize((size_t)count * stride);
+			b->Copying = false;
+			b->Mapped = false;
+			Allocated++;
+			return b;
+		}
+
+		void Free(Buffer* buffer) {
+			delete buffer;
+			Allocated--;
+		}
+
+		void GetParticles(Buffer* b, int count) {
+			std::vector<float> v(count * 4);
+			for (int i = 0; i < count; i++)
+				for (int k = 0; k < 4; k++)
+					v[i * 4 + k] = Position(Step, i, k);
+			Queue(b, &v[0], v.size() * sizeof(float));
+		}
+
+		void GetVelocities(Buffer* b, int count) {
+			std::vector<float> v(count * 3);
+			for (int i = 0; i < count; i++)
+				for (int k = 0; k < 3; k++)
+					v[i * 3 + k] = Velocity(Step, i, k);
+			Queue(b, &v[0], v.size() * sizeof(float));
+		}
+
+		void GetPhases(Buffer* b, int count) {
+			std::vector<int> v(count);
+			for (int i = 0; i < count; i++)
+				v[i] = Phase(Step, i);
+			Queue(b, &v[0], v.size() * sizeof(int));
+		}
+
+		void GetRigidTransforms(Buffer* rotations, Buffer* translations) {
+			std::vector<float> r(NumRigids * 4), t(NumRigids * 3);
+			for (int i = 0; i < NumRigids; i++) {
+				for (int k = 0; k < 4; k++)
+					r[i * 4 + k] = 0.5f * Step + i + 0.1f * k;
+				for (int k = 0; k < 3; k++)
+					t[i * 3 + k] = Position(Step, i, k);
+			}
+			Queue(rotations, &r[0], r.size() * sizeof(float));
+			Queue(translations, &t[0], t.size() * sizeof(float));
+		}
+
+		void* Map(Buffer* b, bool wait) {
+			std::unique_lock<std::mutex> lock(Lock);
+			if (b->Mapped)
+				DoubleMaps++;
+			if (b->Copying) {
+				if (steady_clock::now() < b->Ready) {
+					if (!wait)
+						return NULL;
+					Waits++;
+					steady_clock::time_point ready = b->Ready;
+					lock.unlock();
+					std::this_thread::sleep_until(ready);
+					lock.lock();
+				}
+				memcpy(&b->Data[0], &b->InFlight[0], b->InFlight.size());
+				b->Copying = false;
+			}
+			b->Mapped = true;
+			return &b->Data[0];
+		}
+
+		void Unmap(Buffer* b) {
+			std::lock_guard<std::mutex> lock(Lock);
+			if (!b->Mapped)
+				UnmapsOfUnmapped++;
+			b->Mapped = false;
+		}
+
+		void Queue(Buffer* b, const void* data, size_t size) {
+			std::lock_guard<std::mutex> lock(Lock);
+			if (b->Mapped)
+				CopiesIntoMapped++;
+			b->InFlight.assign((const unsigned char*)data, (const unsigned char*)data + size);
+			b->Ready = steady_clock::now() + Latency;
+			b->Copying = true;
+		}
+	};
+
+	typedef FlexPipeline::Readback<StubDevice> Readback;
+	typedef FlexPipeline::BufferSet<StubDevice> BufferSet;
+
+	///Drives the pipeline the way Flex does: FinishReadback joins the worker and releases its set, ReadSceneStateAsync requests this step
+	///and converts the previous one on a worker thread. The scene is a particle pool plus rigid transforms, like FlexScene.
+	struct Host {
+		StubDevice& Device;
+		Readback Pipeline;
+		std::thread Worker;
+		std::vector<FlexKernels::ParticleRecord> Particles;
+		std::vector<float> Translations, Rotations;
+		float InvScale;
+		int Converted;			//number of conversions finished
+		int ConvertedStep;		//step the last conversion saw, -1 if unknown
+
+		Host(StubDevice& device, int numParticles, float invScale) : Device(device), Particles(numParticles), Translations(device.NumRigids * 3 + 1), Rotations(device.NumRigids * 4 + 1),
+			InvScale(invScale), Converted(0), ConvertedStep(-1) {
+			for (size_t i = 0; i < Particles.size(); i++) {
+				FlexKernels::ParticleRecord r = { -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1 };
+				Particles[i] = r;
+			}
+		}
+
+		~Host() {
+			FinishReadback();
+			Pipeline.Destroy(Device);
+		}
+
+		void FinishReadback() {
+			if (Worker.joinable())
+				Worker.join();
+			Pipeline.Finish(Device);
+		}
+
+		void ReadSceneStateAsync(int channels) {
+			FinishReadback();
+			if (!Pipeline.IsAllocated())
+				Pipeline.Allocate(Device, (int)Particles.size(), Device.NumRigids);
+			BufferSet* previous = Pipeline.Request(Device, (int)Particles.size(), Device.NumRigids, channels);
+			if (!previous)
+				return;
+			Worker = std::thread([this, previous]() {
+				//a set holds the state of exactly one step, read it off the first particle before converting
+				ConvertedStep = previous->MappedPhases && previous->Count > 0 ? previous->MappedPhases[0] / 100 : -1;
+				Readback::Convert(*previous, &Particles[0], &Translations[0], &Rotations[0], InvScale);
+				Converted++;
+			});
+		}
+
+		///True, if every particle holds the state of 'step' in the channels given
+		bool Holds(int step, int channels) {
+			for (int i = 0; i < (int)Particles.size(); i++) {
+				const FlexKernels::ParticleRecord& r = Particles[i];
+				if (channels & FlexPipeline::Positions) {
+					if (!Near(r.PositionX, StubDevice::Position(step, i, 0) * InvScale) || !Near(r.PositionY, StubDevice::Position(step, i, 1) * InvScale) ||
+						!Near(r.PositionZ, StubDevice::Position(step, i, 2) * InvScale) || r.InverseMass != StubDevice::Position(step, i, 3))
+						return false;
+				}
+				if (channels & FlexPipeline::Velocities) {
+					if (!Near(r.VelocityX, StubDevice::Velocity(step, i, 0) * InvScale) || !Near(r.VelocityY, StubDevice::Velocity(step, i, 1) * InvScale) ||
+						!Near(r.VelocityZ, StubDevice::Velocity(step, i, 2) * InvScale))
+						return false;
+				}
+				if ((channels & FlexPipeline::Phases) && r.Phase != StubDevice::Phase(step, i))
+					return false;
+			}
+			return true;
+		}
+
+		static bool Near(float a, float b) { return fabsf(a - b) <= 1e-3f * (fabsf(b) + 1.0f); }
+	};
+
+	const int AllChannels = FlexPipeline::Positions | FlexPipeline::Velocities | FlexPipeline::Phases;
+
+	void CheckNoViolations(StubDevice& device) {
+		CHECK(device.CopiesIntoMapped == 0);
+		CHECK(device.DoubleMaps == 0);
+		CHECK(device.UnmapsOfUnmapped == 0);
+	}
+
+	///The scene lags exactly one step behind the solver
+	void SceneLagsOneStep() {
+		StubDevice device(milliseconds(0));
+		{
+			Host host(device, 64, 0.5f);
+			device.Step = 1;
+			host.ReadSceneStateAsync(AllChannels);
+			host.FinishReadback();
+			CHECK(host.Converted == 0);
+			for (int step = 2; step <= 6; step++) {
+				device.Step = step;
+				host.ReadSceneStateAsync(AllChannels);
+				host.FinishReadback();
+				CHECK(host.Converted == step - 1);
+				CHECK(host.ConvertedStep == step - 1);
+				CHECK(host.Holds(step - 1, AllChannels));
+			}
+		}
+		CheckNoViolations(device);
+		CHECK(device.Allocated == 0);
+	}
+
+	///The worker converts while the solver runs the next step, as in Flex::UpdateSolver. Copies outlast the step, so mapping waits for them.
+	void WorkerOverlapsNextStep() {
+		StubDevice device(milliseconds(15));
+		{
+			Host host(device, 4096, 1.0f);
+			for (int step = 1; step <= 8; step++) {
+				//the solver steps while the worker of the last readback may still be converting
+				device.Step = step;
+				std::this_thread::sleep_for(milliseconds(2));
+				host.ReadSceneStateAsync(AllChannels);
+				if (step > 1) {
+					//the state joined by the next FinishReadback is the one requested one step before
+					host.FinishReadback();
+					CHECK(host.ConvertedStep == step - 1);
+					CHECK(host.Holds(step - 1, AllChannels));
+				}
+			}
+			CHECK(device.Waits > 0);
+		}
+		CheckNoViolations(device);
+	}
+
+	///Without FinishReadback between two steps, the pipeline must not hand the converting set to the solver. Flex always finishes first, the stub
+	///shows what happens otherwise: the second request copies into the mapped set.
+	void RequestWithoutFinishIsDetected() {
+		StubDevice device(milliseconds(0));
+		{
+			Readback pipeline;
+			pipeline.Allocate(device, 16, 0);
+			device.Step = 1;
+			pipeline.Request(device, 16, 0, AllChannels);
+			device.Step = 2;
+			CHECK(pipeline.Request(device, 16, 0, AllChannels) != NULL);
+			device.Step = 3;
+			pipeline.Request(device, 16, 0, AllChannels);
+			CHECK(device.CopiesIntoMapped > 0);
+			pipeline.Finish(device);
+			pipeline.Destroy(device);
+		}
+	}
+
+	///Channels left out of a request keep their values in the scene
+	void SkippedChannelsKeepValues() {
+		StubDevice device(milliseconds(1));
+		{
+			Host host(device, 32, 1.0f);
+			device.Step = 1;
+			host.ReadSceneStateAsync(AllChannels);
+			device.Step = 2;
+			host.ReadSceneStateAsync(FlexPipeline::Positions);
+			device.Step = 3;
+			host.ReadSceneStateAsync(FlexPipeline::Positions);
+			host.FinishReadback();
+			CHECK(host.Holds(2, FlexPipeline::Positions));
+			CHECK(host.Holds(1, FlexPipeline::Velocities | FlexPipeline::Phases));
+		}
+		CheckNoViolations(device);
+	}
+
+	///Rotations are copied as they are, translations are scaled back like positions
+	void RigidTransforms() {
+		StubDevice device(milliseconds(1));
+		device.NumRigids = 5;
+		{
+			Host host(device, 8, 0.25f);
+			device.Step = 1;
+			host.ReadSceneStateAsync(AllChannels | FlexPipeline::RigidTransforms);
+			device.Step = 2;
+			host.ReadSceneStateAsync(AllChannels | FlexPipeline::RigidTransforms);
+			host.FinishReadback();
+			for (int i = 0; i < device.NumRigids; i++) {
+				for (int k = 0; k < 4; k++)
+					CHECK(Host::Near(host.Rotations[i * 4 + k], 0.5f * 1 + i + 0.1f * k));
+				for (int k = 0; k < 3; k++)
+					CHECK(Host::Near(host.Translations[i * 3 + k], StubDevice::Position(1, i, k) * 0.25f));
+			}
+		}
+		CheckNoViolations(device);
+	}
+
+	///Requests in flight during an upload describe the particles before it, they are dropped instead of converted
+	void DiscardDropsRequestsInFlight() {
+		StubDevice device(milliseconds(1));
+		{
+			Host host(device, 16, 1.0f);
+			device.Step = 1;
+			host.ReadSceneStateAsync(AllChannels);
+			host.FinishReadback();
+			host.Pipeline.Discard();
+			device.Step = 2;
+			host.ReadSceneStateAsync(AllChannels);
+			host.FinishReadback();
+			CHECK(host.Converted == 0);
+			device.Step = 3;
+			host.ReadSceneStateAsync(AllChannels);
+			host.FinishReadback();
+			CHECK(host.Converted == 1);
+			CHECK(host.Holds(2, AllChannels));
+		}
+		CheckNoViolations(device);
+	}
+
+	struct Test {
+		const char* Name;
+		void(*Run)();
+	};
+}
+
+int main() {
+	Test tests[] = {
+		{ "SceneLagsOneStep", SceneLagsOneStep },
+		{ "WorkerOverlapsNextStep", WorkerOverlapsNextStep },
+		{ "RequestWithoutFinishIsDetected", RequestWithoutFinishIsDetected },
+		{ "SkippedChannelsKeepValues", SkippedChannelsKeepValues },
+		{ "RigidTransforms", RigidTransforms },
+		{ "DiscardDropsRequestsInFlight", DiscardDropsRequestsInFlight },
+	};
+	for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		int before = failures;
+		tests[i].Run();
+		printf("%s %s\n", failures == before ? "passed" : "FAILED", tests[i].Name);
+	}
+	printf("%d failure(s)\n", failures);
+	return failures == 0 ? 0 : 1;
+}